@@ -4,6 +4,8 @@
 #pragma warning(disable:4800)
 #include "char.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -11,6 +13,7 @@
 #include <ctime>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <common/cbasetypes.hpp>
 #include <common/cli.hpp>
@@ -33,6 +36,7 @@
 #include "char_logif.hpp"
 #include "char_mapif.hpp"
 #include "inter.hpp"
+#include "inter_async.hpp"
 #include "int_elemental.hpp"
 #include "int_guild.hpp"
 #include "int_homun.hpp"
@@ -85,6 +89,37 @@ std::unordered_map<uint32, std::shared_ptr<struct auth_node>>& char_get_authdb()
 std::unordered_map<uint32, std::shared_ptr<struct online_char_data>>& char_get_onlinedb() { return online_char_db; }
 std::unordered_map<uint32, std::shared_ptr<struct mmo_charstatus>>& char_get_chardb() { return char_db; }
 
+/// Character whose saves were not written to SQL yet
+struct s_char_save_pending {
+	struct mmo_charstatus base; ///< Character as it was last written, the queued saves are compared against it
+	t_tick queued; ///< When the first unwritten save was queued, 0 when it is not in the queue
+	char save_status[128]; ///< Tables written for it, for the save log
+	std::vector<std::unique_ptr<struct s_storage>> items; ///< Item containers saved after the status, written in the same transaction
+};
+
+/// Characters with unwritten saves, by char id
+static std::unordered_map<uint32, std::unique_ptr<struct s_char_save_pending>> char_save_pending;
+/// Char ids of the queued characters, in save order
+static std::vector<uint32> char_save_queue;
+
+/// Last written state of an item container, see char_memitemdata_to_sql
+struct s_char_item_image {
+	uint64 hash; ///< Container hash of the rows, see char_item_image_hash
+	std::vector<struct item> rows; ///< Rows of the table, `id` is 0 for rows inserted since the image was read
+};
+
+/// Images of the containers of online characters and loaded guilds, by char_item_image_key
+static std::unordered_map<uint64, std::unique_ptr<s_char_item_image>> char_item_images;
+
+/// Container loads running on the SQL workers
+struct s_char_item_load {
+	int32 pending; ///< Loads of the container that did not finish yet
+	bool stale; ///< The rows were written meanwhile, the loaded rows may be outdated
+};
+
+/// Containers being loaded by char_memitemdata_from_sql_async, by char_item_image_key
+static std::unordered_map<uint64, s_char_item_load> char_item_loads;
+
 online_char_data::online_char_data( uint32 account_id ){
 	this->account_id = account_id;
 	this->char_id = -1;
@@ -167,6 +202,26 @@ void char_set_char_offline(uint32 char_id, uint32 account_id){
 	}
 	else
 	{
+		// The final save has to be written before the character leaves the cache
+		char_save_flush();
+
+		auto pending = char_save_pending.find( char_id );
+
+		if( pending != char_save_pending.end() ){
+			// The batch failed, try once more on its own before the save is lost
+			pending->second->queued = gettick();
+			char_save_queue.push_back( char_id );
+			char_save_flush();
+
+			if( char_save_pending.find( char_id ) != char_save_pending.end() ){
+				ShowError( "char_set_char_offline: Final save of character %d (account %d) could not be written and is lost.\n", char_id, account_id );
+				char_save_pending.erase( char_id );
+			}
+		}
+
+		char_memitemdata_invalidate(TABLE_INVENTORY, char_id);
+		char_memitemdata_invalidate(TABLE_CART, char_id);
+
 		std::shared_ptr<struct mmo_charstatus> cp = util::umap_find( char_get_chardb(), char_id );
 
 		inter_guild_CharOffline(char_id, cp?cp->guild_id:-1);
@@ -177,6 +232,9 @@ void char_set_char_offline(uint32 char_id, uint32 account_id){
 			Sql_ShowDebug(sql_handle);
 	}
 
+	// Item images are only kept while the containers are in use
+	char_memitemdata_invalidate(TABLE_STORAGE, account_id);
+
 	std::shared_ptr<struct online_char_data> character = util::umap_find( char_get_onlinedb(), account_id );
 
 	// We don't free yet to avoid aCalloc/aFree spamming during char change. [Skotlex]
@@ -254,29 +312,40 @@ void char_set_all_offline_sql(void){
 		Sql_ShowDebug(sql_handle);
 }
 
-int32 char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
-	int32 i = 0;
-	int32 count = 0;
-	int32 diff = 0;
-	char save_status[128]; //For displaying save information. [Skotlex]
-	int32 errors = 0; //If there are any errors while saving, "cp" will not be updated at the end.
-	StringBuf buf;
-
-	if (char_id!=p->char_id) return 0;
-
-	std::shared_ptr<struct mmo_charstatus> cp = util::umap_find( char_get_chardb(), char_id );
-
-	if( cp == nullptr ){
-		cp = std::make_shared<struct mmo_charstatus>();
-		cp->char_id = char_id;
-		char_get_chardb()[cp->char_id] = cp;
-	}
-
-	StringBuf_Init(&buf);
-	memset(save_status, 0, sizeof(save_status));
-
-	if (
-		(p->base_exp != cp->base_exp) || (p->base_level != cp->base_level) ||
+/// Counters of the queued character writes
+static struct s_char_save_stats {
+	uint64 saves; ///< Saves received
+	uint64 characters; ///< Characters written
+	uint64 transactions, failed;
+	uint64 statements, rows;
+	uint64 flush_us, flush_us_max; ///< Time spent writing
+	uint64 latency_ms, latency_ms_max; ///< Time from queueing a save to writing it
+	uint64 item_saves, item_unchanged; ///< Item containers saved, and skipped by their hash
+	uint64 item_reads, item_rows; ///< Item tables read for lack of an image, and item rows written
+} char_save_stats;
+
+/// Status columns written by char_save_flush_batch, after `char_id` and `account_id`
+static const char* char_save_columns[] = {
+	"base_level", "job_level", "base_exp", "job_exp", "zeny",
+	"max_hp", "hp", "max_sp", "sp", "status_point", "skill_point",
+	"str", "agi", "vit", "int", "dex", "luk",
+	"option", "party_id", "guild_id", "pet_id", "homun_id", "elemental_id",
+	"weapon", "shield", "head_top", "head_mid", "head_bottom",
+	"last_map", "last_x", "last_y", "last_instanceid",
+	"save_map", "save_x", "save_y", "rename",
+	"delete_date", "robe", "moves", "font", "uniqueitem_counter",
+	"hotkey_rowshift", "clan_id", "title_id", "show_equip", "hotkey_rowshift2",
+	"max_ap", "ap", "trait_point",
+	"pow", "sta", "wis", "spl", "con", "crt",
+	"class", "hair", "hair_color", "clothes_color", "body",
+	"partner_id", "father", "mother", "child",
+	"karma", "manner", "fame", "inventory_slots",
+	"body_direction", "disable_call", "disable_partyinvite", "disable_showcostumes",
+};
+
+/// Whether any of the char_save_columns changed
+static bool char_save_status_changed( const struct mmo_charstatus* p, const struct mmo_charstatus* cp ){
+	return (p->base_exp != cp->base_exp) || (p->base_level != cp->base_level) ||
 		(p->job_level != cp->job_level) || (p->job_exp != cp->job_exp) ||
 		(p->zeny != cp->zeny) ||
 		( strncmp( p->last_point.map, cp->last_point.map, sizeof( p->last_point.map ) ) != 0 ) ||
@@ -299,23 +368,174 @@ int32 char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
 		(p->show_equip != cp->show_equip) || (p->hotkey_rowshift2 != cp->hotkey_rowshift2) ||
 		(p->max_ap != cp->max_ap) || (p->ap != cp->ap) || (p->trait_point != cp->trait_point) ||
 		(p->pow != cp->pow) || (p->sta != cp->sta) || (p->wis != cp->wis) ||
-		(p->spl != cp->spl) || (p->con != cp->con) || (p->crt != cp->crt)
-	)
-	{	//Save status
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `base_level`='%d', `job_level`='%d',"
-			"`base_exp`='%" PRIu64 "', `job_exp`='%" PRIu64 "', `zeny`='%d',"
-			"`max_hp`='%u',`hp`='%u',`max_sp`='%u',`sp`='%u',`status_point`='%d',`skill_point`='%d',"
-			"`str`='%d',`agi`='%d',`vit`='%d',`int`='%d',`dex`='%d',`luk`='%d',"
-			"`option`='%d',`party_id`='%d',`guild_id`='%d',`pet_id`='%d',`homun_id`='%d',`elemental_id`='%d',"
-			"`weapon`='%d',`shield`='%d',`head_top`='%d',`head_mid`='%d',`head_bottom`='%d',"
-			"`last_map`='%s',`last_x`='%d',`last_y`='%d',`last_instanceid`='%d',"
-			"`save_map`='%s',`save_x`='%d',`save_y`='%d', `rename`='%d',"
-			"`delete_date`='%lu',`robe`='%d',`moves`='%d',`font`='%u',`uniqueitem_counter`='%u',"
-			"`hotkey_rowshift`='%d', `clan_id`='%d', `title_id`='%lu', `show_equip`='%d', `hotkey_rowshift2`='%d',"
-			"`max_ap`='%u',`ap`='%u',`trait_point`='%d',"
-			"`pow`='%d',`sta`='%d',`wis`='%d',`spl`='%d',`con`='%d',`crt`='%d'"
-			" WHERE `account_id`='%d' AND `char_id` = '%d'",
-			schema_config.char_db, p->base_level, p->job_level,
+		(p->spl != cp->spl) || (p->con != cp->con) || (p->crt != cp->crt) ||
+		//Values that will seldom change
+		(p->hair != cp->hair) || (p->hair_color != cp->hair_color) || (p->clothes_color != cp->clothes_color) ||
+		(p->body != cp->body) || (p->class_ != cp->class_) ||
+		(p->partner_id != cp->partner_id) || (p->father != cp->father) ||
+		(p->mother != cp->mother) || (p->child != cp->child) ||
+		(p->karma != cp->karma) || (p->manner != cp->manner) ||
+		(p->fame != cp->fame) || (p->inventory_slots != cp->inventory_slots) ||
+		(p->body_direction != cp->body_direction) || (p->disable_call != cp->disable_call) || (p->disable_partyinvite != cp->disable_partyinvite) ||
+		(p->disable_showcostumes != cp->disable_showcostumes);
+}
+
+static bool char_save_memo_changed( const struct mmo_charstatus* p, const struct mmo_charstatus* cp ){
+	return memcmp( p->memo_point, cp->memo_point, sizeof( p->memo_point ) ) != 0;
+}
+
+//`memo` (`memo_id`,`char_id`,`map`,`x`,`y`)
+static void char_save_memo_rows( StringBuf* buf, const struct mmo_charstatus* p, size_t& count ){
+	char esc_mapname[NAME_LENGTH*2+1];
+
+	for( int32 i = 0; i < MAX_MEMOPOINTS; ++i ){
+		if( strcmp( "", p->memo_point[i].map ) != 0 ){
+			if( count++ )
+				StringBuf_AppendStr( buf, "," );
+			Sql_EscapeString( sql_handle, esc_mapname, p->memo_point[i].map );
+			StringBuf_Printf( buf, "('%d', '%s', '%d', '%d')", p->char_id, esc_mapname, p->memo_point[i].x, p->memo_point[i].y );
+		}
+	}
+}
+
+static bool char_save_skill_changed( const struct mmo_charstatus* p, const struct mmo_charstatus* cp ){
+	return memcmp( p->skill, cp->skill, sizeof( p->skill ) ) != 0;
+}
+
+//`skill` (`char_id`, `id`, `lv`)
+static void char_save_skill_rows( StringBuf* buf, const struct mmo_charstatus* p, size_t& count ){
+	for( int32 i = 0; i < MAX_SKILL; ++i ) {
+		if( p->skill[i].id != 0 && p->skill[i].flag != SKILL_FLAG_TEMPORARY ) {
+			if( p->skill[i].lv == 0 && ( p->skill[i].flag == SKILL_FLAG_PERM_GRANTED || p->skill[i].flag == SKILL_FLAG_PERMANENT ) )
+				continue;
+			if( p->skill[i].flag != SKILL_FLAG_PERMANENT && p->skill[i].flag != SKILL_FLAG_PERM_GRANTED && (p->skill[i].flag - SKILL_FLAG_REPLACED_LV_0) == 0 )
+				continue;
+			if( count++ )
+				StringBuf_AppendStr( buf, "," );
+			StringBuf_Printf( buf, "('%d','%d','%d','%d')", p->char_id, p->skill[i].id,
+							 ( (p->skill[i].flag == SKILL_FLAG_PERMANENT || p->skill[i].flag == SKILL_FLAG_PERM_GRANTED) ? p->skill[i].lv : p->skill[i].flag - SKILL_FLAG_REPLACED_LV_0),
+							 p->skill[i].flag == SKILL_FLAG_PERM_GRANTED ? p->skill[i].flag : 0);/* other flags do not need to be saved */
+		}
+	}
+}
+
+static bool char_save_friend_changed( const struct mmo_charstatus* p, const struct mmo_charstatus* cp ){
+	for( int32 i = 0; i < MAX_FRIENDS; i++ ){
+		if( p->friends[i].char_id != cp->friends[i].char_id ||
+			p->friends[i].account_id != cp->friends[i].account_id )
+			return true;
+	}
+	return false;
+}
+
+static void char_save_friend_rows( StringBuf* buf, const struct mmo_charstatus* p, size_t& count ){
+	for( int32 i = 0; i < MAX_FRIENDS; ++i ){
+		if( p->friends[i].char_id > 0 ){
+			if( count++ )
+				StringBuf_AppendStr( buf, "," );
+			StringBuf_Printf( buf, "('%d','%d')", p->char_id, p->friends[i].char_id );
+		}
+	}
+}
+
+/**
+ * Writes an item container queued with a character save
+ * @param p: Container, with the owner and table set by char_save_queue_items
+ * @return 0 on success, see char_memitemdata_to_sql
+ */
+static int32 char_save_items_tosql( const struct s_storage* p ){
+	switch( p->type ){
+		case TABLE_INVENTORY:
+			return char_memitemdata_to_sql( p->u.items_inventory, MAX_INVENTORY, p->id, TABLE_INVENTORY, p->stor_id );
+		case TABLE_CART:
+			return char_memitemdata_to_sql( p->u.items_cart, MAX_CART, p->id, TABLE_CART, p->stor_id );
+		case TABLE_STORAGE:
+			return char_memitemdata_to_sql( p->u.items_storage, MAX_STORAGE, p->id, TABLE_STORAGE, p->stor_id );
+		default:
+			return 1;
+	}
+}
+
+/**
+ * Writes queued characters in one transaction.
+ * Every table is written with one statement for all characters: an upsert for the status,
+ * a delete of all changed characters followed by one insert for memo points, skills and friends.
+ * @param batch: Char ids of the characters to write
+ */
+static void char_save_flush_batch( const std::vector<uint32>& batch ){
+	std::vector<std::pair<struct mmo_charstatus*, struct s_char_save_pending*>> chars;
+	StringBuf buf, del;
+	int32 errors = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for( uint32 char_id : batch ){
+		std::shared_ptr<struct mmo_charstatus> cp = util::umap_find( char_get_chardb(), char_id );
+		std::unique_ptr<struct s_char_save_pending>& pending = char_save_pending[char_id];
+
+		// Characters leave the cache only after their saves were written
+		if( cp == nullptr || pending == nullptr ){
+			char_save_pending.erase( char_id );
+			continue;
+		}
+
+		pending->save_status[0] = '\0';
+		chars.emplace_back( cp.get(), pending.get() );
+	}
+
+	if( chars.empty() )
+		return;
+
+	// Runs one statement, counting the rows it writes
+	auto query = [&errors]( StringBuf* sb, size_t rows ){
+		if( SQL_ERROR == Sql_QueryStr( sql_handle, StringBuf_Value( sb ) ) ){
+			Sql_ShowDebug( sql_handle );
+			errors++;
+		}
+		char_save_stats.statements++;
+		char_save_stats.rows += rows;
+	};
+
+	if( SQL_ERROR == Sql_QueryStr( sql_handle, "START TRANSACTION" ) ){
+		Sql_ShowDebug( sql_handle );
+		errors++;
+	}
+
+	StringBuf_Init( &buf );
+	StringBuf_Init( &del );
+
+	//Save status
+	size_t count = 0;
+
+	StringBuf_Printf( &buf, "INSERT INTO `%s` (`char_id`,`account_id`", schema_config.char_db );
+	for( const char* column : char_save_columns )
+		StringBuf_Printf( &buf, ",`%s`", column );
+	StringBuf_AppendStr( &buf, ") VALUES " );
+
+	for( auto& entry : chars ){
+		const struct mmo_charstatus* p = entry.first;
+
+		if( !char_save_status_changed( p, &entry.second->base ) )
+			continue;
+
+		if( count++ )
+			StringBuf_AppendStr( &buf, "," );
+		StringBuf_Printf( &buf, "('%d','%d','%d','%d',"
+			"'%" PRIu64 "','%" PRIu64 "','%d',"
+			"'%u','%u','%u','%u','%d','%d',"
+			"'%d','%d','%d','%d','%d','%d',"
+			"'%d','%d','%d','%d','%d','%d',"
+			"'%d','%d','%d','%d','%d',"
+			"'%s','%d','%d','%d',"
+			"'%s','%d','%d','%d',"
+			"'%lu','%d','%d','%u','%u',"
+			"'%d','%d','%lu','%d','%d',"
+			"'%u','%u','%d',"
+			"'%d','%d','%d','%d','%d','%d',"
+			"'%d','%d','%d','%d','%d',"
+			"'%u','%u','%u','%u',"
+			"'%d','%d','%d','%hu',"
+			"'%d','%d','%d','%d')",
+			p->char_id, p->account_id, p->base_level, p->job_level,
 			p->base_exp, p->job_exp, p->zeny,
 			p->max_hp, p->hp, p->max_sp, p->sp, p->status_point, p->skill_point,
 			p->str, p->agi, p->vit, p->int_, p->dex, p->luk,
@@ -328,216 +548,464 @@ int32 char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
 			p->hotkey_rowshift, p->clan_id, p->title_id, p->show_equip, p->hotkey_rowshift2,
 			p->max_ap, p->ap, p->trait_point,
 			p->pow, p->sta, p->wis, p->spl, p->con, p->crt,
-			p->account_id, p->char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
-			errors++;
-		} else
-			strcat(save_status, " status");
-	}
-
-	//Values that will seldom change (to speed up saving)
-	if (
-		(p->hair != cp->hair) || (p->hair_color != cp->hair_color) || (p->clothes_color != cp->clothes_color) ||
-		(p->body != cp->body) || (p->class_ != cp->class_) ||
-		(p->partner_id != cp->partner_id) || (p->father != cp->father) ||
-		(p->mother != cp->mother) || (p->child != cp->child) ||
- 		(p->karma != cp->karma) || (p->manner != cp->manner) ||
-		(p->fame != cp->fame) || (p->inventory_slots != cp->inventory_slots) ||
-		(p->body_direction != cp->body_direction) || (p->disable_call != cp->disable_call) || (p->disable_partyinvite != cp->disable_partyinvite) ||
-		(p->disable_showcostumes != cp->disable_showcostumes)
-	)
-	{
-		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `class`='%d',"
-			"`hair`='%d', `hair_color`='%d', `clothes_color`='%d', `body`='%d',"
-			"`partner_id`='%u', `father`='%u', `mother`='%u', `child`='%u',"
-			"`karma`='%d',`manner`='%d', `fame`='%d', `inventory_slots`='%hu',"
-			"`body_direction`='%d',`disable_call`='%d',`disable_partyinvite`='%d',`disable_showcostumes`='%d'"
-			" WHERE  `account_id`='%d' AND `char_id` = '%d'",
-			schema_config.char_db, p->class_,
-			p->hair, p->hair_color, p->clothes_color, p->body,
+			p->class_, p->hair, p->hair_color, p->clothes_color, p->body,
 			p->partner_id, p->father, p->mother, p->child,
 			p->karma, p->manner, p->fame, p->inventory_slots,
-			p->body_direction, p->disable_call, p->disable_partyinvite, p->disable_showcostumes,
-			p->account_id, p->char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
-			errors++;
-		} else
-			strcat(save_status, " status2");
+			p->body_direction, p->disable_call, p->disable_partyinvite, p->disable_showcostumes );
+		strcat( entry.second->save_status, " status" );
+	}
+
+	if( count ){
+		StringBuf_AppendStr( &buf, " ON DUPLICATE KEY UPDATE " );
+		for( size_t i = 0; i < ARRAYLENGTH( char_save_columns ); i++ )
+			StringBuf_Printf( &buf, "%s`%s`=VALUES(`%s`)", i ? "," : "", char_save_columns[i], char_save_columns[i] );
+		query( &buf, count );
 	}
 
 	/* Mercenary Owner */
-	if( (p->mer_id != cp->mer_id) ||
-		(p->arch_calls != cp->arch_calls) || (p->arch_faith != cp->arch_faith) ||
-		(p->spear_calls != cp->spear_calls) || (p->spear_faith != cp->spear_faith) ||
-		(p->sword_calls != cp->sword_calls) || (p->sword_faith != cp->sword_faith) )
-	{
-		if (mercenary_owner_tosql(char_id, p))
-			strcat(save_status, " mercenary");
-		else
-			errors++;
+	for( auto& entry : chars ){
+		struct mmo_charstatus* p = entry.first;
+		const struct mmo_charstatus* cp = &entry.second->base;
+
+		if( (p->mer_id != cp->mer_id) ||
+			(p->arch_calls != cp->arch_calls) || (p->arch_faith != cp->arch_faith) ||
+			(p->spear_calls != cp->spear_calls) || (p->spear_faith != cp->spear_faith) ||
+			(p->sword_calls != cp->sword_calls) || (p->sword_faith != cp->sword_faith) )
+		{
+			if (mercenary_owner_tosql(p->char_id, p))
+				strcat(entry.second->save_status, " mercenary");
+			else
+				errors++;
+			char_save_stats.statements++;
+			char_save_stats.rows++;
+		}
 	}
 
-	//memo points
-	if( memcmp(p->memo_point, cp->memo_point, sizeof(p->memo_point)) )
-	{
-		char esc_mapname[NAME_LENGTH*2+1];
+	// Tables holding several rows per character, rewritten as a whole when they changed
+	const struct {
+		const char* table;
+		const char* columns;
+		const char* label;
+		bool (*changed)( const struct mmo_charstatus* p, const struct mmo_charstatus* cp );
+		void (*rows)( StringBuf* buf, const struct mmo_charstatus* p, size_t& count );
+	} row_tables[] = {
+		{ schema_config.memo_db, "`char_id`,`map`,`x`,`y`", " memo", char_save_memo_changed, char_save_memo_rows },
+		{ schema_config.skill_db, "`char_id`,`id`,`lv`,`flag`", " skills", char_save_skill_changed, char_save_skill_rows },
+		{ schema_config.friend_db, "`char_id`, `friend_id`", " friends", char_save_friend_changed, char_save_friend_rows },
+	};
 
-		//`memo` (`memo_id`,`char_id`,`map`,`x`,`y`)
-		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.memo_db, p->char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
-			errors++;
+	for( const auto& table : row_tables ){
+		size_t deleted = 0;
+
+		count = 0;
+		StringBuf_Clear( &del );
+		StringBuf_Printf( &del, "DELETE FROM `%s` WHERE `char_id` IN (", table.table );
+		StringBuf_Clear( &buf );
+		StringBuf_Printf( &buf, "INSERT INTO `%s`(%s) VALUES ", table.table, table.columns );
+
+		for( auto& entry : chars ){
+			if( !table.changed( entry.first, &entry.second->base ) )
+				continue;
+
+			StringBuf_Printf( &del, "%s'%d'", deleted++ ? "," : "", entry.first->char_id );
+			table.rows( &buf, entry.first, count );
+			strcat( entry.second->save_status, table.label );
 		}
 
-		//insert here.
-		StringBuf_Clear(&buf);
-		StringBuf_Printf(&buf, "INSERT INTO `%s`(`char_id`,`map`,`x`,`y`) VALUES ", schema_config.memo_db);
-		for( i = 0, count = 0; i < MAX_MEMOPOINTS; ++i )
-		{
-			if( strcmp( "", p->memo_point[i].map ) != 0 ){
-				if( count )
-					StringBuf_AppendStr(&buf, ",");
-				Sql_EscapeString( sql_handle, esc_mapname, p->memo_point[i].map );
-				StringBuf_Printf(&buf, "('%d', '%s', '%d', '%d')", char_id, esc_mapname, p->memo_point[i].x, p->memo_point[i].y);
-				++count;
-			}
+		if( deleted ){
+			StringBuf_AppendStr( &del, ")" );
+			query( &del, deleted );
 		}
 		if( count )
-		{
-			if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-			{
-				Sql_ShowDebug(sql_handle);
-				errors++;
+			query( &buf, count );
+	}
+
+#ifdef HOTKEY_SAVING
+	// hotkeys
+	count = 0;
+	StringBuf_Clear( &buf );
+	StringBuf_Printf( &buf, "REPLACE INTO `%s` (`char_id`, `hotkey`, `type`, `itemskill_id`, `skill_lvl`) VALUES ", schema_config.hotkey_db );
+
+	for( auto& entry : chars ){
+		const struct mmo_charstatus* p = entry.first;
+		const struct mmo_charstatus* cp = &entry.second->base;
+		bool diff = false;
+
+		for( int32 i = 0; i < ARRAYLENGTH( p->hotkeys ); i++ ){
+			if( memcmp( &p->hotkeys[i], &cp->hotkeys[i], sizeof( struct hotkey ) ) ){
+				if( count++ )
+					StringBuf_AppendStr( &buf, "," );// not the first hotkey
+				StringBuf_Printf( &buf, "('%d','%u','%u','%u','%u')", p->char_id, (uint32)i, (uint32)p->hotkeys[i].type, p->hotkeys[i].id , (uint32)p->hotkeys[i].lv );
+				diff = true;
 			}
 		}
-		strcat(save_status, " memo");
+		if( diff )
+			strcat( entry.second->save_status, " hotkeys" );
 	}
 
-	//skills
-	if( memcmp(p->skill, cp->skill, sizeof(p->skill)) )
-	{
-		//`skill` (`char_id`, `id`, `lv`)
-		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.skill_db, p->char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
-			errors++;
-		}
+	if( count )
+		query( &buf, count );
+#endif
 
-		StringBuf_Clear(&buf);
-		StringBuf_Printf(&buf, "INSERT INTO `%s`(`char_id`,`id`,`lv`,`flag`) VALUES ", schema_config.skill_db);
-		//insert here.
-		for( i = 0, count = 0; i < MAX_SKILL; ++i ) {
-			if( p->skill[i].id != 0 && p->skill[i].flag != SKILL_FLAG_TEMPORARY ) {
-
-				if( p->skill[i].lv == 0 && ( p->skill[i].flag == SKILL_FLAG_PERM_GRANTED || p->skill[i].flag == SKILL_FLAG_PERMANENT ) )
-					continue;
-				if( p->skill[i].flag != SKILL_FLAG_PERMANENT && p->skill[i].flag != SKILL_FLAG_PERM_GRANTED && (p->skill[i].flag - SKILL_FLAG_REPLACED_LV_0) == 0 )
-					continue;
-				if( count )
-					StringBuf_AppendStr(&buf, ",");
-				StringBuf_Printf(&buf, "('%d','%d','%d','%d')", char_id, p->skill[i].id,
-								 ( (p->skill[i].flag == SKILL_FLAG_PERMANENT || p->skill[i].flag == SKILL_FLAG_PERM_GRANTED) ? p->skill[i].lv : p->skill[i].flag - SKILL_FLAG_REPLACED_LV_0),
-								 p->skill[i].flag == SKILL_FLAG_PERM_GRANTED ? p->skill[i].flag : 0);/* other flags do not need to be saved */
-				++count;
-			}
-		}
-		if( count )
-		{
-			if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-			{
-				Sql_ShowDebug(sql_handle);
+	//Save item containers, after the status they were sent with
+	for( auto& entry : chars ){
+		for( std::unique_ptr<struct s_storage>& stor : entry.second->items ){
+			if( char_save_items_tosql( stor.get() ) != 0 )
 				errors++;
-			}
 		}
+	}
 
-		strcat(save_status, " skills");
+	if( errors == 0 && SQL_ERROR == Sql_QueryStr( sql_handle, "COMMIT" ) ){
+		Sql_ShowDebug( sql_handle );
+		errors++;
 	}
 
-	diff = 0;
-	for(i = 0; i < MAX_FRIENDS; i++){
-		if(p->friends[i].char_id != cp->friends[i].char_id ||
-			p->friends[i].account_id != cp->friends[i].account_id){
-			diff = 1;
-			break;
+	t_tick tick = gettick();
+	uint64 us = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+	char_save_stats.transactions++;
+	char_save_stats.flush_us += us;
+	char_save_stats.flush_us_max = std::max( char_save_stats.flush_us_max, us );
+
+	if( errors ){
+		// Queued characters keep the state they were last written with, their next save writes the changes again
+		Sql_QueryStr( sql_handle, "ROLLBACK" );
+		char_save_stats.failed++;
+
+		// The images already hold the rolled back rows
+		for( auto& entry : chars ){
+			for( std::unique_ptr<struct s_storage>& stor : entry.second->items )
+				char_memitemdata_invalidate( stor->type, stor->id );
 		}
+
+
+		ShowError( "char_save_flush: Failed to write %" PRIuPTR " characters, they are written again on their next save.\n", chars.size() );
+		return;
 	}
 
-	if(diff == 1)
-	{	//Save friends
-		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.friend_db, char_id) )
-		{
-			Sql_ShowDebug(sql_handle);
-			errors++;
-		}
+	for( auto& entry : chars ){
+		uint64 latency = static_cast<uint64>( DIFF_TICK( tick, entry.second->queued ) );
 
-		StringBuf_Clear(&buf);
-		StringBuf_Printf(&buf, "INSERT INTO `%s` (`char_id`, `friend_id`) VALUES ", schema_config.friend_db);
-		for( i = 0, count = 0; i < MAX_FRIENDS; ++i )
-		{
-			if( p->friends[i].char_id > 0 )
-			{
-				if( count )
-					StringBuf_AppendStr(&buf, ",");
-				StringBuf_Printf(&buf, "('%d','%d')", char_id, p->friends[i].char_id);
-				count++;
-			}
-		}
-		if( count )
-		{
-			if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-			{
-				Sql_ShowDebug(sql_handle);
-				errors++;
-			}
-		}
-		strcat(save_status, " friends");
+		char_save_stats.characters++;
+		char_save_stats.latency_ms += latency;
+		char_save_stats.latency_ms_max = std::max( char_save_stats.latency_ms_max, latency );
+
+		if( entry.second->save_status[0] != '\0' && charserv_config.save_log )
+			ShowInfo( "Saved char %d - %s:%s.\n", entry.first->char_id, entry.first->name, entry.second->save_status );
+
+		char_save_pending.erase( entry.first->char_id );
 	}
+}
 
-#ifdef HOTKEY_SAVING
-	// hotkeys
-	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "REPLACE INTO `%s` (`char_id`, `hotkey`, `type`, `itemskill_id`, `skill_lvl`) VALUES ", schema_config.hotkey_db);
-	diff = 0;
-	for(i = 0; i < ARRAYLENGTH(p->hotkeys); i++){
-		if(memcmp(&p->hotkeys[i], &cp->hotkeys[i], sizeof(struct hotkey)))
-		{
-			if( diff )
-				StringBuf_AppendStr(&buf, ",");// not the first hotkey
-			StringBuf_Printf(&buf, "('%d','%u','%u','%u','%u')", char_id, (uint32)i, (uint32)p->hotkeys[i].type, p->hotkeys[i].id , (uint32)p->hotkeys[i].lv);
-			diff = 1;
+/**
+ * Writes all queued character saves
+ * Called before anything reads characters from SQL or writes them another way, so writes keep their order.
+ */
+void char_save_flush( void ){
+	while( !char_save_queue.empty() ){
+		size_t n = std::min<size_t>( char_save_queue.size(), charserv_config.save_flush_max );
+		std::vector<uint32> batch( char_save_queue.begin(), char_save_queue.begin() + n );
+
+		char_save_queue.erase( char_save_queue.begin(), char_save_queue.begin() + n );
+
+		char_save_flush_batch( batch );
+
+		// Characters left over after a failure stay out of the queue until they are saved again
+		for( uint32 char_id : batch ){
+			auto it = char_save_pending.find( char_id );
+
+			if( it != char_save_pending.end() )
+				it->second->queued = 0;
 		}
 	}
-	if(diff) {
-		if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-		{
-			Sql_ShowDebug(sql_handle);
-			errors++;
-		} else
-			strcat(save_status, " hotkeys");
+}
+
+TIMER_FUNC(char_save_flush_timer){
+	char_save_flush();
+	return 0;
+}
+
+/**
+ * Displays the counters of the queued character writes
+ * @param reset: Whether to reset the counters afterwards
+ */
+void char_save_report( bool reset ){
+	s_char_save_stats& stats = char_save_stats;
+
+	ShowInfo( "Character saves: %" PRIu64 " received, %" PRIu64 " characters written in %" PRIu64 " transactions (%.1f per transaction), %" PRIu64 " failed, %" PRIuPTR " queued.\n",
+		stats.saves, stats.characters, stats.transactions, stats.transactions ? static_cast<double>( stats.characters ) / stats.transactions : 0.0, stats.failed, char_save_queue.size() );
+	ShowInfo( "Character save rows: %" PRIu64 " in %" PRIu64 " statements (%.1f per statement, %.1f per transaction).\n",
+		stats.rows, stats.statements, stats.statements ? static_cast<double>( stats.rows ) / stats.statements : 0.0, stats.transactions ? static_cast<double>( stats.rows ) / stats.transactions : 0.0 );
+	ShowInfo( "Character save latency: %.1f ms average, %" PRIu64 " ms at most from queueing to writing; transactions took %.1f us average, %" PRIu64 " us at most.\n",
+		stats.characters ? static_cast<double>( stats.latency_ms ) / stats.characters : 0.0, stats.latency_ms_max,
+		stats.transactions ? static_cast<double>( stats.flush_us ) / stats.transactions : 0.0, stats.flush_us_max );
+	ShowInfo( "Item saves: %" PRIu64 " containers, %" PRIu64 " unchanged, %" PRIu64 " tables read, %" PRIu64 " rows written, %" PRIuPTR " images cached.\n",
+		stats.item_saves, stats.item_unchanged, stats.item_reads, stats.item_rows, char_item_images.size() );
+
+	if( reset )
+		stats = {};
+}
+
+/**
+ * Queues a character save, it is written with the other queued characters after save_flush_interval.
+ * The character cache holds the saved state at once, so the character can be sent to map-servers before it is written.
+ * @param char_id: Character id
+ * @param p: Character to save
+ * @return 0
+ */
+int32 char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
+	if (char_id!=p->char_id) return 0;
+
+	std::shared_ptr<struct mmo_charstatus> cp = util::umap_find( char_get_chardb(), char_id );
+
+	if( cp == nullptr ){
+		cp = std::make_shared<struct mmo_charstatus>();
+		cp->char_id = char_id;
+		char_get_chardb()[cp->char_id] = cp;
 	}
-#endif
 
-	if (save_status[0]!='\0' && charserv_config.save_log)
-		ShowInfo("Saved char %d - %s:%s.\n", char_id, p->name, save_status);
+	std::unique_ptr<struct s_char_save_pending>& pending = char_save_pending[char_id];
 
-	if( !errors ){
-		memcpy( cp.get(), p, sizeof( struct mmo_charstatus ) );
+	if( pending == nullptr ){
+		pending = std::make_unique<struct s_char_save_pending>();
+		memcpy( &pending->base, cp.get(), sizeof( struct mmo_charstatus ) );
+		pending->queued = 0;
 	}
 
+	if( pending->queued == 0 ){
+		pending->queued = gettick();
+		char_save_queue.push_back( char_id );
+	}
+
+	memcpy( cp.get(), p, sizeof( struct mmo_charstatus ) );
+	char_save_stats.saves++;
+
+	if( charserv_config.save_flush_interval == 0 || char_save_queue.size() >= static_cast<size_t>( charserv_config.save_flush_max ) )
+		char_save_flush();
+
 	return 0;
 }
 
-/// Saves an array of 'item' entries into the specified table.
-int32 char_memitemdata_to_sql(const struct item items[], int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id) {
+/**
+ * Queues an item container of a character whose save is still queued.
+ * The container is written in the transaction of the status, so the zeny and the items of a trade never end up apart.
+ * @param char_id: Character that saved the container
+ * @param id: Owner of the container, account id for storages
+ * @param tableswitch: Table of the container
+ * @param p: Container to save
+ * @return true when it was queued, false when the character has no queued save and the container has to be written now
+ */
+bool char_save_queue_items( uint32 char_id, int32 id, enum storage_type tableswitch, const struct s_storage* p ){
+	auto it = char_save_pending.find( char_id );
+
+	if( it == char_save_pending.end() || it->second->queued == 0 )
+		return false;
+
+	std::vector<std::unique_ptr<struct s_storage>>& items = it->second->items;
+	auto stor = std::find_if( items.begin(), items.end(), [tableswitch, p]( const std::unique_ptr<struct s_storage>& queued ){
+		return queued->type == tableswitch && queued->stor_id == p->stor_id;
+	} );
+
+	// A later save of the same container replaces the queued one
+	if( stor == items.end() ){
+		items.push_back( std::make_unique<struct s_storage>() );
+		stor = items.end() - 1;
+	}
+
+	memcpy( stor->get(), p, sizeof( struct s_storage ) );
+	( *stor )->type = tableswitch;
+	( *stor )->id = id;
+
+	return true;
+}
+
+static uint64 char_item_image_key( enum storage_type tableswitch, int32 id, uint8 stor_id ){
+	// Only storages have more than one table
+	if( tableswitch != TABLE_STORAGE )
+		stor_id = 0;
+
+	return ( static_cast<uint64>( tableswitch ) << 40 ) | ( static_cast<uint64>( stor_id ) << 32 ) | static_cast<uint32>( id );
+}
+
+/// Copies the columns of an item stored in the table, so that equal rows have equal bytes
+static void char_item_normalize( const struct item& in, struct item& out, enum storage_type tableswitch ){
+	out = in;
+	out.id = 0;
+
+	if( tableswitch != TABLE_INVENTORY ){
+		out.favorite = 0;
+		out.equipSwitch = 0;
+	}
+}
+
+static uint64 char_item_hash( const struct item& item, enum storage_type tableswitch ){
+	struct item normalized;
+
+	char_item_normalize( item, normalized, tableswitch );
+
+	return hash_fnv64( &normalized, sizeof( normalized ) );
+}
+
+static bool char_item_equal( const struct item& a, const struct item& b, enum storage_type tableswitch ){
+	struct item na, nb;
+
+	char_item_normalize( a, na, tableswitch );
+	char_item_normalize( b, nb, tableswitch );
+
+	return memcmp( &na, &nb, sizeof( na ) ) == 0;
+}
+
+/// Items that are the same item in another state, like the previous matching by content
+static uint64 char_item_identity( const struct item& item ){
+	uint64 key[] = { item.nameid, item.card[0], item.card[2], item.card[3], item.unique_id };
+
+	return hash_fnv64( key, sizeof( key ) );
+}
+
+/// Hash of the non-empty items of a container in order, never 0
+static uint64 char_item_image_hash( const struct item items[], int32 max, enum storage_type tableswitch ){
+	uint64 hash = 14695981039346656037ULL;
+
+	for( int32 i = 0; i < max; i++ ){
+		if( items[i].nameid != 0 )
+			hash = ( hash ^ char_item_hash( items[i], tableswitch ) ) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/// Appends the columns of the item tables after the owner column
+/// @param update: Whether to append them as assignments of ON DUPLICATE KEY UPDATE
+static void char_item_columns( StringBuf* buf, enum storage_type tableswitch, bool update = false ){
+	std::vector<std::string> columns = { "nameid", "amount", "equip", "identify", "refine", "attribute", "expire_time", "bound", "unique_id", "enchantgrade" };
+
+	if (tableswitch == TABLE_INVENTORY) {
+		columns.push_back( "favorite" );
+		columns.push_back( "equip_switch" );
+	}
+	for( int32 j = 0; j < MAX_SLOTS; ++j )
+		columns.push_back( "card" + std::to_string( j ) );
+	for( int32 j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
+		columns.push_back( "option_id" + std::to_string( j ) );
+		columns.push_back( "option_val" + std::to_string( j ) );
+		columns.push_back( "option_parm" + std::to_string( j ) );
+	}
+
+	for( size_t j = 0; j < columns.size(); ++j ){
+		if( j > 0 )
+			StringBuf_AppendStr(buf, ", ");
+
+		if( update )
+			StringBuf_Printf(buf, "`%s`=VALUES(`%s`)", columns[j].c_str(), columns[j].c_str());
+		else
+			StringBuf_Printf(buf, "`%s`", columns[j].c_str());
+	}
+}
+
+/// Appends the values of char_item_columns
+static void char_item_values( StringBuf* buf, const struct item& item, enum storage_type tableswitch ){
+	StringBuf_Printf(buf, "'%u', '%d', '%u', '%d', '%d', '%d', '%u', '%d', '%" PRIu64 "', '%d'",
+		item.nameid, item.amount, item.equip, item.identify, item.refine, item.attribute, item.expire_time, item.bound, item.unique_id, item.enchantgrade);
+	if (tableswitch == TABLE_INVENTORY)
+		StringBuf_Printf(buf, ", '%d', '%u'", item.favorite, item.equipSwitch);
+	for( int32 j = 0; j < MAX_SLOTS; ++j )
+		StringBuf_Printf(buf, ", '%u'", item.card[j]);
+	for( int32 j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
+		StringBuf_Printf(buf, ", '%d'", item.option[j].id);
+		StringBuf_Printf(buf, ", '%d'", item.option[j].value);
+		StringBuf_Printf(buf, ", '%d'", item.option[j].param);
+	}
+}
+
+/// Reads the rows of a container into a new image
+static std::unique_ptr<s_char_item_image> char_item_image_read( int32 id, enum storage_type tableswitch, const char* tablename, const char* selectoption ){
 	StringBuf buf;
 	SqlStmt stmt{ *sql_handle };
-	int32 i, j, offset = 0, errors = 0;
+	int32 i, offset = 0;
+	struct item item = {};
+
+	StringBuf_Init(&buf);
+	StringBuf_AppendStr(&buf, "SELECT `id`, ");
+	char_item_columns(&buf, tableswitch);
+	StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`='%d'", tablename, selectoption, id);
+
+	if( SQL_ERROR == stmt.PrepareStr( StringBuf_Value(&buf))
+	||  SQL_ERROR == stmt.Execute() )
+	{
+		SqlStmt_ShowDebug(stmt);
+		return nullptr;
+	}
+
+	stmt.BindColumn(0, SQLDT_INT32, &item.id);
+	stmt.BindColumn(1, SQLDT_UINT32, &item.nameid);
+	stmt.BindColumn(2, SQLDT_INT16, &item.amount);
+	stmt.BindColumn(3, SQLDT_UINT32, &item.equip);
+	stmt.BindColumn(4, SQLDT_CHAR, &item.identify);
+	stmt.BindColumn(5, SQLDT_CHAR, &item.refine);
+	stmt.BindColumn(6, SQLDT_CHAR, &item.attribute);
+	stmt.BindColumn(7, SQLDT_UINT32, &item.expire_time);
+	stmt.BindColumn(8, SQLDT_CHAR, &item.bound);
+	stmt.BindColumn(9, SQLDT_UINT64, &item.unique_id);
+	stmt.BindColumn(10, SQLDT_INT8, &item.enchantgrade);
+	if (tableswitch == TABLE_INVENTORY){
+		stmt.BindColumn(11, SQLDT_CHAR, &item.favorite);
+		stmt.BindColumn(12, SQLDT_UINT32, &item.equipSwitch);
+		offset = 2;
+	}
+	for( i = 0; i < MAX_SLOTS; ++i )
+		stmt.BindColumn(11+offset+i, SQLDT_UINT32, &item.card[i]);
+	for( i = 0; i < MAX_ITEM_RDM_OPT; ++i ) {
+		stmt.BindColumn(11+offset+MAX_SLOTS+i*3, SQLDT_INT16, &item.option[i].id);
+		stmt.BindColumn(12+offset+MAX_SLOTS+i*3, SQLDT_INT16, &item.option[i].value);
+		stmt.BindColumn(13+offset+MAX_SLOTS+i*3, SQLDT_CHAR, &item.option[i].param);
+	}
+
+	std::unique_ptr<s_char_item_image> image = std::make_unique<s_char_item_image>();
+
+	while( SQL_SUCCESS == stmt.NextRow() )
+		image->rows.push_back( item );
+
+	// Not a container hash, so the next save always compares the rows
+	image->hash = 0;
+	char_save_stats.item_reads++;
+
+	return image;
+}
+
+/// Drops the image of a container whose rows were written and marks its loads as outdated
+static void char_item_changed( uint64 key ){
+	auto load = char_item_loads.find( key );
+
+	if( load != char_item_loads.end() )
+		load->second.stale = true;
+
+	char_item_images.erase( key );
+}
+
+/**
+ * Drops the images of a container, the next save reads its rows again.
+ * Has to be called whenever the rows are written outside of char_memitemdata_to_sql.
+ * @param tableswitch: Type of the container
+ * @param id: Owner of the container
+ */
+void char_memitemdata_invalidate( enum storage_type tableswitch, int32 id ){
+	if( tableswitch == TABLE_STORAGE ){
+		for( auto& storage : interServerDb )
+			char_item_changed( char_item_image_key( tableswitch, id, storage.first ) );
+	}else{
+		char_item_changed( char_item_image_key( tableswitch, id, 0 ) );
+	}
+}
+
+/**
+ * Saves an array of 'item' entries into the specified table.
+ * The rows are compared with the cached image of the table written last, so only changed rows are
+ * written and unchanged containers are skipped by their hash. The rows are read only without an image.
+ */
+int32 char_memitemdata_to_sql(const struct item items[], int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id) {
+	StringBuf buf;
+	int32 i, errors = 0;
 	const char *tablename, *selectoption, *printname;
-	struct item item; // temp storage variable
-	bool* flag; // bit array for inventory matching
-	bool found;
 
 	switch (tableswitch) {
 		case TABLE_INVENTORY:
@@ -572,168 +1040,180 @@ int32 char_memitemdata_to_sql(const struct item items[], int32 max, int32 id, en
 			return 1;
 	}
 
-	// The following code compares inventory with current database values
-	// and performs modification/deletion/insertion only on relevant rows.
-	// This approach is more complicated than a trivial delete&insert, but
-	// it significantly reduces cpu load on the database server.
+	uint64 key = char_item_image_key( tableswitch, id, stor_id );
+	uint64 hash = char_item_image_hash( items, max, tableswitch );
+	std::unique_ptr<s_char_item_image>& image = char_item_images[key];
 
-	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`, `enchantgrade`");
-	if (tableswitch == TABLE_INVENTORY) {
-		StringBuf_Printf(&buf, ", `favorite`, `equip_switch`");
-		offset = 2;
-	}
+	char_save_stats.item_saves++;
 
-	for( i = 0; i < MAX_SLOTS; ++i )
-		StringBuf_Printf(&buf, ", `card%d`", i);
-	for( i = 0; i < MAX_ITEM_RDM_OPT; ++i ) {
-		StringBuf_Printf(&buf, ", `option_id%d`", i);
-		StringBuf_Printf(&buf, ", `option_val%d`", i);
-		StringBuf_Printf(&buf, ", `option_parm%d`", i);
+	if( image != nullptr && image->hash == hash ){
+		char_save_stats.item_unchanged++;
+		return 0;
 	}
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`='%d'", tablename, selectoption, id);
 
-	if( SQL_ERROR == stmt.PrepareStr( StringBuf_Value(&buf))
-	||  SQL_ERROR == stmt.Execute() )
-	{
-		SqlStmt_ShowDebug(stmt);
-		return 1;
-	}
+	// Loads running meanwhile may read the rows from before this save
+	auto load = char_item_loads.find( key );
 
-	stmt.BindColumn(0, SQLDT_INT32, &item.id);
-	stmt.BindColumn(1, SQLDT_UINT32, &item.nameid);
-	stmt.BindColumn(2, SQLDT_INT16, &item.amount);
-	stmt.BindColumn(3, SQLDT_UINT32, &item.equip);
-	stmt.BindColumn(4, SQLDT_CHAR, &item.identify);
-	stmt.BindColumn(5, SQLDT_CHAR, &item.refine);
-	stmt.BindColumn(6, SQLDT_CHAR, &item.attribute);
-	stmt.BindColumn(7, SQLDT_UINT32, &item.expire_time);
-	stmt.BindColumn(8, SQLDT_UINT32, &item.bound);
-	stmt.BindColumn(9, SQLDT_UINT64, &item.unique_id);
-	stmt.BindColumn(10, SQLDT_INT8, &item.enchantgrade);
-	if (tableswitch == TABLE_INVENTORY){
-		stmt.BindColumn(11, SQLDT_CHAR, &item.favorite);
-		stmt.BindColumn(12, SQLDT_UINT32, &item.equipSwitch);
-	}
-	for( i = 0; i < MAX_SLOTS; ++i )
-		stmt.BindColumn(11+offset+i, SQLDT_UINT32, &item.card[i]);
-	for( i = 0; i < MAX_ITEM_RDM_OPT; ++i ) {
-		stmt.BindColumn(11+offset+MAX_SLOTS+i*3, SQLDT_INT16, &item.option[i].id);
-		stmt.BindColumn(12+offset+MAX_SLOTS+i*3, SQLDT_INT16, &item.option[i].value);
-		stmt.BindColumn(13+offset+MAX_SLOTS+i*3, SQLDT_CHAR, &item.option[i].param);
-	}
-	// bit array indicating which inventory items have already been matched
-	flag = (bool*) aCalloc(max, sizeof(bool));
+	if( load != char_item_loads.end() )
+		load->second.stale = true;
 
-	while( SQL_SUCCESS == stmt.NextRow() )
-	{
-		found = false;
-		// search for the presence of the item in the char's inventory
-		for( i = 0; i < max; ++i )
-		{
-			// skip empty and already matched entries
-			if( items[i].nameid == 0 || flag[i] )
+	// The following code compares the items with the rows written last
+	// and performs modification/deletion/insertion only on relevant rows.
+	std::vector<int32> item_row( max, -1 ); // row matched by each item
+	std::vector<bool> row_matched;
+
+	for( int32 attempt = 0; ; attempt++ ){
+		if( image == nullptr && ( image = char_item_image_read( id, tableswitch, tablename, selectoption ) ) == nullptr ){
+			char_item_images.erase( key );
+			return 1;
+		}
+
+		std::unordered_multimap<uint64, int32> rows;
+		bool unknown = false;
+
+		std::fill( item_row.begin(), item_row.end(), -1 );
+		row_matched.assign( image->rows.size(), false );
+
+		// Unchanged items first
+		for( i = 0; i < static_cast<int32>( image->rows.size() ); i++ )
+			rows.emplace( char_item_hash( image->rows[i], tableswitch ), i );
+
+		for( i = 0; i < max; i++ ){
+			if( items[i].nameid == 0 )
 				continue;
 
-			if( items[i].nameid == item.nameid
-			&&  items[i].card[0] == item.card[0]
-			&&  items[i].card[2] == item.card[2]
-			&&  items[i].card[3] == item.card[3]
-			&&  items[i].unique_id == item.unique_id
-			) {	//They are the same item.
-				int32 k;
-				
-				ARR_FIND( 0, MAX_SLOTS, j, items[i].card[j] != item.card[j] );
-				ARR_FIND( 0, MAX_ITEM_RDM_OPT, k, items[i].option[k].id != item.option[k].id || items[i].option[k].value != item.option[k].value || items[i].option[k].param != item.option[k].param );
-				
-				if( j == MAX_SLOTS &&
-					k == MAX_ITEM_RDM_OPT &&
-					items[i].amount == item.amount &&
-					items[i].equip == item.equip &&
-					items[i].identify == item.identify &&
-					items[i].refine == item.refine &&
-					items[i].attribute == item.attribute &&
-					items[i].expire_time == item.expire_time &&
-					items[i].bound == item.bound &&
-					items[i].enchantgrade == item.enchantgrade &&
-					(tableswitch != TABLE_INVENTORY || (items[i].favorite == item.favorite && items[i].equipSwitch == item.equipSwitch)) )
-				;	//Do nothing.
-				else
-				{
-					// update all fields.
-					StringBuf_Clear(&buf);
-					StringBuf_Printf(&buf, "UPDATE `%s` SET `amount`='%d', `equip`='%u', `identify`='%d', `refine`='%d',`attribute`='%d', `expire_time`='%u', `bound`='%d', `unique_id`='%" PRIu64 "', `enchantgrade`='%d'",
-						tablename, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].bound, items[i].unique_id, items[i].enchantgrade);
-					if (tableswitch == TABLE_INVENTORY)
-						StringBuf_Printf(&buf, ", `favorite`='%d', `equip_switch`='%u'", items[i].favorite, items[i].equipSwitch);
-					for( j = 0; j < MAX_SLOTS; ++j )
-						StringBuf_Printf(&buf, ", `card%d`=%u", j, items[i].card[j]);
-					for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-						StringBuf_Printf(&buf, ", `option_id%d`=%d", j, items[i].option[j].id);
-						StringBuf_Printf(&buf, ", `option_val%d`=%d", j, items[i].option[j].value);
-						StringBuf_Printf(&buf, ", `option_parm%d`=%d", j, items[i].option[j].param);
-					}
-					StringBuf_Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
-
-					if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-					{
-						Sql_ShowDebug(sql_handle);
-						errors++;
-					}
-				}
+			auto range = rows.equal_range( char_item_hash( items[i], tableswitch ) );
 
-				found = flag[i] = true; //Item dealt with,
-				break; //skip to next item in the db.
+			for( auto it = range.first; it != range.second; it++ ){
+				if( !row_matched[it->second] && char_item_equal( items[i], image->rows[it->second], tableswitch ) ){
+					item_row[i] = it->second;
+					row_matched[it->second] = true;
+					break;
+				}
 			}
 		}
-		if( !found )
-		{// Item not present in inventory, remove it.
-			if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", tablename, item.id) )
-			{
-				Sql_ShowDebug(sql_handle);
-				errors++;
+
+		// Then items that changed since the last save
+		rows.clear();
+		for( i = 0; i < static_cast<int32>( image->rows.size() ); i++ ){
+			if( !row_matched[i] )
+				rows.emplace( char_item_identity( image->rows[i] ), i );
+		}
+
+		for( i = 0; i < max; i++ ){
+			if( items[i].nameid == 0 || item_row[i] >= 0 )
+				continue;
+
+			auto range = rows.equal_range( char_item_identity( items[i] ) );
+
+			for( auto it = range.first; it != range.second; it++ ){
+				const struct item& row = image->rows[it->second];
+
+				if( !row_matched[it->second]
+				&&  items[i].nameid == row.nameid
+				&&  items[i].card[0] == row.card[0]
+				&&  items[i].card[2] == row.card[2]
+				&&  items[i].card[3] == row.card[3]
+				&&  items[i].unique_id == row.unique_id ){
+					item_row[i] = it->second;
+					row_matched[it->second] = true;
+					unknown |= ( row.id == 0 );
+					break;
+				}
 			}
 		}
+
+		for( i = 0; i < static_cast<int32>( image->rows.size() ); i++ ){
+			if( !row_matched[i] && image->rows[i].id == 0 )
+				unknown = true;
+		}
+
+		// Rows inserted since the image was read have to be updated or deleted, read their ids
+		if( !unknown || attempt > 0 )
+			break;
+
+		image.reset();
 	}
 
-	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`, `enchantgrade`", tablename, selectoption);
-	if (tableswitch == TABLE_INVENTORY)
-		StringBuf_Printf(&buf, ", `favorite`, `equip_switch`");
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-		StringBuf_Printf(&buf, ", `option_id%d`", j);
-		StringBuf_Printf(&buf, ", `option_val%d`", j);
-		StringBuf_Printf(&buf, ", `option_parm%d`", j);
+	std::vector<struct item> written;
+	bool found = false;
+
+	written.reserve( max );
+
+	StringBuf_Init(&buf);
+
+	// Remove the rows of items that are gone
+	StringBuf_Printf(&buf, "DELETE FROM `%s` WHERE `id` IN (", tablename);
+	for( i = 0; i < static_cast<int32>( image->rows.size() ); i++ ){
+		if( row_matched[i] )
+			continue;
+
+		StringBuf_Printf(&buf, "%s'%d'", found ? "," : "", image->rows[i].id);
+		found = true;
+		char_save_stats.item_rows++;
+	}
+	StringBuf_AppendStr(&buf, ")");
+
+	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
+	{
+		Sql_ShowDebug(sql_handle);
+		errors++;
 	}
+
+	// Update all fields of the rows of changed items
+	StringBuf_Clear(&buf);
+	StringBuf_Printf(&buf, "INSERT INTO `%s`(`id`, `%s`, ", tablename, selectoption);
+	char_item_columns(&buf, tableswitch);
 	StringBuf_AppendStr(&buf, ") VALUES ");
 
 	found = false;
-	// insert non-matched items into the db as new items
-	for( i = 0; i < max; ++i )
-	{
-		// skip empty and already matched entries
-		if( items[i].nameid == 0 || flag[i] )
+	for( i = 0; i < max; i++ ){
+		if( items[i].nameid == 0 || item_row[i] < 0 )
 			continue;
 
-		if( found )
-			StringBuf_AppendStr(&buf, ",");
-		else
-			found = true;
+		struct item& row = image->rows[item_row[i]];
 
-		StringBuf_Printf(&buf, "('%d', '%u', '%d', '%u', '%d', '%d', '%d', '%u', '%d', '%" PRIu64 "', '%d'",
-			id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].bound, items[i].unique_id, items[i].enchantgrade);
-		if (tableswitch == TABLE_INVENTORY)
-			StringBuf_Printf(&buf, ", '%d', '%u'", items[i].favorite, items[i].equipSwitch);
-		for( j = 0; j < MAX_SLOTS; ++j )
-			StringBuf_Printf(&buf, ", '%u'", items[i].card[j]);
-		for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-			StringBuf_Printf(&buf, ", '%d'", items[i].option[j].id);
-			StringBuf_Printf(&buf, ", '%d'", items[i].option[j].value);
-			StringBuf_Printf(&buf, ", '%d'", items[i].option[j].param);
+		if( !char_item_equal( items[i], row, tableswitch ) ){
+			StringBuf_Printf(&buf, "%s('%d', '%d', ", found ? "," : "", row.id, id);
+			char_item_values(&buf, items[i], tableswitch);
+			StringBuf_AppendStr(&buf, ")");
+			found = true;
+			char_save_stats.item_rows++;
 		}
+
+		written.push_back( items[i] );
+		written.back().id = row.id;
+	}
+
+	StringBuf_AppendStr(&buf, " ON DUPLICATE KEY UPDATE ");
+	char_item_columns(&buf, tableswitch, true);
+
+	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
+	{
+		Sql_ShowDebug(sql_handle);
+		errors++;
+	}
+
+	// Insert new items as new rows
+	StringBuf_Clear(&buf);
+	StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, ", tablename, selectoption);
+	char_item_columns(&buf, tableswitch);
+	StringBuf_AppendStr(&buf, ") VALUES ");
+
+	found = false;
+	for( i = 0; i < max; i++ ){
+		if( items[i].nameid == 0 || item_row[i] >= 0 )
+			continue;
+
+		StringBuf_Printf(&buf, "%s('%d', ", found ? "," : "", id);
+		char_item_values(&buf, items[i], tableswitch);
 		StringBuf_AppendStr(&buf, ")");
+		found = true;
+		char_save_stats.item_rows++;
+
+		// The id is read again once the row has to be changed
+		written.push_back( items[i] );
+		written.back().id = 0;
 	}
 
 	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
@@ -742,33 +1222,42 @@ int32 char_memitemdata_to_sql(const struct item items[], int32 max, int32 id, en
 		errors++;
 	}
 
+	if( errors > 0 ){
+		// The table is in an unknown state, read it on the next save
+		char_item_images.erase( key );
+	}else{
+		image->rows = std::move( written );
+		image->hash = hash;
+	}
+
 	ShowInfo("Saved %s (%d) data to table %s for %s: %d\n", printname, stor_id, tablename, selectoption, id);
-	aFree(flag);
 
 	return errors;
 }
 
-bool char_memitemdata_from_sql(struct s_storage* p, int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id) {
-	StringBuf buf;
-	SqlStmt stmt{ *sql_handle };
-	int32 i,j, offset = 0, max2;
-	struct item item, *storage;
-	const char *tablename, *selectoption, *printname;
-
+/// Table and size of a container, see char_item_table
+struct s_char_item_table {
+	const char* printname;
+	const char* tablename;
+	const char* selectoption;
+	int32 max_amount;
+};
+
+/// Finds the table of a container
+/// @return false if the container type or storage id is invalid
+static bool char_item_table( enum storage_type tableswitch, int32 id, uint8 stor_id, s_char_item_table& table ){
 	switch (tableswitch) {
 		case TABLE_INVENTORY:
-			printname = "Inventory";
-			tablename = schema_config.inventory_db;
-			selectoption = "char_id";
-			storage = p->u.items_inventory;
-			max2 = MAX_INVENTORY;
+			table.printname = "Inventory";
+			table.tablename = schema_config.inventory_db;
+			table.selectoption = "char_id";
+			table.max_amount = MAX_INVENTORY;
 			break;
 		case TABLE_CART:
-			printname = "Cart";
-			tablename = schema_config.cart_db;
-			selectoption = "char_id";
-			storage = p->u.items_cart;
-			max2 = MAX_CART;
+			table.printname = "Cart";
+			table.tablename = schema_config.cart_db;
+			table.selectoption = "char_id";
+			table.max_amount = MAX_CART;
 			break;
 		case TABLE_STORAGE: {
 			std::shared_ptr<s_storage_table> storage_info = interServerDb.find( stor_id );
@@ -778,84 +1267,175 @@ bool char_memitemdata_from_sql(struct s_storage* p, int32 max, int32 id, enum st
 				return false;
 			}
 
-			printname = storage_info->name;
-			tablename = storage_info->table;
-			selectoption = "account_id";
-			storage = p->u.items_storage;
-			max2 = storage_info->max_num;
+			table.printname = storage_info->name;
+			table.tablename = storage_info->table;
+			table.selectoption = "account_id";
+			table.max_amount = storage_info->max_num;
 			} break;
 		case TABLE_GUILD_STORAGE:
-			printname = "Guild Storage";
-			tablename = schema_config.guild_storage_db;
-			selectoption = "guild_id";
-			storage = p->u.items_guild;
-			max2 = inter_guild_storagemax(id);
+			table.printname = "Guild Storage";
+			table.tablename = schema_config.guild_storage_db;
+			table.selectoption = "guild_id";
+			table.max_amount = inter_guild_storagemax(id);
 			break;
 		default:
 			ShowError("Invalid table name!\n");
 			return false;
 	}
 
+	return true;
+}
+
+/// Statement reading the rows of a container, see char_item_fromrow
+static std::string char_item_load_statement( const s_char_item_table& table, enum storage_type tableswitch, int32 id ){
+	StringBuf buf;
+
+	StringBuf_Init(&buf);
+	StringBuf_AppendStr(&buf, "SELECT `id`, ");
+	char_item_columns(&buf, tableswitch);
+	StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`='%d' ORDER BY `id`", table.tablename, table.selectoption, id);
+
+	return std::string( StringBuf_Value(&buf) );
+}
+
+/// Reads an item from a row of char_item_load_statement
+static void char_item_fromrow( const std::vector<std::string>& row, enum storage_type tableswitch, struct item& item ){
+	size_t column = 0;
+	auto next = [&row, &column](){
+		return column < row.size() ? row[column++].c_str() : "0";
+	};
+
+	item = {};
+	item.id = atoi( next() );
+	item.nameid = strtoul( next(), nullptr, 10 );
+	item.amount = atoi( next() );
+	item.equip = strtoul( next(), nullptr, 10 );
+	item.identify = atoi( next() );
+	item.refine = atoi( next() );
+	item.attribute = atoi( next() );
+	item.expire_time = strtoul( next(), nullptr, 10 );
+	item.bound = atoi( next() );
+	item.unique_id = strtoull( next(), nullptr, 10 );
+	item.enchantgrade = atoi( next() );
+	if (tableswitch == TABLE_INVENTORY){
+		item.favorite = atoi( next() );
+		item.equipSwitch = strtoul( next(), nullptr, 10 );
+	}
+	for( int32 i = 0; i < MAX_SLOTS; ++i )
+		item.card[i] = strtoul( next(), nullptr, 10 );
+	for( int32 i = 0; i < MAX_ITEM_RDM_OPT; ++i ) {
+		item.option[i].id = atoi( next() );
+		item.option[i].value = atoi( next() );
+		item.option[i].param = atoi( next() );
+	}
+}
+
+/**
+ * Fills a container from the rows read by char_item_load_statement.
+ * @param image: Whether the rows are current and can be kept as image of the table
+ * @return true on success
+ */
+static bool char_memitemdata_from_result( struct s_storage* p, int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id, const s_char_item_table& table, const s_inter_async_result& result, bool image ){
+	struct item* storage;
+	int32 i;
+
+	switch (tableswitch) {
+		case TABLE_INVENTORY: storage = p->u.items_inventory; break;
+		case TABLE_CART: storage = p->u.items_cart; break;
+		case TABLE_STORAGE: storage = p->u.items_storage; break;
+		default: storage = p->u.items_guild; break;
+	}
+
 	memset(p, 0, sizeof(struct s_storage)); //clean up memory
 	p->id = id;
 	p->type = tableswitch;
 	p->stor_id = stor_id;
-	p->max_amount = max2;
+	p->max_amount = table.max_amount;
+
+	if( !result.success )
+		return false;
 
+	std::unique_ptr<s_char_item_image> rows = std::make_unique<s_char_item_image>();
 
-	StringBuf_Init(&buf);
-	StringBuf_AppendStr(&buf, "SELECT `id`,`nameid`,`amount`,`equip`,`identify`,`refine`,`attribute`,`expire_time`,`bound`,`unique_id`,`enchantgrade`");
-	if (tableswitch == TABLE_INVENTORY) {
-		StringBuf_Printf(&buf, ", `favorite`, `equip_switch`");
-		offset = 2;
+	for( i = 0; i < max && i < static_cast<int32>( result.rows.size() ); ++i ){
+		char_item_fromrow( result.rows[i], tableswitch, storage[i] );
+		rows->rows.push_back( storage[i] );
 	}
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ",`card%d`", j);
-	for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-		StringBuf_Printf(&buf, ", `option_id%d`", j);
-		StringBuf_Printf(&buf, ", `option_val%d`", j);
-		StringBuf_Printf(&buf, ", `option_parm%d`", j);
+
+	p->amount = i;
+
+	uint64 key = char_item_image_key( tableswitch, id, stor_id );
+
+	// Rows that did not fit are only known by reading the table again
+	if( image && i == static_cast<int32>( result.rows.size() ) ){
+		rows->hash = char_item_image_hash( storage, i, tableswitch );
+		char_item_images[key] = std::move( rows );
+	}else{
+		char_item_images.erase( key );
 	}
-	StringBuf_Printf(&buf, " FROM `%s` WHERE `%s`=? ORDER BY `id`", tablename, selectoption );
 
-	if( SQL_ERROR == stmt.PrepareStr(StringBuf_Value(&buf))
-		||	SQL_ERROR == stmt.BindParam(0, SQLDT_INT32, &id, 0)
-		||	SQL_ERROR == stmt.Execute() )
-	{
-		SqlStmt_ShowDebug(stmt);
+	ShowInfo("Loaded %s data from table %s for %s: %d (total: %d)\n", table.printname, table.tablename, table.selectoption, id, p->amount);
+
+	return true;
+}
+
+bool char_memitemdata_from_sql(struct s_storage* p, int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id) {
+	s_char_item_table table;
+
+	if( !char_item_table( tableswitch, id, stor_id, table ) )
 		return false;
+
+	std::vector<s_inter_async_result> results = inter_async_query_now( { char_item_load_statement( table, tableswitch, id ) } );
+
+	return char_memitemdata_from_result( p, max, id, tableswitch, stor_id, table, results[0], true );
+}
+
+/**
+ * Loads a container on the SQL workers, see char_memitemdata_from_sql.
+ * If the rows are written while they are read, they are read again on the main connection.
+ * @param callback: Called by the main thread with the container and whether it was loaded
+ */
+void char_memitemdata_from_sql_async( int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id, char_memitemdata_callback callback ){
+	s_char_item_table table;
+
+	if( !char_item_table( tableswitch, id, stor_id, table ) ){
+		struct s_storage stor = {};
+
+		callback( stor, false );
+		return;
 	}
 
-	stmt.BindColumn(0, SQLDT_INT32, &item.id);
-	stmt.BindColumn(1, SQLDT_UINT32, &item.nameid);
-	stmt.BindColumn(2, SQLDT_INT16, &item.amount);
-	stmt.BindColumn(3, SQLDT_UINT32, &item.equip);
-	stmt.BindColumn(4, SQLDT_CHAR, &item.identify);
-	stmt.BindColumn(5, SQLDT_CHAR, &item.refine);
-	stmt.BindColumn(6, SQLDT_CHAR, &item.attribute);
-	stmt.BindColumn(7, SQLDT_UINT32, &item.expire_time);
-	stmt.BindColumn(8, SQLDT_CHAR, &item.bound);
-	stmt.BindColumn(9, SQLDT_ULONGLONG, &item.unique_id);
-	stmt.BindColumn(10, SQLDT_INT8, &item.enchantgrade);
-	if (tableswitch == TABLE_INVENTORY){
-		stmt.BindColumn(11, SQLDT_CHAR, &item.favorite);
-		stmt.BindColumn(12, SQLDT_UINT32, &item.equipSwitch);
+	uint64 key = char_item_image_key( tableswitch, id, stor_id );
+	auto load = char_item_loads.find( key );
+
+	if( load == char_item_loads.end() ){
+		char_item_loads[key] = { 1, false };
+	}else{
+		load->second.pending++;
 	}
-	for( i = 0; i < MAX_SLOTS; ++i )
-		stmt.BindColumn(11+offset+i, SQLDT_UINT32, &item.card[i]);
- 	for( i = 0; i < MAX_ITEM_RDM_OPT; ++i ) {
-		stmt.BindColumn(11+offset+MAX_SLOTS+i*3, SQLDT_INT16, &item.option[i].id);
-		stmt.BindColumn(12+offset+MAX_SLOTS+i*3, SQLDT_INT16, &item.option[i].value);
-		stmt.BindColumn(13+offset+MAX_SLOTS+i*3, SQLDT_CHAR, &item.option[i].param);
- 	}
 
-	for( i = 0; i < max && SQL_SUCCESS == stmt.NextRow(); ++i )
-		memcpy(&storage[i], &item, sizeof(item));
+	e_inter_async_key type = tableswitch == TABLE_STORAGE ? INTER_ASYNC_ACCOUNT : ( tableswitch == TABLE_GUILD_STORAGE ? INTER_ASYNC_GUILD : INTER_ASYNC_CHAR );
 
-	p->amount = i;
-	ShowInfo("Loaded %s data from table %s for %s: %d (total: %d)\n", printname, tablename, selectoption, id, p->amount);
+	inter_async_query( type, id, { char_item_load_statement( table, tableswitch, id ) }, [max, id, tableswitch, stor_id, key, callback]( std::vector<s_inter_async_result>& results ){
+		s_char_item_load& load = char_item_loads[key];
+		bool stale = load.stale;
 
-	return true;
+		if( --load.pending <= 0 )
+			char_item_loads.erase( key );
+
+		std::unique_ptr<struct s_storage> stor = std::make_unique<struct s_storage>();
+		s_char_item_table table;
+		bool result;
+
+		if( stale )
+			result = char_memitemdata_from_sql( stor.get(), max, id, tableswitch, stor_id );
+		else if( char_item_table( tableswitch, id, stor_id, table ) )
+			result = char_memitemdata_from_result( stor.get(), max, id, tableswitch, stor_id, table, results[0], true );
+		else
+			result = false;
+
+		callback( *stor, result );
+	} );
 }
 
 /**
@@ -915,6 +1495,8 @@ int32 char_mmo_chars_fromsql( char_session_data& sd, CHARACTER_INFO chars[], uin
 
 	memset(&p, 0, sizeof(p));
 
+	char_save_flush();
+
 	for( i = 0; i < MAX_CHARS; i++ ) {
 		sd.found_char[i] = -1;
 		sd.unban_time[i] = 0;
@@ -1036,6 +1618,9 @@ int32 char_mmo_char_fromsql(uint32 char_id, struct mmo_charstatus* p, bool load_
 
 	memset(p, 0, sizeof(struct mmo_charstatus));
 
+	// Queued saves have to be written before reading the character back
+	char_save_flush();
+
 	if (charserv_config.save_log) ShowInfo("Char load request (%d)\n", char_id);
 
 	// read char data
@@ -1241,6 +1826,7 @@ int32 char_mmo_char_fromsql(uint32 char_id, struct mmo_charstatus* p, bool load_
 	}
 
 	memcpy( cp.get(), p, sizeof( struct mmo_charstatus ) );
+	char_save_pending.erase( char_id );
 
 	return 1;
 }
@@ -1532,6 +2118,8 @@ int32 char_divorce_char_sql(int32 partner_id1, int32 partner_id2){
 		Sql_ShowDebug(sql_handle);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE (`nameid`='%u' OR `nameid`='%u') AND (`char_id`='%d' OR `char_id`='%d') LIMIT 2", schema_config.inventory_db, WEDDING_RING_M, WEDDING_RING_F, partner_id1, partner_id2) )
 		Sql_ShowDebug(sql_handle);
+	char_memitemdata_invalidate(TABLE_INVENTORY, partner_id1);
+	char_memitemdata_invalidate(TABLE_INVENTORY, partner_id2);
 	chmapif_send_ackdivorce(partner_id1, partner_id2);
 	return 0;
 }
@@ -1552,6 +2140,8 @@ enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_i
 	size_t len;
 	int32 i;
 
+	char_save_flush();
+
 	ARR_FIND(0, MAX_CHARS, i, sd->found_char[i] == char_id);
 
 	// Such a character does not exist in the account
@@ -1681,6 +2271,8 @@ enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_i
 	/* delete cart inventory */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.cart_db, char_id) )
 		Sql_ShowDebug(sql_handle);
+	char_memitemdata_invalidate(TABLE_INVENTORY, char_id);
+	char_memitemdata_invalidate(TABLE_CART, char_id);
 
 	/* delete memo areas */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.memo_db, char_id) )
@@ -2814,8 +3406,11 @@ void char_set_defaults(){
 	charserv_config.max_connect_user = -1;
 	charserv_config.gm_allow_group = -1;
 	charserv_config.autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
+	charserv_config.save_flush_interval = 100;
+	charserv_config.save_flush_max = 256;
 	charserv_config.start_zeny = 0;
 	charserv_config.guild_exp_rate = 100;
+	charserv_config.guild_exp_save_interval = 300000;
 
 	charserv_config.clan_remove_inactive_days = 14;
 	charserv_config.mail_return_days = 14;
@@ -3002,6 +3597,10 @@ bool char_config_read(const char* cfgName, bool normal){
 			charserv_config.autosave_interval = atoi(w2)*1000;
 			if (charserv_config.autosave_interval <= 0)
 				charserv_config.autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
+		} else if (strcmpi(w1, "save_flush_interval") == 0) {
+			charserv_config.save_flush_interval = std::max( 0, atoi( w2 ) );
+		} else if (strcmpi(w1, "save_flush_max") == 0) {
+			charserv_config.save_flush_max = std::max( 1, atoi( w2 ) );
 		} else if (strcmpi(w1, "save_log") == 0) {
 			charserv_config.save_log = config_switch(w2);
 #ifdef RENEWAL
@@ -3075,6 +3674,8 @@ bool char_config_read(const char* cfgName, bool normal){
 			}
 		} else if (strcmpi(w1, "guild_exp_rate") == 0) {
 			charserv_config.guild_exp_rate = atoi(w2);
+		} else if (strcmpi(w1, "guild_exp_save_interval") == 0) {
+			charserv_config.guild_exp_save_interval = std::max( 0, atoi( w2 ) ) * 1000;
 		} else if (strcmpi(w1, "pincode_enabled") == 0) {
 #if PACKETVER_SUPPORTS_PINCODE
 			charserv_config.pincode_config.pincode_enabled = config_switch(w2);
@@ -3151,6 +3752,7 @@ void char_do_final_msg(void){
 void CharacterServer::finalize(){
 	ShowStatus("Terminating...\n");
 
+	char_save_flush();
 	char_set_all_offline(-1);
 	char_set_all_offline_sql();
 
@@ -3242,6 +3844,11 @@ bool CharacterServer::initialize( int32 argc, char *argv[] ){
 	// Timer to clear (online_char_db)
 	add_timer_func_list(char_chardb_waiting_disconnect, "chardb_waiting_disconnect");
 
+	// write the queued character saves
+	add_timer_func_list(char_save_flush_timer, "char_save_flush_timer");
+	if( charserv_config.save_flush_interval > 0 )
+		add_timer_interval(gettick() + charserv_config.save_flush_interval, char_save_flush_timer, 0, 0, charserv_config.save_flush_interval);
+
 	// Online Data timers (checking if char still connected)
 	add_timer_func_list(char_online_data_cleanup, "online_data_cleanup");
 	add_timer_interval(gettick() + 1000, char_online_data_cleanup, 0, 0, 600 * 1000);
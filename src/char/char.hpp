@@ -4,6 +4,7 @@
 #ifndef CHAR_HPP
 #define CHAR_HPP
 
+#include <functional>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -195,8 +196,11 @@ struct CharServ_Config {
 	int32 max_connect_user;
 	int32 gm_allow_group;
 	int32 autosave_interval;
+	int32 save_flush_interval; // how long character saves are queued before they are written, 0 writes them at once
+	int32 save_flush_max; // characters written in one transaction
 	int32 start_zeny;
 	int32 guild_exp_rate;
+	int32 guild_exp_save_interval; // how often guild and member exp and online members are written
 
 	int32 clan_remove_inactive_days;
 	int32 mail_return_days;
@@ -304,13 +308,20 @@ TIMER_FUNC(char_chardb_waiting_disconnect);
 int32 char_mmo_gender(const struct char_session_data *sd, const struct mmo_charstatus *p, char sex);
 int32 char_mmo_char_tobuf( CHARACTER_INFO& info, mmo_charstatus& p );
 int32 char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p);
+void char_save_flush(void);
+void char_save_report(bool reset);
+bool char_save_queue_items(uint32 char_id, int32 id, enum storage_type tableswitch, const struct s_storage* p);
 int32 char_mmo_char_fromsql(uint32 char_id, struct mmo_charstatus* p, bool load_everything);
 int32 char_mmo_chars_fromsql( char_session_data& sd, CHARACTER_INFO chars[], uint8* count = nullptr );
 enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_id);
 int32 char_rename_char_sql(struct char_session_data *sd, uint32 char_id);
 int32 char_divorce_char_sql(int32 partner_id1, int32 partner_id2);
 int32 char_memitemdata_to_sql(const struct item items[], int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id);
+void char_memitemdata_invalidate(enum storage_type tableswitch, int32 id);
 bool char_memitemdata_from_sql(struct s_storage* p, int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id);
+/// Continuation of char_memitemdata_from_sql_async, with the container and whether it was loaded
+using char_memitemdata_callback = std::function<void( struct s_storage& stor, bool result )>;
+void char_memitemdata_from_sql_async(int32 max, int32 id, enum storage_type tableswitch, uint8 stor_id, char_memitemdata_callback callback);
 
 int32 char_married(int32 pl1,int32 pl2);
 int32 char_child(int32 parent_id, int32 child_id);
@@ -13,6 +13,8 @@
 #include <common/timer.hpp>
 
 #include "char.hpp"
+#include "int_guild.hpp"
+#include "inter_async.hpp"
 
 /*======================================================
  * Login-Server help option info
@@ -86,12 +88,39 @@ int32 cnslif_parse(const char* buf)
 	else if( strcmpi("ers_report", type) == 0 ){
 		ers_report();
 	}
+	else if( n == 2 && strcmpi("save", type) == 0 ){
+		if( strcmpi("stats", command) == 0 )
+			char_save_report(false);
+		else if( strcmpi("stats reset", command) == 0 )
+			char_save_report(true);
+		else
+			ShowInfo("Usage: save:stats {reset}\n");
+	}
+	else if( n == 2 && strcmpi("guild", type) == 0 ){
+		if( strcmpi("stats", command) == 0 )
+			inter_guild_save_report(false);
+		else if( strcmpi("stats reset", command) == 0 )
+			inter_guild_save_report(true);
+		else
+			ShowInfo("Usage: guild:stats {reset}\n");
+	}
+	else if( n == 2 && strcmpi("sql", type) == 0 ){
+		if( strcmpi("stats", command) == 0 )
+			inter_async_report(false);
+		else if( strcmpi("stats reset", command) == 0 )
+			inter_async_report(true);
+		else
+			ShowInfo("Usage: sql:stats {reset}\n");
+	}
 	else if( strcmpi("help", type) == 0 ){
 		ShowInfo("Available commands:\n");
 		ShowInfo("\t server:shutdown => Stops the server.\n");
 		ShowInfo("\t server:alive => Checks if the server is running.\n");
 		ShowInfo("\t server:reloadconf => Reload config file: \"%s\"\n", CHAR_CONF_NAME);
 		ShowInfo("\t ers_report => Displays database usage.\n");
+		ShowInfo("\t save:stats {reset} => Displays the transactions, rows and latency of the queued character saves.\n");
+		ShowInfo("\t guild:stats {reset} => Displays the guild writes and the writes that were avoided.\n");
+		ShowInfo("\t sql:stats {reset} => Displays the requests and latency of the SQL workers.\n");
 	}
 
 	return 0;
@@ -458,6 +458,7 @@ void chlogif_parse_change_sex_sub(int32 sex, int32 acc, int32 char_id, int32 cla
 
 	if (SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `equip` = '0', `equip_switch` = '0' WHERE `char_id` = '%d'", schema_config.inventory_db, char_id))
 		Sql_ShowDebug(sql_handle);
+	char_memitemdata_invalidate(TABLE_INVENTORY, char_id);
 
 	if (SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `class` = '%d', `body` = '%d', `weapon` = '0', `shield` = '0', `head_top` = '0', `head_mid` = '0', `head_bottom` = '0', `robe` = '0', `sex` = '%c' WHERE `char_id` = '%d'", schema_config.char_db, class_, class_, sex == SEX_MALE ? 'M' : 'F', char_id))
 		Sql_ShowDebug(sql_handle);
@@ -780,6 +781,11 @@ int32 chlogif_parse(int32 fd) {
 		//  1: Continue parsing
 		int32 next = 1;
 		uint16 command = RFIFOW(fd,0);
+
+		// Write queued character saves before a sex change rewrites the characters
+		if( command == 0x2723 )
+			char_save_flush();
+
 		switch( command ) {
 			case 0x2711: next = chlogif_parse_ackconnect(fd); break;
 			case 0x2713: next = chlogif_parse_ackaccreq(fd); break;
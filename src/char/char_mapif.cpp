@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <cstring> //memcpy
 #include <memory>
+#include <unordered_map>
 
 #include <common/malloc.hpp>
 #include <common/showmsg.hpp>
@@ -14,6 +15,7 @@
 #include <common/strlib.hpp>
 #include <common/timer.hpp>
 #include <common/utilities.hpp>
+#include <common/utils.hpp>
 
 #include "char.hpp"
 #include "char_logif.hpp"
@@ -21,6 +23,9 @@
 
 using namespace rathena;
 
+/// Characters whose whole status was requested after a delta save could not be applied, with their map-server id
+static std::unordered_map<uint32, int32> chmapif_save_resent;
+
 /**
  * Packet send to all map-servers, attach to ourself
  * @param buf: packet to send in form of an array buffer
@@ -419,6 +424,9 @@ int32 chmapif_parse_reqsavechar(int32 fd, int32 id){
 			return 1;
 		}
 
+		// Delta saves apply again on top of this one
+		chmapif_save_resent.erase( cid );
+
 		std::shared_ptr<struct online_char_data> character = util::umap_find( char_get_onlinedb(), aid );
 
 		//Check account only if this ain't final save. Final-save goes through because of the char-map reconnect
@@ -445,6 +453,88 @@ int32 chmapif_parse_reqsavechar(int32 fd, int32 id){
 	return 1;
 }
 
+/**
+ * Asks mapserv to send the whole status of a character, after a delta save could not be applied
+ * Delta saves of the character are ignored until the whole status arrives, see chmapif_parse_reqsavechar_delta.
+ * @param fd : FD link to mapserv
+ * @param id : map-serv id
+ * @param aid : Player account id
+ * @param cid : Player char id
+ */
+void chmapif_save_resend(int32 fd, int32 id, uint32 aid, uint32 cid){
+	chmapif_save_resent[cid] = id;
+
+	WFIFOHEAD(fd,10);
+	WFIFOW(fd,0) = 0x2b29;
+	WFIFOL(fd,2) = aid;
+	WFIFOL(fd,6) = cid;
+	WFIFOSET(fd,10);
+}
+
+/**
+ * Save the changed blocks of a character, applied to the cached copy of the character
+ * @param fd: which fd to parse from
+ * @param id: which map_serv id
+ * @return : 0 not enough data received, 1 success
+ */
+int32 chmapif_parse_reqsavechar_delta(int32 fd, int32 id){
+	if (RFIFOREST(fd) < 4 || RFIFOREST(fd) < RFIFOW(fd,2))
+		return 0;
+	else {
+		uint32 aid = RFIFOL( fd, 4 ), cid = RFIFOL( fd, 8 );
+		uint16 size = RFIFOW( fd, 2 );
+
+		// The whole status was already requested, the deltas sent until it arrives do not apply either
+		if( chmapif_save_resent.find( cid ) != chmapif_save_resent.end() ){
+			RFIFOSKIP( fd, size );
+			return 1;
+		}
+
+		if( size < 25 || RFIFOW( fd, 12 ) != sizeof( struct mmo_charstatus ) || RFIFOB( fd, 14 ) != DELTA_SAVE_VERSION ){
+			ShowError( "parse_from_map (save-char-delta): Unsupported delta save of character %d:%d (size %d, version %d).\n", aid, cid, RFIFOW( fd, 12 ), RFIFOB( fd, 14 ) );
+			chmapif_save_resend( fd, id, aid, cid );
+			RFIFOSKIP( fd, size );
+			return 1;
+		}
+
+		std::shared_ptr<struct online_char_data> character = util::umap_find( char_get_onlinedb(), aid );
+		std::shared_ptr<struct mmo_charstatus> cp = util::umap_find( char_get_chardb(), cid );
+
+		// The changes only apply to the exact status the map-server saved last
+		if( character == nullptr || character->char_id != cid || cp == nullptr || hash_fnv64( cp.get(), sizeof( struct mmo_charstatus ) ) != RFIFOQ( fd, 15 ) ){
+			chmapif_save_resend( fd, id, aid, cid );
+			RFIFOSKIP( fd, size );
+			return 1;
+		}
+
+		struct mmo_charstatus char_dat;
+		uint8* dat = (uint8*)&char_dat;
+		uint16 runs = RFIFOW( fd, 23 );
+		int32 pos = 25;
+
+		memcpy( &char_dat, cp.get(), sizeof( struct mmo_charstatus ) );
+
+		for( ; runs > 0 && pos + 4 <= size; runs-- ){
+			uint16 offset = RFIFOW( fd, pos ), len = RFIFOW( fd, pos + 2 );
+
+			if( offset + len > sizeof( struct mmo_charstatus ) || pos + 4 + len > size )
+				break;
+
+			memcpy( dat + offset, RFIFOP( fd, pos + 4 ), len );
+			pos += 4 + len;
+		}
+
+		if( runs > 0 || pos != size ){
+			ShowError( "parse_from_map (save-char-delta): Malformed delta save of character %d:%d.\n", aid, cid );
+			chmapif_save_resend( fd, id, aid, cid );
+		}else
+			char_mmo_char_tosql( cid, &char_dat );
+
+		RFIFOSKIP( fd, size );
+	}
+	return 1;
+}
+
 /**
  * Inform mapserv of a new character selection request
  * @param fd : FD link tomapserv
@@ -1388,6 +1478,40 @@ void chmapif_connectack(int32 fd, uint8 errCode){
 	WFIFOSET(fd,3);
 }
 
+/**
+ * Whether a packet from mapserv reaches rows held back in the queue of character saves.
+ * Only these handlers see the queue written first, everything else keeps adding to the batch.
+ * Loading, selecting, renaming and deleting characters write the queue on their own.
+ * @param cmd : Packet id
+ */
+static bool chmapif_save_needs_flush( uint16 cmd ){
+	switch( cmd ){
+		case 0x2b07: // remove friend
+		case 0x2b10: // update fame list
+		case 0x2b11: // divorce
+		case 0x2b1a: // fame list
+		case 0x2b28: // ban character
+		case 0x2b2a: // unban character
+		case 0x3007: // account info
+		case 0x3020: // party create
+		case 0x3022: // party add member
+		case 0x3024: // party leave
+		case 0x3026: // party break
+		case 0x3030: // guild create
+		case 0x3032: // guild add member
+		case 0x3033: // guild master change
+		case 0x3034: // guild leave
+		case 0x3036: // guild break
+		case 0x3056: // bound item retrieval
+		case 0x308a: // storage load
+		case 0x30A2: // clan leave
+		case 0x30A3: // clan join
+			return true;
+		default:
+			return false;
+	}
+}
+
 /**
  * Entry point from map-server to char-server.
  * Function that checks incoming command, then splits it to the correct handler.
@@ -1415,6 +1539,11 @@ int32 chmapif_parse(int32 fd){
 
 	while(RFIFOREST(fd) >= 2){
 		int32 next=1;
+
+		// Keep the order of writes, handlers touching queued rows see them written first
+		if( chmapif_save_needs_flush( RFIFOW(fd,0) ) )
+			char_save_flush();
+
 		switch(RFIFOW(fd,0)){
 			case 0x2afa: next=chmapif_parse_getmapname(fd,id); break;
 			case 0x2afc: next=chmapif_parse_askscdata(fd); break;
@@ -1441,7 +1570,7 @@ int32 chmapif_parse(int32 fd){
 			case 0x2b26: next=chmapif_parse_reqauth(fd,id); break;
 			case 0x2b28: next=chmapif_parse_reqcharban(fd); break; //charban
 			case 0x2b2a: next=chmapif_parse_reqcharunban(fd); break; //charunban
-			//case 0x2b2c: /*free*/; break;
+			case 0x2b2c: next=chmapif_parse_reqsavechar_delta(fd,id); break;
 			case 0x2b2d: next=chmapif_bonus_script_get(fd); break; //Load data
 			case 0x2b2e: next=chmapif_bonus_script_save(fd); break;//Save data
 			default:
@@ -1525,6 +1654,14 @@ void chmapif_server_reset(int32 id){
 		char_db_setoffline( pair.second, id );
 	}
 
+	// Whole saves requested from this server will not arrive anymore
+	for( auto it = chmapif_save_resent.begin(); it != chmapif_save_resent.end(); ){
+		if( it->second == id )
+			it = chmapif_save_resent.erase( it );
+		else
+			it++;
+	}
+
 	chmapif_server_destroy(id);
 	chmapif_server_init(id);
 }
@@ -17,6 +17,8 @@ int32 chmapif_parse_askscdata(int32 fd);
 int32 chmapif_parse_getusercount(int32 fd, int32 id);
 int32 chmapif_parse_regmapuser(int32 fd, int32 id);
 int32 chmapif_parse_reqsavechar(int32 fd, int32 id);
+void chmapif_save_resend(int32 fd, int32 id, uint32 aid, uint32 cid);
+int32 chmapif_parse_reqsavechar_delta(int32 fd, int32 id);
 int32 chmapif_parse_authok(int32 fd);
 int32 chmapif_parse_req_saveskillcooldown(int32 fd);
 int32 chmapif_parse_req_skillcooldown(int32 fd);
@@ -5,8 +5,11 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <common/cbasetypes.hpp>
 #include <common/malloc.hpp>
@@ -19,12 +22,19 @@
 #include "char.hpp"
 #include "char_mapif.hpp"
 #include "inter.hpp"
+#include "inter_async.hpp"
 
 using namespace rathena;
 
 #define GS_MEMBER_UNMODIFIED 0x00
-#define GS_MEMBER_MODIFIED 0x01
+#define GS_MEMBER_MODIFIED 0x01 // Position changed
 #define GS_MEMBER_NEW 0x02
+#define GS_MEMBER_EXP 0x04 // Only the exp changed, written on guild_exp_save_interval
+#define GS_MEMBER_TOUCHED 0x08 // Only fields that are not stored in the member table changed
+#define GS_MEMBER_DIRTY (GS_MEMBER_MODIFIED|GS_MEMBER_NEW|GS_MEMBER_EXP)
+
+// Save flags of the fields that change all the time, written on guild_exp_save_interval
+#define GS_FREQUENT (GS_CONNECT|GS_LEVEL|GS_MEMBER)
 
 #define GS_POSITION_UNMODIFIED 0x00
 #define GS_POSITION_MODIFIED 0x01
@@ -48,6 +58,36 @@ int32 mapif_guild_info( int32 fd, const struct mmo_guild &g );
 int32 inter_guild_tosql( mmo_guild &g, int32 flag );
 int32 guild_checkskill( std::shared_ptr<CharGuild> g, int32 id );
 
+/// Counters of the guild writes
+static struct s_guild_save_stats {
+	uint64 saves; ///< Guilds written
+	uint64 deferred; ///< Saves of only exp and online members postponed to guild_exp_save_interval
+	uint64 statements; ///< Statements run by inter_guild_tosql
+	uint64 member_rows; ///< Member rows written
+	uint64 member_avoided; ///< Member changes that needed no row, like logins
+	uint64 rows; ///< Position, alliance, expulsion and skill rows written
+} guild_save_stats;
+
+/**
+ * Whether the changes of a guild have to be written now.
+ * Changes of the exp and online members alone wait for guild_exp_save_interval.
+ */
+static bool inter_guild_save_due( std::shared_ptr<CharGuild> g, t_tick tick ){
+	if( g->save_flag&GS_REMOVE || ( g->save_flag&GS_MASK&~GS_FREQUENT ) )
+		return true;
+
+	if( DIFF_TICK( tick, g->save_tick ) >= charserv_config.guild_exp_save_interval )
+		return true;
+
+	// Members that joined or changed position
+	for( int32 i = 0; i < g->guild.max_member; i++ ){
+		if( g->guild.member[i].modified&(GS_MEMBER_MODIFIED|GS_MEMBER_NEW) )
+			return true;
+	}
+
+	return false;
+}
+
 TIMER_FUNC(guild_save_timer){
 	static int32 last_id = 0; //To know in which guild we were.
 	int32 state = 0; //0: Have not reached last guild. 1: Reached last guild, ready for save. 2: Some guild saved, don't do further saving.
@@ -60,10 +100,13 @@ TIMER_FUNC(guild_save_timer){
 
 		if( state == 0 && g->guild.guild_id == last_id )
 			state++; //Save next guild in the list.
+		else if( state == 1 && g->save_flag&GS_MASK && !inter_guild_save_due( g, tick ) )
+			guild_save_stats.deferred++;
 		else if( state == 1 && g->save_flag&GS_MASK )
 		{
 			inter_guild_tosql(g->guild, g->save_flag&GS_MASK);
 			g->save_flag &= ~GS_MASK;
+			g->save_tick = tick;
 
 			//Some guild saved.
 			last_id = g->guild.guild_id;
@@ -74,6 +117,7 @@ TIMER_FUNC(guild_save_timer){
 		if( g->save_flag == GS_REMOVE ){
 			if (charserv_config.save_log)
 				ShowInfo("Guild Unloaded (%d - %s)\n", g->guild.guild_id, g->guild.name);
+			char_memitemdata_invalidate(TABLE_GUILD_STORAGE, g->guild.guild_id);
 			it = guild_db.erase( it );
 		}else{
 			it++;
@@ -226,46 +270,72 @@ int32 inter_guild_tosql( mmo_guild &g, int32 flag ){
 		StringBuf_Printf(&buf, " WHERE `guild_id`=%d", g.guild_id);
 		if( SQL_ERROR == Sql_Query(sql_handle, "%s", StringBuf_Value(&buf)) )
 			Sql_ShowDebug(sql_handle);
+		guild_save_stats.statements++;
 	}
 
 	if (flag&GS_MEMBER)
 	{
+		StringBuf buf, new_members;
+		int32 count = 0, count_new = 0;
+
 		strcat(t_info, " members");
+		StringBuf_Init(&buf);
+		StringBuf_Init(&new_members);
 		// Update only needed players
 		for(i=0;i<g.max_member;i++){
 			struct guild_member *m = &g.member[i];
 			if (!m->modified)
 				continue;
+			if (!(m->modified&GS_MEMBER_DIRTY) && new_guild != 1) {
+				guild_save_stats.member_avoided++;
+				m->modified = GS_MEMBER_UNMODIFIED;
+				continue;
+			}
 			if(m->account_id) {
 				//Since nothing references guild member table as foreign keys, it's safe to use REPLACE INTO
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`char_id`,`exp`,`position`) "
-					"VALUES ('%d','%d','%" PRIu64 "','%d')",
-					schema_config.guild_member_db, g.guild_id, m->char_id, m->exp, m->position ) )
-					Sql_ShowDebug(sql_handle);
+				StringBuf_Printf(&buf, "%s('%d','%d','%" PRIu64 "','%d')", count++ ? "," : "", g.guild_id, m->char_id, m->exp, m->position);
 				if (m->modified&GS_MEMBER_NEW || new_guild == 1)
-				{
-					if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id` = '%d' WHERE `char_id` = '%d'",
-						schema_config.char_db, g.guild_id, m->char_id) )
-						Sql_ShowDebug(sql_handle);
-				}
+					StringBuf_Printf(&new_members, "%s'%d'", count_new++ ? "," : "", m->char_id);
 				m->modified = GS_MEMBER_UNMODIFIED;
 			}
 		}
+
+		if( count > 0 ){
+			if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`char_id`,`exp`,`position`) VALUES %s", schema_config.guild_member_db, StringBuf_Value(&buf)) )
+				Sql_ShowDebug(sql_handle);
+			guild_save_stats.statements++;
+			guild_save_stats.member_rows += count;
+		}
+
+		if( count_new > 0 ){
+			if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id` = '%d' WHERE `char_id` IN (%s)", schema_config.char_db, g.guild_id, StringBuf_Value(&new_members)) )
+				Sql_ShowDebug(sql_handle);
+			guild_save_stats.statements++;
+		}
 	}
 
 	if (flag&GS_POSITION){
+		StringBuf buf;
+		int32 count = 0;
+
 		strcat(t_info, " positions");
+		StringBuf_Init(&buf);
 		//printf("- Insert guild %d to guild_position\n",g.guild_id);
 		for(i=0;i<MAX_GUILDPOSITION;i++){
 			struct guild_position *p = &g.position[i];
 			if (!p->modified)
 				continue;
 			Sql_EscapeStringLen(sql_handle, esc_name, p->name, strnlen(p->name, NAME_LENGTH));
-			if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`position`,`name`,`mode`,`exp_mode`) VALUES ('%d','%d','%s','%d','%d')",
-				schema_config.guild_position_db, g.guild_id, i, esc_name, p->mode, p->exp_mode) )
-				Sql_ShowDebug(sql_handle);
+			StringBuf_Printf(&buf, "%s('%d','%d','%s','%d','%d')", count++ ? "," : "", g.guild_id, i, esc_name, p->mode, p->exp_mode);
 			p->modified = GS_POSITION_UNMODIFIED;
 		}
+
+		if( count > 0 ){
+			if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`position`,`name`,`mode`,`exp_mode`) VALUES %s", schema_config.guild_position_db, StringBuf_Value(&buf)) )
+				Sql_ShowDebug(sql_handle);
+			guild_save_stats.statements++;
+			guild_save_stats.rows += count;
+		}
 	}
 
 	if (flag&GS_ALLIANCE)
@@ -275,12 +345,17 @@ int32 inter_guild_tosql( mmo_guild &g, int32 flag ){
 		// their info changed, not to mention this would also mess up oppositions!
 		// [Skotlex]
 		//if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id`='%d' OR `alliance_id`='%d'", guild_alliance_db, g.guild_id, g.guild_id) )
+		guild_save_stats.statements++;
 		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_alliance_db, g.guild_id) )
 		{
 			Sql_ShowDebug(sql_handle);
 		}
 		else
 		{
+			StringBuf buf;
+			int32 count = 0;
+
+			StringBuf_Init(&buf);
 			//printf("- Insert guild %d to guild_alliance\n",g.guild_id);
 			for(i=0;i<MAX_GUILDALLIANCE;i++)
 			{
@@ -288,17 +363,25 @@ int32 inter_guild_tosql( mmo_guild &g, int32 flag ){
 				if(a->guild_id>0)
 				{
 					Sql_EscapeStringLen(sql_handle, esc_name, a->name, strnlen(a->name, NAME_LENGTH));
-					if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`opposition`,`alliance_id`,`name`) "
-						"VALUES ('%d','%d','%d','%s')",
-						schema_config.guild_alliance_db, g.guild_id, a->opposition, a->guild_id, esc_name) )
-						Sql_ShowDebug(sql_handle);
+					StringBuf_Printf(&buf, "%s('%d','%d','%d','%s')", count++ ? "," : "", g.guild_id, a->opposition, a->guild_id, esc_name);
 				}
 			}
+
+			if( count > 0 ){
+				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`opposition`,`alliance_id`,`name`) VALUES %s", schema_config.guild_alliance_db, StringBuf_Value(&buf)) )
+					Sql_ShowDebug(sql_handle);
+				guild_save_stats.statements++;
+				guild_save_stats.rows += count;
+			}
 		}
 	}
 
 	if (flag&GS_EXPULSION){
+		StringBuf buf;
+		int32 count = 0;
+
 		strcat(t_info, " expulsions");
+		StringBuf_Init(&buf);
 		//printf("- Insert guild %d to guild_expulsion\n",g.guild_id);
 		for(i=0;i<MAX_GUILDEXPULSION;i++){
 			struct guild_expulsion *e=&g.expulsion[i];
@@ -307,86 +390,126 @@ int32 inter_guild_tosql( mmo_guild &g, int32 flag ){
 
 				Sql_EscapeStringLen(sql_handle, esc_name, e->name, strnlen(e->name, NAME_LENGTH));
 				Sql_EscapeStringLen(sql_handle, esc_mes, e->mes, strnlen(e->mes, sizeof(e->mes)));
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`account_id`,`name`,`mes`,`char_id`) "
-					"VALUES ('%u','%u','%s','%s','%u')", schema_config.guild_expulsion_db, g.guild_id, e->account_id, esc_name, esc_mes, e->char_id) )
-					Sql_ShowDebug(sql_handle);
+				StringBuf_Printf(&buf, "%s('%u','%u','%s','%s','%u')", count++ ? "," : "", g.guild_id, e->account_id, esc_name, esc_mes, e->char_id);
 			}
 		}
+
+		if( count > 0 ){
+			if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`account_id`,`name`,`mes`,`char_id`) VALUES %s", schema_config.guild_expulsion_db, StringBuf_Value(&buf)) )
+				Sql_ShowDebug(sql_handle);
+			guild_save_stats.statements++;
+			guild_save_stats.rows += count;
+		}
 	}
 
 	if (flag&GS_SKILL){
+		StringBuf buf;
+		int32 count = 0;
+
 		strcat(t_info, " skills");
+		StringBuf_Init(&buf);
 		//printf("- Insert guild %d to guild_skill\n",g.guild_id);
 		for(i=0;i<MAX_GUILDSKILL;i++){
 			if (g.skill[i].id>0 && g.skill[i].lv>0){
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`id`,`lv`) VALUES ('%d','%d','%d')",
-					schema_config.guild_skill_db, g.guild_id, g.skill[i].id, g.skill[i].lv) )
-					Sql_ShowDebug(sql_handle);
+				StringBuf_Printf(&buf, "%s('%d','%d','%d')", count++ ? "," : "", g.guild_id, g.skill[i].id, g.skill[i].lv);
 			}
 		}
+
+		if( count > 0 ){
+			if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`guild_id`,`id`,`lv`) VALUES %s", schema_config.guild_skill_db, StringBuf_Value(&buf)) )
+				Sql_ShowDebug(sql_handle);
+			guild_save_stats.statements++;
+			guild_save_stats.rows += count;
+		}
 	}
 
+	guild_save_stats.saves++;
+
 	if (charserv_config.save_log)
 		ShowInfo("Saved guild (%d - %s):%s\n",g.guild_id,g.name,t_info);
 	return 1;
 }
 
-// Read guild from sql
-std::shared_ptr<CharGuild> inter_guild_fromsql( int32 guild_id ){
-	char* data;
-	size_t len;
+/// Guild loads running on the SQL workers
+struct s_guild_load {
+	bool stale = false; ///< The guild was read or changed by the main thread meanwhile, the rows may be outdated
+	std::vector<std::function<void( std::shared_ptr<CharGuild> g )>> callbacks; ///< Continuations waiting for the guild, in order
+};
+
+/// Guilds being loaded by inter_guild_load, by guild id
+static std::unordered_map<int32, s_guild_load> guild_loads;
+
+/// Statements loading a guild, see inter_guild_fromresults
+static std::vector<std::string> inter_guild_statements( int32 guild_id ){
+	std::string id = std::to_string( guild_id );
+
+	return {
+		"SELECT g.`name`,c.`name`,g.`guild_lv`,g.`connect_member`,g.`max_member`,g.`average_lv`,g.`exp`,g.`next_exp`,g.`skill_point`,g.`mes1`,g.`mes2`,g.`emblem_len`,g.`emblem_id`,COALESCE(UNIX_TIMESTAMP(g.`last_master_change`),0), g.`emblem_data` "
+		"FROM `" + std::string( schema_config.guild_db ) + "` g LEFT JOIN `" + std::string( schema_config.char_db ) + "` c ON c.`char_id` = g.`char_id` WHERE g.`guild_id`='" + id + "'",
+		// load guild member info
+		"SELECT `c`.`account_id`,`m`.`char_id`,`c`.`hair`,`c`.`hair_color`,`c`.`sex`,`c`.`class`,`c`.`base_level`,`m`.`exp`,`c`.`online`,`m`.`position`,`c`.`name`,coalesce(UNIX_TIMESTAMP(`c`.`last_login`),0) "
+		"FROM `" + std::string( schema_config.guild_member_db ) + "` `m` INNER JOIN `" + std::string( schema_config.char_db ) + "` `c` on `c`.`char_id`=`m`.`char_id` WHERE `m`.`guild_id`='" + id + "' ORDER BY `position`",
+		"SELECT `position`,`name`,`mode`,`exp_mode` FROM `" + std::string( schema_config.guild_position_db ) + "` WHERE `guild_id`='" + id + "'",
+		"SELECT `opposition`,`alliance_id`,`name` FROM `" + std::string( schema_config.guild_alliance_db ) + "` WHERE `guild_id`='" + id + "'",
+		"SELECT `account_id`,`name`,`mes`,`char_id` FROM `" + std::string( schema_config.guild_expulsion_db ) + "` WHERE `guild_id`='" + id + "'",
+		"SELECT `id`,`lv` FROM `" + std::string( schema_config.guild_skill_db ) + "` WHERE `guild_id`='" + id + "' ORDER BY `id`",
+	};
+}
+
+/**
+ * Creates a guild from the results of inter_guild_statements and adds it to the cache.
+ * A guild that is in the cache already is kept.
+ * @param guild_id: Guild to create
+ * @param results: Rows of the guild tables
+ * @return Guild or nullptr if it does not exist or could not be read
+ */
+static std::shared_ptr<CharGuild> inter_guild_fromresults( int32 guild_id, std::vector<s_inter_async_result>& results ){
+	const char* data;
 	char* p;
 	int32 i;
 
-	if( guild_id <= 0 ){
-		return nullptr;
-	}
-
 	auto g = util::umap_find( guild_db, guild_id );
 
 	if( g != nullptr ){
 		return g;
 	}
 
-#ifdef NOISY
-	ShowInfo("Guild load request (%d)...\n", guild_id);
-#endif
-
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT g.`name`,c.`name`,g.`guild_lv`,g.`connect_member`,g.`max_member`,g.`average_lv`,g.`exp`,g.`next_exp`,g.`skill_point`,g.`mes1`,g.`mes2`,g.`emblem_len`,g.`emblem_id`,COALESCE(UNIX_TIMESTAMP(g.`last_master_change`),0), g.`emblem_data` "
-		"FROM `%s` g LEFT JOIN `%s` c ON c.`char_id` = g.`char_id` WHERE g.`guild_id`='%d'", schema_config.guild_db, schema_config.char_db, guild_id) )
-	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
+	for( s_inter_async_result& result : results ){
+		if( !result.success ){
+			return nullptr;
+		}
 	}
 
 	// Guild does not exists.
-	if( SQL_SUCCESS != Sql_NextRow( sql_handle ) ){
+	if( results[0].rows.empty() ){
 		return nullptr;
 	}
 
+	std::vector<std::string>& row = results[0].rows[0];
+
 	g = std::make_shared<CharGuild>();
 
 	g->guild.guild_id = guild_id;
-	Sql_GetData(sql_handle,  0, &data, &len); memcpy(g->guild.name, data, zmin(len, NAME_LENGTH));
-	Sql_GetData(sql_handle,  1, &data, &len); memcpy(g->guild.master, data, zmin(len, NAME_LENGTH));
-	Sql_GetData(sql_handle,  2, &data, nullptr); g->guild.guild_lv = atoi(data);
-	Sql_GetData(sql_handle,  3, &data, nullptr); g->guild.connect_member = atoi(data);
-	Sql_GetData(sql_handle,  4, &data, nullptr); g->guild.max_member = atoi(data);
+	memcpy(g->guild.name, row[0].c_str(), zmin(row[0].size(), NAME_LENGTH));
+	memcpy(g->guild.master, row[1].c_str(), zmin(row[1].size(), NAME_LENGTH));
+	g->guild.guild_lv = atoi(row[2].c_str());
+	g->guild.connect_member = atoi(row[3].c_str());
+	g->guild.max_member = atoi(row[4].c_str());
 	if( g->guild.max_member > MAX_GUILD )
 	{	// Fix reduction of MAX_GUILD [PoW]
 		ShowWarning("Guild %d:%s specifies higher capacity (%d) than MAX_GUILD (%d)\n", guild_id, g->guild.name, g->guild.max_member, MAX_GUILD);
 		g->guild.max_member = MAX_GUILD;
 	}
-	Sql_GetData(sql_handle,  5, &data, nullptr); g->guild.average_lv = atoi(data);
-	Sql_GetData(sql_handle,  6, &data, nullptr); g->guild.exp = strtoull(data, nullptr, 10);
-	Sql_GetData(sql_handle,  7, &data, nullptr); g->guild.next_exp = strtoull(data, nullptr, 10);
-	Sql_GetData(sql_handle,  8, &data, nullptr); g->guild.skill_point = atoi(data);
-	Sql_GetData(sql_handle,  9, &data, &len); memcpy(g->guild.mes1, data, zmin(len, sizeof(g->guild.mes1)));
-	Sql_GetData(sql_handle, 10, &data, &len); memcpy(g->guild.mes2, data, zmin(len, sizeof(g->guild.mes2)));
-	Sql_GetData(sql_handle, 11, &data, &len); g->guild.emblem_len = atoi(data);
-	Sql_GetData(sql_handle, 12, &data, &len); g->guild.emblem_id = atoi(data);
-	Sql_GetData(sql_handle, 13, &data, nullptr); g->guild.last_leader_change = atoi(data);
-	Sql_GetData(sql_handle, 14, &data, &len);
+	g->guild.average_lv = atoi(row[5].c_str());
+	g->guild.exp = strtoull(row[6].c_str(), nullptr, 10);
+	g->guild.next_exp = strtoull(row[7].c_str(), nullptr, 10);
+	g->guild.skill_point = atoi(row[8].c_str());
+	memcpy(g->guild.mes1, row[9].c_str(), zmin(row[9].size(), sizeof(g->guild.mes1)));
+	memcpy(g->guild.mes2, row[10].c_str(), zmin(row[10].size(), sizeof(g->guild.mes2)));
+	g->guild.emblem_len = atoi(row[11].c_str());
+	g->guild.emblem_id = atoi(row[12].c_str());
+	g->guild.last_leader_change = atoi(row[13].c_str());
+	data = row[14].c_str();
 	// convert emblem data from hexadecimal to binary
 	//TODO: why not store it in the db as binary directly? [ultramage]
 	for( i = 0, p = g->guild.emblem_data; i < g->guild.emblem_len; ++i, ++p )
@@ -409,23 +532,16 @@ std::shared_ptr<CharGuild> inter_guild_fromsql( int32 guild_id ){
 		++data;
 	}
 
-	// load guild member info
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `c`.`account_id`,`m`.`char_id`,`c`.`hair`,`c`.`hair_color`,`c`.`sex`,`c`.`class`,`c`.`base_level`,`m`.`exp`,`c`.`online`,`m`.`position`,`c`.`name`,coalesce(UNIX_TIMESTAMP(`c`.`last_login`),0) "
-		"FROM `%s` `m` INNER JOIN `%s` `c` on `c`.`char_id`=`m`.`char_id` WHERE `m`.`guild_id`='%d' ORDER BY `position`", schema_config.guild_member_db, schema_config.char_db, guild_id) )
-	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
-	}
-	for( i = 0; i < g->guild.max_member && SQL_SUCCESS == Sql_NextRow(sql_handle); ++i )
+	for( i = 0; i < g->guild.max_member && i < static_cast<int32>( results[1].rows.size() ); ++i )
 	{
 		struct guild_member* m = &g->guild.member[i];
+		std::vector<std::string>& member = results[1].rows[i];
 
-		Sql_GetData(sql_handle,  0, &data, nullptr); m->account_id = atoi(data);
-		Sql_GetData(sql_handle,  1, &data, nullptr); m->char_id = atoi(data);
-		Sql_GetData(sql_handle,  2, &data, nullptr); m->hair = atoi(data);
-		Sql_GetData(sql_handle,  3, &data, nullptr); m->hair_color = atoi(data);
-		Sql_GetData(sql_handle,  4, &data, nullptr);
-		switch( *data ){
+		m->account_id = atoi(member[0].c_str());
+		m->char_id = atoi(member[1].c_str());
+		m->hair = atoi(member[2].c_str());
+		m->hair_color = atoi(member[3].c_str());
+		switch( member[4].empty() ? '\0' : member[4][0] ){
 			case 'F':
 				m->gender = SEX_FEMALE;
 				break;
@@ -433,79 +549,55 @@ std::shared_ptr<CharGuild> inter_guild_fromsql( int32 guild_id ){
 				m->gender = SEX_MALE;
 				break;
 			default:
-				ShowWarning( "inter_guild_fromsql: Unsupported gender %c for char_id %u. Defaulting to male...\n", *data, m->char_id );
+				ShowWarning( "inter_guild_fromsql: Unsupported gender %s for char_id %u. Defaulting to male...\n", member[4].c_str(), m->char_id );
 				m->gender = SEX_MALE;
 				break;
 		}
-		Sql_GetData(sql_handle,  5, &data, nullptr); m->class_ = atoi(data);
-		Sql_GetData(sql_handle,  6, &data, nullptr); m->lv = atoi(data);
-		Sql_GetData(sql_handle,  7, &data, nullptr); m->exp = strtoull(data, nullptr, 10);
-		Sql_GetData(sql_handle,  8, &data, nullptr); m->online = atoi(data);
-		Sql_GetData(sql_handle,  9, &data, nullptr); m->position = atoi(data);
+		m->class_ = atoi(member[5].c_str());
+		m->lv = atoi(member[6].c_str());
+		m->exp = strtoull(member[7].c_str(), nullptr, 10);
+		m->online = atoi(member[8].c_str());
+		m->position = atoi(member[9].c_str());
 		if( m->position >= MAX_GUILDPOSITION ) // Fix reduction of MAX_GUILDPOSITION [PoW]
 			m->position = MAX_GUILDPOSITION - 1;
-		Sql_GetData(sql_handle, 10, &data, &len); memcpy(m->name, data, zmin(len, NAME_LENGTH));
-		Sql_GetData(sql_handle, 11, &data, nullptr); m->last_login = atoi(data);
+		memcpy(m->name, member[10].c_str(), zmin(member[10].size(), NAME_LENGTH));
+		m->last_login = atoi(member[11].c_str());
 		m->modified = GS_MEMBER_UNMODIFIED;
 	}
 
-	//printf("- Read guild_position %d from sql \n",guild_id);
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `position`,`name`,`mode`,`exp_mode` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_position_db, guild_id) )
+	for( std::vector<std::string>& position_row : results[2].rows )
 	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
-	}
-	while( SQL_SUCCESS == Sql_NextRow(sql_handle) )
-	{
-		int32 position;
+		int32 position = atoi(position_row[0].c_str());
 		struct guild_position* gpos;
 
-		Sql_GetData(sql_handle, 0, &data, nullptr); position = atoi(data);
 		if( position < 0 || position >= MAX_GUILDPOSITION )
 			continue;// invalid position
 		gpos = &g->guild.position[position];
-		Sql_GetData(sql_handle, 1, &data, &len); memcpy(gpos->name, data, zmin(len, NAME_LENGTH));
-		Sql_GetData(sql_handle, 2, &data, nullptr); gpos->mode = atoi(data);
-		Sql_GetData(sql_handle, 3, &data, nullptr); gpos->exp_mode = atoi(data);
+		memcpy(gpos->name, position_row[1].c_str(), zmin(position_row[1].size(), NAME_LENGTH));
+		gpos->mode = atoi(position_row[2].c_str());
+		gpos->exp_mode = atoi(position_row[3].c_str());
 		gpos->modified = GS_POSITION_UNMODIFIED;
 	}
 
-	//printf("- Read guild_alliance %d from sql \n",guild_id);
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `opposition`,`alliance_id`,`name` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_alliance_db, guild_id) )
-	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
-	}
-	for( i = 0; i < MAX_GUILDALLIANCE && SQL_SUCCESS == Sql_NextRow(sql_handle); ++i )
+	for( i = 0; i < MAX_GUILDALLIANCE && i < static_cast<int32>( results[3].rows.size() ); ++i )
 	{
 		struct guild_alliance* a = &g->guild.alliance[i];
+		std::vector<std::string>& alliance = results[3].rows[i];
 
-		Sql_GetData(sql_handle, 0, &data, nullptr); a->opposition = atoi(data);
-		Sql_GetData(sql_handle, 1, &data, nullptr); a->guild_id = atoi(data);
-		Sql_GetData(sql_handle, 2, &data, &len); memcpy(a->name, data, zmin(len, NAME_LENGTH));
+		a->opposition = atoi(alliance[0].c_str());
+		a->guild_id = atoi(alliance[1].c_str());
+		memcpy(a->name, alliance[2].c_str(), zmin(alliance[2].size(), NAME_LENGTH));
 	}
 
-	//printf("- Read guild_expulsion %d from sql \n",guild_id);
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `account_id`,`name`,`mes`,`char_id` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_expulsion_db, guild_id) )
-	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
-	}
-	for( i = 0; i < MAX_GUILDEXPULSION && SQL_SUCCESS == Sql_NextRow(sql_handle); ++i )
+	for( i = 0; i < MAX_GUILDEXPULSION && i < static_cast<int32>( results[4].rows.size() ); ++i )
 	{
 		struct guild_expulsion *e = &g->guild.expulsion[i];
+		std::vector<std::string>& expulsion = results[4].rows[i];
 
-		Sql_GetData(sql_handle, 0, &data, nullptr); e->account_id = atoi(data);
-		Sql_GetData(sql_handle, 1, &data, &len); memcpy(e->name, data, zmin(len, NAME_LENGTH));
-		Sql_GetData(sql_handle, 2, &data, &len); memcpy(e->mes, data, zmin(len, sizeof(e->mes)));
-		Sql_GetData(sql_handle, 3, &data, nullptr); e->char_id = strtoul(data, nullptr, 10);
-	}
-
-	//printf("- Read guild_skill %d from sql \n",guild_id);
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `id`,`lv` FROM `%s` WHERE `guild_id`='%d' ORDER BY `id`", schema_config.guild_skill_db, guild_id) )
-	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
+		e->account_id = atoi(expulsion[0].c_str());
+		memcpy(e->name, expulsion[1].c_str(), zmin(expulsion[1].size(), NAME_LENGTH));
+		memcpy(e->mes, expulsion[2].c_str(), zmin(expulsion[2].size(), sizeof(e->mes)));
+		e->char_id = strtoul(expulsion[3].c_str(), nullptr, 10);
 	}
 
 	for(i = 0; i < MAX_GUILDSKILL; i++)
@@ -513,18 +605,17 @@ std::shared_ptr<CharGuild> inter_guild_fromsql( int32 guild_id ){
 		g->guild.skill[i].id = i + GD_SKILLBASE;
 	}
 
-	while( SQL_SUCCESS == Sql_NextRow(sql_handle) )
+	for( std::vector<std::string>& skill : results[5].rows )
 	{
-		int32 id;
-		Sql_GetData(sql_handle, 0, &data, nullptr); id = atoi(data) - GD_SKILLBASE;
+		int32 id = atoi(skill[0].c_str()) - GD_SKILLBASE;
 		if( id < 0 || id >= MAX_GUILDSKILL )
 			continue;// invalid guild skill
-		Sql_GetData(sql_handle, 1, &data, nullptr); g->guild.skill[id].lv = atoi(data);
+		g->guild.skill[id].lv = atoi(skill[1].c_str());
 	}
-	Sql_FreeResult(sql_handle);
 
 	// Add to cache
 	guild_db[g->guild.guild_id] = g;
+	g->save_tick = gettick();
 
 	// But set it to be removed, in case it is not needed for long.
 	g->save_flag |= GS_REMOVE;
@@ -535,6 +626,70 @@ std::shared_ptr<CharGuild> inter_guild_fromsql( int32 guild_id ){
 	return g;
 }
 
+// Read guild from sql
+std::shared_ptr<CharGuild> inter_guild_fromsql( int32 guild_id ){
+	if( guild_id <= 0 ){
+		return nullptr;
+	}
+
+	// Whatever the main thread does with the guild, a load running on the SQL workers may miss it
+	auto load = guild_loads.find( guild_id );
+
+	if( load != guild_loads.end() ){
+		load->second.stale = true;
+	}
+
+	auto g = util::umap_find( guild_db, guild_id );
+
+	if( g != nullptr ){
+		return g;
+	}
+
+#ifdef NOISY
+	ShowInfo("Guild load request (%d)...\n", guild_id);
+#endif
+
+	std::vector<s_inter_async_result> results = inter_async_query_now( inter_guild_statements( guild_id ) );
+
+	return inter_guild_fromresults( guild_id, results );
+}
+
+/**
+ * Runs a continuation with a guild, a guild that is not cached is loaded by the SQL workers.
+ * Continuations of a guild run in the order they were given.
+ * @param guild_id: Guild to load
+ * @param callback: Continuation, gets nullptr if the guild does not exist
+ */
+static void inter_guild_load( int32 guild_id, std::function<void( std::shared_ptr<CharGuild> g )> callback ){
+	auto load = guild_loads.find( guild_id );
+
+	if( load != guild_loads.end() ){
+		load->second.callbacks.push_back( std::move( callback ) );
+		return;
+	}
+
+	auto g = util::umap_find( guild_db, guild_id );
+
+	if( g != nullptr || guild_id <= 0 ){
+		callback( g );
+		return;
+	}
+
+	guild_loads[guild_id].callbacks.push_back( std::move( callback ) );
+
+	inter_async_query( INTER_ASYNC_GUILD, guild_id, inter_guild_statements( guild_id ), [guild_id]( std::vector<s_inter_async_result>& results ){
+		s_guild_load load = std::move( guild_loads[guild_id] );
+
+		guild_loads.erase( guild_id );
+
+		auto g = load.stale ? inter_guild_fromsql( guild_id ) : inter_guild_fromresults( guild_id, results );
+
+		for( auto& callback : load.callbacks ){
+			callback( g );
+		}
+	} );
+}
+
 /**
  * Get the max storage size of a guild.
  * @param guild_id: Guild ID to search
@@ -636,8 +791,6 @@ std::shared_ptr<struct guild_castle> inter_guildcastle_fromsql( int32 castle_id
 
 int32 inter_guild_CharOnline(uint32 char_id, int32 guild_id)
 {
-	int32 i;
-
 	if (guild_id == -1) {
 		//Get guild_id from the database
 		if( SQL_ERROR == Sql_Query(sql_handle, "SELECT guild_id FROM `%s` WHERE char_id='%d'", schema_config.char_db, char_id) )
@@ -662,32 +815,32 @@ int32 inter_guild_CharOnline(uint32 char_id, int32 guild_id)
 	if (guild_id == 0)
 		return 0; //No guild...
 
-	auto g = inter_guild_fromsql( guild_id );
+	inter_guild_load( guild_id, [char_id, guild_id]( std::shared_ptr<CharGuild> g ){
+		int32 i;
 
-	if( g == nullptr ){
-		ShowError("Character %d's guild %d not found!\n", char_id, guild_id);
-		return 0;
-	}
+		if( g == nullptr ){
+			ShowError("Character %d's guild %d not found!\n", char_id, guild_id);
+			return;
+		}
 
-	//Member has logged in before saving, tell saver not to delete
-	if(g->save_flag & GS_REMOVE)
-		g->save_flag &= ~GS_REMOVE;
+		//Member has logged in before saving, tell saver not to delete
+		if(g->save_flag & GS_REMOVE)
+			g->save_flag &= ~GS_REMOVE;
 
-	//Set member online
-	ARR_FIND( 0, g->guild.max_member, i, g->guild.member[i].char_id == char_id );
-	if( i < g->guild.max_member )
-	{
-		g->guild.member[i].online = 1;
-		g->guild.member[i].modified = GS_MEMBER_MODIFIED;
-	}
+		//Set member online
+		ARR_FIND( 0, g->guild.max_member, i, g->guild.member[i].char_id == char_id );
+		if( i < g->guild.max_member )
+		{
+			g->guild.member[i].online = 1;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
+		}
+	} );
 
 	return 1;
 }
 
 int32 inter_guild_CharOffline(uint32 char_id, int32 guild_id)
 {
-	int32 online_count, i;
-
 	if (guild_id == -1)
 	{
 		//Get guild_id from the database
@@ -714,29 +867,31 @@ int32 inter_guild_CharOffline(uint32 char_id, int32 guild_id)
 		return 0; //No guild...
 
 	//Character has a guild, set character offline and check if they were the only member online
-	auto g = inter_guild_fromsql( guild_id );
+	inter_guild_load( guild_id, [char_id]( std::shared_ptr<CharGuild> g ){
+		int32 online_count, i;
 
-	// Guild not found?
-	if( g == nullptr ){
-		return 0;
-	}
+		// Guild not found?
+		if( g == nullptr ){
+			return;
+		}
 
-	//Set member offline
-	ARR_FIND( 0, g->guild.max_member, i, g->guild.member[i].char_id == char_id );
-	if( i < g->guild.max_member )
-	{
-		g->guild.member[i].online = 0;
-		g->guild.member[i].modified = GS_MEMBER_MODIFIED;
-	}
+		//Set member offline
+		ARR_FIND( 0, g->guild.max_member, i, g->guild.member[i].char_id == char_id );
+		if( i < g->guild.max_member )
+		{
+			g->guild.member[i].online = 0;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
+		}
 
-	online_count = 0;
-	for( i = 0; i < g->guild.max_member; i++ )
-		if( g->guild.member[i].online )
-			online_count++;
+		online_count = 0;
+		for( i = 0; i < g->guild.max_member; i++ )
+			if( g->guild.member[i].online )
+				online_count++;
 
-	// Remove guild from memory if no players online
-	if( online_count == 0 )
-		g->save_flag |= GS_REMOVE;
+		// Remove guild from memory if no players online
+		if( online_count == 0 )
+			g->save_flag |= GS_REMOVE;
+	} );
 
 	return 1;
 }
@@ -819,6 +974,23 @@ void inter_guild_sql_final(void)
 	castle_db.clear();
 }
 
+/**
+ * Displays the counters of the guild writes
+ * @param reset: Whether to reset the counters afterwards
+ */
+void inter_guild_save_report(bool reset)
+{
+	s_guild_save_stats& stats = guild_save_stats;
+
+	ShowInfo( "Guild saves: %" PRIu64 " written in %" PRIu64 " statements, %" PRIu64 " postponed to the exp save interval, %" PRIuPTR " guilds cached.\n",
+		stats.saves, stats.statements, stats.deferred, guild_db.size() );
+	ShowInfo( "Guild rows: %" PRIu64 " member rows written, %" PRIu64 " member changes needed no write, %" PRIu64 " other rows written.\n",
+		stats.member_rows, stats.member_avoided, stats.rows );
+
+	if( reset )
+		stats = {};
+}
+
 // Get guild_id by its name. Returns 0 if not found, -1 on error.
 int32 search_guildname(char *str)
 {
@@ -1245,6 +1417,7 @@ int32 mapif_parse_CreateGuild(int32 fd,uint32 account_id,char *name,struct guild
 
 	// Add to cache
 	guild_db[g->guild.guild_id] = g;
+	g->save_tick = gettick();
 
 	// Report to client
 	mapif_guild_created(fd, account_id, &g->guild);
@@ -1258,15 +1431,20 @@ int32 mapif_parse_CreateGuild(int32 fd,uint32 account_id,char *name,struct guild
 }
 
 // Return guild info to client
+// Guilds that are not cached are loaded by the SQL workers, the info is sent once they are
 int32 mapif_parse_GuildInfo(int32 fd,int32 guild_id)
 {
-	auto g = inter_guild_fromsql( guild_id );
+	inter_guild_load( guild_id, [fd, guild_id]( std::shared_ptr<CharGuild> g ){
+		if( !inter_mapif_isactive( fd ) )
+			return;
+
+		if( g != nullptr ){
+			if (!guild_calcinfo(g))
+				mapif_guild_info(fd,g->guild);
+		}else
+			mapif_guild_noinfo(fd,guild_id); // Failed to load info
+	} );
 
-	if( g != nullptr ){
-		if (!guild_calcinfo(g))
-			mapif_guild_info(fd,g->guild);
-	}else
-		mapif_guild_noinfo(fd,guild_id); // Failed to load info
 	return 0;
 }
 
@@ -1381,7 +1559,7 @@ int32 mapif_parse_GuildChangeMemberInfoShort(int32 fd,int32 guild_id,uint32 acco
 		g->guild.member[i].online = online;
 		g->guild.member[i].lv = lv;
 		g->guild.member[i].class_ = class_;
-		g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+		g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 		mapif_guild_memberinfoshort(g->guild,i);
 	}
 
@@ -1438,6 +1616,7 @@ int32 mapif_parse_BreakGuild(int32 fd,int32 guild_id)
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d'", schema_config.guild_storage_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
+	char_memitemdata_invalidate(TABLE_GUILD_STORAGE, guild_id);
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d' OR `alliance_id` = '%d'", schema_config.guild_alliance_db, guild_id, guild_id) )
 		Sql_ShowDebug(sql_handle);
@@ -1542,7 +1721,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		case GMI_POSITION:
 		  {
 			g->guild.member[i].position=*((int16 *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_MODIFIED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
 			g->save_flag |= GS_MEMBER;
 			break;
@@ -1551,7 +1730,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		{	// EXP
 			t_exp old_exp=g->guild.member[i].exp;
 			g->guild.member[i].exp=*((t_exp *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_EXP;
 			if (g->guild.member[i].exp > old_exp)
 			{
 				t_exp exp = g->guild.member[i].exp - old_exp;
@@ -1574,7 +1753,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		case GMI_HAIR:
 		{
 			g->guild.member[i].hair=*((int16 *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
 			g->save_flag |= GS_MEMBER; //Save new data.
 			break;
@@ -1582,7 +1761,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		case GMI_HAIR_COLOR:
 		{
 			g->guild.member[i].hair_color=*((int16 *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
 			g->save_flag |= GS_MEMBER; //Save new data.
 			break;
@@ -1590,7 +1769,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		case GMI_GENDER:
 		{
 			g->guild.member[i].gender=*((int16 *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
 			g->save_flag |= GS_MEMBER; //Save new data.
 			break;
@@ -1598,7 +1777,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		case GMI_CLASS:
 		{
 			g->guild.member[i].class_=*((int16 *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
 			g->save_flag |= GS_MEMBER; //Save new data.
 			break;
@@ -1606,7 +1785,7 @@ int32 mapif_parse_GuildMemberInfoChange(int32 fd,int32 guild_id,uint32 account_i
 		case GMI_LEVEL:
 		{
 			g->guild.member[i].lv=*((int16 *)data);
-			g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+			g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 			mapif_guild_memberinfochanged(guild_id,account_id,char_id,type,data,len);
 			g->save_flag |= GS_MEMBER; //Save new data.
 			break;
@@ -1647,7 +1826,7 @@ int32 inter_guild_charname_changed(int32 guild_id,uint32 account_id, uint32 char
 		flag |= GS_BASIC;
 	}
 	safestrncpy(g->guild.member[i].name, name, NAME_LENGTH);
-	g->guild.member[i].modified = GS_MEMBER_MODIFIED;
+	g->guild.member[i].modified |= GS_MEMBER_TOUCHED;
 	flag |= GS_MEMBER;
 
 	if( !inter_guild_tosql(g->guild, flag) )
@@ -1694,8 +1873,11 @@ int32 mapif_parse_GuildSkillUp(int32 fd,int32 guild_id,uint16 skill_id,uint32 ac
 			mapif_guild_info(-1,g->guild);
 		mapif_guild_skillupack(guild_id,skill_id,account_id);
 		g->save_flag |= (GS_LEVEL|GS_SKILL); // Change guild & guild_skill
-		if (skill_id == GD_GUILD_STORAGE)
+		if (skill_id == GD_GUILD_STORAGE) {
 			inter_guild_tosql(g->guild, g->save_flag); // Force save for GD_GUILD_STORAGE
+			g->save_flag &= ~GS_MASK;
+			g->save_tick = gettick();
+		}
 	}
 	return 0;
 }
@@ -1793,6 +1975,8 @@ int32 mapif_parse_GuildNotice(int32 fd,int32 guild_id,const char *mes1,const cha
 	memcpy(g->guild.mes2,mes2,MAX_GUILDMES2);
 	g->save_flag |= GS_MES;	//Change mes of guild
 	inter_guild_tosql(g->guild, g->save_flag);
+	g->save_flag &= ~GS_MASK;
+	g->save_tick = gettick();
 	return mapif_guild_notice(g->guild);
 }
 
@@ -1882,9 +2066,9 @@ int32 mapif_parse_GuildMasterChange(int32 fd, int32 guild_id, const char* name,
 
 	// Switch positions
 	g->guild.member[pos].position = g->guild.member[0].position;
-	g->guild.member[pos].modified = GS_MEMBER_MODIFIED;
+	g->guild.member[pos].modified |= GS_MEMBER_MODIFIED;
 	g->guild.member[0].position = 0; //Position 0: guild Master.
-	g->guild.member[0].modified = GS_MEMBER_MODIFIED;
+	g->guild.member[0].modified |= GS_MEMBER_MODIFIED;
 
 	// Store changing time
 	g->guild.last_leader_change = time(nullptr);
@@ -9,6 +9,7 @@
 #include <common/cbasetypes.hpp>
 #include <common/database.hpp>
 #include <common/mmo.hpp>
+#include <common/timer.hpp>
 
 enum e_guild_action : uint32 {
 	GS_BASIC = 0x0001,
@@ -52,6 +53,7 @@ class CharGuild {
 public:
 	struct mmo_guild guild;
 	uint16 save_flag;
+	t_tick save_tick; ///< Last time the exp and online members were written, see guild_exp_save_interval
 };
 
 int32 inter_guild_parse_frommap(int32 fd);
@@ -65,5 +67,6 @@ int32 inter_guild_charname_changed(int32 guild_id,uint32 account_id, uint32 char
 int32 inter_guild_CharOnline(uint32 char_id, int32 guild_id);
 int32 inter_guild_CharOffline(uint32 char_id, int32 guild_id);
 uint16 inter_guild_storagemax(int32 guild_id);
+void inter_guild_save_report(bool reset);
 
 #endif /* INT_GUILD_HPP */
@@ -6,6 +6,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <common/mmo.hpp>
 #include <common/showmsg.hpp>
@@ -17,6 +20,7 @@
 #include "char.hpp"
 #include "char_mapif.hpp"
 #include "inter.hpp"
+#include "inter_async.hpp"
 
 using namespace rathena;
 
@@ -24,57 +28,16 @@ bool mail_loadmessage(int32 mail_id, struct mail_message* msg);
 void mapif_Mail_return( int32 fd, uint32 char_id, int32 mail_id, uint32 account_id_receiver = 0, uint32 account_id_sender = 0 );
 bool mapif_Mail_delete( int32 fd, uint32 char_id, int32 mail_id, uint32 account_id = 0 );
 
-int32 mail_fromsql(uint32 char_id, struct mail_data* md)
+/// Sets when a message is returned or deleted
+static void mail_set_scheduled_deletion(struct mail_message* msg)
 {
-	int32 i;
-	char *data;
-
-	memset(md, 0, sizeof(struct mail_data));
-	md->amount = 0;
-	md->full = false;
-
-	// First we prefill the msg ids
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `id` FROM `%s` WHERE `dest_id`='%d' AND `status` < 3 ORDER BY `id` LIMIT %d", schema_config.mail_db, char_id, MAIL_MAX_INBOX + 1) ){
-		Sql_ShowDebug(sql_handle);
-		return 0;
-	}
-
-	md->full = (Sql_NumRows(sql_handle) > MAIL_MAX_INBOX);
-
-	for( i = 0; i < MAIL_MAX_INBOX && SQL_SUCCESS == Sql_NextRow(sql_handle); i++ ){
-		Sql_GetData(sql_handle, 0, &data, nullptr); md->msg[i].id = atoi(data);
-	}
-
-	md->amount = i;
-	Sql_FreeResult(sql_handle);
-
-	// Now we load them
-	for( i = 0; i < md->amount; i++ ){
-		if( !mail_loadmessage( md->msg[i].id, &md->msg[i] ) ){
-			return 0;
-		}
-	}
-
-	md->unchecked = 0;
-	md->unread = 0;
-	for (i = 0; i < md->amount; i++)
-	{
-		struct mail_message *msg = &md->msg[i];
-
-		if( msg->status == MAIL_NEW )
-		{
-			if ( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `status` = '%d' WHERE `id` = '%d'", schema_config.mail_db, MAIL_UNREAD, msg->id) )
-				Sql_ShowDebug(sql_handle);
-
-			msg->status = MAIL_UNREAD;
-			md->unchecked++;
-		}
-		else if ( msg->status == MAIL_UNREAD )
-			md->unread++;
+	if( msg->type == MAIL_INBOX_NORMAL && charserv_config.mail_return_days > 0 ){
+		msg->scheduled_deletion = msg->timestamp + charserv_config.mail_return_days * 24 * 60 * 60;
+	}else if( msg->type == MAIL_INBOX_RETURNED && charserv_config.mail_delete_days > 0 ){
+		msg->scheduled_deletion = msg->timestamp + charserv_config.mail_delete_days * 24 * 60 * 60;
+	}else{
+		msg->scheduled_deletion = 0;
 	}
-
-	ShowInfo("mail load complete from DB - id: %d (total: %d)\n", char_id, md->amount);
-	return 1;
 }
 
 /// Stores a single message in the database.
@@ -184,13 +147,7 @@ bool mail_loadmessage(int32 mail_id, struct mail_message* msg)
 		Sql_GetData(sql_handle, 9, &data, nullptr); msg->zeny = atoi(data);
 		Sql_GetData(sql_handle,10, &data, nullptr); msg->type = (mail_inbox_type)atoi(data);
 
-		if( msg->type == MAIL_INBOX_NORMAL && charserv_config.mail_return_days > 0 ){
-			msg->scheduled_deletion = msg->timestamp + charserv_config.mail_return_days * 24 * 60 * 60;
-		}else if( msg->type == MAIL_INBOX_RETURNED && charserv_config.mail_delete_days > 0 ){
-			msg->scheduled_deletion = msg->timestamp + charserv_config.mail_delete_days * 24 * 60 * 60;
-		}else{
-			msg->scheduled_deletion = 0;
-		}
+		mail_set_scheduled_deletion(msg);
 
 		Sql_FreeResult(sql_handle);
 	}
@@ -327,18 +284,120 @@ TIMER_FUNC(mail_delete_timer){
  *------------------------------------------*/
 void mapif_Mail_sendinbox(int32 fd, uint32 char_id, unsigned char flag, enum mail_inbox_type type)
 {
-	struct mail_data md;
-	mail_fromsql(char_id, &md);
+	StringBuf buf;
+	std::string inbox = "FROM `" + std::string( schema_config.mail_db ) + "` WHERE `dest_id` = '" + std::to_string( char_id ) + "' AND `status` < 3 ORDER BY `id`";
+	std::vector<std::string> statements;
 
-	//FIXME: dumping the whole structure like this is unsafe [ultramage]
-	WFIFOHEAD(fd, sizeof(md) + 10);
-	WFIFOW(fd,0) = 0x3848;
-	WFIFOW(fd,2) = sizeof(md) + 10;
-	WFIFOL(fd,4) = char_id;
-	WFIFOB(fd,8) = flag;
-	WFIFOB(fd,9) = type;
-	memcpy(WFIFOP(fd,10),&md,sizeof(md));
-	WFIFOSET(fd,WFIFOW(fd,2));
+	// Messages, one more than fits to know whether the inbox is full
+	statements.push_back( "SELECT `id`,`send_name`,`send_id`,`dest_name`,`dest_id`,`title`,`message`,`time`,`status`,`zeny`,`type` " + inbox + " LIMIT " + std::to_string( MAIL_MAX_INBOX + 1 ) );
+
+	// Attachments of all messages in one go
+	StringBuf_Init(&buf);
+	StringBuf_AppendStr(&buf, "SELECT a.`id`,`amount`,`nameid`,`refine`,`attribute`,`identify`,`unique_id`,`bound`,`enchantgrade`");
+	for( int32 j = 0; j < MAX_SLOTS; j++ )
+		StringBuf_Printf(&buf, ",`card%d`", j);
+	for( int32 j = 0; j < MAX_ITEM_RDM_OPT; ++j ){
+		StringBuf_Printf(&buf, ", `option_id%d`", j);
+		StringBuf_Printf(&buf, ", `option_val%d`", j);
+		StringBuf_Printf(&buf, ", `option_parm%d`", j);
+	}
+	StringBuf_Printf(&buf, " FROM `%s` a", schema_config.mail_attachment_db);
+	StringBuf_Printf(&buf, " JOIN (SELECT `id` %s LIMIT %d) m ON a.`id` = m.`id`", inbox.c_str(), MAIL_MAX_INBOX);
+	StringBuf_AppendStr(&buf, " ORDER BY a.`id`, a.`index` ASC");
+	statements.push_back( StringBuf_Value(&buf) );
+
+	inter_async_query( INTER_ASYNC_CHAR, char_id, std::move( statements ), [fd, char_id, flag, type]( std::vector<s_inter_async_result>& results ){
+		if( !inter_mapif_isactive( fd ) ){
+			return;
+		}
+
+		struct mail_data md = {};
+		std::unordered_map<int32, struct mail_message*> messages;
+		std::string unchecked;
+
+		md.full = results[0].rows.size() > MAIL_MAX_INBOX;
+
+		for( std::vector<std::string>& row : results[0].rows ){
+			if( md.amount == MAIL_MAX_INBOX ){
+				break;
+			}
+
+			struct mail_message* msg = &md.msg[md.amount++];
+
+			msg->id = atoi( row[0].c_str() );
+			safestrncpy( msg->send_name, row[1].c_str(), NAME_LENGTH );
+			msg->send_id = atoi( row[2].c_str() );
+			safestrncpy( msg->dest_name, row[3].c_str(), NAME_LENGTH );
+			msg->dest_id = atoi( row[4].c_str() );
+			safestrncpy( msg->title, row[5].c_str(), MAIL_TITLE_LENGTH );
+			safestrncpy( msg->body, row[6].c_str(), MAIL_BODY_LENGTH );
+			msg->timestamp = atoi( row[7].c_str() );
+			msg->status = (mail_status)atoi( row[8].c_str() );
+			msg->zeny = atoi( row[9].c_str() );
+			msg->type = (mail_inbox_type)atoi( row[10].c_str() );
+			mail_set_scheduled_deletion( msg );
+
+			if( msg->status == MAIL_NEW ){
+				unchecked += ( unchecked.empty() ? "" : "," ) + std::to_string( msg->id );
+				msg->status = MAIL_UNREAD;
+				md.unchecked++;
+			}else if( msg->status == MAIL_UNREAD ){
+				md.unread++;
+			}
+
+			messages[msg->id] = msg;
+		}
+
+		std::unordered_map<int32, int32> counts;
+
+		for( std::vector<std::string>& row : results[1].rows ){
+			int32 id = atoi( row[0].c_str() );
+			auto it = messages.find( id );
+
+			// Messages sent or deleted in between
+			if( it == messages.end() || counts[id] == MAIL_MAX_ITEM ){
+				continue;
+			}
+
+			struct item* item = &it->second->item[counts[id]++];
+
+			item->amount = (int16)atoi( row[1].c_str() );
+			item->nameid = strtoul( row[2].c_str(), nullptr, 10 );
+			item->refine = atoi( row[3].c_str() );
+			item->attribute = atoi( row[4].c_str() );
+			item->identify = atoi( row[5].c_str() );
+			item->unique_id = strtoull( row[6].c_str(), nullptr, 10 );
+			item->bound = atoi( row[7].c_str() );
+			item->enchantgrade = atoi( row[8].c_str() );
+			item->expire_time = 0;
+
+			for( int32 j = 0; j < MAX_SLOTS; j++ ){
+				item->card[j] = strtoul( row[9 + j].c_str(), nullptr, 10 );
+			}
+
+			for( int32 j = 0; j < MAX_ITEM_RDM_OPT; j++ ){
+				item->option[j].id = atoi( row[9 + MAX_SLOTS + j * 3].c_str() );
+				item->option[j].value = atoi( row[10 + MAX_SLOTS + j * 3].c_str() );
+				item->option[j].param = atoi( row[11 + MAX_SLOTS + j * 3].c_str() );
+			}
+		}
+
+		if( !unchecked.empty() ){
+			inter_async_query( INTER_ASYNC_CHAR, char_id, { "UPDATE `" + std::string( schema_config.mail_db ) + "` SET `status` = '" + std::to_string( MAIL_UNREAD ) + "' WHERE `id` IN (" + unchecked + ") AND `status` = '" + std::to_string( MAIL_NEW ) + "'" } );
+		}
+
+		ShowInfo("mail load complete from DB - id: %d (total: %d)\n", char_id, md.amount);
+
+		//FIXME: dumping the whole structure like this is unsafe [ultramage]
+		WFIFOHEAD(fd, sizeof(md) + 10);
+		WFIFOW(fd,0) = 0x3848;
+		WFIFOW(fd,2) = sizeof(md) + 10;
+		WFIFOL(fd,4) = char_id;
+		WFIFOB(fd,8) = flag;
+		WFIFOB(fd,9) = type;
+		memcpy(WFIFOP(fd,10),&md,sizeof(md));
+		WFIFOSET(fd,WFIFOW(fd,2));
+	} );
 }
 
 void mapif_parse_Mail_requestinbox(int32 fd)
@@ -701,26 +760,34 @@ void mapif_Mail_receiver_send( int32 fd, int32 requesting_char_id, int32 char_id
 
 void mapif_parse_Mail_receiver_check( int32 fd ){
 	char name[NAME_LENGTH], esc_name[NAME_LENGTH * 2 + 1];
-	uint32 char_id = 0;
-	uint16 class_ = 0, base_level = 0;
+	uint32 requesting_char_id = RFIFOL(fd, 2);
+	std::string query;
 
 	safestrncpy( name, RFIFOCP(fd, 6), NAME_LENGTH );
 
 	// Try to find the Dest Char by Name
 	Sql_EscapeStringLen( sql_handle, esc_name, name, strnlen( name, NAME_LENGTH ) );
 
-	if( SQL_ERROR == Sql_Query( sql_handle, "SELECT `char_id`,`class`,`base_level` FROM `%s` WHERE `name` = '%s'", schema_config.char_db, esc_name ) ){
-		Sql_ShowDebug(sql_handle);
-	}else if( SQL_SUCCESS == Sql_NextRow(sql_handle) ){
-		char *data;
+	query = "SELECT `char_id`,`class`,`base_level` FROM `" + std::string( schema_config.char_db ) + "` WHERE `name` = '" + esc_name + "'";
 
-		Sql_GetData(sql_handle, 0, &data, nullptr); char_id = atoi(data);
-		Sql_GetData(sql_handle, 1, &data, nullptr); class_ = atoi(data);
-		Sql_GetData(sql_handle, 2, &data, nullptr); base_level = atoi(data);
-	}
+	inter_async_query( INTER_ASYNC_CHAR, requesting_char_id, { query }, [fd, requesting_char_id, receiver = std::string( name )]( std::vector<s_inter_async_result>& results ){
+		uint32 char_id = 0;
+		uint16 class_ = 0, base_level = 0;
 
-	Sql_FreeResult(sql_handle);
-	mapif_Mail_receiver_send( fd, RFIFOL(fd, 2), char_id, class_, base_level, name );
+		if( !inter_mapif_isactive( fd ) ){
+			return;
+		}
+
+		if( !results[0].rows.empty() ){
+			std::vector<std::string>& row = results[0].rows[0];
+
+			char_id = atoi( row[0].c_str() );
+			class_ = atoi( row[1].c_str() );
+			base_level = atoi( row[2].c_str() );
+		}
+
+		mapif_Mail_receiver_send( fd, requesting_char_id, char_id, class_, base_level, receiver.c_str() );
+	} );
 }
 
 /*==========================================
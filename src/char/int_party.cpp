@@ -5,8 +5,11 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <common/cbasetypes.hpp>
 #include <common/malloc.hpp>
@@ -20,6 +23,7 @@
 #include "char.hpp"
 #include "char_mapif.hpp"
 #include "inter.hpp"
+#include "inter_async.hpp"
 
 using namespace rathena;
 
@@ -188,66 +192,69 @@ int32 inter_party_tosql(struct party *p, int32 flag, int32 index)
 	return 1;
 }
 
-// Read party from mysql
-std::shared_ptr<struct party_data> inter_party_fromsql( int32 party_id ){
-	int32 leader_id = 0;
-	int32 leader_char = 0;
-	struct party_member* m;
-	char* data;
-	size_t len;
-	int32 i;
+/// Party loads running on the SQL workers
+struct s_party_load {
+	bool stale = false; ///< The party was read or changed by the main thread meanwhile, the rows may be outdated
+	std::vector<std::function<void( std::shared_ptr<struct party_data> p )>> callbacks; ///< Continuations waiting for the party, in order
+};
 
-#ifdef NOISY
-	ShowInfo("Load party request (" CL_BOLD "%d" CL_RESET ")\n", party_id);
-#endif
-	if( party_id <= 0 )
-		return nullptr;
+/// Parties being loaded by inter_party_load, by party id
+static std::unordered_map<int32, s_party_load> party_loads;
 
-	//Load from memory
+/// Statements loading a party, see inter_party_fromresults
+static std::vector<std::string> inter_party_statements( int32 party_id ){
+	std::string id = std::to_string( party_id );
+
+	return {
+		"SELECT `party_id`, `name`,`exp`,`item`, `leader_id`, `leader_char` FROM `" + std::string( schema_config.party_db ) + "` WHERE `party_id`='" + id + "'",
+		"SELECT `account_id`,`char_id`,`name`,`base_level`,`last_map`,`online`,`class` FROM `" + std::string( schema_config.char_db ) + "` WHERE `party_id`='" + id + "'",
+	};
+}
+
+/**
+ * Creates a party from the results of inter_party_statements and adds it to the cache.
+ * A party that is in the cache already is kept.
+ * @param party_id: Party to create
+ * @param results: Rows of the party and its members
+ * @return Party or nullptr if it does not exist or could not be read
+ */
+static std::shared_ptr<struct party_data> inter_party_fromresults( int32 party_id, std::vector<s_inter_async_result>& results ){
 	std::shared_ptr<struct party_data> p = util::umap_find( party_db, party_id );
 
 	if( p != nullptr ){
 		return p;
 	}
 
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `party_id`, `name`,`exp`,`item`, `leader_id`, `leader_char` FROM `%s` WHERE `party_id`='%d'", schema_config.party_db, party_id) )
-	{
-		Sql_ShowDebug(sql_handle);
+	if( !results[0].success || !results[1].success || results[0].rows.empty() )
 		return nullptr;
-	}
 
-	if( SQL_SUCCESS != Sql_NextRow(sql_handle) )
-		return nullptr;
+	std::vector<std::string>& row = results[0].rows[0];
+	int32 leader_id, leader_char;
 
 	p = std::make_shared<struct party_data>();
 
 	p->party.party_id = party_id;
-	Sql_GetData(sql_handle, 1, &data, &len); memcpy(p->party.name, data, zmin(len, NAME_LENGTH));
-	Sql_GetData(sql_handle, 2, &data, nullptr); p->party.exp = (atoi(data) ? 1 : 0);
-	Sql_GetData(sql_handle, 3, &data, nullptr); p->party.item = atoi(data);
-	Sql_GetData(sql_handle, 4, &data, nullptr); leader_id = atoi(data);
-	Sql_GetData(sql_handle, 5, &data, nullptr); leader_char = atoi(data);
-	Sql_FreeResult(sql_handle);
+	memcpy(p->party.name, row[1].c_str(), zmin(row[1].size(), NAME_LENGTH));
+	p->party.exp = (atoi(row[2].c_str()) ? 1 : 0);
+	p->party.item = atoi(row[3].c_str());
+	leader_id = atoi(row[4].c_str());
+	leader_char = atoi(row[5].c_str());
 
 	// Load members
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `account_id`,`char_id`,`name`,`base_level`,`last_map`,`online`,`class` FROM `%s` WHERE `party_id`='%d'", schema_config.char_db, party_id) )
+	for( size_t i = 0; i < MAX_PARTY && i < results[1].rows.size(); ++i )
 	{
-		Sql_ShowDebug(sql_handle);
-		return nullptr;
-	}
-	for( i = 0; i < MAX_PARTY && SQL_SUCCESS == Sql_NextRow(sql_handle); ++i )
-	{
-		m = &p->party.member[i];
-		Sql_GetData(sql_handle, 0, &data, nullptr); m->account_id = atoi(data);
-		Sql_GetData(sql_handle, 1, &data, nullptr); m->char_id = atoi(data);
-		Sql_GetData(sql_handle, 2, &data, &len); memcpy(m->name, data, zmin(len, NAME_LENGTH));
-		Sql_GetData(sql_handle, 3, &data, nullptr); m->lv = atoi(data);
-		Sql_GetData(sql_handle, 4, &data, &len); memcpy(m->map, data, zmin(len, sizeof(m->map)));
-		Sql_GetData(sql_handle, 5, &data, nullptr); m->online = (atoi(data) ? 1 : 0);
-		Sql_GetData(sql_handle, 6, &data, nullptr); m->class_ = atoi(data);
+		struct party_member* m = &p->party.member[i];
+		std::vector<std::string>& member = results[1].rows[i];
+
+		m->account_id = atoi(member[0].c_str());
+		m->char_id = atoi(member[1].c_str());
+		memcpy(m->name, member[2].c_str(), zmin(member[2].size(), NAME_LENGTH));
+		m->lv = atoi(member[3].c_str());
+		memcpy(m->map, member[4].c_str(), zmin(member[4].size(), sizeof(m->map)));
+		m->online = (atoi(member[5].c_str()) ? 1 : 0);
+		m->class_ = atoi(member[6].c_str());
 		m->leader = (m->account_id == leader_id && m->char_id == leader_char ? 1 : 0);
 	}
-	Sql_FreeResult(sql_handle);
 
 	if( charserv_config.save_log )
 		ShowInfo("Party loaded (%d - %s).\n", party_id, p->party.name);
@@ -260,6 +267,68 @@ std::shared_ptr<struct party_data> inter_party_fromsql( int32 party_id ){
 	return p;
 }
 
+// Read party from mysql
+std::shared_ptr<struct party_data> inter_party_fromsql( int32 party_id ){
+#ifdef NOISY
+	ShowInfo("Load party request (" CL_BOLD "%d" CL_RESET ")\n", party_id);
+#endif
+	if( party_id <= 0 )
+		return nullptr;
+
+	// Whatever the main thread does with the party, a load running on the SQL workers may miss it
+	auto load = party_loads.find( party_id );
+
+	if( load != party_loads.end() )
+		load->second.stale = true;
+
+	//Load from memory
+	std::shared_ptr<struct party_data> p = util::umap_find( party_db, party_id );
+
+	if( p != nullptr ){
+		return p;
+	}
+
+	std::vector<s_inter_async_result> results = inter_async_query_now( inter_party_statements( party_id ) );
+
+	return inter_party_fromresults( party_id, results );
+}
+
+/**
+ * Runs a continuation with a party, a party that is not cached is loaded by the SQL workers.
+ * Continuations of a party run in the order they were given.
+ * @param party_id: Party to load
+ * @param callback: Continuation, gets nullptr if the party does not exist
+ */
+static void inter_party_load( int32 party_id, std::function<void( std::shared_ptr<struct party_data> p )> callback ){
+	auto load = party_loads.find( party_id );
+
+	if( load != party_loads.end() ){
+		load->second.callbacks.push_back( std::move( callback ) );
+		return;
+	}
+
+	std::shared_ptr<struct party_data> p = util::umap_find( party_db, party_id );
+
+	if( p != nullptr || party_id <= 0 ){
+		callback( p );
+		return;
+	}
+
+	party_loads[party_id].callbacks.push_back( std::move( callback ) );
+
+	inter_async_query( INTER_ASYNC_PARTY, party_id, inter_party_statements( party_id ), [party_id]( std::vector<s_inter_async_result>& results ){
+		s_party_load load = std::move( party_loads[party_id] );
+
+		party_loads.erase( party_id );
+
+		std::shared_ptr<struct party_data> p = load.stale ? inter_party_fromsql( party_id ) : inter_party_fromresults( party_id, results );
+
+		for( auto& callback : load.callbacks ){
+			callback( p );
+		}
+	} );
+}
+
 int32 inter_party_sql_init(void)
 {
 	// Remove parties with no members on startup from party_db. [Skotlex]
@@ -559,15 +628,19 @@ int32 mapif_parse_CreateParty(int32 fd, char *name, int32 item, int32 item2, str
 }
 
 // Party information request
+// Parties that are not cached are loaded by the SQL workers, the info is sent once they are
 void mapif_parse_PartyInfo(int32 fd, int32 party_id, uint32 char_id)
 {
-	std::shared_ptr<struct party_data> p = inter_party_fromsql( party_id );
-
-	if( p != nullptr ){
-		mapif_party_info(fd, &p->party, char_id);
-	}else{
-		mapif_party_noinfo(fd, party_id, char_id);
-	}
+	inter_party_load( party_id, [fd, party_id, char_id]( std::shared_ptr<struct party_data> p ){
+		if( !inter_mapif_isactive( fd ) )
+			return;
+
+		if( p != nullptr ){
+			mapif_party_info(fd, &p->party, char_id);
+		}else{
+			mapif_party_noinfo(fd, party_id, char_id);
+		}
+	} );
 }
 
 // Add a player to party request
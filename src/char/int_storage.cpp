@@ -346,6 +346,7 @@ bool mapif_parse_itembound_retrieve(int32 fd)
 		mapif_itembound_ack(fd,account_id,guild_id);
 		return true;
 	}
+	char_memitemdata_invalidate(TABLE_INVENTORY, char_id);
 
 	// Send the deleted items to map-server to store them in guild storage [Cydh]
 	mapif_itembound_store2gstorage(fd, guild_id, items, count);
@@ -451,34 +452,39 @@ bool mapif_parse_StorageLoad(int32 fd) {
 	uint32 aid, cid;
 	int32 type;
 	uint8 stor_id, mode;
-	struct s_storage stor;
-	bool res = true;
 
 	type = RFIFOB(fd,2);
 	aid = RFIFOL(fd,3);
 	cid = RFIFOL(fd,7);
 	stor_id = RFIFOB(fd,11);
+	mode = RFIFOB(fd, 12);
 
-	memset(&stor, 0, sizeof(struct s_storage));
-	stor.stor_id = stor_id;
+	// Sends the container once the SQL workers read it
+	auto loaded = [fd, aid, type, mode]( struct s_storage& stor, bool res ){
+		if( !inter_mapif_isactive( fd ) )
+			return;
+
+		stor.state.put = (mode&STOR_MODE_PUT) ? 1 : 0;
+		stor.state.get = (mode&STOR_MODE_GET) ? 1 : 0;
+
+		mapif_storage_data_loaded(fd, aid, type, &stor, res);
+	};
 
 	//ShowInfo("Loading storage for AID=%d.\n", aid);
 	switch (type) {
-		case TABLE_INVENTORY: res = inventory_fromsql(cid, &stor); break;
+		case TABLE_INVENTORY: char_memitemdata_from_sql_async( MAX_INVENTORY, cid, TABLE_INVENTORY, stor_id, loaded ); break;
 		case TABLE_STORAGE:
-			res = storage_fromsql(aid, &stor);
-			break;
-		case TABLE_CART:      res = cart_fromsql(cid, &stor);      break;
-		default:
-			res = false;
+			char_memitemdata_from_sql_async( MAX_STORAGE, aid, TABLE_STORAGE, stor_id, loaded );
 			break;
-	}
+		case TABLE_CART:      char_memitemdata_from_sql_async( MAX_CART, cid, TABLE_CART, stor_id, loaded );      break;
+		default: {
+			struct s_storage stor = {};
 
-	mode = RFIFOB(fd, 12);
-	stor.state.put = (mode&STOR_MODE_PUT) ? 1 : 0;
-	stor.state.get = (mode&STOR_MODE_GET) ? 1 : 0;
+			stor.stor_id = stor_id;
+			loaded( stor, false );
+			} break;
+	}
 
-	mapif_storage_data_loaded(fd, aid, type, &stor, res);
 	return true;
 }
 
@@ -500,6 +506,12 @@ bool mapif_parse_StorageSave(int32 fd) {
 	memcpy(&stor, RFIFOP(fd, 13), sizeof(struct s_storage));
 
 	//ShowInfo("Saving storage data for AID=%d.\n", aid);
+	// Items of a character with a queued save are written together with its status
+	if( ( type == TABLE_INVENTORY || type == TABLE_CART || type == TABLE_STORAGE ) && char_save_queue_items( cid, type == TABLE_STORAGE ? aid : cid, static_cast<enum storage_type>( type ), &stor ) ){
+		mapif_storage_saved(fd, aid, cid, true, type, stor.stor_id);
+		return true;
+	}
+
 	switch(type){
 		case TABLE_INVENTORY:
 			res = inventory_tosql(cid, &stor) == 0;
@@ -19,11 +19,13 @@
 #include <common/socket.hpp>
 #include <common/strlib.hpp>
 #include <common/timer.hpp>
+#include <common/utils.hpp>
 
 #include "char.hpp"
 #include "char_logif.hpp"
 #include "char_mapif.hpp"
 #include "inter.hpp"
+#include "inter_async.hpp"
 #include "int_achievement.hpp"
 #include "int_auction.hpp"
 #include "int_clan.hpp"
@@ -52,6 +54,7 @@ std::string char_server_id = "ragnarok";
 std::string char_server_pw = ""; // Allow user to send empty password (bugreport:7787)
 std::string char_server_db = "ragnarok";
 std::string default_codepage = ""; //Feature by irmin.
+int32 sql_async_workers = 2;
 uint32 party_share_level = 10;
 
 /// Received packet Lengths from map-server
@@ -854,6 +857,8 @@ int32 inter_config_read(const char* cfgName)
 			char_server_db = w2;
 		else if(!strcmpi(w1,"default_codepage"))
 			default_codepage = w2;
+		else if(!strcmpi(w1,"sql_async_workers"))
+			sql_async_workers = cap_value(atoi(w2), 0, 32);
 		else if(!strcmpi(w1,"party_share_level"))
 			party_share_level = (uint32)atof(w2);
 		else if(!strcmpi(w1,"log_inter"))
@@ -991,6 +996,7 @@ int32 inter_init_sql(const char *file)
 	inter_mail_sql_init();
 	inter_auction_sql_init();
 	inter_clan_init();
+	inter_async_init(sql_async_workers);
 
 	geoip_readdb();
 	return 0;
@@ -1001,6 +1007,7 @@ void inter_final(void)
 {
 	wis_db.clear();
 
+	inter_async_final();
 	inter_guild_sql_final();
 	inter_storage_sql_final();
 	inter_party_sql_final();
@@ -1039,6 +1046,23 @@ void inter_Storage_sendInfo(int32 fd) {
 	WFIFOSET(fd, len);
 }
 
+/**
+ * Checks whether a connection is still a map-server, for replies to asynchronous requests
+ * @param fd: Connection the request came from
+ * @return true if replies can be sent to fd
+ */
+bool inter_mapif_isactive(int32 fd)
+{
+	int32 i;
+
+	if( !session_isActive(fd) )
+		return false;
+
+	ARR_FIND( 0, ARRAYLENGTH(map_server), i, map_server[i].fd == fd );
+
+	return i < ARRAYLENGTH(map_server);
+}
+
 int32 inter_mapif_init(int32 fd)
 {
 	inter_Storage_sendInfo(fd);
@@ -30,6 +30,7 @@ int32 inter_init_sql(const char *file);
 void inter_final(void);
 int32 inter_parse_frommap(int32 fd);
 int32 inter_mapif_init(int32 fd);
+bool inter_mapif_isactive(int32 fd);
 int32 mapif_disconnectplayer(int32 fd, uint32 account_id, uint32 char_id, int32 reason);
 void mapif_accinfo_ack( bool success, int32 map_fd, int32 u_fd, int32 u_aid, int32 account_id, int32 group_id, int32 logincount, int32 state, const char* email, const char* last_ip, const char* lastlogin, const char* birthdate, const char* userid );
 
@@ -37,6 +38,13 @@ int32 inter_log(const char *fmt,...);
 
 extern uint32 party_share_level;
 
+extern int32 char_server_port;
+extern std::string char_server_ip;
+extern std::string char_server_id;
+extern std::string char_server_pw;
+extern std::string char_server_db;
+extern std::string default_codepage;
+
 extern Sql* sql_handle;
 extern Sql* lsql_handle;
 
@@ -0,0 +1,395 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "inter_async.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <errmsg.h> // CR_SERVER_GONE_ERROR, CR_SERVER_LOST
+
+#include <common/showmsg.hpp>
+#include <common/sql.hpp>
+#include <common/timer.hpp>
+
+#include "inter.hpp"
+
+/// How often the main thread runs the callbacks of finished requests, in ms
+#define INTER_ASYNC_POLL_INTERVAL 10
+
+/// Statements and callback of one asynchronous SQL request
+struct s_inter_async_request {
+	std::vector<std::string> statements;
+	inter_async_callback callback;
+	std::vector<s_inter_async_result> results;
+	std::chrono::steady_clock::time_point queued, started, finished;
+};
+
+/// SQL worker thread.
+/// Each worker owns its own MySQL connection and only uses the MySQL client
+/// library and the standard library, since the memory manager is not thread-safe.
+struct s_inter_async_worker {
+	std::thread thread;
+	std::condition_variable wakeup;
+	std::deque<std::unique_ptr<s_inter_async_request>> queue; ///< Requests of the keys of this worker, guarded by inter_async.mutex
+	MYSQL* handle = nullptr;
+};
+
+static struct s_inter_async {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<s_inter_async_worker>> workers;
+	std::deque<std::unique_ptr<s_inter_async_request>> done; ///< Finished requests waiting for their callbacks
+	bool stop = false;
+	int32 timer = INVALID_TIMER;
+
+	// Statistics, see inter_async_report
+	uint64 requests = 0; ///< Requests queued
+	uint64 statements = 0; ///< Statements run
+	uint64 failed = 0; ///< Statements that failed
+	uint64 wait_us = 0, wait_us_max = 0; ///< Time requests waited for their worker
+	uint64 run_us = 0, run_us_max = 0; ///< Time workers took to run requests
+	uint64 done_us = 0, done_us_max = 0; ///< Time from queueing requests to running their callbacks
+	size_t peak = 0; ///< Highest number of unfinished requests
+	size_t pending = 0; ///< Unfinished requests
+} inter_async;
+
+/// Connects the MySQL handle of a worker to the char-server database
+/// @return true on success, otherwise the error is in errmsg
+static bool inter_async_connect( s_inter_async_worker& worker, std::string& errmsg ){
+	MYSQL* handle = mysql_init( nullptr );
+
+	if( handle == nullptr ){
+		errmsg = "out of memory";
+		return false;
+	}
+
+	if( mysql_real_connect( handle, char_server_ip.c_str(), char_server_id.c_str(), char_server_pw.c_str(), char_server_db.c_str(), char_server_port, nullptr, 0 ) == nullptr
+	||  ( !default_codepage.empty() && mysql_set_character_set( handle, default_codepage.c_str() ) != 0 ) ){
+		errmsg = mysql_error( handle );
+		mysql_close( handle );
+		return false;
+	}
+
+	worker.handle = handle;
+
+	return true;
+}
+
+/// Runs a statement on the connection of a worker, reconnecting once if the server went away
+/// @return true on success, otherwise the error is in result.error
+static bool inter_async_execute( s_inter_async_worker& worker, const std::string& statement, s_inter_async_result& result ){
+	for( int32 attempt = 0; attempt < 2; attempt++ ){
+		if( worker.handle == nullptr && !inter_async_connect( worker, result.error ) )
+			return false;
+
+		if( mysql_real_query( worker.handle, statement.c_str(), static_cast<unsigned long>( statement.length() ) ) == 0 ){
+			MYSQL_RES* res = mysql_store_result( worker.handle );
+
+			if( res != nullptr ){
+				uint32 columns = mysql_num_fields( res );
+				MYSQL_ROW row;
+
+				while( ( row = mysql_fetch_row( res ) ) != nullptr ){
+					unsigned long* lengths = mysql_fetch_lengths( res );
+					std::vector<std::string>& out = result.rows.emplace_back();
+
+					out.reserve( columns );
+					for( uint32 i = 0; i < columns; i++ )
+						out.emplace_back( row[i] != nullptr ? std::string( row[i], lengths[i] ) : std::string() );
+				}
+
+				mysql_free_result( res );
+			}else if( mysql_errno( worker.handle ) != 0 ){
+				result.error = mysql_error( worker.handle );
+				return false;
+			}
+
+			result.affected_rows = mysql_affected_rows( worker.handle );
+			result.success = true;
+			return true;
+		}
+
+		uint32 error = mysql_errno( worker.handle );
+
+		result.error = mysql_error( worker.handle );
+
+		if( error != CR_SERVER_GONE_ERROR && error != CR_SERVER_LOST )
+			return false;
+
+		mysql_close( worker.handle );
+		worker.handle = nullptr;
+	}
+
+	return false;
+}
+
+/// Main function of a worker thread, runs the requests of its queue in order
+static void inter_async_main( s_inter_async_worker* worker ){
+	mysql_thread_init();
+
+	std::unique_lock<std::mutex> lock( inter_async.mutex );
+
+	for(;;){
+		worker->wakeup.wait( lock, [worker]{
+			return inter_async.stop || !worker->queue.empty();
+		} );
+
+		// Requests queued before stopping are still run
+		if( worker->queue.empty() )
+			break;
+
+		std::unique_ptr<s_inter_async_request> request = std::move( worker->queue.front() );
+
+		worker->queue.pop_front();
+		lock.unlock();
+
+		request->started = std::chrono::steady_clock::now();
+		request->results.resize( request->statements.size() );
+
+		for( size_t i = 0; i < request->statements.size(); i++ ){
+			if( !inter_async_execute( *worker, request->statements[i], request->results[i] ) ){
+				for( i++; i < request->statements.size(); i++ )
+					request->results[i].error = "not run after a failed statement";
+				break;
+			}
+		}
+
+		request->finished = std::chrono::steady_clock::now();
+
+		lock.lock();
+		inter_async.done.push_back( std::move( request ) );
+	}
+
+	lock.unlock();
+
+	if( worker->handle != nullptr ){
+		mysql_close( worker->handle );
+		worker->handle = nullptr;
+	}
+
+	mysql_thread_end();
+}
+
+/// Runs a request on the main connection, used when there are no workers
+static void inter_async_run_sync( s_inter_async_request& request ){
+	request.started = std::chrono::steady_clock::now();
+	request.results.resize( request.statements.size() );
+
+	for( size_t i = 0; i < request.statements.size(); i++ ){
+		s_inter_async_result& result = request.results[i];
+
+		if( SQL_ERROR == Sql_QueryStr( sql_handle, request.statements[i].c_str() ) ){
+			Sql_ShowDebug( sql_handle );
+			result.error = "see the error above";
+			for( i++; i < request.statements.size(); i++ )
+				request.results[i].error = "not run after a failed statement";
+			break;
+		}
+
+		uint32 columns = Sql_NumColumns( sql_handle );
+
+		while( columns > 0 && SQL_SUCCESS == Sql_NextRow( sql_handle ) ){
+			std::vector<std::string>& out = result.rows.emplace_back();
+
+			for( uint32 j = 0; j < columns; j++ ){
+				char* data;
+				size_t len;
+
+				Sql_GetData( sql_handle, j, &data, &len );
+				out.emplace_back( data != nullptr ? std::string( data, len ) : std::string() );
+			}
+		}
+
+		result.affected_rows = Sql_NumRowsAffected( sql_handle );
+		result.success = true;
+		Sql_FreeResult( sql_handle );
+	}
+
+	request.finished = std::chrono::steady_clock::now();
+}
+
+/// Runs the callback of a finished request and counts it
+static void inter_async_complete( s_inter_async_request& request ){
+	auto now = std::chrono::steady_clock::now();
+	auto us = []( std::chrono::steady_clock::duration d ){
+		return static_cast<uint64>( std::chrono::duration_cast<std::chrono::microseconds>( d ).count() );
+	};
+	uint64 wait = us( request.started - request.queued ), run = us( request.finished - request.started ), total = us( now - request.queued );
+
+	inter_async.pending--;
+	inter_async.statements += request.statements.size();
+	inter_async.wait_us += wait;
+	inter_async.wait_us_max = std::max( inter_async.wait_us_max, wait );
+	inter_async.run_us += run;
+	inter_async.run_us_max = std::max( inter_async.run_us_max, run );
+	inter_async.done_us += total;
+	inter_async.done_us_max = std::max( inter_async.done_us_max, total );
+
+	for( s_inter_async_result& result : request.results ){
+		if( !result.success ){
+			inter_async.failed++;
+			ShowSQL( "DB error - %s\n", result.error.c_str() );
+			break;
+		}
+	}
+
+	if( request.callback )
+		request.callback( request.results );
+}
+
+/// Runs the callbacks of the finished requests
+static void inter_async_poll(){
+	std::deque<std::unique_ptr<s_inter_async_request>> done;
+
+	{
+		std::lock_guard<std::mutex> lock( inter_async.mutex );
+		done.swap( inter_async.done );
+	}
+
+	for( std::unique_ptr<s_inter_async_request>& request : done )
+		inter_async_complete( *request );
+}
+
+static TIMER_FUNC(inter_async_timer){
+	inter_async_poll();
+	return 0;
+}
+
+/**
+ * Queues statements for the SQL workers.
+ * The statements run in order on one connection, the callback is called by the main thread once all of them ran.
+ * Requests with the same key run and call back in the order they were queued.
+ * Without workers the statements run on the main connection and the callback is called at once.
+ * @param type: Key space
+ * @param id: Key, like a char or guild id
+ * @param statements: Statements to run
+ * @param callback: Continuation, may be empty
+ */
+void inter_async_query( e_inter_async_key type, uint32 id, std::vector<std::string> statements, inter_async_callback callback ){
+	std::unique_ptr<s_inter_async_request> request = std::make_unique<s_inter_async_request>();
+
+	request->statements = std::move( statements );
+	request->callback = std::move( callback );
+	request->queued = std::chrono::steady_clock::now();
+
+	inter_async.requests++;
+	inter_async.pending++;
+	inter_async.peak = std::max( inter_async.peak, inter_async.pending );
+
+	if( inter_async.workers.empty() ){
+		inter_async_run_sync( *request );
+		inter_async_complete( *request );
+		return;
+	}
+
+	// All requests of a key go to the same worker, which runs them in order
+	s_inter_async_worker& worker = *inter_async.workers[( static_cast<uint64>( id ) * 31 + type ) % inter_async.workers.size()];
+
+	{
+		std::lock_guard<std::mutex> lock( inter_async.mutex );
+		worker.queue.push_back( std::move( request ) );
+	}
+	worker.wakeup.notify_one();
+}
+
+/**
+ * Runs statements on the main connection at once.
+ * For callers that need the rows before returning, the results are the same as the ones of inter_async_query.
+ * @param statements: Statements to run
+ * @return One result per statement
+ */
+std::vector<s_inter_async_result> inter_async_query_now( std::vector<std::string> statements ){
+	s_inter_async_request request;
+
+	request.statements = std::move( statements );
+	inter_async_run_sync( request );
+
+	return std::move( request.results );
+}
+
+/**
+ * Displays the counters of the SQL workers
+ * @param reset: Whether to reset the counters afterwards
+ */
+void inter_async_report( bool reset ){
+	s_inter_async& async = inter_async;
+
+	ShowInfo( "SQL workers: %" PRIuPTR ", %" PRIuPTR " requests unfinished, peak of %" PRIuPTR ".\n", async.workers.size(), async.pending, async.peak );
+	ShowInfo( "SQL requests: %" PRIu64 " queued, %" PRIu64 " statements run, %" PRIu64 " failed.\n", async.requests, async.statements, async.failed );
+
+	uint64 finished = async.requests - async.pending;
+
+	if( finished > 0 ){
+		ShowInfo( "SQL request latency: %.1f us waiting (at most %" PRIu64 "), %.1f us running (at most %" PRIu64 "), %.1f us until the callback (at most %" PRIu64 ").\n",
+			static_cast<double>( async.wait_us ) / finished, async.wait_us_max,
+			static_cast<double>( async.run_us ) / finished, async.run_us_max,
+			static_cast<double>( async.done_us ) / finished, async.done_us_max );
+	}
+
+	if( reset ){
+		async.requests = async.pending;
+		async.statements = async.failed = 0;
+		async.wait_us = async.wait_us_max = async.run_us = async.run_us_max = async.done_us = async.done_us_max = 0;
+		async.peak = async.pending;
+	}
+}
+
+/**
+ * Starts the SQL workers
+ * @param workers: Number of workers, 0 runs the requests on the main connection
+ */
+void inter_async_init( int32 workers ){
+	for( int32 i = 0; i < workers; i++ ){
+		std::unique_ptr<s_inter_async_worker> worker = std::make_unique<s_inter_async_worker>();
+		std::string errmsg;
+
+		if( !inter_async_connect( *worker, errmsg ) ){
+			ShowError( "inter_async_init: Couldn't connect SQL worker %d: %s.\n", i, errmsg.c_str() );
+			break;
+		}
+
+		inter_async.workers.push_back( std::move( worker ) );
+	}
+
+	inter_async.stop = false;
+	for( std::unique_ptr<s_inter_async_worker>& worker : inter_async.workers )
+		worker->thread = std::thread( inter_async_main, worker.get() );
+
+	add_timer_func_list( inter_async_timer, "inter_async_timer" );
+
+	if( inter_async.workers.empty() ){
+		if( workers > 0 )
+			ShowWarning( "inter_async_init: No SQL worker could connect, inter-server requests run on the main connection.\n" );
+		return;
+	}
+
+	inter_async.timer = add_timer_interval( gettick() + INTER_ASYNC_POLL_INTERVAL, inter_async_timer, 0, 0, INTER_ASYNC_POLL_INTERVAL );
+
+	ShowStatus( "Running inter-server SQL requests on '" CL_WHITE "%" PRIuPTR CL_RESET "' worker connections.\n", inter_async.workers.size() );
+}
+
+/// Runs the queued requests and stops the SQL workers
+void inter_async_final(){
+	if( inter_async.timer != INVALID_TIMER ){
+		delete_timer( inter_async.timer, inter_async_timer );
+		inter_async.timer = INVALID_TIMER;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( inter_async.mutex );
+		inter_async.stop = true;
+	}
+
+	for( std::unique_ptr<s_inter_async_worker>& worker : inter_async.workers ){
+		worker->wakeup.notify_one();
+		worker->thread.join();
+	}
+
+	inter_async.workers.clear();
+	inter_async_poll();
+}
@@ -0,0 +1,46 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef INTER_ASYNC_HPP
+#define INTER_ASYNC_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <common/cbasetypes.hpp>
+
+/// Key spaces of the asynchronous SQL requests.
+/// Requests with the same key run in the order they were queued.
+enum e_inter_async_key : uint8 {
+	INTER_ASYNC_ACCOUNT = 0,
+	INTER_ASYNC_CHAR,
+	INTER_ASYNC_GUILD,
+	INTER_ASYNC_PARTY,
+};
+
+/// Result of one statement of an asynchronous SQL request
+struct s_inter_async_result {
+	bool success = false; ///< Whether the statement ran, statements after a failed one are not run
+	std::string error; ///< Error message of a failed statement
+	uint64 affected_rows = 0; ///< Rows changed by an UPDATE, INSERT or DELETE
+	std::vector<std::vector<std::string>> rows; ///< Rows of a SELECT, NULL columns are empty
+};
+
+/// Continuation of an asynchronous SQL request, called by the main thread with one result per statement
+using inter_async_callback = std::function<void( std::vector<s_inter_async_result>& results )>;
+
+// queues statements for the SQL workers, the callback runs once all of them ran
+void inter_async_query( e_inter_async_key type, uint32 id, std::vector<std::string> statements, inter_async_callback callback = nullptr );
+
+// runs statements on the main connection and returns their results
+std::vector<s_inter_async_result> inter_async_query_now( std::vector<std::string> statements );
+
+// displays the counters of the SQL workers
+void inter_async_report( bool reset );
+
+//
+void inter_async_init( int32 workers );
+void inter_async_final();
+
+#endif /* INTER_ASYNC_HPP */
@@ -70,9 +70,18 @@
 
 #include "db.hpp"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define DB_FLAT_SSE2
+#endif
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
 #include "cbasetypes.hpp"
 #include "ers.hpp"
 #include "malloc.hpp"
@@ -88,6 +97,9 @@
  *  DBNColor        - Enumeration of colors of the nodes.                    *
  *  DBNode          - Structure of a node in RED-BLACK trees.                *
  *  struct db_free  - Structure that holds a deleted node to be freed.       *
+ *  DB_FLAT_*       - Defines of the open addressing hashtable.              *
+ *  struct db_flat_entry - Structure of an entry in open addressing mode.    *
+ *  struct db_flat  - Structure of the open addressing hashtable.            *
  *  DBMap_impl      - Structure of the database.                             *
  *  stats           - Statistics about the database system.                  *
 \*****************************************************************************/
@@ -158,6 +170,107 @@ struct db_free {
 	DBNode **root;
 };
 
+/**
+ * Number of control bytes that are probed at once in DB_OPT_FLAT databases.
+ * @private
+ * @see struct db_flat
+ */
+#define DB_FLAT_GROUP 16
+
+/**
+ * Entries of DB_OPT_FLAT databases are allocated in chunks of
+ * (1<<DB_FLAT_CHUNK_BITS) entries and never move, so the DBData pointers
+ * given to the callers stay valid until the entry is removed.
+ * @private
+ * @see struct db_flat
+ */
+#define DB_FLAT_CHUNK_BITS 7
+#define DB_FLAT_CHUNK_SIZE (1<<DB_FLAT_CHUNK_BITS)
+
+/**
+ * Control bytes of the slots of the hashtable.
+ * A used slot holds the low 7 bits of the hash of its key.
+ * A deleted slot (tombstone) keeps the probe sequences that go through it intact.
+ * @private
+ * @see struct db_flat
+ */
+#define DB_FLAT_EMPTY 0x80
+#define DB_FLAT_DELETED 0xFE
+
+/**
+ * Invalid entry index.
+ * @private
+ */
+#define DB_FLAT_NONE UINT32_MAX
+
+/**
+ * State of an entry in a DB_OPT_FLAT database.
+ * @private
+ * @see struct db_flat_entry
+ */
+enum e_db_flat_state : uint8 {
+	DB_FLAT_FREE = 0,
+	DB_FLAT_USED,
+	DB_FLAT_REMOVED,
+};
+
+/**
+ * An entry of a DB_OPT_FLAT database.
+ * Removed entries stay in the hashtable until the database is unlocked,
+ * like the deleted nodes of the RED-BLACK trees.
+ * @param key Key of this database entry
+ * @param data Data of this database entry
+ * @param slot Slot of the hashtable that points to this entry
+ * @param next Next entry in the list of free entries
+ * @param state State of the entry
+ * @param pending If the entry is in the list of entries to be freed
+ * @private
+ * @see struct db_flat
+ */
+struct db_flat_entry {
+	DBKey key;
+	DBData data;
+	uint32 slot;
+	uint32 next;
+	e_db_flat_state state;
+	unsigned pending : 1;
+};
+
+/**
+ * Open addressing hashtable used by DB_OPT_FLAT databases.
+ * The control bytes are probed in groups of DB_FLAT_GROUP, the slots hold
+ * the index of the entry. Iteration goes through the entries, so it is not
+ * affected by the hashtable growing.
+ * @param ctrl Control bytes of the slots
+ * @param slots Entry index of each slot
+ * @param capacity Number of slots (power of 2, at least DB_FLAT_GROUP)
+ * @param used Number of slots pointing to an entry
+ * @param growth_left Number of empty slots that can still be used before growing
+ * @param chunks Chunks of entries
+ * @param chunk_count Number of chunks
+ * @param entry_top Number of entries ever allocated in the chunks
+ * @param free_head First free entry
+ * @param pending Indexes of the entries removed while the database is locked
+ * @param pending_count Number of entries in pending
+ * @param pending_max Current maximum capacity of pending
+ * @private
+ * @see DBMap_impl#flat
+ */
+struct db_flat {
+	uint8 *ctrl;
+	uint32 *slots;
+	uint32 capacity;
+	uint32 used;
+	uint32 growth_left;
+	struct db_flat_entry **chunks;
+	uint32 chunk_count;
+	uint32 entry_top;
+	uint32 free_head;
+	uint32 *pending;
+	uint32 pending_count;
+	uint32 pending_max;
+};
+
 /**
  * Complete database structure.
  * @param vtable Interface of the database
@@ -172,6 +285,7 @@ struct db_free {
  * @param hash Hasher of the database
  * @param release Releaser of the database
  * @param ht Hashtable of RED-BLACK trees
+ * @param flat Open addressing hashtable (DB_OPT_FLAT)
  * @param type Type of the database
  * @param options Options of the database
  * @param item_count Number of items in the database
@@ -198,6 +312,7 @@ typedef struct DBMap_impl {
 	DBReleaser release;
 	DBNode *ht[HASH_SIZE];
 	DBNode *cache;
+	struct db_flat flat;
 	DBType type;
 	DBOptions options;
 	uint32 item_count;
@@ -209,7 +324,7 @@ typedef struct DBMap_impl {
  * Complete iterator structure.
  * @param vtable Interface of the iterator
  * @param db Parent database
- * @param ht_index Current index of the hashtable
+ * @param ht_index Current index of the hashtable (of the entry in DB_OPT_FLAT databases)
  * @param node Current node
  * @private
  * @see #DBIterator
@@ -349,6 +464,7 @@ struct eri *db_alloc_ers;
  *  db_dup_key_free    - Free the duplicated key.                            *
  *  db_free_add        - Add a node to the free_list of a database.          *
  *  db_free_remove     - Remove a node from the free_list of a database.     *
+ *  db_flat_*          - Open addressing hashtable of DB_OPT_FLAT databases. *
  *  db_free_lock       - Increment the free_lock of a database.              *
  *  db_free_unlock     - Decrement the free_lock of a database.              *
  *         If it was the last lock, frees the nodes in free_list.            *
@@ -782,6 +898,365 @@ static void db_free_remove(DBMap_impl* db, DBNode *node)
 	db->item_count++;
 }
 
+/**
+ * Returns a bitmask of the control bytes of a group equal to value.
+ * @param group First control byte of the group
+ * @param value Control byte to look for
+ * @return Bit i is set if group[i] == value
+ * @private
+ */
+static inline uint32 db_flat_match(const uint8 *group, uint8 value)
+{
+#if defined(DB_FLAT_SSE2)
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+	uint32 mask = 0;
+
+	for (int32 i = 0; i < DB_FLAT_GROUP; i++) {
+		if (group[i] == value)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Returns a bitmask of the empty or deleted control bytes of a group.
+ * Both have the high bit set, used slots don't.
+ * @param group First control byte of the group
+ * @return Bit i is set if group[i] can hold a new entry
+ * @private
+ */
+static inline uint32 db_flat_match_free(const uint8 *group)
+{
+#if defined(DB_FLAT_SSE2)
+	return (uint32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+	uint32 mask = 0;
+
+	for (int32 i = 0; i < DB_FLAT_GROUP; i++) {
+		if (group[i]&0x80)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Returns the index of the lowest set bit of a non-zero mask.
+ * @private
+ */
+static inline uint32 db_flat_ctz(uint32 mask)
+{
+#if defined(__GNUC__)
+	return (uint32)__builtin_ctz(mask);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (uint32)index;
+#else
+	uint32 index = 0;
+
+	while (!(mask&1)) {
+		mask >>= 1;
+		index++;
+	}
+	return index;
+#endif
+}
+
+/**
+ * Returns the entry of a DB_OPT_FLAT database with the given index.
+ * @private
+ */
+static inline struct db_flat_entry* db_flat_entry(DBMap_impl* db, uint32 index)
+{
+	return &db->flat.chunks[index>>DB_FLAT_CHUNK_BITS][index&(DB_FLAT_CHUNK_SIZE-1)];
+}
+
+/**
+ * Hashes a key for the open addressing hashtable.
+ * The default hashers return the key itself for numeric keys, so the bits
+ * are mixed to spread consecutive ids over the groups and control bytes.
+ * @param db Target database
+ * @param key Key to be hashed
+ * @return Mixed hash of the key
+ * @private
+ */
+static inline uint64 db_flat_hash(DBMap_impl* db, DBKey key)
+{
+	uint64 hash = db->hash(key, db->maxlen);
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/**
+ * Looks for the entry of a key in a DB_OPT_FLAT database.
+ * Removed entries that were not freed yet are also found.
+ * @param db Target database
+ * @param key Key of the entry
+ * @param hash Hash of the key
+ * @return Index of the entry or DB_FLAT_NONE
+ * @private
+ */
+static uint32 db_flat_find(DBMap_impl* db, DBKey key, uint64 hash)
+{
+	struct db_flat *flat = &db->flat;
+	uint32 group_mask, group, step;
+	uint8 h2 = (uint8)(hash&0x7F);
+
+	if (flat->capacity == 0)
+		return DB_FLAT_NONE;
+
+	group_mask = flat->capacity/DB_FLAT_GROUP - 1;
+	group = (uint32)(hash>>7)&group_mask;
+	for (step = 1; ; step++) {
+		const uint8 *ctrl = &flat->ctrl[group*DB_FLAT_GROUP];
+
+		for (uint32 mask = db_flat_match(ctrl, h2); mask; mask &= mask - 1) {
+			uint32 index = flat->slots[group*DB_FLAT_GROUP + db_flat_ctz(mask)];
+
+			if (db->cmp(key, db_flat_entry(db, index)->key, db->maxlen) == 0)
+				return index;
+		}
+		if (db_flat_match(ctrl, DB_FLAT_EMPTY))
+			return DB_FLAT_NONE; // the key would have been put in this group
+		group = (group + step)&group_mask; // triangular probing visits every group
+	}
+}
+
+/**
+ * Returns the first slot that can hold a new entry in the probe sequence of a hash.
+ * @param flat Target hashtable
+ * @param hash Hash of the key
+ * @return Empty or deleted slot
+ * @private
+ */
+static uint32 db_flat_find_slot(struct db_flat *flat, uint64 hash)
+{
+	uint32 group_mask = flat->capacity/DB_FLAT_GROUP - 1;
+	uint32 group = (uint32)(hash>>7)&group_mask;
+
+	for (uint32 step = 1; ; step++) {
+		uint32 mask = db_flat_match_free(&flat->ctrl[group*DB_FLAT_GROUP]);
+
+		if (mask)
+			return group*DB_FLAT_GROUP + db_flat_ctz(mask);
+		group = (group + step)&group_mask;
+	}
+}
+
+/**
+ * Rebuilds the hashtable of a DB_OPT_FLAT database with a new capacity.
+ * Drops the tombstones. Entries don't move, only the slots are rebuilt.
+ * @param db Target database
+ * @param capacity New number of slots
+ * @private
+ */
+static void db_flat_rehash(DBMap_impl* db, uint32 capacity)
+{
+	struct db_flat *flat = &db->flat;
+
+	aFree(flat->ctrl);
+	aFree(flat->slots);
+	CREATE(flat->ctrl, uint8, capacity);
+	CREATE(flat->slots, uint32, capacity);
+	memset(flat->ctrl, DB_FLAT_EMPTY, capacity);
+	flat->capacity = capacity;
+	for (uint32 i = 0; i < flat->entry_top; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+		uint64 hash;
+		uint32 slot;
+
+		if (entry->state == DB_FLAT_FREE)
+			continue;
+		hash = db_flat_hash(db, entry->key);
+		slot = db_flat_find_slot(flat, hash);
+		flat->ctrl[slot] = (uint8)(hash&0x7F);
+		flat->slots[slot] = i;
+		entry->slot = slot;
+	}
+	flat->growth_left = capacity - capacity/8 - flat->used;
+}
+
+/**
+ * Allocates an entry for a key that is not in a DB_OPT_FLAT database and
+ * puts it in the hashtable, growing it if needed.
+ * The key and data of the entry are not set.
+ * @param db Target database
+ * @param hash Hash of the key
+ * @return Index of the new entry
+ * @private
+ */
+static uint32 db_flat_insert(DBMap_impl* db, uint64 hash)
+{
+	struct db_flat *flat = &db->flat;
+	struct db_flat_entry *entry;
+	uint32 index, slot;
+
+	if (flat->growth_left == 0) { // grow, or only drop the tombstones if at most half of the slots are used
+		uint32 capacity = flat->capacity;
+
+		if (capacity == 0)
+			capacity = DB_FLAT_GROUP;
+		else if (flat->used + 1 > capacity/2)
+			capacity *= 2;
+		db_flat_rehash(db, capacity);
+	}
+
+	DB_COUNTSTAT(db_node_alloc);
+	if (flat->free_head != DB_FLAT_NONE) {
+		index = flat->free_head;
+		flat->free_head = db_flat_entry(db, index)->next;
+	} else {
+		if (flat->entry_top == flat->chunk_count*DB_FLAT_CHUNK_SIZE) {
+			RECREATE(flat->chunks, struct db_flat_entry*, flat->chunk_count + 1);
+			CREATE(flat->chunks[flat->chunk_count], struct db_flat_entry, DB_FLAT_CHUNK_SIZE);
+			flat->chunk_count++;
+		}
+		index = flat->entry_top++;
+	}
+	entry = db_flat_entry(db, index);
+	entry->state = DB_FLAT_USED;
+	entry->pending = 0;
+	slot = db_flat_find_slot(flat, hash);
+	if (flat->ctrl[slot] == DB_FLAT_EMPTY)
+		flat->growth_left--;
+	flat->ctrl[slot] = (uint8)(hash&0x7F);
+	flat->slots[slot] = index;
+	flat->used++;
+	entry->slot = slot;
+	return index;
+}
+
+/**
+ * Removes an entry from the hashtable of a DB_OPT_FLAT database and frees it.
+ * NOTE: Frees the duplicated key of the entry.
+ * @param db Target database
+ * @param index Index of the entry
+ * @private
+ */
+static void db_flat_erase(DBMap_impl* db, uint32 index)
+{
+	struct db_flat *flat = &db->flat;
+	struct db_flat_entry *entry = db_flat_entry(db, index);
+
+	// A group with an empty slot never had a probe sequence going through it,
+	// so the slot can be emptied instead of leaving a tombstone.
+	if (db_flat_match(&flat->ctrl[entry->slot&~(DB_FLAT_GROUP - 1)], DB_FLAT_EMPTY)) {
+		flat->ctrl[entry->slot] = DB_FLAT_EMPTY;
+		flat->growth_left++;
+	} else {
+		flat->ctrl[entry->slot] = DB_FLAT_DELETED;
+	}
+	flat->used--;
+	db_dup_key_free(db, entry->key);
+	DB_COUNTSTAT(db_node_free);
+	entry->state = DB_FLAT_FREE;
+	entry->next = flat->free_head;
+	flat->free_head = index;
+}
+
+/**
+ * Marks an entry of a DB_OPT_FLAT database as removed.
+ * The entry stays in the hashtable until the database is unlocked.
+ * If the key isn't duplicated, the key is duplicated and released.
+ * @param db Target database
+ * @param index Index of the entry
+ * @private
+ * @see #db_free_add(DBMap_impl*,DBNode *,DBNode **)
+ */
+static void db_flat_free_add(DBMap_impl* db, uint32 index)
+{
+	struct db_flat *flat = &db->flat;
+	struct db_flat_entry *entry = db_flat_entry(db, index);
+
+	DB_COUNTSTAT(db_free_add);
+	if (!(db->options&DB_OPT_DUP_KEY)) { // Make sure we have a key until the entry is freed
+		DBKey old_key = entry->key;
+		entry->key = db_dup_key(db, entry->key);
+		db->release(old_key, entry->data, DB_RELEASE_KEY);
+	}
+	if (!entry->pending) {
+		if (flat->pending_count == flat->pending_max) {
+			flat->pending_max = (flat->pending_max<<2) + 3;
+			if (flat->pending_max <= flat->pending_count) {
+				ShowFatalError("db_flat_free_add: pending_count overflow\n"
+						"Database allocated at %s:%d\n",
+						db->alloc_file, db->alloc_line);
+				exit(EXIT_FAILURE);
+			}
+			RECREATE(flat->pending, uint32, flat->pending_max);
+		}
+		flat->pending[flat->pending_count++] = index;
+		entry->pending = 1;
+	}
+	entry->state = DB_FLAT_REMOVED;
+	db->item_count--;
+}
+
+/**
+ * Puts back an entry of a DB_OPT_FLAT database that was removed while the
+ * database was locked.
+ * NOTE: Frees the duplicated key of the entry.
+ * @param db Target database
+ * @param entry Removed entry
+ * @private
+ * @see #db_free_remove(DBMap_impl*,DBNode *)
+ */
+static void db_flat_free_remove(DBMap_impl* db, struct db_flat_entry *entry)
+{
+	DB_COUNTSTAT(db_free_remove);
+	db_dup_key_free(db, entry->key);
+	entry->state = DB_FLAT_USED; // stays in pending, skipped when unlocking
+	db->item_count++;
+}
+
+/**
+ * Frees the entries of a DB_OPT_FLAT database that were removed while the
+ * database was locked.
+ * @param db Target database
+ * @private
+ * @see #db_free_unlock(DBMap_impl*)
+ */
+static void db_flat_free_pending(DBMap_impl* db)
+{
+	struct db_flat *flat = &db->flat;
+
+	for (uint32 i = 0; i < flat->pending_count; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, flat->pending[i]);
+
+		entry->pending = 0;
+		if (entry->state == DB_FLAT_REMOVED)
+			db_flat_erase(db, flat->pending[i]);
+	}
+	flat->pending_count = 0;
+}
+
+/**
+ * Frees the memory of the hashtable and of the entries of a DB_OPT_FLAT database.
+ * @param db Target database
+ * @private
+ * @see #db_obj_vdestroy(DBMap*,DBApply,va_list)
+ */
+static void db_flat_final(DBMap_impl* db)
+{
+	struct db_flat *flat = &db->flat;
+
+	for (uint32 i = 0; i < flat->chunk_count; i++)
+		aFree(flat->chunks[i]);
+	aFree(flat->chunks);
+	aFree(flat->ctrl);
+	aFree(flat->slots);
+	aFree(flat->pending);
+	memset(flat, 0, sizeof(*flat));
+	flat->free_head = DB_FLAT_NONE;
+}
+
 /**
  * Increment the free_lock of the database.
  * @param db Target database
@@ -827,6 +1302,11 @@ static void db_free_unlock(DBMap_impl* db)
 	if (db->free_lock)
 		return; // Not last lock
 
+	if (db->options&DB_OPT_FLAT) {
+		db_flat_free_pending(db);
+		return;
+	}
+
 	for (i = 0; i < db->free_count ; i++) {
 		db_rebalance_erase(db->free_list[i].node, db->free_list[i].root);
 		db_dup_key_free(db, db->free_list[i].node->key);
@@ -1213,6 +1693,7 @@ static void db_release_both(DBKey key, DBData data, DBRelease which)
  *  db_obj_size     - Return the size of the database.                       *
  *  db_obj_type     - Return the type of the database.                       *
  *  db_obj_options  - Return the options of the database.                    *
+ *  dbit_flat_*, db_flat_* - Same as above for DB_OPT_FLAT databases.       *
 \*****************************************************************************/
 
 /**
@@ -2236,7 +2717,10 @@ static int32 db_obj_vdestroy(DBMap* self, DBApply func, va_list args)
 	aFree(db->free_list);
 	db->free_list = nullptr;
 	db->free_max = 0;
-	ers_destroy(db->nodes);
+	if (db->options&DB_OPT_FLAT)
+		db_flat_final(db);
+	else
+		ers_destroy(db->nodes);
 	db_free_unlock(db);
 	ers_free(db_alloc_ers, db);
 	return sum;
@@ -2341,77 +2825,554 @@ static DBOptions db_obj_options(DBMap* self)
 	return options;
 }
 
-/*****************************************************************************\
- *  (5) Section with public functions.
- *  db_fix_options     - Apply database type restrictions to the options.
- *  db_default_cmp     - Get the default comparator for a type of database.
- *  db_default_hash    - Get the default hasher for a type of database.
- *  db_default_release - Get the default releaser for a type of database with the specified options.
- *  db_custom_release  - Get a releaser that behaves a certain way.
- *  db_alloc           - Allocate a new database.
- *  db_i2key           - Manual cast from 'int' to 'DBKey'.
- *  db_ui2key          - Manual cast from 'uint32' to 'DBKey'.
- *  db_str2key         - Manual cast from 'unsigned char *' to 'DBKey'.
- *  db_i642key         - Manual cast from 'int64' to 'DBKey'.
- *  db_ui642key        - Manual cast from 'uin64' to 'DBKey'.
- *  db_i2data          - Manual cast from 'int' to 'DBData'.
- *  db_ui2data         - Manual cast from 'uint32' to 'DBData'.
- *  db_ptr2data        - Manual cast from 'void*' to 'DBData'.
- *  db_data2i          - Gets 'int' value from 'DBData'.
- *  db_data2ui         - Gets 'uint32' value from 'DBData'.
- *  db_data2ptr        - Gets 'void*' value from 'DBData'.
- *  db_init            - Initializes the database system.
- *  db_final           - Finalizes the database system.
-\*****************************************************************************/
-
 /**
- * Returns the fixed options according to the database type.
- * Sets required options and unsets unsupported options.
- * For numeric databases DB_OPT_DUP_KEY and DB_OPT_RELEASE_KEY are unset.
- * @param type Type of the database
- * @param options Original options of the database
- * @return Fixed options of the database
- * @private
- * @see #db_default_release(DBType,DBOptions)
- * @see #db_alloc(const char *,int32,DBType,DBOptions,uint16)
+ * Fetches the first entry in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBIterator#first
  */
-DBOptions db_fix_options(DBType type, DBOptions options)
+DBData* dbit_flat_first(DBIterator* self, DBKey* out_key)
 {
-	DB_COUNTSTAT(db_fix_options);
-	switch (type) {
-		case DB_INT:
-		case DB_UINT:
-		case DB_INT64:
-		case DB_UINT64: // Numeric database, do nothing with the keys
-			return (DBOptions)(options&~(DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY));
+	DBIterator_impl* it = (DBIterator_impl*)self;
 
-		default:
-			ShowError("db_fix_options: Unknown database type %u with options %x\n", type, options);
-		[[fallthrough]];
-		case DB_STRING:
-		case DB_ISTRING: // String databases, no fix required
-			return options;
-	}
+	DB_COUNTSTAT(dbit_first);
+	// position before the first entry
+	it->ht_index = -1;
+	// get next entry
+	return self->next(self, out_key);
 }
 
 /**
- * Returns the default comparator for the specified type of database.
- * @param type Type of database
- * @return Comparator for the type of database or nullptr if unknown database
- * @public
- * @see #db_int_cmp(DBKey,DBKey,uint16)
- * @see #db_uint_cmp(DBKey,DBKey,uint16)
- * @see #db_string_cmp(DBKey,DBKey,uint16)
- * @see #db_istring_cmp(DBKey,DBKey,uint16)
- * @see #db_int64_cmp(DBKey,DBKey,uint16)
- * @see #db_uint64_cmp(DBKey,DBKey,uint16)
+ * Fetches the last entry in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBIterator#last
  */
-DBComparator db_default_cmp(DBType type)
+DBData* dbit_flat_last(DBIterator* self, DBKey* out_key)
 {
-	DB_COUNTSTAT(db_default_cmp);
-	switch (type) {
-		case DB_INT:     return &db_int_cmp;
-		case DB_UINT:    return &db_uint_cmp;
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_last);
+	// position after the last entry
+	it->ht_index = (int32)it->db->flat.entry_top;
+	// get previous entry
+	return self->prev(self, out_key);
+}
+
+/**
+ * Fetches the next entry in a DB_OPT_FLAT database.
+ * Entries are visited in the order of their index, which does not change
+ * when the hashtable grows or entries are removed.
+ * @protected
+ * @see DBIterator#next
+ */
+DBData* dbit_flat_next(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+
+	DB_COUNTSTAT(dbit_next);
+	while( (uint32)(it->ht_index + 1) < db->flat.entry_top )
+	{
+		struct db_flat_entry *entry = db_flat_entry(db, ++(it->ht_index));
+
+		if( entry->state == DB_FLAT_USED )
+		{// found next entry
+			if( out_key )
+				memcpy(out_key, &entry->key, sizeof(DBKey));
+			return &entry->data;
+		}
+	}
+	it->ht_index = (int32)db->flat.entry_top;
+	return nullptr;// not found
+}
+
+/**
+ * Fetches the previous entry in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBIterator#prev
+ */
+DBData* dbit_flat_prev(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBMap_impl* db = it->db;
+
+	DB_COUNTSTAT(dbit_prev);
+	if( it->ht_index > (int32)db->flat.entry_top )
+		it->ht_index = (int32)db->flat.entry_top;
+	while( it->ht_index > 0 )
+	{
+		struct db_flat_entry *entry = db_flat_entry(db, --(it->ht_index));
+
+		if( entry->state == DB_FLAT_USED )
+		{// found previous entry
+			if( out_key )
+				memcpy(out_key, &entry->key, sizeof(DBKey));
+			return &entry->data;
+		}
+	}
+	it->ht_index = -1;
+	return nullptr;// not found
+}
+
+/**
+ * @protected
+ * @see DBIterator#exists
+ */
+bool dbit_flat_exists(DBIterator* self)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_exists);
+	return (it->ht_index >= 0 && (uint32)it->ht_index < it->db->flat.entry_top
+		&& db_flat_entry(it->db, it->ht_index)->state == DB_FLAT_USED);
+}
+
+/**
+ * Removes the current entry from a DB_OPT_FLAT database.
+ * @protected
+ * @see DBIterator#remove
+ */
+int32 dbit_flat_remove(DBIterator* self, DBData *out_data)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	struct db_flat_entry *entry;
+
+	DB_COUNTSTAT(dbit_remove);
+	if( !self->exists(self) )
+		return 0;
+
+	entry = db_flat_entry(it->db, it->ht_index);
+	it->db->release(entry->key, entry->data, DB_RELEASE_DATA);
+	if( out_data )
+		memcpy(out_data, &entry->data, sizeof(DBData));
+	db_flat_free_add(it->db, it->ht_index);
+	return 1;
+}
+
+/**
+ * Returns a new iterator for a DB_OPT_FLAT database.
+ * The iterator keeps the database locked until it is destroyed.
+ * @protected
+ * @see #db_obj_iterator(DBMap*)
+ */
+static DBIterator* db_flat_iterator(DBMap* self)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBIterator_impl* it;
+
+	DB_COUNTSTAT(db_iterator);
+	it = ers_alloc(db_iterator_ers, struct DBIterator_impl);
+	/* Interface of the iterator **/
+	it->vtable.first   = dbit_flat_first;
+	it->vtable.last    = dbit_flat_last;
+	it->vtable.next    = dbit_flat_next;
+	it->vtable.prev    = dbit_flat_prev;
+	it->vtable.exists  = dbit_flat_exists;
+	it->vtable.remove  = dbit_flat_remove;
+	it->vtable.destroy = dbit_obj_destroy;
+	/* Initial state (before the first entry) */
+	it->db = db;
+	it->ht_index = -1;
+	it->node = nullptr;
+	/* Lock the database */
+	db_free_lock(db);
+	return &it->vtable;
+}
+
+/**
+ * Returns true if the entry exists in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBMap#exists
+ */
+static bool db_flat_exists(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	uint32 index;
+
+	DB_COUNTSTAT(db_exists);
+	if (db == nullptr) return false; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		return false; // nullpo candidate
+	}
+
+	index = db_flat_find(db, key, db_flat_hash(db, key));
+	return (index != DB_FLAT_NONE && db_flat_entry(db, index)->state == DB_FLAT_USED);
+}
+
+/**
+ * Get the data of the entry identified by the key in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBMap#get
+ */
+static DBData* db_flat_get(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_entry *entry;
+	uint32 index;
+
+	DB_COUNTSTAT(db_get);
+	if (db == nullptr) return nullptr; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_get: Attempted to retrieve non-allowed nullptr key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return nullptr; // nullpo candidate
+	}
+
+	index = db_flat_find(db, key, db_flat_hash(db, key));
+	if (index == DB_FLAT_NONE)
+		return nullptr;
+	entry = db_flat_entry(db, index);
+	if (entry->state != DB_FLAT_USED)
+		return nullptr;
+	return &entry->data;
+}
+
+/**
+ * Get the data of the entries matched by <code>match</code> in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBMap#vgetall
+ */
+static uint32 db_flat_vgetall(DBMap* self, DBData **buf, uint32 max, DBMatcher match, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	uint32 ret = 0;
+
+	DB_COUNTSTAT(db_vgetall);
+	if (db == nullptr) return 0; // nullpo candidate
+	if (match == nullptr) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	for (uint32 i = 0; i < db->flat.entry_top; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+		va_list argscopy;
+
+		if (entry->state != DB_FLAT_USED)
+			continue;
+		va_copy(argscopy, args);
+		if (match(entry->key, entry->data, argscopy) == 0) {
+			if (buf && ret < max)
+				buf[ret] = &entry->data;
+			ret++;
+		}
+		va_end(argscopy);
+	}
+	db_free_unlock(db);
+	return ret;
+}
+
+/**
+ * Get the data of the entry identified by the key in a DB_OPT_FLAT
+ * database, creating it with <code>create</code> if it doesn't exist.
+ * @protected
+ * @see DBMap#vensure
+ */
+static DBData* db_flat_vensure(DBMap* self, DBKey key, DBCreateData create, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_entry *entry;
+	uint64 hash;
+	uint32 index;
+
+	DB_COUNTSTAT(db_vensure);
+	if (db == nullptr) return nullptr; // nullpo candidate
+	if (create == nullptr) {
+		ShowError("db_ensure: Create function is nullptr for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return nullptr; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_ensure: Attempted to use non-allowed nullptr key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return nullptr; // nullpo candidate
+	}
+
+	hash = db_flat_hash(db, key);
+	index = db_flat_find(db, key, hash);
+	if (index != DB_FLAT_NONE && db_flat_entry(db, index)->state == DB_FLAT_USED)
+		return &db_flat_entry(db, index)->data;
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_vensure: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return nullptr;
+	}
+	db_free_lock(db);
+	if (index != DB_FLAT_NONE) { // removed while locked, reuse the entry
+		entry = db_flat_entry(db, index);
+		db_flat_free_remove(db, entry);
+	} else {
+		entry = db_flat_entry(db, db_flat_insert(db, hash));
+		db->item_count++;
+	}
+	// put key and data in the entry
+	if (db->options&DB_OPT_DUP_KEY) {
+		entry->key = db_dup_key(db, key);
+		if (db->options&DB_OPT_RELEASE_KEY)
+			db->release(key, entry->data, DB_RELEASE_KEY);
+	} else {
+		entry->key = key;
+	}
+	va_list argscopy;
+	va_copy(argscopy, args);
+	entry->data = create(key, argscopy);
+	va_end(argscopy);
+	db_free_unlock(db);
+	return &entry->data;
+}
+
+/**
+ * Put the data identified by the key in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBMap#put
+ */
+static int32 db_flat_put(DBMap* self, DBKey key, DBData data, DBData *out_data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_entry *entry;
+	int32 retval = 0;
+	uint64 hash;
+	uint32 index;
+
+	DB_COUNTSTAT(db_put);
+	if (db == nullptr) return 0; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_put: Database is being destroyed, aborting entry insertion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_put: Attempted to use non-allowed nullptr key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_DATA) && (data.type == DB_DATA_PTR && data.u.ptr == nullptr)) {
+		ShowError("db_put: Attempted to use non-allowed nullptr data for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_put: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return 0;
+	}
+	db_free_lock(db);
+	hash = db_flat_hash(db, key);
+	index = db_flat_find(db, key, hash);
+	if (index != DB_FLAT_NONE) { // equal entry, replace
+		entry = db_flat_entry(db, index);
+		if (entry->state == DB_FLAT_REMOVED) {
+			db_flat_free_remove(db, entry);
+		} else {
+			db->release(entry->key, entry->data, DB_RELEASE_BOTH);
+			if (out_data)
+				memcpy(out_data, &entry->data, sizeof(*out_data));
+			retval = 1;
+		}
+	} else {
+		entry = db_flat_entry(db, db_flat_insert(db, hash));
+		db->item_count++;
+	}
+	// put key and data in the entry
+	if (db->options&DB_OPT_DUP_KEY) {
+		entry->key = db_dup_key(db, key);
+		if (db->options&DB_OPT_RELEASE_KEY)
+			db->release(key, data, DB_RELEASE_KEY);
+	} else {
+		entry->key = key;
+	}
+	entry->data = data;
+	db_free_unlock(db);
+	return retval;
+}
+
+/**
+ * Remove an entry from a DB_OPT_FLAT database.
+ * @protected
+ * @see DBMap#remove
+ */
+static int32 db_flat_remove(DBMap* self, DBKey key, DBData *out_data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat_entry *entry;
+	int32 retval = 0;
+	uint32 index;
+
+	DB_COUNTSTAT(db_remove);
+	if (db == nullptr) return 0; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_remove: Database is being destroyed. Aborting entry deletion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_remove: Attempted to use non-allowed nullptr key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	index = db_flat_find(db, key, db_flat_hash(db, key));
+	if (index != DB_FLAT_NONE && (entry = db_flat_entry(db, index))->state == DB_FLAT_USED) {
+		db->release(entry->key, entry->data, DB_RELEASE_DATA);
+		if (out_data)
+			memcpy(out_data, &entry->data, sizeof(*out_data));
+		retval = 1;
+		db_flat_free_add(db, index);
+	}
+	db_free_unlock(db);
+	return retval;
+}
+
+/**
+ * Apply <code>func</code> to every entry in a DB_OPT_FLAT database.
+ * @protected
+ * @see DBMap#vforeach
+ */
+static int32 db_flat_vforeach(DBMap* self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	int32 sum = 0;
+
+	DB_COUNTSTAT(db_vforeach);
+	if (db == nullptr) return 0; // nullpo candidate
+	if (func == nullptr) {
+		ShowError("db_foreach: Passed function is nullptr for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	for (uint32 i = 0; i < db->flat.entry_top; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+
+		if (entry->state == DB_FLAT_USED) {
+			va_list argscopy;
+			va_copy(argscopy, args);
+			sum += func(entry->key, &entry->data, argscopy);
+			va_end(argscopy);
+		}
+	}
+	db_free_unlock(db);
+	return sum;
+}
+
+/**
+ * Removes all entries from a DB_OPT_FLAT database.
+ * Before deleting an entry, func is applied to it.
+ * Keeps the memory of the hashtable and of the entries for reuse.
+ * @protected
+ * @see DBMap#vclear
+ */
+static int32 db_flat_vclear(DBMap* self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	struct db_flat *flat;
+	int32 sum = 0;
+
+	DB_COUNTSTAT(db_vclear);
+	if (db == nullptr) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	flat = &db->flat;
+	for (uint32 i = 0; i < flat->entry_top; i++) {
+		struct db_flat_entry *entry = db_flat_entry(db, i);
+
+		if (entry->state == DB_FLAT_REMOVED) {
+			db_dup_key_free(db, entry->key);
+		} else if (entry->state == DB_FLAT_USED) {
+			if (func) {
+				va_list argscopy;
+				va_copy(argscopy, args);
+				sum += func(entry->key, &entry->data, argscopy);
+				va_end(argscopy);
+			}
+			db->release(entry->key, entry->data, DB_RELEASE_BOTH);
+		}
+		DB_COUNTSTAT(db_node_free);
+		entry->state = DB_FLAT_FREE;
+		entry->pending = 0;
+	}
+	if (flat->capacity)
+		memset(flat->ctrl, DB_FLAT_EMPTY, flat->capacity);
+	flat->used = 0;
+	flat->growth_left = flat->capacity - flat->capacity/8;
+	flat->entry_top = 0;
+	flat->free_head = DB_FLAT_NONE;
+	flat->pending_count = 0;
+	db->item_count = 0;
+	db_free_unlock(db);
+	return sum;
+}
+
+/*****************************************************************************\
+ *  (5) Section with public functions.
+ *  db_fix_options     - Apply database type restrictions to the options.
+ *  db_default_cmp     - Get the default comparator for a type of database.
+ *  db_default_hash    - Get the default hasher for a type of database.
+ *  db_default_release - Get the default releaser for a type of database with the specified options.
+ *  db_custom_release  - Get a releaser that behaves a certain way.
+ *  db_alloc           - Allocate a new database.
+ *  db_i2key           - Manual cast from 'int' to 'DBKey'.
+ *  db_ui2key          - Manual cast from 'uint32' to 'DBKey'.
+ *  db_str2key         - Manual cast from 'unsigned char *' to 'DBKey'.
+ *  db_i642key         - Manual cast from 'int64' to 'DBKey'.
+ *  db_ui642key        - Manual cast from 'uin64' to 'DBKey'.
+ *  db_i2data          - Manual cast from 'int' to 'DBData'.
+ *  db_ui2data         - Manual cast from 'uint32' to 'DBData'.
+ *  db_ptr2data        - Manual cast from 'void*' to 'DBData'.
+ *  db_data2i          - Gets 'int' value from 'DBData'.
+ *  db_data2ui         - Gets 'uint32' value from 'DBData'.
+ *  db_data2ptr        - Gets 'void*' value from 'DBData'.
+ *  db_init            - Initializes the database system.
+ *  db_benchmark       - Compares the database implementations.
+ *  db_final           - Finalizes the database system.
+\*****************************************************************************/
+
+/**
+ * Returns the fixed options according to the database type.
+ * Sets required options and unsets unsupported options.
+ * For numeric databases DB_OPT_DUP_KEY and DB_OPT_RELEASE_KEY are unset.
+ * @param type Type of the database
+ * @param options Original options of the database
+ * @return Fixed options of the database
+ * @private
+ * @see #db_default_release(DBType,DBOptions)
+ * @see #db_alloc(const char *,int32,DBType,DBOptions,uint16)
+ */
+DBOptions db_fix_options(DBType type, DBOptions options)
+{
+	DB_COUNTSTAT(db_fix_options);
+	switch (type) {
+		case DB_INT:
+		case DB_UINT:
+		case DB_INT64:
+		case DB_UINT64: // Numeric database, do nothing with the keys
+			return (DBOptions)(options&~(DB_OPT_DUP_KEY|DB_OPT_RELEASE_KEY));
+
+		default:
+			ShowError("db_fix_options: Unknown database type %u with options %x\n", type, options);
+		[[fallthrough]];
+		case DB_STRING:
+		case DB_ISTRING: // String databases, no fix required
+			return options;
+	}
+}
+
+/**
+ * Returns the default comparator for the specified type of database.
+ * @param type Type of database
+ * @return Comparator for the type of database or nullptr if unknown database
+ * @public
+ * @see #db_int_cmp(DBKey,DBKey,uint16)
+ * @see #db_uint_cmp(DBKey,DBKey,uint16)
+ * @see #db_string_cmp(DBKey,DBKey,uint16)
+ * @see #db_istring_cmp(DBKey,DBKey,uint16)
+ * @see #db_int64_cmp(DBKey,DBKey,uint16)
+ * @see #db_uint64_cmp(DBKey,DBKey,uint16)
+ */
+DBComparator db_default_cmp(DBType type)
+{
+	DB_COUNTSTAT(db_default_cmp);
+	switch (type) {
+		case DB_INT:     return &db_int_cmp;
+		case DB_UINT:    return &db_uint_cmp;
 		case DB_STRING:  return &db_string_cmp;
 		case DB_ISTRING: return &db_istring_cmp;
 		case DB_INT64:   return &db_int64_cmp;
@@ -2557,6 +3518,17 @@ DBMap* db_alloc(const char *file, const char *func, int32 line, DBType type, DBO
 	db->vtable.size     = db_obj_size;
 	db->vtable.type     = db_obj_type;
 	db->vtable.options  = db_obj_options;
+	if (options&DB_OPT_FLAT) {
+		db->vtable.iterator = db_flat_iterator;
+		db->vtable.exists   = db_flat_exists;
+		db->vtable.get      = db_flat_get;
+		db->vtable.vgetall  = db_flat_vgetall;
+		db->vtable.vensure  = db_flat_vensure;
+		db->vtable.put      = db_flat_put;
+		db->vtable.remove   = db_flat_remove;
+		db->vtable.vforeach = db_flat_vforeach;
+		db->vtable.vclear   = db_flat_vclear;
+	}
 	/* File and line of allocation */
 	db->alloc_file = file;
 	db->alloc_line = line;
@@ -2566,14 +3538,20 @@ DBMap* db_alloc(const char *file, const char *func, int32 line, DBType type, DBO
 	db->free_max = 0;
 	db->free_lock = 0;
 	/* Other */
-	snprintf(ers_name, 50, "db_alloc:nodes:%s:%s:%d",func,file,line);
-	db->nodes = ers_new(sizeof(struct dbn),ers_name,ERS_DBN_OPTIONS);
+	if (options&DB_OPT_FLAT) {
+		db->nodes = nullptr;
+	} else {
+		snprintf(ers_name, 50, "db_alloc:nodes:%s:%s:%d",func,file,line);
+		db->nodes = ers_new(sizeof(struct dbn),ers_name,ERS_DBN_OPTIONS);
+	}
 	db->cmp = db_default_cmp(type);
 	db->hash = db_default_hash(type);
 	db->release = db_default_release(type, options);
 	for (i = 0; i < HASH_SIZE; i++)
 		db->ht[i] = nullptr;
 	db->cache = nullptr;
+	memset(&db->flat, 0, sizeof(db->flat));
+	db->flat.free_head = DB_FLAT_NONE;
 	db->type = type;
 	db->options = options;
 	db->item_count = 0;
@@ -2798,6 +3776,84 @@ void db_init(void) {
 	DB_COUNTSTAT(db_init);
 }
 
+/**
+ * Benchmarks the database implementations.
+ * For every key type a RED-BLACK tree database and a DB_OPT_FLAT database
+ * are filled with the same keys, then lookups of existing and missing keys,
+ * a full iteration and the removal of every entry are timed.
+ * @param count Number of entries
+ * @public
+ */
+void db_benchmark(uint32 count)
+{
+	static const DBType types[] = { DB_INT, DB_UINT, DB_STRING };
+	static const char* type_names[] = { "int", "uint", "string" };
+	auto ms = []( std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to ){
+		return std::chrono::duration<double, std::milli>( to - from ).count();
+	};
+	DBKey *keys;
+	char *names;
+
+	if (count == 0 || count > UINT32_MAX/2)
+		return;
+
+	// the second half of the keys is never inserted
+	CREATE(keys, DBKey, count*2);
+	CREATE(names, char, count*2*16);
+	for (uint32 i = 0; i < count*2; i++) {
+		uint32 value = i*2654435761U; // distinct and spread over the whole range
+
+		snprintf(&names[i*16], 16, "key%08x", value);
+	}
+
+	for (size_t t = 0; t < ARRAYLENGTH(types); t++) {
+		for (uint32 i = 0; i < count*2; i++) {
+			uint32 value = i*2654435761U;
+
+			switch (types[t]) {
+				case DB_INT: keys[i] = db_i2key((int32)value); break;
+				case DB_UINT: keys[i] = db_ui2key(value); break;
+				default: keys[i] = db_str2key(&names[i*16]); break;
+			}
+		}
+
+		for (int32 flat = 0; flat < 2; flat++) {
+			DBMap* db = db_alloc(__FILE__, __func__, __LINE__, types[t], flat ? DB_OPT_FLAT : DB_OPT_BASE, 16);
+			DBIterator* iter;
+			uint64 checksum = 0;
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32 i = 0; i < count; i++)
+				db->put(db, keys[i], db_ui2data(i), nullptr);
+			auto put = std::chrono::steady_clock::now();
+			for (uint32 i = 0; i < count; i++)
+				checksum += db_data2ui(db->get(db, keys[i]));
+			auto get = std::chrono::steady_clock::now();
+			for (uint32 i = count; i < count*2; i++) {
+				if (db->get(db, keys[i]) != nullptr)
+					checksum++;
+			}
+			auto miss = std::chrono::steady_clock::now();
+			iter = db->iterator(db);
+			for (DBData* data = iter->first(iter, nullptr); iter->exists(iter); data = iter->next(iter, nullptr))
+				checksum += db_data2ui(data);
+			iter->destroy(iter);
+			auto iterate = std::chrono::steady_clock::now();
+			for (uint32 i = 0; i < count; i++)
+				checksum += db->remove(db, keys[i], nullptr);
+			auto remove = std::chrono::steady_clock::now();
+
+			ShowInfo("db_benchmark: %-6s %-5s put %8.2fms get %8.2fms miss %8.2fms iterate %8.2fms remove %8.2fms (checksum %" PRIu64 ", %u left)\n",
+				type_names[t], flat ? "flat" : "tree", ms(start, put), ms(put, get), ms(get, miss), ms(miss, iterate), ms(iterate, remove),
+				checksum, db->size(db));
+			db->destroy(db, nullptr);
+		}
+	}
+
+	aFree(keys);
+	aFree(names);
+}
+
 /**
  * Finalizes the database system.
  * @public
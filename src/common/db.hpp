@@ -122,6 +122,9 @@ typedef enum DBType {
  * @param DB_OPT_RELEASE_BOTH Releases both key and data.
  * @param DB_OPT_ALLOW_NULL_KEY Allow nullptr keys in the database.
  * @param DB_OPT_ALLOW_NULL_DATA Allow nullptr data in the database.
+ * @param DB_OPT_FLAT Stores the entries in an open addressing hashtable
+ *          instead of the hashtable of RED-BLACK trees. Faster lookups and
+ *          iteration for large databases, same interface and semantics.
  * @public
  * @see #db_fix_options(DBType,DBOptions)
  * @see #db_default_release(DBType,DBOptions)
@@ -135,6 +138,7 @@ typedef enum DBOptions {
 	DB_OPT_RELEASE_BOTH    = DB_OPT_RELEASE_KEY|DB_OPT_RELEASE_DATA,
 	DB_OPT_ALLOW_NULL_KEY  = 0x08,
 	DB_OPT_ALLOW_NULL_DATA = 0x10,
+	DB_OPT_FLAT            = 0x20,
 } DBOptions;
 
 /**
@@ -740,6 +744,7 @@ struct DBMap {
  *  db_data2ui         - Gets 'uint32' value from 'DBData'.                  *
  *  db_data2ptr        - Gets 'void*' value from 'DBData'.                   *
  *  db_init            - Initializes the database system.                    *
+ *  db_benchmark       - Compares the database implementations.              *
  *  db_final           - Finalizes the database system.                      *
 \*****************************************************************************/
 
@@ -943,6 +948,15 @@ int64 db_data2i64( const DBData* data );
  */
 void db_init(void);
 
+/**
+ * Benchmarks the RED-BLACK tree and the open addressing implementations
+ * of the database with int, uint32 and string keys.
+ * @param count Number of entries to insert in each database
+ * @public
+ * @see #DB_OPT_FLAT
+ */
+void db_benchmark(uint32 count);
+
 /**
  * Finalize the database system.
  * Frees the memory used by the block reusage system.
@@ -129,6 +129,10 @@ void aFree_(void *p, const char *file, int32 line, const char *func)
 
 /* USE_MEMMGR */
 
+/// Set on threads that allocate from the system instead, the memory manager is not thread safe.
+/// @see malloc_thread_direct
+static thread_local bool memmgr_thread_direct = false;
+
 /*
  * Memory manager
  *     able to handle malloc and free efficiently
@@ -231,6 +235,9 @@ void* _mmalloc(size_t size, const char *file, int32 line, const char *func )
 	int16 size_hash = size2hash( size );
 	struct unit_head *head;
 
+	if( memmgr_thread_direct )
+		return aMalloc_( size, file, line, func );
+
 	if( static_cast<long>( size ) < 0 || size == 0 ){
 		ShowError( "_mmalloc: Invalid allocation size %" PRIuPTR " bytes at %s:%d\n", size, file, line );
 		return nullptr;
@@ -337,6 +344,8 @@ void* _mcalloc(size_t num, size_t size, const char *file, int32 line, const char
 void* _mrealloc(void *memblock, size_t size, const char *file, int32 line, const char *func )
 {
 	size_t old_size;
+	if( memmgr_thread_direct )
+		return aRealloc_( memblock, size, file, line, func );
 	if(memblock == nullptr) {
 		return _mmalloc(size,file,line,func);
 	}
@@ -375,6 +384,11 @@ void _mfree(void *ptr, const char *file, int32 line, const char *func )
 {
 	struct unit_head *head;
 
+	if( memmgr_thread_direct ){
+		aFree_( ptr, file, line, func );
+		return;
+	}
+
 	if (ptr == nullptr)
 		return; 
 
@@ -698,6 +712,15 @@ size_t malloc_usage (void)
 #endif
 }
 
+/// Makes the calling thread allocate from the system instead of the memory manager.
+/// Memory allocated in this mode must be freed by the same thread in the same mode.
+/// @param direct: Whether to bypass the memory manager
+void malloc_thread_direct( bool direct ){
+#ifdef USE_MEMMGR
+	memmgr_thread_direct = direct;
+#endif
+}
+
 void malloc_final (void)
 {
 #ifdef USE_MEMMGR
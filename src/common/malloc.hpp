@@ -102,6 +102,7 @@
 void malloc_memory_check(void);
 bool malloc_verify_ptr(void* ptr);
 size_t malloc_usage (void);
+void malloc_thread_direct( bool direct );
 void malloc_init (void);
 void malloc_final (void);
 
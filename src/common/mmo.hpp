@@ -559,6 +559,9 @@ struct hotkey {
 };
 #endif
 
+/// Version of the delta character save format (0x2b2c)
+#define DELTA_SAVE_VERSION 1
+
 struct mmo_charstatus {
 	uint32 char_id;
 	uint32 account_id;
@@ -3,7 +3,14 @@
 
 #include "socket.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #ifdef WIN32
 	#include "winapi.hpp"
@@ -22,6 +29,7 @@
 
 		#ifdef SOCKET_EPOLL
 			#include <sys/epoll.h>
+			#include <sys/eventfd.h>
 		#endif
 	#else 
 		#include <netinet/in.h>
@@ -38,6 +46,8 @@
 	#ifdef HAVE_SETRLIMIT
 		#include <sys/resource.h>
 	#endif
+
+	#include <sys/uio.h>
 #endif
 
 #include "cbasetypes.hpp"
@@ -46,6 +56,7 @@
 #include "showmsg.hpp"
 #include "strlib.hpp"
 #include "timer.hpp"
+#include "utils.hpp"
 
 // Reuseable global packet buffer to prevent too many allocations
 // Take socket.cpp::socket_max_client_packet into consideration
@@ -228,6 +239,43 @@ char* sErr(int32 code)
 	static int32 epfd = SOCKET_ERROR;
 	static struct epoll_event epevent;
 	static struct epoll_event *epevents = nullptr;
+
+	// Threaded network I/O
+	// Client sessions can be handed to a pool of I/O threads, which own their own epoll sets
+	// and do the recv/send syscalls. The game thread only copies received data into the RFIFO
+	// and hands finished WFIFO data over to the owning thread.
+
+	// Maximum amount of received data buffered per session before the I/O thread stops reading
+	#define SOCKET_IO_INBOX_MAX (64*1024)
+
+	struct s_socket_io_session{
+		size_t thread; // index of the owning I/O thread
+		std::vector<uint8> inbox; // received data, not yet handed to the game thread
+		std::vector<uint8> outbox; // data handed over by the game thread, not yet sent
+		bool eof; // connection was closed or had an error
+		bool reading; // EPOLLIN is armed
+		bool writing; // EPOLLOUT is armed
+		bool ready; // queued in the thread's ready list
+		bool pending_send; // queued in the thread's send list
+	};
+
+	struct s_socket_io_thread{
+		std::thread thread;
+		std::mutex mutex; // protects the lists below and all sessions owned by this thread
+		int32 epfd;
+		int32 wakefd; // eventfd to wake the thread up for new send requests or shutdown
+		std::vector<int32> ready; // sessions with received data or eof for the game thread
+		std::vector<int32> sends; // sessions with new data in their outbox
+	};
+
+	static int32 socket_io_thread_count = 0;
+	static std::vector<std::unique_ptr<s_socket_io_thread>> socket_io_threads;
+	static std::atomic<bool> socket_io_running( false );
+	static int32 socket_io_notifyfd = SOCKET_ERROR; // eventfd to wake up the game thread for received data
+	// Sessions owned by an I/O thread. Only changed by the game thread while holding the owner's mutex.
+	static s_socket_io_session* socket_io_sessions[MAXCONN];
+	// Accepted sessions that stay with the game thread until their first packet tells whether they are a server link
+	static bool socket_io_waiting[MAXCONN];
 #endif
 
 int32 fd_max;
@@ -249,6 +297,7 @@ static size_t socket_max_client_packet = USHRT_MAX;
 // Data I/O statistics
 static size_t socket_data_i = 0, socket_data_ci = 0, socket_data_qi = 0;
 static size_t socket_data_o = 0, socket_data_co = 0, socket_data_qo = 0;
+static size_t socket_data_so = 0; // sent from shared packet buffers without copying them into the WFIFO
 static time_t socket_data_last_tick = 0;
 #endif
 
@@ -264,6 +313,26 @@ static time_t socket_data_last_tick = 0;
 
 struct socket_data* session[MAXCONN];
 
+#ifndef WIN32
+/// Shared packet buffers are sent with scatter/gather I/O, other platforms copy them into the WFIFO.
+#define SOCKET_SHARED_SEND
+#endif
+
+// Maximum number of buffers passed to a single sendmsg call
+#define SOCKET_SHARED_IOV_MAX 64
+
+/// Shared packet buffer queued for a session
+struct s_socket_shared_send{
+	std::shared_ptr<s_shared_packet> packet;
+	size_t wpos; // position in the WFIFO, where the packet was queued
+	size_t sent; // bytes of the packet, that were already sent
+};
+
+// Shared packet buffers queued for each session, in the order they were queued
+static std::deque<s_socket_shared_send> socket_shared_sends[MAXCONN];
+// Bytes of shared packet buffers, that are still waiting to be sent for each session
+static size_t socket_shared_size[MAXCONN];
+
 #ifdef SEND_SHORTLIST
 int32 send_shortlist_array[MAXCONN];// we only support MAXCONN sockets, limit the array to that
 size_t send_shortlist_count = 0;// how many fd's are in the shortlist
@@ -405,6 +474,136 @@ int32 recv_to_fifo(int32 fd)
 	return 0;
 }
 
+/// Returns true if there is data in the WFIFO or shared packet buffers waiting to be sent.
+static bool session_has_wdata( int32 fd ){
+	return session[fd]->wdata_size > 0 || socket_shared_size[fd] > 0;
+}
+
+#ifdef SOCKET_SHARED_SEND
+/// Sends the WFIFO and the shared packet buffers in between with a single call.
+static int32 send_from_fifo_shared( int32 fd ){
+	struct socket_data* s = session[fd];
+	std::deque<s_socket_shared_send>& queue = socket_shared_sends[fd];
+	struct iovec iov[SOCKET_SHARED_IOV_MAX];
+	int32 count = 0;
+	size_t pos = 0;
+	bool complete = true;
+
+	// Collect the WFIFO parts and shared packets in the order they were queued
+	for( s_socket_shared_send& it : queue ){
+		if( it.wpos > pos ){
+			if( count == SOCKET_SHARED_IOV_MAX ){
+				complete = false;
+				break;
+			}
+
+			iov[count].iov_base = s->wdata + pos;
+			iov[count].iov_len = it.wpos - pos;
+			count++;
+			pos = it.wpos;
+		}
+
+		if( count == SOCKET_SHARED_IOV_MAX ){
+			complete = false;
+			break;
+		}
+
+		iov[count].iov_base = it.packet->data.get() + it.sent;
+		iov[count].iov_len = it.packet->length - it.sent;
+		count++;
+	}
+
+	if( complete && pos < s->wdata_size && count < SOCKET_SHARED_IOV_MAX ){
+		iov[count].iov_base = s->wdata + pos;
+		iov[count].iov_len = s->wdata_size - pos;
+		count++;
+	}
+
+	struct msghdr msg = {};
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+	ssize_t len = sendmsg( fd, &msg, MSG_NOSIGNAL );
+
+	if( len == SOCKET_ERROR ){
+		if( sErrno != S_EWOULDBLOCK ){
+#ifdef SHOW_SERVER_STATS
+			socket_data_qo -= s->wdata_size + socket_shared_size[fd];
+#endif
+			// Clear the send queue as we can't send anymore
+			s->wdata_size = 0;
+			queue.clear();
+			socket_shared_size[fd] = 0;
+			set_eof( fd );
+		}
+		return 0;
+	}
+
+	if( len <= 0 ){
+		return 0;
+	}
+
+	s->wdata_tick = last_tick;
+
+#ifdef SHOW_SERVER_STATS
+	socket_data_o += len;
+	socket_data_qo -= len;
+	if( !s->flag.server ){
+		socket_data_co += len;
+	}
+#endif
+
+	// Consume the sent data in queue order
+	size_t left = len;
+	size_t wsent = 0;
+
+	while( left > 0 ){
+		if( queue.empty() ){
+			wsent += left;
+			break;
+		}
+
+		s_socket_shared_send& front = queue.front();
+		size_t part = std::min( left, front.wpos - wsent );
+
+		wsent += part;
+		left -= part;
+
+		if( left == 0 ){
+			break;
+		}
+
+		part = std::min( left, front.packet->length - front.sent );
+		front.sent += part;
+		left -= part;
+		socket_shared_size[fd] -= part;
+#ifdef SHOW_SERVER_STATS
+		socket_data_so += part;
+#endif
+
+		if( front.sent == front.packet->length ){
+			queue.pop_front();
+		}
+	}
+
+	// shift unsent data to the beginning of the queue
+	if( wsent > 0 ){
+		if( wsent < s->wdata_size ){
+			memmove( s->wdata, s->wdata + wsent, s->wdata_size - wsent );
+		}
+
+		s->wdata_size -= wsent;
+
+		for( s_socket_shared_send& it : queue ){
+			it.wpos -= wsent;
+		}
+	}
+
+	return 0;
+}
+#endif
+
 int32 send_from_fifo(int32 fd)
 {
 	int32 len;
@@ -412,6 +611,11 @@ int32 send_from_fifo(int32 fd)
 	if( !session_isValid(fd) )
 		return -1;
 
+#ifdef SOCKET_SHARED_SEND
+	if( socket_shared_size[fd] > 0 )
+		return send_from_fifo_shared(fd);
+#endif
+
 	if( session[fd]->wdata_size == 0 )
 		return 0; // nothing to send
 
@@ -467,6 +671,496 @@ void flush_fifos(void)
 		flush_fifo(i);
 }
 
+#ifdef SOCKET_EPOLL
+/*======================================
+ *	CORE : Threaded network I/O
+ *--------------------------------------*/
+
+/// Wakes up a thread that is waiting in epoll_wait on the given eventfd.
+static void socket_io_wakeup( int32 fd ){
+	uint64 value = 1;
+
+	if( write( fd, &value, sizeof( value ) ) < 0 ){
+		// The counter can only overflow if nobody is reading it, so there is nothing to do
+	}
+}
+
+/// Drains an eventfd after it woke up a thread.
+static void socket_io_drain( int32 fd ){
+	uint64 value;
+
+	if( read( fd, &value, sizeof( value ) ) < 0 ){
+		// Spurious wakeup, nothing to do
+	}
+}
+
+/// Updates the epoll interest of a session to match its reading/writing state.
+/// Caller must hold the owning thread's mutex.
+static void socket_io_rearm( s_socket_io_thread& io, int32 fd, s_socket_io_session& s ){
+	struct epoll_event ev = {};
+
+	ev.data.fd = fd;
+	ev.events = ( s.reading ? EPOLLIN : 0 ) | ( s.writing ? EPOLLOUT : 0 );
+
+	epoll_ctl( io.epfd, EPOLL_CTL_MOD, fd, &ev );
+}
+
+/// Queues a session for the game thread.
+/// Caller must hold the owning thread's mutex.
+static void socket_io_setready( s_socket_io_thread& io, int32 fd, s_socket_io_session& s ){
+	if( !s.ready ){
+		s.ready = true;
+		io.ready.push_back( fd );
+	}
+}
+
+/// Receives as much data as possible into the inbox of a session.
+/// Caller must hold the owning thread's mutex.
+/// @return true if new data or an eof is available for the game thread
+static bool socket_io_recv( s_socket_io_thread& io, int32 fd, s_socket_io_session& s ){
+	uint8 buf[RFIFO_SIZE * 8];
+	bool changed = false;
+
+	while( !s.eof && s.inbox.size() < SOCKET_IO_INBOX_MAX ){
+		int32 len = sRecv( fd, (char*)buf, sizeof( buf ), 0 );
+
+		if( len == SOCKET_ERROR ){
+			if( sErrno != S_EWOULDBLOCK && sErrno != S_EINTR ){
+				s.eof = true;
+				changed = true;
+			}
+			break;
+		}
+
+		if( len == 0 ){
+			// Normal connection end
+			s.eof = true;
+			changed = true;
+			break;
+		}
+
+		s.inbox.insert( s.inbox.end(), buf, buf + len );
+		changed = true;
+	}
+
+	// Stop reading until the game thread consumed the data, otherwise level triggered epoll keeps waking us up
+	if( !s.eof && s.inbox.size() >= SOCKET_IO_INBOX_MAX && s.reading ){
+		s.reading = false;
+		socket_io_rearm( io, fd, s );
+	}
+
+	if( changed ){
+		socket_io_setready( io, fd, s );
+	}
+
+	return changed;
+}
+
+/// Sends as much data as possible from the outbox of a session.
+/// Caller must hold the owning thread's mutex.
+/// @return true if an eof is available for the game thread
+static bool socket_io_send( s_socket_io_thread& io, int32 fd, s_socket_io_session& s ){
+	size_t sent = 0;
+	bool failed = false;
+
+	while( !s.eof && sent < s.outbox.size() ){
+		int32 len = sSend( fd, (const char*)s.outbox.data() + sent, (int32)( s.outbox.size() - sent ), MSG_NOSIGNAL );
+
+		if( len == SOCKET_ERROR ){
+			if( sErrno != S_EWOULDBLOCK && sErrno != S_EINTR ){
+				// Clear the send queue as we can't send anymore
+				s.eof = true;
+				failed = true;
+			}
+			break;
+		}
+
+		sent += len;
+	}
+
+	if( failed ){
+		s.outbox.clear();
+	}else if( sent > 0 ){
+		// shift unsent data to the beginning of the queue
+		s.outbox.erase( s.outbox.begin(), s.outbox.begin() + sent );
+	}
+
+	// Wait for the socket to become writeable again, if the kernel buffer is full
+	bool writing = !s.eof && !s.outbox.empty();
+
+	if( writing != s.writing ){
+		s.writing = writing;
+		socket_io_rearm( io, fd, s );
+	}
+
+	if( failed ){
+		socket_io_setready( io, fd, s );
+	}
+
+	return failed;
+}
+
+/// Main loop of an I/O thread.
+static void socket_io_thread_main( s_socket_io_thread* io ){
+	std::vector<struct epoll_event> events( epoll_maxevents );
+
+	while( socket_io_running ){
+		int32 ret = epoll_wait( io->epfd, events.data(), (int32)events.size(), 1000 );
+
+		if( ret == SOCKET_ERROR ){
+			if( sErrno == S_EINTR ){
+				continue;
+			}
+
+			ShowFatalError( "socket_io_thread_main: epoll_wait() failed, %s!\n", error_msg() );
+			exit( EXIT_FAILURE );
+		}
+
+		bool notify = false;
+
+		{
+			std::lock_guard<std::mutex> lock( io->mutex );
+
+			for( int32 i = 0; i < ret; i++ ){
+				struct epoll_event* it = &events[i];
+				int32 fd = it->data.fd;
+
+				if( fd == io->wakefd ){
+					socket_io_drain( fd );
+					continue;
+				}
+
+				s_socket_io_session* s = socket_io_sessions[fd];
+
+				// Session was closed by the game thread in the meantime
+				if( s == nullptr ){
+					continue;
+				}
+
+				if( it->events & ( EPOLLERR | EPOLLHUP ) ){
+					if( !s->eof ){
+						s->eof = true;
+						socket_io_setready( *io, fd, *s );
+						notify = true;
+					}
+					continue;
+				}
+
+				if( it->events & EPOLLIN ){
+					notify |= socket_io_recv( *io, fd, *s );
+				}
+
+				if( it->events & EPOLLOUT ){
+					notify |= socket_io_send( *io, fd, *s );
+				}
+			}
+
+			// Process send requests of the game thread
+			for( int32 fd : io->sends ){
+				s_socket_io_session* s = socket_io_sessions[fd];
+
+				// Session was closed or the fd was reused in the meantime
+				if( s == nullptr || !s->pending_send ){
+					continue;
+				}
+
+				s->pending_send = false;
+				notify |= socket_io_send( *io, fd, *s );
+			}
+
+			io->sends.clear();
+		}
+
+		if( notify ){
+			socket_io_wakeup( socket_io_notifyfd );
+		}
+	}
+}
+
+/// Hands a new client session over to an I/O thread.
+/// @return false if the session could not be added to the thread's event dispatcher
+static bool socket_io_attach( int32 fd ){
+	size_t thread = fd % socket_io_threads.size();
+	s_socket_io_thread& io = *socket_io_threads[thread];
+	s_socket_io_session* s = new s_socket_io_session{};
+	struct epoll_event ev = {};
+
+	s->thread = thread;
+	s->reading = true;
+
+	ev.data.fd = fd;
+	ev.events = EPOLLIN;
+
+	std::lock_guard<std::mutex> lock( io.mutex );
+
+	if( epoll_ctl( io.epfd, EPOLL_CTL_ADD, fd, &ev ) == SOCKET_ERROR ){
+		ShowError( "socket_io_attach: Failed to add socket #%d to I/O thread %" PRIuPTR ": %s\n", fd, thread, error_msg() );
+		delete s;
+		return false;
+	}
+
+	socket_io_sessions[fd] = s;
+
+	return true;
+}
+
+/// Takes a session away from its I/O thread, trying to send what's left.
+static void socket_io_detach( int32 fd ){
+	s_socket_io_session* s = socket_io_sessions[fd];
+
+	if( s == nullptr ){
+		return;
+	}
+
+	s_socket_io_thread& io = *socket_io_threads[s->thread];
+
+	std::lock_guard<std::mutex> lock( io.mutex );
+
+	epoll_ctl( io.epfd, EPOLL_CTL_DEL, fd, nullptr );
+
+	// Best effort - there's no warranty that the data will be sent
+	if( !s->eof && !s->outbox.empty() ){
+		sSend( fd, (const char*)s->outbox.data(), (int32)s->outbox.size(), MSG_NOSIGNAL );
+	}
+
+	// Entries left in the ready and send lists are skipped, because the session is gone
+	socket_io_sessions[fd] = nullptr;
+	delete s;
+}
+
+/// Send function of sessions owned by an I/O thread.
+/// Hands the WFIFO data over to the owning thread.
+int32 send_to_io_thread( int32 fd ){
+	if( !session_isValid( fd ) ){
+		return -1;
+	}
+
+	struct socket_data* sd = session[fd];
+	s_socket_io_session* s = socket_io_sessions[fd];
+
+	if( !session_has_wdata( fd ) || s == nullptr ){
+		return 0; // nothing to send
+	}
+
+	size_t size = sd->wdata_size + socket_shared_size[fd];
+
+	s_socket_io_thread& io = *socket_io_threads[s->thread];
+	bool wakeup = false;
+	bool overflow = false;
+
+	{
+		std::lock_guard<std::mutex> lock( io.mutex );
+
+		if( !s->eof ){
+			if( !sd->flag.server && s->outbox.size() + size > WFIFO_MAX ){
+				// The client does not read its data anymore
+				overflow = true;
+			}else{
+				size_t pos = 0;
+
+				// Shared packet buffers are copied in the order they were queued
+				for( s_socket_shared_send& it : socket_shared_sends[fd] ){
+					s->outbox.insert( s->outbox.end(), sd->wdata + pos, sd->wdata + it.wpos );
+					s->outbox.insert( s->outbox.end(), it.packet->data.get() + it.sent, it.packet->data.get() + it.packet->length );
+					pos = it.wpos;
+				}
+
+				s->outbox.insert( s->outbox.end(), sd->wdata + pos, sd->wdata + sd->wdata_size );
+
+				if( !s->pending_send ){
+					s->pending_send = true;
+					// Only wake up the thread, if it did not already get a request
+					wakeup = io.sends.empty();
+					io.sends.push_back( fd );
+				}
+			}
+		}
+	}
+
+	if( overflow ){
+		ShowError( "send_to_io_thread: Maximum write buffer size for client connection %d exceeded (ip=%lu.%lu.%lu.%lu).\n", fd, CONVIP( sd->client_addr ) );
+		set_eof( fd );
+	}
+
+#ifdef SHOW_SERVER_STATS
+	socket_data_o += size;
+	socket_data_qo -= size;
+	if( !sd->flag.server ){
+		socket_data_co += size;
+	}
+#endif
+
+	sd->wdata_size = 0;
+	sd->wdata_tick = last_tick;
+	socket_shared_sends[fd].clear();
+	socket_shared_size[fd] = 0;
+
+	if( wakeup ){
+		socket_io_wakeup( io.wakefd );
+	}
+
+	return 0;
+}
+
+/// Hands an accepted session over to an I/O thread, once its first packet was parsed.
+/// Server links mark themselves while parsing their first packet and stay with the game thread.
+static void socket_io_handover( int32 fd ){
+	socket_io_waiting[fd] = false;
+
+	if( session[fd]->flag.server || session[fd]->flag.eof ){
+		return;
+	}
+
+	epevent.data.fd = fd;
+	epevent.events = EPOLLIN;
+	epoll_ctl( epfd, EPOLL_CTL_DEL, fd, &epevent );
+
+	if( !socket_io_attach( fd ) ){
+		set_eof( fd );
+		return;
+	}
+
+	// Data that is still queued in the WFIFO is handed to the I/O thread with the next send
+	session[fd]->func_recv = null_recv;
+	session[fd]->func_send = send_to_io_thread;
+}
+
+/// Copies data received by the I/O threads into the RFIFOs of their sessions.
+static void socket_io_collect( void ){
+	std::vector<int32> ready;
+
+	for( std::unique_ptr<s_socket_io_thread>& io : socket_io_threads ){
+		std::lock_guard<std::mutex> lock( io->mutex );
+
+		ready.clear();
+		ready.swap( io->ready );
+
+		for( int32 fd : ready ){
+			s_socket_io_session* s = socket_io_sessions[fd];
+
+			// Session was closed or the fd was reused in the meantime
+			if( s == nullptr || !s->ready || !session_isValid( fd ) ){
+				continue;
+			}
+
+			s->ready = false;
+
+			// The game thread is already closing this session
+			if( session[fd]->flag.eof ){
+				s->inbox.clear();
+				continue;
+			}
+
+			size_t len = std::min( s->inbox.size(), RFIFOSPACE( fd ) );
+
+			if( len > 0 ){
+				memcpy( session[fd]->rdata + session[fd]->rdata_size, s->inbox.data(), len );
+				s->inbox.erase( s->inbox.begin(), s->inbox.begin() + len );
+				session[fd]->rdata_size += len;
+				session[fd]->rdata_tick = last_tick;
+#ifdef SHOW_SERVER_STATS
+				socket_data_i += len;
+				socket_data_qi += len;
+				if( !session[fd]->flag.server ){
+					socket_data_ci += len;
+				}
+#endif
+			}
+
+			if( !s->inbox.empty() ){
+				// The RFIFO is full, continue next time
+				socket_io_setready( *io, fd, *s );
+			}else if( s->eof ){
+				set_eof( fd );
+			}
+
+			// Resume reading, after enough data was consumed
+			if( !s->eof && !s->reading && s->inbox.size() < SOCKET_IO_INBOX_MAX / 2 ){
+				s->reading = true;
+				socket_io_rearm( *io, fd, *s );
+			}
+		}
+	}
+}
+
+/// Starts the I/O threads.
+static void socket_io_init( void ){
+	if( socket_io_thread_count <= 0 ){
+		return;
+	}
+
+	socket_io_notifyfd = eventfd( 0, EFD_NONBLOCK );
+
+	if( socket_io_notifyfd == SOCKET_ERROR ){
+		ShowError( "socket_io_init: Failed to create eventfd: %s\n", error_msg() );
+		exit( EXIT_FAILURE );
+	}
+
+	epevent.data.fd = socket_io_notifyfd;
+	epevent.events = EPOLLIN;
+
+	if( epoll_ctl( epfd, EPOLL_CTL_ADD, socket_io_notifyfd, &epevent ) == SOCKET_ERROR ){
+		ShowError( "socket_io_init: Failed to add eventfd to epoll event dispatcher: %s\n", error_msg() );
+		exit( EXIT_FAILURE );
+	}
+
+	socket_io_running = true;
+
+	for( int32 i = 0; i < socket_io_thread_count; i++ ){
+		std::unique_ptr<s_socket_io_thread> io = std::make_unique<s_socket_io_thread>();
+
+		io->epfd = epoll_create( MAXCONN );
+		io->wakefd = eventfd( 0, EFD_NONBLOCK );
+
+		if( io->epfd == SOCKET_ERROR || io->wakefd == SOCKET_ERROR ){
+			ShowError( "socket_io_init: Failed to create event dispatcher for I/O thread %d: %s\n", i, error_msg() );
+			exit( EXIT_FAILURE );
+		}
+
+		struct epoll_event ev = {};
+
+		ev.data.fd = io->wakefd;
+		ev.events = EPOLLIN;
+
+		if( epoll_ctl( io->epfd, EPOLL_CTL_ADD, io->wakefd, &ev ) == SOCKET_ERROR ){
+			ShowError( "socket_io_init: Failed to add eventfd to I/O thread %d: %s\n", i, error_msg() );
+			exit( EXIT_FAILURE );
+		}
+
+		io->thread = std::thread( socket_io_thread_main, io.get() );
+
+		socket_io_threads.push_back( std::move( io ) );
+	}
+
+	ShowInfo( "Server uses '" CL_WHITE "%d" CL_RESET "' threads for client network I/O\n", socket_io_thread_count );
+}
+
+/// Stops the I/O threads.
+/// All sessions have to be closed already.
+static void socket_io_final( void ){
+	if( socket_io_threads.empty() ){
+		return;
+	}
+
+	socket_io_running = false;
+
+	for( std::unique_ptr<s_socket_io_thread>& io : socket_io_threads ){
+		socket_io_wakeup( io->wakefd );
+	}
+
+	for( std::unique_ptr<s_socket_io_thread>& io : socket_io_threads ){
+		io->thread.join();
+		sClose( io->wakefd );
+		sClose( io->epfd );
+	}
+
+	socket_io_threads.clear();
+
+	sClose( socket_io_notifyfd );
+	socket_io_notifyfd = SOCKET_ERROR;
+}
+#endif
+
 /*======================================
  *	CORE : Connection functions
  *--------------------------------------*/
@@ -519,6 +1213,9 @@ int32 connect_client(int32 listen_fd)
 		sClose( fd );
 		return -1;
 	}
+
+	// Threaded network I/O takes over, once the session turned out to be a client
+	socket_io_waiting[fd] = socket_io_thread_count > 0;
 #endif
 
 	if( fd_max <= fd ) fd_max = fd + 1;
@@ -744,8 +1441,10 @@ static void delete_session(int32 fd)
 	{
 #ifdef SHOW_SERVER_STATS
 		socket_data_qi -= session[fd]->rdata_size - session[fd]->rdata_pos;
-		socket_data_qo -= session[fd]->wdata_size;
+		socket_data_qo -= session[fd]->wdata_size + socket_shared_size[fd];
 #endif
+		socket_shared_sends[fd].clear();
+		socket_shared_size[fd] = 0;
 		aFree(session[fd]->rdata);
 		aFree(session[fd]->wdata);
 		aFree(session[fd]->session_data);
@@ -860,7 +1559,7 @@ int32 WFIFOSET(int32 fd, size_t len)
 			return 0;
 		}
 
-		if( s->wdata_size+len > WFIFO_MAX ) {// reached maximum write fifo size
+		if( s->wdata_size+socket_shared_size[fd]+len > WFIFO_MAX ) {// reached maximum write fifo size
 			ShowError("WFIFOSET: Maximum write buffer size for client connection %d exceeded, most likely caused by packet 0x%04x (len=%" PRIuPTR ", ip=%lu.%lu.%lu.%lu).\n", fd, WFIFOW(fd,0), len, CONVIP(s->client_addr));
 			set_eof(fd);
 			return 0;
@@ -889,6 +1588,124 @@ int32 WFIFOSET(int32 fd, size_t len)
 	return 0;
 }
 
+std::shared_ptr<s_shared_packet> socket_shared_packet( const void* buf, size_t len ){
+	std::shared_ptr<s_shared_packet> packet = std::make_shared<s_shared_packet>();
+
+	packet->data = std::make_unique<uint8[]>( len );
+	packet->length = len;
+	memcpy( packet->data.get(), buf, len );
+
+	return packet;
+}
+
+bool socket_send_shared( int32 fd, const std::shared_ptr<s_shared_packet>& packet ){
+	if( !session_isActive( fd ) ){
+		return false;
+	}
+
+	struct socket_data* s = session[fd];
+	size_t len = packet->length;
+
+#ifdef SOCKET_SHARED_SEND
+	// Sessions of I/O threads copy everything into their outbox anyway
+	bool shared = s->func_send == send_from_fifo;
+#else
+	bool shared = false;
+#endif
+
+	if( !shared ){
+		WFIFOHEAD( fd, len );
+		memcpy( WFIFOP( fd, 0 ), packet->data.get(), len );
+		WFIFOSET( fd, len );
+
+		return true;
+	}
+
+	if( len == 0 || len > 0xFFFF ){
+		ShowError( "socket_send_shared: Invalid length for shared packet 0x%04x (len=%" PRIuPTR ").\n", len > 1 ? RBUFW( packet->data.get(), 0 ) : 0, len );
+		return false;
+	}
+
+	if( !s->flag.server ){
+		if( len > socket_max_client_packet ){// see declaration of socket_max_client_packet for details
+			ShowError( "socket_send_shared: Dropped too large client packet 0x%04x (length=%" PRIuPTR ", max=%" PRIuPTR ").\n", RBUFW( packet->data.get(), 0 ), len, socket_max_client_packet );
+			return false;
+		}
+
+		if( s->wdata_size + socket_shared_size[fd] + len > WFIFO_MAX ){// reached maximum write fifo size
+			ShowError( "socket_send_shared: Maximum write buffer size for client connection %d exceeded, most likely caused by packet 0x%04x (len=%" PRIuPTR ", ip=%lu.%lu.%lu.%lu).\n", fd, RBUFW( packet->data.get(), 0 ), len, CONVIP( s->client_addr ) );
+			set_eof( fd );
+			return false;
+		}
+	}
+
+	socket_shared_sends[fd].push_back( { packet, s->wdata_size, 0 } );
+	socket_shared_size[fd] += len;
+#ifdef SHOW_SERVER_STATS
+	socket_data_qo += len;
+#endif
+
+#ifdef SEND_SHORTLIST
+	send_shortlist_add_fd( fd );
+#endif
+
+	return true;
+}
+
+/// Creates a session that is not backed by a socket, so that a parse function can run on recorded data.
+/// The last free slot is used, it is above fd_max and never polled or sent to.
+/// @return Session id or -1 if every slot is taken
+int32 socket_stub_open( void ){
+	for( int32 fd = MAXCONN - 1; fd > 0; fd-- ){
+		if( session[fd] == nullptr ){
+			create_session( fd, null_recv, null_send, null_parse );
+			return fd;
+		}
+	}
+
+	return -1;
+}
+
+/// Replaces the received data of a stub session with a copy of the given buffer.
+void socket_stub_fill( int32 fd, const void* buf, size_t len ){
+	socket_data* s = session[fd];
+
+	if( len > s->max_rdata ){
+		RECREATE( s->rdata, unsigned char, len );
+		s->max_rdata = len;
+	}
+
+#ifdef SHOW_SERVER_STATS
+	socket_data_qi += len - ( s->rdata_size - s->rdata_pos );
+#endif
+	memcpy( s->rdata, buf, len );
+	s->rdata_size = len;
+	s->rdata_pos = 0;
+}
+
+/// Discards everything written to a stub session and clears its eof flag, so that it can be parsed further.
+void socket_stub_discard( int32 fd ){
+	socket_data* s = session[fd];
+
+#ifdef SHOW_SERVER_STATS
+	socket_data_qo -= s->wdata_size + socket_shared_size[fd];
+#endif
+	s->wdata_size = 0;
+	socket_shared_sends[fd].clear();
+	socket_shared_size[fd] = 0;
+	s->flag.eof = 0;
+}
+
+/// Deletes a stub session. The session data belongs to the caller and is not freed.
+void socket_stub_close( int32 fd ){
+	if( !session_isValid( fd ) ){
+		return;
+	}
+
+	session[fd]->session_data = nullptr;
+	delete_session( fd );
+}
+
 int32 do_sockets(t_tick next)
 {
 #ifndef SOCKET_EPOLL
@@ -907,7 +1724,7 @@ int32 do_sockets(t_tick next)
 		if(!session[i])
 			continue;
 
-		if(session[i]->wdata_size)
+		if(session_has_wdata(i))
 			session[i]->func_send(i);
 	}
 #endif
@@ -962,6 +1779,13 @@ int32 do_sockets(t_tick next)
 	for( i = 0; i < ret; i++ ){
 		struct epoll_event *it = &epevents[i];
 		int32 fd = it->data.fd;
+
+		if( fd == socket_io_notifyfd ){
+			// I/O threads received data, it is collected below
+			socket_io_drain( fd );
+			continue;
+		}
+
 		struct socket_data *sock = session[fd];
 
 		if( !sock ){
@@ -988,6 +1812,13 @@ int32 do_sockets(t_tick next)
 	}
 #endif
 
+#ifdef SOCKET_EPOLL
+	// Hand over data received by the I/O threads
+	if( socket_io_thread_count > 0 ){
+		socket_io_collect();
+	}
+#endif
+
 	// POSTSEND Send remaining data and handle eof sessions.
 #ifdef SEND_SHORTLIST
 	send_shortlist_do_sends();
@@ -997,7 +1828,7 @@ int32 do_sockets(t_tick next)
 		if(!session[i])
 			continue;
 
-		if(session[i]->wdata_size)
+		if(session_has_wdata(i))
 			session[i]->func_send(i);
 
 		if(session[i]->flag.eof) //func_send can't free a session, this is safe.
@@ -1028,8 +1859,22 @@ int32 do_sockets(t_tick next)
 		if(!session[i])
 			continue;
 
+#ifdef SOCKET_EPOLL
+		// The first packet was parsed, server links marked themselves by now
+		if( socket_io_waiting[i] && session[i]->rdata_pos > 0 )
+			socket_io_handover(i);
+#endif
+
 		// after parse, check client's RFIFO size to know if there is an invalid packet (too big and not parsed)
-		if (session[i]->rdata_size == RFIFO_SIZE && session[i]->max_rdata == RFIFO_SIZE) {
+		bool invalid_packet = session[i]->rdata_size == RFIFO_SIZE && session[i]->max_rdata == RFIFO_SIZE;
+
+#ifdef SOCKET_EPOLL
+		// I/O threads hand over as much as fits at once, a full buffer is only stuck if nothing of it was parsed
+		if( socket_io_sessions[i] != nullptr && session[i]->rdata_pos > 0 )
+			invalid_packet = false;
+#endif
+
+		if (invalid_packet) {
 			set_eof(i);
 			continue;
 		}
@@ -1041,7 +1886,7 @@ int32 do_sockets(t_tick next)
 	{
 		char buf[1024];
 		
-		sprintf(buf, "In: %.03f kB/s (%.03f kB/s, Q: %.03f kB) | Out: %.03f kB/s (%.03f kB/s, Q: %.03f kB) | RAM: %.03f MB", socket_data_i/1024., socket_data_ci/1024., socket_data_qi/1024., socket_data_o/1024., socket_data_co/1024., socket_data_qo/1024., malloc_usage()/1024.);
+		sprintf(buf, "In: %.03f kB/s (%.03f kB/s, Q: %.03f kB) | Out: %.03f kB/s (%.03f kB/s, Q: %.03f kB, Shared: %.03f kB/s) | RAM: %.03f MB", socket_data_i/1024., socket_data_ci/1024., socket_data_qi/1024., socket_data_o/1024., socket_data_co/1024., socket_data_qo/1024., socket_data_so/1024., malloc_usage()/1024.);
 #ifdef _WIN32
 		SetConsoleTitle(buf);
 #else
@@ -1049,7 +1894,7 @@ int32 do_sockets(t_tick next)
 #endif
 		socket_data_last_tick = last_tick;
 		socket_data_i = socket_data_ci = 0;
-		socket_data_o = socket_data_co = 0;
+		socket_data_o = socket_data_co = socket_data_so = 0;
 	}
 #endif
 
@@ -1316,6 +2161,14 @@ int32 socket_config_read(const char* cfgName)
 			if( stall_time < 3 )
 				stall_time = 3;/* a minimum is required to refrain it from killing itself */
 		}
+		else if (!strcmpi(w1, "timer_backend")) {
+			if (!strcmpi(w2, "heap"))
+				timer_set_backend(TIMER_BACKEND_HEAP);
+			else if (!strcmpi(w2, "wheel"))
+				timer_set_backend(TIMER_BACKEND_WHEEL);
+			else
+				ShowWarning("socket_config_read: Unknown timer_backend '%s', expected 'heap' or 'wheel'.\n", w2);
+		}
 #ifndef MINICORE
 		else if (!strcmpi(w1, "enable_ip_rules")) {
 			ip_rules = config_switch(w2);
@@ -1357,6 +2210,13 @@ int32 socket_config_read(const char* cfgName)
 				epoll_maxevents = 16;
 			}
 		}
+		else if( !strcmpi( w1, "io_threads" ) ){
+			if( socket_io_running ){
+				ShowWarning( "socket_config_read: io_threads can not be changed while the server is running.\n" );
+			}else{
+				socket_io_thread_count = cap_value( atoi( w2 ), 0, 64 );
+			}
+		}
 #endif
 #endif
 		else if (!strcmpi(w1, "import"))
@@ -1395,6 +2255,10 @@ void socket_final(void)
 		if(session[i])
 			do_close(i);
 
+#ifdef SOCKET_EPOLL
+	socket_io_final();
+#endif
+
 	// session[0]
 	aFree(session[0]->rdata);
 	aFree(session[0]->wdata);
@@ -1432,10 +2296,17 @@ void do_close(int32 fd)
 	// Select based Event Dispatcher
 	sFD_CLR(fd, &readfds);// this needs to be done before closing the socket
 #else
-	// Epoll based Event Dispatcher
-	epevent.data.fd = fd;
-	epevent.events = EPOLLIN;
-	epoll_ctl( epfd, EPOLL_CTL_DEL, fd, &epevent ); // removing the socket from epoll when it's being closed is not required but recommended
+	socket_io_waiting[fd] = false;
+
+	if( socket_io_sessions[fd] != nullptr ){
+		// Threaded network I/O
+		socket_io_detach( fd );
+	}else{
+		// Epoll based Event Dispatcher
+		epevent.data.fd = fd;
+		epevent.events = EPOLLIN;
+		epoll_ctl( epfd, EPOLL_CTL_DEL, fd, &epevent ); // removing the socket from epoll when it's being closed is not required but recommended
+	}
 #endif
 
 	sShutdown(fd, SHUT_RDWR); // Disallow further reads/writes
@@ -1607,6 +2478,10 @@ void socket_init(void)
 
 	socket_config_read(SOCKET_CONF_FILENAME);
 
+#ifdef SOCKET_EPOLL
+	socket_io_init();
+#endif
+
 	// initialise last send-receive tick
 	last_tick = time(nullptr);
 
@@ -1744,7 +2619,7 @@ void send_shortlist_do_sends()
 		if( session[fd] )
 		{
 			// Send data
-			if( session[fd]->wdata_size )
+			if( session_has_wdata(fd) )
 				session[fd]->func_send(fd);
 
 			// If it's been marked as eof, call the parse func on it so that
@@ -1754,7 +2629,7 @@ void send_shortlist_do_sends()
 
 			// If the session still exists, is not eof and has things left to
 			// be sent from it we'll re-add it to the shortlist.
-			if( session_isActive(fd) && session[fd]->wdata_size )
+			if( session_isActive(fd) && session_has_wdata(fd) )
 				send_shortlist_add_fd(fd);
 		}
 	}
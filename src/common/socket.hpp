@@ -5,6 +5,7 @@
 #define SOCKET_HPP
 
 #include <ctime>
+#include <memory>
 
 #include <config/core.hpp>
 
@@ -199,6 +200,27 @@ void send_shortlist_add_fd(int32 fd);
 void send_shortlist_do_sends();
 #endif
 
+/// Immutable packet buffer, that can be queued for multiple sessions at once.
+/// Sessions keep a reference to the buffer until it was sent, instead of copying it into their WFIFO.
+struct s_shared_packet{
+	std::unique_ptr<uint8[]> data;
+	size_t length;
+};
+
+// Creates a shared packet buffer from a copy of the given packet.
+std::shared_ptr<s_shared_packet> socket_shared_packet( const void* buf, size_t len );
+// Queues a shared packet buffer for sending, behind the data already in the WFIFO.
+bool socket_send_shared( int32 fd, const std::shared_ptr<s_shared_packet>& packet );
+
+// Creates a session without a socket, to run a parse function on recorded data. Returns -1 if there is no free slot.
+int32 socket_stub_open( void );
+// Replaces the received data of a stub session.
+void socket_stub_fill( int32 fd, const void* buf, size_t len );
+// Discards everything written to a stub session and clears its eof flag.
+void socket_stub_discard( int32 fd );
+// Deletes a stub session, its session data is left to the caller.
+void socket_stub_close( int32 fd );
+
 // Reuseable global packet buffer to prevent too many allocations
 // Take socket.cpp::socket_max_client_packet into consideration
 extern int8 packet_buffer[UINT16_MAX];
@@ -3,9 +3,13 @@
 
 #include "timer.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <cstdlib>
 #include <cstring>
 #include <utility>
+#include <vector>
 
 #include "cbasetypes.hpp"
 #include "db.hpp"
@@ -41,10 +45,260 @@ static int32 free_timer_list_pos = 0;
 /// @param tid1 First timer
 /// @param tid2 Second timer
 /// @return negative if tid1 is top, positive if tid2 is top, 0 if equal
-#define DIFFTICK_MINTOPCMP(tid1,tid2) DIFF_TICK(timer_data[tid1].tick,timer_data[tid2].tick)
+#define DIFFTICK_MINTOPCMP(tid1,tid2) DIFF_TICK((*this->timers)[tid1].tick,(*this->timers)[tid2].tick)
+
+/// Queue of pending timer ids, ordered by their expiration tick.
+/// The timer data itself is owned by the caller, the queue only keeps the ids.
+class TimerQueue{
+protected:
+	TimerData* const* timers;
+
+public:
+	TimerQueue( TimerData* const* timers ) : timers( timers ){}
+	virtual ~TimerQueue() = default;
+
+	/// Queues a timer at its current tick.
+	virtual void push( int32 tid ) = 0;
+	/// Removes a queued timer, returns false if it was not queued.
+	virtual bool remove( int32 tid ) = 0;
+	/// Removes and returns the next timer that expired at 'tick' or INVALID_TIMER if there is none.
+	/// 'diff' is set to the difference between the timer's tick and 'tick', or to the time
+	/// until the next timer might expire if none expired.
+	virtual int32 pop( t_tick tick, t_tick& diff ) = 0;
+	/// Appends all queued timer ids to 'tids'.
+	virtual void collect( std::vector<int32>& tids ) = 0;
+};
+
+/// Binary heap of timer ids.
+/// Adding and expiring timers is O(log n), changing a timer's tick is O(n).
+class TimerHeap : public TimerQueue{
+private:
+	BHEAP_STRUCT_DECL( s_timer_heap, int32 );
+	BHEAP_STRUCT_VAR( s_timer_heap, heap );
+
+public:
+	TimerHeap( TimerData* const* timers ) : TimerQueue( timers ){
+		BHEAP_INIT( this->heap );
+	}
+
+	~TimerHeap() override{
+		BHEAP_CLEAR( this->heap );
+	}
+
+	void push( int32 tid ) override{
+		BHEAP_ENSURE( this->heap, 1, 256 );
+		BHEAP_PUSH( this->heap, tid, DIFFTICK_MINTOPCMP );
+	}
+
+	bool remove( int32 tid ) override{
+		size_t i;
+
+		// search timer position
+		ARR_FIND( 0, BHEAP_LENGTH( this->heap ), i, BHEAP_DATA( this->heap )[i] == tid );
+		if( i == BHEAP_LENGTH( this->heap ) )
+			return false;
+
+		BHEAP_POPINDEX( this->heap, i, DIFFTICK_MINTOPCMP );
+		return true;
+	}
+
+	int32 pop( t_tick tick, t_tick& diff ) override{
+		if( BHEAP_LENGTH( this->heap ) == 0 ){
+			diff = TIMER_MAX_INTERVAL;
+			return INVALID_TIMER;
+		}
+
+		int32 tid = BHEAP_PEEK( this->heap ); // top element in heap (smallest tick)
+
+		diff = DIFF_TICK( (*this->timers)[tid].tick, tick );
+		if( diff > 0 )
+			return INVALID_TIMER; // no more expired timers to process
+
+		BHEAP_POP( this->heap, DIFFTICK_MINTOPCMP );
+		return tid;
+	}
+
+	void collect( std::vector<int32>& tids ) override{
+		tids.insert( tids.end(), BHEAP_DATA( this->heap ), BHEAP_DATA( this->heap ) + BHEAP_LENGTH( this->heap ) );
+	}
+};
+
+/// Hierarchical timing wheel of timer ids.
+/// The first level has one slot per millisecond for the next 256ms, every further level
+/// covers 64 times the range of the previous one. Timers of a higher level are moved down
+/// (cascaded) when the lower level wraps around, so adding, changing and expiring a timer is O(1).
+/// Timers further away than the last level are kept in its last slot until they get closer.
+/// Timers that expire on the same tick are executed in the order they were queued.
+/// Like with the heap, a timer added by a timer function is still executed by the same do_timer
+/// call if it expires at or before the tick do_timer runs for: pop only moves past a slot once it
+/// is empty and only stops after the slot of that tick, so such a timer is queued on the slot
+/// being processed or on one that is still ahead in this pass.
+class TimerWheel : public TimerQueue{
+private:
+	static const int32 ROOT_BITS = 8;
+	static const int32 LEVEL_BITS = 6;
+	static const int32 LEVELS = 4; // Levels after the first one
+	static const int32 ROOT_SIZE = 1 << ROOT_BITS;
+	static const int32 LEVEL_SIZE = 1 << LEVEL_BITS;
+	static const int64 MAX_DELTA = ( INT64_C( 1 ) << ( ROOT_BITS + LEVELS * LEVEL_BITS ) ) - 1;
+
+	/// Timer list of a slot
+	struct s_slot{
+		int32 head = INVALID_TIMER;
+		int32 tail = INVALID_TIMER;
+	};
+
+	/// Links of a timer inside its slot
+	struct s_link{
+		int32 prev;
+		int32 next;
+		int32 slot; // -1 if the timer is not queued
+	};
+
+	s_slot slots[ROOT_SIZE + LEVELS * LEVEL_SIZE];
+	std::vector<s_link> links;
+	t_tick now; // Tick of the next slot to process, every timer before it was executed
+
+	void link( int32 tid, int32 slot ){
+		if( tid >= static_cast<int32>( this->links.size() ) )
+			this->links.resize( tid + 256, { INVALID_TIMER, INVALID_TIMER, -1 } );
+
+		s_link& l = this->links[tid];
+		s_slot& s = this->slots[slot];
+
+		l.prev = s.tail;
+		l.next = INVALID_TIMER;
+		l.slot = slot;
+
+		if( s.tail == INVALID_TIMER )
+			s.head = tid;
+		else
+			this->links[s.tail].next = tid;
+		s.tail = tid;
+	}
+
+	void unlink( int32 tid ){
+		s_link& l = this->links[tid];
+		s_slot& s = this->slots[l.slot];
+
+		if( l.prev == INVALID_TIMER )
+			s.head = l.next;
+		else
+			this->links[l.prev].next = l.next;
+
+		if( l.next == INVALID_TIMER )
+			s.tail = l.prev;
+		else
+			this->links[l.next].prev = l.prev;
+
+		l.slot = -1;
+	}
+
+	/// Moves the timers of the current slot of a level to the lower levels.
+	/// Returns the index of the slot.
+	int32 cascade( int32 level ){
+		int32 index = static_cast<int32>( ( static_cast<uint64>( this->now ) >> ( ROOT_BITS + level * LEVEL_BITS ) ) & ( LEVEL_SIZE - 1 ) );
+		s_slot& s = this->slots[ROOT_SIZE + level * LEVEL_SIZE + index];
+		int32 tid = s.head;
+
+		s.head = s.tail = INVALID_TIMER;
+
+		while( tid != INVALID_TIMER ){
+			int32 next = this->links[tid].next;
+
+			this->push( tid );
+			tid = next;
+		}
+
+		return index;
+	}
+
+	/// Returns the time until the next timer might expire, at most TIMER_MAX_INTERVAL.
+	/// Stops at the next cascade, since timers of the upper levels can not be checked cheaply.
+	t_tick next_diff( t_tick tick ){
+		for( t_tick t = this->now; DIFF_TICK( t, tick ) < TIMER_MAX_INTERVAL; t++ ){
+			if( t != this->now && ( t & ( ROOT_SIZE - 1 ) ) == 0 )
+				return DIFF_TICK( t, tick );
+			if( this->slots[t & ( ROOT_SIZE - 1 )].head != INVALID_TIMER )
+				return DIFF_TICK( t, tick );
+		}
+
+		return TIMER_MAX_INTERVAL;
+	}
+
+public:
+	TimerWheel( TimerData* const* timers, t_tick now ) : TimerQueue( timers ), now( now ){
+	}
+
+	void push( int32 tid ) override{
+		t_tick expires = (*this->timers)[tid].tick;
+		int64 delta = DIFF_TICK( expires, this->now );
+		int32 slot;
+
+		if( delta < 0 ){
+			// Already expired, execute it with the slot being processed
+			// Between do_timer calls that is the first slot the next call processes
+			slot = static_cast<int32>( this->now & ( ROOT_SIZE - 1 ) );
+		}else if( delta < ROOT_SIZE ){
+			slot = static_cast<int32>( expires & ( ROOT_SIZE - 1 ) );
+		}else{
+			if( delta > MAX_DELTA )
+				expires = this->now + MAX_DELTA;
+
+			int32 level = 0;
+
+			while( level < LEVELS - 1 && delta >= ( INT64_C( 1 ) << ( ROOT_BITS + ( level + 1 ) * LEVEL_BITS ) ) )
+				level++;
+
+			slot = ROOT_SIZE + level * LEVEL_SIZE + static_cast<int32>( ( static_cast<uint64>( expires ) >> ( ROOT_BITS + level * LEVEL_BITS ) ) & ( LEVEL_SIZE - 1 ) );
+		}
+
+		this->link( tid, slot );
+	}
+
+	bool remove( int32 tid ) override{
+		if( tid >= static_cast<int32>( this->links.size() ) || this->links[tid].slot < 0 )
+			return false;
+
+		this->unlink( tid );
+		return true;
+	}
+
+	int32 pop( t_tick tick, t_tick& diff ) override{
+		while( DIFF_TICK( this->now, tick ) <= 0 ){
+			int32 tid = this->slots[this->now & ( ROOT_SIZE - 1 )].head;
+
+			if( tid != INVALID_TIMER ){
+				this->unlink( tid );
+				diff = DIFF_TICK( (*this->timers)[tid].tick, tick );
+				return tid;
+			}
+
+			this->now++;
+
+			if( ( this->now & ( ROOT_SIZE - 1 ) ) == 0 ){
+				for( int32 level = 0; level < LEVELS && this->cascade( level ) == 0; level++ );
+			}
+		}
+
+		diff = this->next_diff( tick );
+		return INVALID_TIMER;
+	}
+
+	void collect( std::vector<int32>& tids ) override{
+		for( const s_slot& s : this->slots ){
+			for( int32 tid = s.head; tid != INVALID_TIMER; tid = this->links[tid].next )
+				tids.push_back( tid );
+		}
+	}
+};
+
+// timer queue of the server
+static TimerQueue* timer_queue = nullptr;
+static e_timer_backend timer_backend = TIMER_BACKEND_HEAP;
 
-// timer heap (binary heap of tid's)
-static BHEAP_VAR(int32, timer_heap);
+// workload recording for timer_benchmark
+static FILE* timer_record_fp = nullptr;
 
 
 // server startup time
@@ -202,14 +456,37 @@ t_tick gettick(void)
 //////////////////////////////////////////////////////////////////////////
 
 /*======================================
- * 	CORE : Timer Heap
+ * 	CORE : Timer Queue
  *--------------------------------------*/
 
-/// Adds a timer to the timer_heap
-static void push_timer_heap(int32 tid)
+/// Creates an empty timer queue of the given backend
+static TimerQueue* timer_queue_create(e_timer_backend backend, TimerData* const* timers, t_tick tick)
 {
-	BHEAP_ENSURE(timer_heap, 1, 256);
-	BHEAP_PUSH(timer_heap, tid, DIFFTICK_MINTOPCMP);
+	if( backend == TIMER_BACKEND_WHEEL )
+		return new TimerWheel(timers, tick);
+
+	return new TimerHeap(timers);
+}
+
+/// Switches the timer queue to another backend, moving all pending timers.
+void timer_set_backend(e_timer_backend backend)
+{
+	if( timer_queue != nullptr && backend == timer_backend )
+		return;
+
+	TimerQueue* queue = timer_queue_create(backend, &timer_data, gettick_nocache());
+
+	if( timer_queue != nullptr ){
+		std::vector<int32> tids;
+
+		timer_queue->collect(tids);
+		for( int32 tid : tids )
+			queue->push(tid);
+		delete timer_queue;
+	}
+
+	timer_queue = queue;
+	timer_backend = backend;
 }
 
 /*==========================
@@ -261,7 +538,10 @@ int32 add_timer(t_tick tick, TimerFunc func, int32 id, intptr_t data)
 	timer_data[tid].data     = data;
 	timer_data[tid].type     = TIMER_ONCE_AUTODEL;
 	timer_data[tid].interval = 1000;
-	push_timer_heap(tid);
+	timer_queue->push(tid);
+
+	if( timer_record_fp != nullptr )
+		fprintf(timer_record_fp, "A %d %" PRtf " 0\n", tid, tick);
 
 	return tid;
 }
@@ -285,7 +565,10 @@ int32 add_timer_interval(t_tick tick, TimerFunc func, int32 id, intptr_t data, i
 	timer_data[tid].data     = data;
 	timer_data[tid].type     = TIMER_INTERVAL;
 	timer_data[tid].interval = interval;
-	push_timer_heap(tid);
+	timer_queue->push(tid);
+
+	if( timer_record_fp != nullptr )
+		fprintf(timer_record_fp, "A %d %" PRtf " %d\n", tid, tick, interval);
 
 	return tid;
 }
@@ -315,6 +598,9 @@ int32 delete_timer(int32 tid, TimerFunc func)
 	timer_data[tid].func = nullptr;
 	timer_data[tid].type = TIMER_ONCE_AUTODEL;
 
+	if( timer_record_fp != nullptr )
+		fprintf(timer_record_fp, "D %d\n", tid);
+
 	return 0;
 }
 
@@ -329,26 +615,25 @@ t_tick addtick_timer(int32 tid, t_tick tick)
 /// Returns the new tick value, or -1 if it fails.
 t_tick settick_timer(int32 tid, t_tick tick)
 {
-	size_t i;
+	if( tick == -1 )
+		tick = 0;// add 1ms to avoid the error value -1
+
+	if( tid >= 0 && tid < timer_data_num && timer_data[tid].tick == tick && !(timer_data[tid].type&TIMER_REMOVE_HEAP) && timer_data[tid].type )
+		return tick;// nothing to do, already in propper position
 
-	// search timer position
-	ARR_FIND(0, BHEAP_LENGTH(timer_heap), i, BHEAP_DATA(timer_heap)[i] == tid);
-	if( i == BHEAP_LENGTH(timer_heap) )
+	// pop and push adjusted timer
+	if( tid < 0 || tid >= timer_data_num || !timer_queue->remove(tid) )
 	{
 		ShowError("settick_timer: no such timer %d (%p(%s))\n", tid, timer_data[tid].func, search_timer_func_list(timer_data[tid].func));
 		return -1;
 	}
 
-	if( tick == -1 )
-		tick = 0;// add 1ms to avoid the error value -1
+	timer_data[tid].tick = tick;
+	timer_queue->push(tid);
 
-	if( timer_data[tid].tick == tick )
-		return tick;// nothing to do, already in propper position
+	if( timer_record_fp != nullptr )
+		fprintf(timer_record_fp, "S %d %" PRtf "\n", tid, tick);
 
-	// pop and push adjusted timer
-	BHEAP_POPINDEX(timer_heap, i, DIFFTICK_MINTOPCMP);
-	timer_data[tid].tick = tick;
-	BHEAP_PUSH(timer_heap, tid, DIFFTICK_MINTOPCMP);
 	return tick;
 }
 
@@ -357,18 +642,14 @@ t_tick settick_timer(int32 tid, t_tick tick)
 t_tick do_timer(t_tick tick)
 {
 	t_tick diff = TIMER_MAX_INTERVAL; // return value
+	int32 tid;
 
-	// process all timers one by one
-	while( BHEAP_LENGTH(timer_heap) )
-	{
-		int32 tid = BHEAP_PEEK(timer_heap);// top element in heap (smallest tick)
-
-		diff = DIFF_TICK(timer_data[tid].tick, tick);
-		if( diff > 0 )
-			break; // no more expired timers to process
+	if( timer_record_fp != nullptr )
+		fprintf(timer_record_fp, "T %" PRtf "\n", tick);
 
-		// remove timer
-		BHEAP_POP(timer_heap, DIFFTICK_MINTOPCMP);
+	// process all expired timers one by one
+	while( ( tid = timer_queue->pop(tick, diff) ) != INVALID_TIMER )
+	{
 		timer_data[tid].type |= TIMER_REMOVE_HEAP;
 
 		if( timer_data[tid].func )
@@ -402,7 +683,7 @@ t_tick do_timer(t_tick tick)
 					timer_data[tid].tick = tick + timer_data[tid].interval;
 				else
 					timer_data[tid].tick += timer_data[tid].interval;
-				push_timer_heap(tid);
+				timer_queue->push(tid);
 			break;
 			}
 		}
@@ -411,6 +692,179 @@ t_tick do_timer(t_tick tick)
 	return cap_value(diff, TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
 }
 
+/*==========================
+ * 	Timer Benchmark
+ *--------------------------*/
+
+/// Starts recording the timer workload to 'file' for timer_benchmark.
+/// Stops a running recording first, passing nullptr only stops it.
+/// Returns true if the recording was started.
+bool timer_record(const char* file)
+{
+	if( timer_record_fp != nullptr ){
+		fclose(timer_record_fp);
+		timer_record_fp = nullptr;
+		ShowStatus("Stopped recording timers.\n");
+	}
+
+	if( file == nullptr )
+		return false;
+
+	if( ( timer_record_fp = fopen(file, "w") ) == nullptr ){
+		ShowError("timer_record: Could not open '%s' for writing.\n", file);
+		return false;
+	}
+
+	// Pending timers are part of the workload
+	std::vector<int32> tids;
+
+	timer_queue->collect(tids);
+	for( int32 tid : tids ){
+		fprintf(timer_record_fp, "A %d %" PRtf " %d\n", tid, timer_data[tid].tick, ( timer_data[tid].type == TIMER_INTERVAL ) ? timer_data[tid].interval : 0);
+		if( timer_data[tid].func == nullptr )
+			fprintf(timer_record_fp, "D %d\n", tid);
+	}
+
+	ShowStatus("Recording timers to '%s'...\n", file);
+	return true;
+}
+
+/// Operation of a recorded timer workload
+struct s_timer_record_op{
+	char type; // A = add, D = delete, S = settick, T = do_timer
+	int32 tid;
+	t_tick tick;
+	int32 interval;
+};
+
+static TIMER_FUNC(timer_benchmark_func){
+	return 0;
+}
+
+/// Replays a recorded workload on a new queue of the given backend.
+/// Returns the number of executed timers.
+static size_t timer_benchmark_replay(e_timer_backend backend, const std::vector<s_timer_record_op>& ops, int32 tid_max, int64& duration)
+{
+	std::vector<TimerData> data(tid_max + 1);
+	TimerData* timers = data.data();
+	auto first = std::find_if(ops.begin(), ops.end(), []( const s_timer_record_op& op ){ return op.type == 'T'; });
+	TimerQueue* queue = timer_queue_create(backend, &timers, ( first != ops.end() ) ? first->tick : ops.front().tick);
+	size_t executed = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for( const s_timer_record_op& op : ops ){
+		TimerData& timer = timers[op.tid];
+
+		switch( op.type ){
+			case 'A':
+				if( timer.type )
+					queue->remove(op.tid); // Still pending because it expired later than recorded
+				timer.tick = op.tick;
+				timer.func = timer_benchmark_func;
+				timer.type = op.interval ? TIMER_INTERVAL : TIMER_ONCE_AUTODEL;
+				timer.interval = op.interval ? op.interval : 1000;
+				queue->push(op.tid);
+				break;
+			case 'D':
+				timer.func = nullptr;
+				timer.type = TIMER_ONCE_AUTODEL;
+				break;
+			case 'S':
+				if( timer.type && queue->remove(op.tid) ){
+					timer.tick = op.tick;
+					queue->push(op.tid);
+				}
+				break;
+			case 'T': {
+				t_tick diff;
+				int32 tid;
+
+				while( ( tid = queue->pop(op.tick, diff) ) != INVALID_TIMER ){
+					TimerData& expired = timers[tid];
+
+					executed++;
+					if( expired.func )
+						expired.func(tid, expired.tick, expired.id, expired.data);
+
+					if( expired.type == TIMER_INTERVAL ){
+						if( DIFF_TICK(expired.tick, op.tick) < -1000 )
+							expired.tick = op.tick + expired.interval;
+						else
+							expired.tick += expired.interval;
+						queue->push(tid);
+					}else
+						expired.type = 0;
+				}
+			}	break;
+		}
+	}
+
+	duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	delete queue;
+
+	return executed;
+}
+
+/// Replays a timer workload recorded by timer_record against all backends.
+void timer_benchmark(const char* file)
+{
+	FILE* fp = fopen(file, "r");
+
+	if( fp == nullptr ){
+		ShowError("timer_benchmark: Could not open '%s'.\n", file);
+		return;
+	}
+
+	std::vector<s_timer_record_op> ops;
+	char line[128];
+	int32 tid_max = 0;
+
+	while( fgets(line, sizeof(line), fp) ){
+		s_timer_record_op op = {};
+		int64 tick = 0;
+		int32 n;
+
+		switch( line[0] ){
+			case 'A': n = sscanf(line + 1, "%11d %20" SCNd64 " %11d", &op.tid, &tick, &op.interval); break;
+			case 'D': n = sscanf(line + 1, "%11d", &op.tid) + 2; break;
+			case 'S': n = sscanf(line + 1, "%11d %20" SCNd64, &op.tid, &tick) + 1; break;
+			case 'T': n = sscanf(line + 1, "%20" SCNd64, &tick) + 2; break;
+			default: n = 0; break;
+		}
+
+		if( n != 3 || op.tid < 0 || op.interval < 0 ){
+			ShowWarning("timer_benchmark: Skipping invalid line '%s'.\n", line);
+			continue;
+		}
+
+		op.type = line[0];
+		op.tick = tick;
+		tid_max = max(tid_max, op.tid);
+		ops.push_back(op);
+	}
+
+	fclose(fp);
+
+	if( ops.empty() ){
+		ShowError("timer_benchmark: '%s' does not contain any timer operations.\n", file);
+		return;
+	}
+
+	ShowStatus("Replaying %" PRIuPTR " timer operations on %d timer ids from '%s'...\n", ops.size(), tid_max + 1, file);
+
+	const struct { e_timer_backend backend; const char* name; } backends[] = {
+		{ TIMER_BACKEND_HEAP, "heap" },
+		{ TIMER_BACKEND_WHEEL, "wheel" },
+	};
+
+	for( const auto& it : backends ){
+		int64 duration;
+		size_t executed = timer_benchmark_replay(it.backend, ops, tid_max, duration);
+
+		ShowInfo("%-5s: %8" PRId64 " us, %5" PRId64 " ns/operation, %" PRIuPTR " timers executed\n", it.name, duration, duration * 1000 / static_cast<int64>(ops.size()), executed);
+	}
+}
+
 unsigned long get_uptime(void)
 {
 	return (unsigned long)difftime(time(nullptr), start_time);
@@ -521,6 +975,8 @@ void timer_init(void)
 #endif
 
 	time(&start_time);
+
+	timer_set_backend(timer_backend);
 }
 
 void timer_final(void)
@@ -534,7 +990,10 @@ void timer_final(void)
 		aFree(tfl);
 	}
 
+	timer_record(nullptr);
+	delete timer_queue;
+	timer_queue = nullptr;
+
 	if (timer_data) aFree(timer_data);
-	BHEAP_CLEAR(timer_heap);
 	if (free_timer_list) aFree(free_timer_list);
 }
@@ -30,6 +30,12 @@ enum {
 	TIMER_REMOVE_HEAP = 0x10,
 };
 
+/// Data structures the pending timers can be kept in
+enum e_timer_backend : uint8 {
+	TIMER_BACKEND_HEAP = 0, ///< Binary heap
+	TIMER_BACKEND_WHEEL, ///< Hierarchical timing wheel
+};
+
 #define TIMER_FUNC(x) int32 x ( int32 tid, t_tick tick, int32 id, intptr_t data )
 
 // Struct declaration
@@ -69,6 +75,9 @@ void split_time(int32 time, int32* year, int32* month, int32* day, int32* hour,
 double solve_time(char* modif_p);
 
 t_tick do_timer(t_tick tick);
+void timer_set_backend(e_timer_backend backend);
+bool timer_record(const char* file);
+void timer_benchmark(const char* file);
 void timer_init(void);
 void timer_final(void);
 
@@ -400,3 +400,17 @@ uint32 get_percentage_exp(const uint64 a, const uint64 b)
 
 	return (uint32)floor(result);
 }
+
+/// 64-bit FNV-1a hash of 'length' bytes of 'buffer'
+uint64 hash_fnv64(const void* buffer, size_t length)
+{
+	const uint8* p = (const uint8*)buffer;
+	uint64 hash = 0xcbf29ce484222325ULL;
+
+	for( size_t i = 0; i < length; i++ ){
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
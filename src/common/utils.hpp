@@ -29,6 +29,9 @@ bool exists(const char* filename);
 uint32 get_percentage(const uint32 A, const uint32 B);
 uint32 get_percentage_exp(const uint64 a, const uint64 b);
 
+/// 64-bit FNV-1a hash of a buffer
+uint64 hash_fnv64(const void* buffer, size_t length);
+
 //////////////////////////////////////////////////////////////////////////
 // byte word dword access [Shinomori]
 //////////////////////////////////////////////////////////////////////////
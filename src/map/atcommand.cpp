@@ -11483,6 +11483,53 @@ ACMD_FUNC(macrochecker){
 	return 0;
 }
 
+/**
+ * Controls the script profiler
+ * Usage: @scriptprofile <on|off|reset|show {<count>}|dump {<file>}>
+ */
+ACMD_FUNC(scriptprofile){
+	char action[16], param[256];
+
+	memset(action, '\0', sizeof(action));
+	memset(param, '\0', sizeof(param));
+
+	if( !message || !*message || sscanf( message, "%15s %255s", action, param ) < 1 ){
+		clif_displaymessage( fd, msg_txt( sd, 1541 ) ); // Usage: @scriptprofile <on|off|reset|show {<count>}|dump {<file>}>
+		return -1;
+	}
+
+	if( strcmpi( action, "on" ) == 0 ){
+		script_profile_enable( true );
+		clif_displaymessage( fd, msg_txt( sd, 1542 ) ); // Script profiling has been enabled for newly started scripts.
+	}else if( strcmpi( action, "off" ) == 0 ){
+		script_profile_enable( false );
+		clif_displaymessage( fd, msg_txt( sd, 1543 ) ); // Script profiling has been disabled.
+	}else if( strcmpi( action, "reset" ) == 0 ){
+		script_profile_reset();
+		clif_displaymessage( fd, msg_txt( sd, 1544 ) ); // Script profiling counters have been reset.
+	}else if( strcmpi( action, "show" ) == 0 ){
+		int32 count = param[0] ? atoi( param ) : 10;
+
+		script_profile_show( fd, sd, cap_value( count, 1, 100 ) );
+	}else if( strcmpi( action, "dump" ) == 0 ){
+		const char* file = param[0] ? param : "log/script_profile";
+
+		if( !script_profile_dump( file ) ){
+			sprintf( atcmd_output, msg_txt( sd, 1546 ), file ); // Failed to write the script profile to '%s'.
+			clif_displaymessage( fd, atcmd_output );
+			return -1;
+		}
+
+		sprintf( atcmd_output, msg_txt( sd, 1545 ), file, file ); // Script profile has been written to '%s.csv' and '%s.folded'.
+		clif_displaymessage( fd, atcmd_output );
+	}else{
+		clif_displaymessage( fd, msg_txt( sd, 1541 ) ); // Usage: @scriptprofile <on|off|reset|show {<count>}|dump {<file>}>
+		return -1;
+	}
+
+	return 0;
+}
+
 #include <custom/atcommand.inc>
 
 /**
@@ -11813,6 +11860,7 @@ void atcommand_basecommands(void) {
 		ACMD_DEFR(roulette, ATCMD_NOCONSOLE|ATCMD_NOAUTOTRADE),
 		ACMD_DEF(setcard),
 		ACMD_DEF(macrochecker),
+		ACMD_DEF(scriptprofile),
 	};
 	AtCommandInfo* atcommand;
 	int32 i;
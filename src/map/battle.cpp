@@ -8908,6 +8908,10 @@ static const struct _battle_data {
 	{ "enable_bonus_map_drops",             &battle_config.enable_bonus_map_drops,          1,      0,      1,              },
 	{ "hide_cloaked_units",                 &battle_config.hide_cloaked_units,              0,      0,      BL_ALL,         },
 	{ "oridecon_research_fix",              &battle_config.oridecon_research_fix,           0,      0,      1,              },
+	{ "monster_ai_threads",                 &battle_config.mob_ai_threads,                  0,      0,      64,             },
+	{ "path_search_algorithm",              &battle_config.path_search_algorithm,           0,      0,      1,              },
+	{ "path_cache_size",                    &battle_config.path_cache_size,                 512,    0,      65535,          },
+	{ "max_walk_route",                     &battle_config.max_walk_route,                  0,      0,      MAX_WALKROUTE,  },
 
 #include <custom/battle_config_init.inc>
 };
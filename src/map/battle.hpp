@@ -781,6 +781,10 @@ struct Battle_Config
 	int32 enable_bonus_map_drops;
 	int32 hide_cloaked_units;
 	int32 oridecon_research_fix;
+	int32 mob_ai_threads;
+	int32 path_search_algorithm;
+	int32 path_cache_size;
+	int32 max_walk_route;
 
 #include <custom/battle_config_struct.inc>
 };
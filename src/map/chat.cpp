@@ -50,7 +50,7 @@ static chat_data* chat_createchat(block_list* bl, const char* title, const char*
 	cd->x    = bl->x;
 	cd->y    = bl->y;
 	cd->type = BL_CHAT;
-	cd->next = cd->prev = nullptr;
+	cd->prev = nullptr;
 
 	if( cd->id == 0 ) {
 		aFree(cd);
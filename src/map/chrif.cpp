@@ -3,6 +3,8 @@
 
 #include "chrif.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 
@@ -14,6 +16,7 @@
 #include <common/socket.hpp>
 #include <common/strlib.hpp>
 #include <common/timer.hpp>
+#include <common/utils.hpp>
 
 #include "battle.hpp"
 #include "clan.hpp"
@@ -46,7 +49,7 @@ static const int32 packet_len_table[0x3d] = { // U - used, F - free
 	11,10,10, 0,11, -1, 0,10,	// 2b10-2b17: U->2b10, U->2b11, U->2b12, F->2b13, U->2b14, U->2b15, F->2b16, U->2b17
 	 2,10, 2,-1,-1,-1, 2, 7,	// 2b18-2b1f: U->2b18, U->2b19, U->2b1a, U->2b1b, U->2b1c, U->2b1d, U->2b1e, U->2b1f
 	-1,10, 8, 2, 2,14,19,19,	// 2b20-2b27: U->2b20, U->2b21, U->2b22, U->2b23, U->2b24, U->2b25, U->2b26, U->2b27
-	-1, 0, 6,15, 0, 6,-1,-1,	// 2b28-2b2f: U->2b28, F->2b29, U->2b2a, U->2b2b, F->2b2c, U->2b2d, U->2b2e, U->2b2f
+	-1,10, 6,15, 0, 6,-1,-1,	// 2b28-2b2f: U->2b28, U->2b29, U->2b2a, U->2b2b, U->2b2c, U->2b2d, U->2b2e, U->2b2f
  };
 
 //Used Packets:
@@ -98,10 +101,10 @@ static const int32 packet_len_table[0x3d] = { // U - used, F - free
 //2b26: Outgoing, chrif_authreq -> 'client authentication request'
 //2b27: Incoming, chrif_authfail -> 'client authentication failed'
 //2b28: Outgoing, chrif_req_charban -> 'ban a specific char '
-//2b29: FREE
+//2b29: Incoming, chrif_save_resend -> char-server could not apply a delta save, send the whole status again
 //2b2a: Outgoing, chrif_req_charunban -> 'unban a specific char '
 //2b2b: Incoming, chrif_parse_ack_vipActive -> vip info result
-//2b2c: FREE
+//2b2c: Outgoing, chrif_save_status -> 'delta charsave of char XY account XY (changed blocks only)'
 //2b2d: Outgoing, chrif_bsdata_request -> request bonus_script for pc_authok'ed char.
 //2b2e: Outgoing, chrif_bsdata_save -> Send bonus_script of player for saving.
 //2b2f: Incoming, chrif_bsdata_received -> received bonus_script of player for loading.
@@ -274,9 +277,189 @@ int32 chrif_isconnected(void) {
  *  CSAVE_INVENTORY: Character changed inventory data
  *  CSAVE_CART: Character changed cart data
  */
-int32 chrif_save(map_session_data *sd, int32 flag) {
-	uint16 mmo_charstatus_len = 0;
+/// Size of the blocks of mmo_charstatus compared on delta saves
+#define CHRIF_SAVE_BLOCK 32
+
+/// Field groups of mmo_charstatus compared on delta saves, each one reaches up to the next one
+static const struct s_chrif_save_group {
+	const char* name;
+	size_t offset;
+} chrif_save_groups[] = {
+	{ "ids", offsetof( struct mmo_charstatus, char_id ) },
+	{ "exp/zeny", offsetof( struct mmo_charstatus, base_exp ) },
+	{ "status", offsetof( struct mmo_charstatus, class_ ) },
+	{ "look", offsetof( struct mmo_charstatus, weapon ) },
+	{ "stats", offsetof( struct mmo_charstatus, name ) },
+	{ "position", offsetof( struct mmo_charstatus, mapip ) },
+	{ "memo", offsetof( struct mmo_charstatus, memo_point ) },
+	{ "skills", offsetof( struct mmo_charstatus, skill ) },
+	{ "friends", offsetof( struct mmo_charstatus, friends ) },
+#ifdef HOTKEY_SAVING
+	{ "hotkeys", offsetof( struct mmo_charstatus, hotkeys ) },
+#endif
+	{ "misc", offsetof( struct mmo_charstatus, show_equip ) },
+};
+
+/// Counters of the character status saves
+static struct s_chrif_save_stats {
+	uint64 full, delta, unchanged, resend;
+	uint64 bytes; ///< Bytes sent in 0x2b01 and 0x2b2c
+	uint64 bytes_full; ///< Bytes the same saves would have sent as 0x2b01
+	uint64 groups[ARRAYLENGTH( chrif_save_groups )]; ///< Delta saves that sent a group
+} chrif_save_stats;
+
+/**
+ * Sends the status of a player to the char-server.
+ * Saves that do not log the player out only send the blocks that changed since the last save (0x2b2c),
+ * the char-server applies them to its cached copy and asks for the whole status (0x2b29) when that copy differs from ours.
+ * @param sd: Player
+ * @param flag: e_chrif_save_opt
+ */
+static void chrif_save_status( map_session_data* sd, int32 flag ){
+	const uint8* cur = (const uint8*)&sd->status;
+	const uint16 full_len = sizeof( struct mmo_charstatus ) + 13;
+
+	WFIFOHEAD( char_fd, full_len );
+
+	chrif_save_stats.bytes_full += full_len;
+
+	if( save_delta && !( flag&CSAVE_QUITTING ) && sd->save_base != nullptr ){
+		const uint8* base = (const uint8*)sd->save_base.get();
+		uint16 len = 25, runs = 0, run_pos = 0;
+		size_t run_end = 0;
+		bool dirty[ARRAYLENGTH( chrif_save_groups )] = {};
+
+		for( size_t g = 0; g < ARRAYLENGTH( chrif_save_groups ) && len < full_len; g++ ){
+			size_t end = ( g + 1 < ARRAYLENGTH( chrif_save_groups ) ) ? chrif_save_groups[g + 1].offset : sizeof( struct mmo_charstatus );
+
+			for( size_t i = chrif_save_groups[g].offset; i < end; i += CHRIF_SAVE_BLOCK ){
+				size_t n = std::min<size_t>( CHRIF_SAVE_BLOCK, end - i );
+
+				if( memcmp( cur + i, base + i, n ) == 0 )
+					continue;
+
+				if( runs == 0 || run_end != i ){ // Start a new run
+					if( len + 4 + n >= full_len ){
+						len = full_len;
+						break;
+					}
+					run_pos = len;
+					WFIFOW( char_fd, run_pos ) = static_cast<uint16>( i );
+					WFIFOW( char_fd, run_pos + 2 ) = 0;
+					len += 4;
+					runs++;
+				}else if( len + n >= full_len ){
+					len = full_len;
+					break;
+				}
+
+				memcpy( WFIFOP( char_fd, len ), cur + i, n );
+				len += static_cast<uint16>( n );
+				WFIFOW( char_fd, run_pos + 2 ) += static_cast<uint16>( n );
+				run_end = i + n;
+				dirty[g] = true;
+			}
+		}
+
+		if( runs == 0 ){ // Nothing changed since the last save
+			chrif_save_stats.unchanged++;
+			return;
+		}
+
+		if( len < full_len ){
+			WFIFOW( char_fd, 0 ) = 0x2b2c;
+			WFIFOW( char_fd, 2 ) = len;
+			WFIFOL( char_fd, 4 ) = sd->status.account_id;
+			WFIFOL( char_fd, 8 ) = sd->status.char_id;
+			WFIFOW( char_fd, 12 ) = sizeof( struct mmo_charstatus );
+			WFIFOB( char_fd, 14 ) = DELTA_SAVE_VERSION;
+			WFIFOQ( char_fd, 15 ) = sd->save_base_hash;
+			WFIFOW( char_fd, 23 ) = runs;
+			WFIFOSET( char_fd, len );
+
+			memcpy( sd->save_base.get(), cur, sizeof( struct mmo_charstatus ) );
+			sd->save_base_hash = hash_fnv64( cur, sizeof( struct mmo_charstatus ) );
+
+			chrif_save_stats.delta++;
+			chrif_save_stats.bytes += len;
+			for( size_t g = 0; g < ARRAYLENGTH( chrif_save_groups ); g++ ){
+				if( dirty[g] )
+					chrif_save_stats.groups[g]++;
+			}
+			return;
+		}
+		// The changed blocks are as large as the whole status, send that instead
+	}
+
+	WFIFOW( char_fd, 0 ) = 0x2b01;
+	WFIFOW( char_fd, 2 ) = full_len;
+	WFIFOL( char_fd, 4 ) = sd->status.account_id;
+	WFIFOL( char_fd, 8 ) = sd->status.char_id;
+	WFIFOB( char_fd, 12 ) = ( flag&CSAVE_QUIT ) ? 1 : 0; //Flag to tell char-server this character is quitting.
+
+	// Copy the whole status into the packet
+	memcpy( WFIFOP( char_fd, 13 ), cur, sizeof( struct mmo_charstatus ) );
+
+	WFIFOSET( char_fd, full_len );
 
+	chrif_save_stats.full++;
+	chrif_save_stats.bytes += full_len;
+
+	if( !save_delta || ( flag&CSAVE_QUITTING ) ){
+		sd->save_base.reset();
+		return;
+	}
+
+	if( sd->save_base == nullptr )
+		sd->save_base = std::make_unique<struct mmo_charstatus>();
+
+	memcpy( sd->save_base.get(), cur, sizeof( struct mmo_charstatus ) );
+	sd->save_base_hash = hash_fnv64( cur, sizeof( struct mmo_charstatus ) );
+}
+
+/**
+ * The char-server could not apply a delta save, send the whole status again
+ * @param fd: Char-server file descriptor
+ */
+static void chrif_save_resend( int32 fd ){
+	uint32 account_id = RFIFOL( fd, 2 ), char_id = RFIFOL( fd, 6 );
+	map_session_data* sd = map_id2sd( account_id );
+
+	// Players logging in or out send their whole status anyway
+	if( sd == nullptr || sd->status.char_id != char_id || !sd->state.active || chrif_search( account_id ) != nullptr )
+		return;
+
+	chrif_save_stats.resend++;
+	sd->save_base.reset();
+	pc_makesavestatus( sd );
+	chrif_save_status( sd, CSAVE_NORMAL );
+}
+
+/**
+ * Displays the counters of the character status saves
+ * @param reset: Whether to reset the counters afterwards
+ */
+void chrif_save_report( bool reset ){
+	s_chrif_save_stats& stats = chrif_save_stats;
+
+	if( !save_delta && stats.delta == 0 ){
+		ShowInfo( "Delta character saves are disabled, %" PRIu64 " whole saves sent.\n", stats.full );
+		return;
+	}
+
+	ShowInfo( "Character saves: %" PRIu64 " whole, %" PRIu64 " delta, %" PRIu64 " unchanged, %" PRIu64 " resent whole on char-server request.\n",
+		stats.full, stats.delta, stats.unchanged, stats.resend );
+	ShowInfo( "Character save bytes: %" PRIu64 " sent, %" PRIu64 " as whole saves (%.1f%% saved).\n",
+		stats.bytes, stats.bytes_full, stats.bytes_full ? 100.0 - 100.0 * stats.bytes / stats.bytes_full : 0.0 );
+
+	for( size_t g = 0; g < ARRAYLENGTH( chrif_save_groups ); g++ )
+		ShowInfo( "  %-10s changed in %" PRIu64 " delta saves.\n", chrif_save_groups[g].name, stats.groups[g] );
+
+	if( reset )
+		stats = {};
+}
+
+int32 chrif_save(map_session_data *sd, int32 flag) {
 	nullpo_retr(-1, sd);
 
 	pc_makesavestatus(sd);
@@ -314,18 +497,7 @@ int32 chrif_save(map_session_data *sd, int32 flag) {
 	if (sd->vars_dirty)
 		intif_saveregistry(sd);
 
-	mmo_charstatus_len = sizeof(sd->status) + 13;
-	WFIFOHEAD(char_fd, mmo_charstatus_len);
-	WFIFOW(char_fd,0) = 0x2b01;
-	WFIFOW(char_fd,2) = mmo_charstatus_len;
-	WFIFOL(char_fd,4) = sd->status.account_id;
-	WFIFOL(char_fd,8) = sd->status.char_id;
-	WFIFOB(char_fd,12) = (flag&CSAVE_QUIT) ? 1 : 0; //Flag to tell char-server this character is quitting.
-
-	// Copy the whole status into the packet
-	memcpy( WFIFOP( char_fd, 13 ), &sd->status, sizeof( struct mmo_charstatus ) );
-
-	WFIFOSET(char_fd, WFIFOW(char_fd,2));
+	chrif_save_status(sd, flag);
 
 	if( sd->status.pet_id > 0 && sd->pd )
 		intif_save_petdata(sd->status.account_id,&sd->pd->pet);
@@ -1790,6 +1962,7 @@ int32 chrif_parse(int32 fd) {
 			case 0x2b24: chrif_keepalive_ack(fd); break;
 			case 0x2b25: chrif_deadopt(RFIFOL(fd,2), RFIFOL(fd,6), RFIFOL(fd,10)); break;
 			case 0x2b27: chrif_authfail(fd); break;
+			case 0x2b29: chrif_save_resend(fd); break;
 			case 0x2b2b: chrif_parse_ack_vipActive(fd); break;
 			case 0x2b2f: chrif_bsdata_received(fd); break;
 			default:
@@ -61,6 +61,7 @@ int32 chrif_skillcooldown_save( const map_session_data& sd );
 int32 chrif_skillcooldown_load(int32 fd);
 
 int32 chrif_save(map_session_data* sd, int32 flag);
+void chrif_save_report(bool reset);
 int32 chrif_charselectreq(map_session_data* sd, uint32 s_ip);
 int32 chrif_changemapserver(map_session_data* sd, uint32 ip, uint16 port);
 
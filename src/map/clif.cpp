@@ -4,6 +4,7 @@
 
 #include "clif.hpp"
 
+#include <chrono>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -78,7 +79,6 @@ static inline int32 client_exp(t_exp exp) {
 /* for clif_clearunit_delayed */
 static struct eri *delay_clearunit_ers;
 
-struct s_packet_db packet_db[MAX_PACKET_DB + 1];
 unsigned long color_table[COLOR_MAX];
 
 #include "clif_obfuscation.hpp"
@@ -388,6 +388,39 @@ static bool clif_session_isValid(const map_session_data* sd) {
 	return ( sd != nullptr && session_isActive(sd->fd) );
 }
 
+/// Packet that is sent to multiple sessions.
+/// Only the first recipient gets a copy in its WFIFO, all other recipients share
+/// a single reference counted buffer, that is sent without copying it again.
+class ClifBroadcast{
+public:
+	const void* buf;
+	int32 len;
+
+	ClifBroadcast( const void* buf, int32 len ) : buf( buf ), len( len ){
+	}
+
+	void send( int32 fd ){
+		if( this->first ){
+			this->first = false;
+
+			WFIFOHEAD( fd, this->len );
+			memcpy( WFIFOP( fd, 0 ), this->buf, this->len );
+			WFIFOSET( fd, this->len );
+			return;
+		}
+
+		if( this->shared == nullptr ){
+			this->shared = socket_shared_packet( this->buf, this->len );
+		}
+
+		socket_send_shared( fd, this->shared );
+	}
+
+private:
+	bool first = true;
+	std::shared_ptr<s_shared_packet> shared;
+};
+
 /*==========================================
  * sub process of clif_send
  * Called from a map_foreachinallarea (grabs all players in specific area and subjects them to this function)
@@ -398,12 +431,10 @@ static bool clif_session_isValid(const map_session_data* sd) {
  * - AREA_WOS (AREA WITHOUT SELF) : Not run for self
  * - AREA_CHAT_WOC : Everyone in the area of your chat without a chat
  *------------------------------------------*/
-static int32 clif_send_sub(block_list *bl, va_list ap)
+static int32 clif_send_sub(block_list *bl, ClifBroadcast& broadcast, const block_list* src_bl, int32 type)
 {
-	block_list *src_bl;
 	map_session_data *sd;
-	unsigned char *buf;
-	int32 len, type, fd;
+	int32 fd;
 
 	nullpo_ret(bl);
 	nullpo_ret(sd = (map_session_data *)bl);
@@ -413,11 +444,6 @@ static int32 clif_send_sub(block_list *bl, va_list ap)
 		return 0;
 	}
 
-	buf = va_arg(ap,unsigned char*);
-	len = va_arg(ap,int32);
-	nullpo_ret(src_bl = va_arg(ap,block_list*));
-	type = va_arg(ap,int32);
-
 	switch(type) {
 	case AREA_WOS:
 		if (bl == src_bl)
@@ -453,10 +479,10 @@ static int32 clif_send_sub(block_list *bl, va_list ap)
 		!sd->sc.getSCE(SC_INTRAVISION) && battle_check_target(src_bl,sd,BCT_ENEMY) > 0)
 		return 0;
 
-	WFIFOHEAD(fd, len);
-	if (WFIFOP(fd,0) == buf) {
+	WFIFOHEAD(fd, broadcast.len);
+	if (WFIFOP(fd,0) == broadcast.buf) {
 		ShowError("WARNING: Invalid use of clif_send function\n");
-		ShowError("         Packet x%4x use a WFIFO of a player instead of to use a buffer.\n", WBUFW(buf,0));
+		ShowError("         Packet x%4x use a WFIFO of a player instead of to use a buffer.\n", WBUFW(broadcast.buf,0));
 		ShowError("         Please correct your code.\n");
 		// don't send to not move the pointer of the packet for next sessions in the loop
 		//WFIFOSET(fd,0);//## TODO is this ok?
@@ -464,8 +490,7 @@ static int32 clif_send_sub(block_list *bl, va_list ap)
 		return 0;
 	}
 
-	memcpy(WFIFOP(fd,0), buf, len);
-	WFIFOSET(fd,len);
+	broadcast.send(fd);
 
 	return 0;
 }
@@ -482,6 +507,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 	std::shared_ptr<s_battleground_data> bg;
 	int32 x0 = 0, x1 = 0, y0 = 0, y1 = 0, fd;
 	struct s_mapiterator* iter;
+	ClifBroadcast broadcast( buf, len );
 
 	if( type != ALL_CLIENT )
 		nullpo_ret(bl);
@@ -494,9 +520,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		iter = mapit_getallusers();
 		while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 			if( session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				broadcast.send( fd );
 			}
 		}
 		mapit_free(iter);
@@ -506,9 +530,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		iter = mapit_getallusers();
 		while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 			if( bl->m == tsd->m && session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				broadcast.send( fd );
 			}
 		}
 		mapit_free(iter);
@@ -521,12 +543,12 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		[[fallthrough]];
 	case AREA_WOC:
 	case AREA_WOS:
-		map_foreachinallarea(clif_send_sub, bl->m, bl->x-AREA_SIZE, bl->y-AREA_SIZE, bl->x+AREA_SIZE, bl->y+AREA_SIZE,
-			BL_PC, buf, len, bl, type);
+		map_foreachinallarea([&]( block_list* tbl ){ return clif_send_sub( tbl, broadcast, bl, type ); },
+			bl->m, bl->x-AREA_SIZE, bl->y-AREA_SIZE, bl->x+AREA_SIZE, bl->y+AREA_SIZE, BL_PC);
 		break;
 	case AREA_CHAT_WOC:
-		map_foreachinallarea(clif_send_sub, bl->m, bl->x-(AREA_SIZE-5), bl->y-(AREA_SIZE-5),
-			bl->x+(AREA_SIZE-5), bl->y+(AREA_SIZE-5), BL_PC, buf, len, bl, AREA_WOC);
+		map_foreachinallarea([&]( block_list* tbl ){ return clif_send_sub( tbl, broadcast, bl, AREA_WOC ); },
+			bl->m, bl->x-(AREA_SIZE-5), bl->y-(AREA_SIZE-5), bl->x+(AREA_SIZE-5), bl->y+(AREA_SIZE-5), BL_PC);
 		break;
 
 	case CHAT:
@@ -544,9 +566,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 				if (type == CHAT_WOS && cd->usersd[i] == sd)
 					continue;
 				if( session_isActive( fd = cd->usersd[i]->fd ) ){
-					WFIFOHEAD(fd,len);
-					memcpy(WFIFOP(fd,0), buf, len);
-					WFIFOSET(fd,len);
+					broadcast.send( fd );
 				}
 			}
 		}
@@ -583,9 +603,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 				if( (type == PARTY_AREA || type == PARTY_AREA_WOS) && (sd->x < x0 || sd->y < y0 || sd->x > x1 || sd->y > y1) )
 					continue;
 
-				WFIFOHEAD(fd, len);
-				memcpy(WFIFOP(fd, 0), buf, len);
-				WFIFOSET(fd, len);
+				broadcast.send( fd );
 			}
 			if (!enable_spy) //Skip unnecessary parsing. [Skotlex]
 				break;
@@ -593,9 +611,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 			iter = mapit_getallusers();
 			while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 				if( tsd->partyspy == p->party.party_id && session_isActive( fd = tsd->fd ) ){
-					WFIFOHEAD( fd, len );
-					memcpy( WFIFOP( fd, 0 ), buf, len );
-					WFIFOSET( tsd->fd, len );
+					broadcast.send( fd );
 				}
 			}
 			mapit_free(iter);
@@ -611,9 +627,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 			if( type == DUEL_WOS && bl->id == tsd->id )
 				continue;
 			if( sd->duel_group == tsd->duel_group && session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				broadcast.send( fd );
 			}
 		}
 		mapit_free(iter);
@@ -622,9 +636,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 	case SELF:
 		if( clif_session_isValid(sd) ){
 			fd = sd->fd;
-			WFIFOHEAD(fd,len);
-			memcpy(WFIFOP(fd,0), buf, len);
-			WFIFOSET(fd,len);
+			broadcast.send( fd );
 		}
 		break;
 
@@ -662,9 +674,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 				if( (type == GUILD_AREA || type == GUILD_AREA_WOS) && (sd->x < x0 || sd->y < y0 || sd->x > x1 || sd->y > y1) )
 					continue;
 
-				WFIFOHEAD(fd,len);
-				memcpy(WFIFOP(fd,0), buf, len);
-				WFIFOSET(fd,len);
+				broadcast.send( fd );
 			}
 		}
 		if (!enable_spy) //Skip unnecessary parsing. [Skotlex]
@@ -673,9 +683,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		iter = mapit_getallusers();
 		while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 			if( tsd->guildspy == g.guild_id && session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				broadcast.send( fd );
 			}
 		}
 		mapit_free(iter);
@@ -703,9 +711,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 					continue;
 				if( (type == BG_AREA || type == BG_AREA_WOS) && (sd->x < x0 || sd->y < y0 || sd->x > x1 || sd->y > y1) )
 					continue;
-				WFIFOHEAD(fd,len);
-				memcpy(WFIFOP(fd,0), buf, len);
-				WFIFOSET(fd,len);
+				broadcast.send( fd );
 			}
 		}
 		break;
@@ -718,9 +724,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 					continue;
 				}
 
-				WFIFOHEAD(fd,len);
-				memcpy(WFIFOP(fd,0), buf, len);
-				WFIFOSET(fd,len);
+				broadcast.send( fd );
 			}
 
 			if (!enable_spy) //Skip unnecessary parsing. [Skotlex]
@@ -729,9 +733,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 			iter = mapit_getallusers();
 			while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 				if( tsd->clanspy == clan->id && session_isActive( fd = tsd->fd ) ){
-					WFIFOHEAD(fd, len);
-					memcpy(WFIFOP(fd, 0), buf, len);
-					WFIFOSET(fd, len);
+					broadcast.send( fd );
 				}
 			}
 			mapit_free(iter);
@@ -999,7 +1001,6 @@ static TIMER_FUNC(clif_clearunit_delayed_sub){
 void clif_clearunit_delayed( const block_list* bl, clr_type type, t_tick tick)
 {
 	block_list *tbl = ers_alloc(delay_clearunit_ers, block_list);
-	tbl->next = nullptr;
 	tbl->prev = nullptr;
 	tbl->id = bl->id;
 	tbl->m = bl->m;
@@ -10442,7 +10443,7 @@ void clif_msg_color( const map_session_data& sd, e_clif_messages msg_id, uint32
 static bool clif_process_message(map_session_data* sd, bool whisperFormat, char* out_name, char* out_message, char* out_full_message ){
 	const char* separator = " : ";
 	int32 fd;
-	struct s_packet_db* info;
+	const struct s_packet_db* info;
 	uint16 packetLength, inputLength;
 	const char *input, *name, *message;
 	size_t nameLength, messageLength;
@@ -11610,7 +11611,7 @@ void clif_parse_ChangeDir(int32 fd, map_session_data *sd)
 {
 	unsigned char headdir, dir;
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	headdir = RFIFOB(fd,info->pos[0]);
 	dir = RFIFOB(fd,info->pos[1]);
@@ -11822,7 +11823,7 @@ void clif_parse_ActionRequest(int32 fd, map_session_data *sd)
 	}
 
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	clif_parse_ActionRequest_sub( *sd,
 		RFIFOB(fd,info->pos[1]),
 		RFIFOL(fd,info->pos[0]),
@@ -11838,7 +11839,9 @@ void clif_parse_ActionRequest(int32 fd, map_session_data *sd)
 ///     1 = char-select (disconnect)
 void clif_parse_Restart(int32 fd, map_session_data *sd)
 {
-	switch(RFIFOB(fd,packet_db[RFIFOW(fd,0)].pos[0])) {
+	const PACKET_CZ_RESTART& p = *reinterpret_cast<const PACKET_CZ_RESTART*>( RFIFOP( fd, 0 ) );
+
+	switch( p.type ){
 	case 0x00:
 		pc_respawn(sd,CLR_OUTSIGHT);
 		break;
@@ -12041,7 +12044,7 @@ void clif_parse_TakeItem(int32 fd, map_session_data *sd)
 /// There are various variants of this packet, some of them have padding between fields.
 void clif_parse_DropItem(int32 fd, map_session_data *sd){
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int32 item_index  = RFIFOW(fd,info->pos[0]) -2;
 	int32 item_amount = RFIFOW(fd,info->pos[1]) ;
 
@@ -12180,7 +12183,9 @@ void clif_parse_UnequipItem(int32 fd,map_session_data *sd)
 	else if (pc_cant_act2(sd))
 		return;
 
-	index = RFIFOW(fd,packet_db[RFIFOW(fd,0)].pos[0])-2;
+	const PACKET_CZ_REQ_TAKEOFF_EQUIP& p = *reinterpret_cast<const PACKET_CZ_REQ_TAKEOFF_EQUIP*>( RFIFOP( fd, 0 ) );
+
+	index = server_index( p.index );
 
 	if (battle_config.idletime_option&IDLE_USEITEM)
 		sd->idletime = last_tick;
@@ -12722,13 +12727,9 @@ void clif_parse_ChangeCart(int32 fd,map_session_data *sd)
 ///     Newer clients (2013-12-23 and newer) send the correct amount.
 void clif_parse_StatusUp(int32 fd,map_session_data *sd)
 {
-	int32 increase_amount = RFIFOB(fd,packet_db[RFIFOW(fd,0)].pos[1]);
+	const PACKET_CZ_STATUS_CHANGE& p = *reinterpret_cast<const PACKET_CZ_STATUS_CHANGE*>( RFIFOP( fd, 0 ) );
 
-	if( increase_amount < 0 ) {
-		ShowDebug("clif_parse_StatusUp: Negative 'increase' value sent by client! (fd: %d, value: %d)\n",
-			fd, increase_amount);
-	}
-	pc_statusup(sd,RFIFOW(fd,packet_db[RFIFOW(fd,0)].pos[0]),increase_amount);
+	pc_statusup( sd, p.type, p.amount );
 }
 
 
@@ -12756,7 +12757,9 @@ void clif_parse_traitstatus_up( int32 fd, map_session_data *sd ){
 /// 0112 <skill id>.W
 void clif_parse_SkillUp(int32 fd,map_session_data *sd)
 {
-	pc_skillup(sd,RFIFOW(fd,packet_db[RFIFOW(fd,0)].pos[0]));
+	const PACKET_CZ_UPGRADE_SKILLLEVEL& p = *reinterpret_cast<const PACKET_CZ_UPGRADE_SKILLLEVEL*>( RFIFOP( fd, 0 ) );
+
+	pc_skillup( sd, p.skill_id );
 }
 
 static void clif_parse_UseSkillToId_homun(homun_data *hd, map_session_data *sd, t_tick tick, uint16 skill_id, uint16 skill_lv, int32 target_id)
@@ -12992,7 +12995,7 @@ void clif_parse_skill_toid( map_session_data* sd, uint16 skill_id, uint16 skill_
 /// There are various variants of this packet, some of them have padding between fields.
 void clif_parse_UseSkillToId( int32 fd, map_session_data *sd ){
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd, 0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd, 0)];
 
 	clif_parse_skill_toid( sd, RFIFOW(fd, info->pos[1]), RFIFOW(fd, info->pos[0]), RFIFOL(fd, info->pos[2]) );
 }
@@ -13104,7 +13107,7 @@ void clif_parse_UseSkillToPos(int32 fd, map_session_data *sd)
 	}
 
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	if (pc_cant_act(sd))
 		return;
 	if (pc_issit(sd))
@@ -13133,7 +13136,7 @@ void clif_parse_UseSkillToPosMoreInfo(int32 fd, map_session_data *sd)
 	}
 
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	if (pc_cant_act(sd))
 		return;
 	if (pc_issit(sd))
@@ -13317,9 +13320,9 @@ void clif_parse_WeaponRefine( int32 fd, map_session_data *sd ){
 /// NOTE: If there were more than 254 items in the list, choice
 ///     overflows to choice%256.
 void clif_parse_NpcSelectMenu(int32 fd,map_session_data *sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
-	int32 npc_id = RFIFOL(fd,info->pos[0]);
-	uint8 select = RFIFOB(fd,info->pos[1]);
+	const PACKET_CZ_CHOOSE_MENU& p = *reinterpret_cast<const PACKET_CZ_CHOOSE_MENU*>( RFIFOP( fd, 0 ) );
+	int32 npc_id = p.GID;
+	uint8 select = p.select;
 
 #ifdef SECURE_NPCTIMEOUT
 	if( sd->npc_idle_timer == INVALID_TIMER && !sd->state.ignoretimeout )
@@ -13347,11 +13350,13 @@ void clif_parse_NpcSelectMenu(int32 fd,map_session_data *sd){
 /// 00b9 <npc id>.L
 void clif_parse_NpcNextClicked(int32 fd,map_session_data *sd)
 {
+	const PACKET_CZ_REQ_NEXT_SCRIPT& p = *reinterpret_cast<const PACKET_CZ_REQ_NEXT_SCRIPT*>( RFIFOP( fd, 0 ) );
+
 	if( battle_config.idletime_option&IDLE_NPC_NEXT ){
 		sd->idletime = last_tick;
 	}
 
-	npc_scriptcont(sd,RFIFOL(fd,packet_db[RFIFOW(fd,0)].pos[0]), false);
+	npc_scriptcont( sd, p.GID, false );
 }
 
 
@@ -13622,7 +13627,7 @@ void clif_parse_MoveToKafra(int32 fd, map_session_data *sd)
 {
 	int32 item_index, item_amount;
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	if (pc_istrading(sd))
 		return;
@@ -13654,7 +13659,7 @@ void clif_parse_MoveFromKafra(int32 fd,map_session_data *sd)
 {
 	int32 item_index, item_amount;
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	item_index = RFIFOW(fd,info->pos[0])-1;
 	item_amount = RFIFOL(fd,info->pos[1]);
@@ -13763,7 +13768,7 @@ void clif_storagepassword(map_session_data* sd, int16 info)
 /// NOTE: This packet is only available on certain non-kRO clients.
 void clif_parse_StoragePassword(int32 fd, map_session_data *sd){ //@TODO
 	// TODO: shuffle packet
-//	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+//	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 //	int32 type = RFIFOW(fd,info->pos[0]);
 //	char* password = RFIFOP(fd,info->pos[1]);
 //	char* new_password = RFIFOP(fd,info->pos[2]);
@@ -13940,7 +13945,7 @@ void clif_parse_PartyChangeOption(int32 fd, map_session_data *sd)
 	struct party_data *p;
 	int32 i,expflag;
 	int32 cmd = RFIFOW(fd,0);
-	struct s_packet_db* info = &packet_db[cmd];
+	const struct s_packet_db* info = &packet_db[cmd];
 
 	if( !sd->status.party_id )
 		return;
@@ -13992,7 +13997,7 @@ void clif_parse_PartyChangeLeader(int32 fd, map_session_data* sd){
 /// 0802 <level>.W <map id>.W { <job>.W }*6
 void clif_parse_PartyBookingRegisterReq(int32 fd, map_session_data* sd){
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int16 level = RFIFOW(fd,info->pos[0]);
 	int16 mapid = RFIFOW(fd,info->pos[1]);
 	int32 idxpbj = info->pos[2];
@@ -14026,7 +14031,7 @@ void clif_PartyBookingRegisterAck( const map_session_data* sd, int32 flag)
 /// Request to search for party booking advertisments (CZ_PARTY_BOOKING_REQ_SEARCH).
 /// 0804 <level>.W <map id>.W <job>.W <last index>.L <result count>.W
 void clif_parse_PartyBookingSearchReq(int32 fd, map_session_data* sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int16 level = RFIFOW(fd,info->pos[0]);
 	int16 mapid = RFIFOW(fd,info->pos[1]);
 	int16 job = RFIFOW(fd,info->pos[2]);
@@ -14217,7 +14222,7 @@ void clif_parse_OpenVending(int32 fd, map_session_data* sd){
 	}
 
 	int32 cmd = RFIFOW(fd,0);
-	struct s_packet_db* info = &packet_db[cmd];
+	const struct s_packet_db* info = &packet_db[cmd];
 	int16 len = (int16)RFIFOW(fd,info->pos[0]);
 	const char* message = RFIFOCP(fd,info->pos[1]);
 	const uint8* data = (uint8*)RFIFOP(fd,info->pos[3]);
@@ -14334,7 +14339,7 @@ void clif_parse_GuildRequestInfo(int32 fd, map_session_data *sd)
 void clif_parse_GuildChangePositionInfo(int32 fd, map_session_data *sd)
 {
 	int32 i;
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int32 len = RFIFOW(fd,info->pos[0]);
 	int32 idxgpos = info->pos[1];
 
@@ -14438,7 +14443,7 @@ void clif_parse_GuildChangeEmblem(int32 fd,map_session_data *sd){
 		return;
 	}
 
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	unsigned long emblem_len = RFIFOW(fd,info->pos[0])-4;
 	const uint8* emblem = RFIFOP(fd,info->pos[1]);
 	int32 emb_val=0;
@@ -14494,7 +14499,7 @@ void clif_parse_GuildChangeEmblem2(int32 fd, map_session_data* sd) {
 /// Guild notice update request (CZ_GUILD_NOTICE).
 /// 016e <guild id>.L <msg1>.60B <msg2>.120B
 void clif_parse_GuildChangeNotice(int32 fd, map_session_data* sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int32 guild_id = RFIFOL(fd,info->pos[0]);
 	char* msg1 = RFIFOCP(fd,info->pos[1]);
 	char* msg2 = RFIFOCP(fd,info->pos[2]);
@@ -14631,7 +14636,7 @@ void clif_parse_GuildRequestAlliance(int32 fd, map_session_data *sd)
 ///     0 = refuse
 ///     1 = accept
 void clif_parse_GuildReplyAlliance(int32 fd, map_session_data *sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	guild_reply_reqalliance(sd,
 	    RFIFOL(fd,info->pos[0]),
 	    RFIFOL(fd,info->pos[1]));
@@ -14644,7 +14649,7 @@ void clif_parse_GuildReplyAlliance(int32 fd, map_session_data *sd){
 ///     0 = Ally
 ///     1 = Enemy
 void clif_parse_GuildDelAlliance(int32 fd, map_session_data *sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	if(!sd->state.gmaster_flag)
 		return;
 
@@ -14930,7 +14935,7 @@ void clif_parse_GMRecall2(int32 fd, map_session_data* sd)
 /// 09ce <item/mob name>.100B [Ind/Yommy]
 void clif_parse_GM_Item_Monster(int32 fd, map_session_data *sd)
 {
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	StringBuf command;
 	char *str;
 //#if PACKETVER >= 20131218
@@ -15037,7 +15042,7 @@ void clif_parse_GMReqNoChat(int32 fd,map_session_data *sd)
 	int32 id, type, value;
 	map_session_data *dstsd;
 	char command[NAME_LENGTH+15];
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 
 	id = RFIFOL(fd,info->pos[0]);
@@ -15112,7 +15117,7 @@ void clif_parse_GMReqAccountName(int32 fd, map_session_data *sd)
 void clif_parse_GMChangeMapType(int32 fd, map_session_data *sd)
 {
 	int32 x,y,type;
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	if(! pc_has_permission(sd, PC_PERM_USE_CHANGEMAPTYPE) )
 		return;
@@ -15138,7 +15143,7 @@ void clif_parse_PMIgnore(int32 fd, map_session_data* sd)
 	char* nick;
 	uint8 type;
 	int32 i;
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	nick = RFIFOCP(fd,info->pos[0]);
 	nick[NAME_LENGTH-1] = '\0'; // to be sure that the player name has at most 23 characters
@@ -15489,7 +15494,7 @@ void clif_parse_FriendsListReply(int32 fd, map_session_data *sd)
 	map_session_data *f_sd;
 	uint32 account_id;
 	char reply;
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	account_id = RFIFOL(fd,info->pos[0]);
 	//char_id = RFIFOL(fd,info->pos[1]);
@@ -15558,7 +15563,7 @@ void clif_parse_FriendsListRemove(int32 fd, map_session_data *sd)
 	map_session_data *f_sd = nullptr;
 	uint32 account_id, char_id;
 	int32 i, j;
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	account_id = RFIFOL(fd,info->pos[0]);
 	char_id = RFIFOL(fd,info->pos[1]);
@@ -15746,7 +15751,7 @@ void clif_parse_HomMoveTo(int32 fd, map_session_data *sd){
 void clif_parse_HomAttack(int32 fd,map_session_data *sd)
 {
 	block_list *bl = nullptr;
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int32 id = RFIFOL(fd,info->pos[0]);
 	int32 target_id = RFIFOL(fd,info->pos[1]);
 	int32 action_type = RFIFOB(fd,info->pos[2]);
@@ -16725,7 +16730,7 @@ void clif_parse_Mail_return(int32 fd, map_session_data *sd){
 /// 0247 <index>.W <amount>.L (CZ_MAIL_ADD_ITEM)
 /// 0a04 <index>.W <amount>.W (CZ_REQ_ADD_ITEM_TO_MAIL)
 void clif_parse_Mail_setattach(int32 fd, map_session_data *sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	uint16 idx = RFIFOW(fd,info->pos[0]);
 #if PACKETVER < 20150513
 	int32 amount = RFIFOL(fd,info->pos[1]);
@@ -16818,7 +16823,7 @@ void clif_parse_Mail_winopen(int32 fd, map_session_data *sd)
 /// 0a6e <packet len>.W <recipient>.24B <sender>.24B <zeny>.Q <title length>.W <body length>.W <char id>.L <title>.?B <body>.?B (CZ_REQ_WRITE_MAIL2)
 void clif_parse_Mail_send(int32 fd, map_session_data *sd){
 #if PACKETVER < 20150513
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 
 	if( !chrif_isconnected() )
 		return;
@@ -16988,7 +16993,7 @@ void clif_parse_Auction_cancelreg(int32 fd, map_session_data *sd){
 /// Request to add an item to the action (CZ_AUCTION_ADD_ITEM).
 /// 024c <index>.W <count>.L
 void clif_parse_Auction_setitem(int32 fd, map_session_data *sd){
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int32 idx = RFIFOW(fd,info->pos[0]) - 2;
 	int32 amount = RFIFOL(fd,info->pos[1]); // Always 1
 
@@ -19051,7 +19056,7 @@ void clif_parse_ItemListWindowSelected(int32 fd, map_session_data* sd) {
 	}
 
 	// TODO: shuffle packet
-	struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
+	const struct s_packet_db* info = &packet_db[RFIFOW(fd,0)];
 	int32 n = (RFIFOW(fd,info->pos[0])-12) / 4;
 	int32 type = RFIFOL(fd,info->pos[1]);
 	int32 flag = RFIFOL(fd,info->pos[2]); // Button clicked: 0 = Cancel, 1 = OK
@@ -25661,6 +25666,248 @@ void clif_parse_MoveFromKafraFav( int32 fd, map_session_data* sd ){
 #endif
 }
 
+/**
+ * Builds the packet database from clif_packetdb.hpp and clif_shuffle.hpp.
+ * Runs at compile time, so the lengths and handlers of the configured PACKETVER are constants
+ * and a packet with too many positions fails to compile.
+ * Later definitions of a packet replace the length, handler and leading positions of earlier ones.
+ */
+static constexpr std::array<s_packet_db, MAX_PACKET_DB + 1> packetdb_build(){
+	std::array<s_packet_db, MAX_PACKET_DB + 1> db = {};
+
+	auto add = [&db]( uint16 cmd, int16 length, void (*func)(int32, map_session_data *), std::initializer_list<int16> positions ){
+		if( cmd <= 0 || cmd > MAX_PACKET_DB ){
+			return;
+		}
+
+		s_packet_db& entry = db[cmd];
+		size_t i = 0;
+
+		entry.len = length;
+		entry.func = func;
+
+		for( int16 offset : positions ){
+			if( offset == 0 ){
+				break;
+			}
+
+			entry.pos[i++] = offset;
+		}
+	};
+
+#define packet(cmd,length) add(cmd,length,nullptr,{})
+#define parseable_packet(cmd,length,func,...) add(cmd,length,func,{__VA_ARGS__})
+#include "clif_packetdb.hpp"
+#include "clif_shuffle.hpp"
+#undef packet
+#undef parseable_packet
+
+	return db;
+}
+
+constexpr std::array<s_packet_db, MAX_PACKET_DB + 1> packet_db = packetdb_build();
+
+/// File the parsed client packets are appended to, see clif_packet_record
+static FILE* clif_packet_record_fp = nullptr;
+
+/**
+ * Returns the length of a client packet.
+ * @param cmd: Packet id, decrypted and known to the packet database
+ * @param buf: Received data starting with the packet
+ * @param rest: Number of bytes received
+ * @return Packet length, 0 if the length is not received yet or -1 if it is invalid
+ */
+static inline int32 clif_packet_length( uint16 cmd, const uint8* buf, size_t rest ){
+	int32 length = packet_db[cmd].len;
+
+	if( length != -1 ){
+		return length;
+	}
+
+	// variable-length packet
+	if( rest < 4 ){
+		return 0;
+	}
+
+	length = buf[2] | ( buf[3] << 8 );
+
+	if( length < 4 || length > 32768 ){
+		return -1;
+	}
+
+	return length;
+}
+
+/**
+ * Calls the handler of a client packet, if the session is in a state that accepts it.
+ * @param fd: Session the packet is read from
+ * @param sd: Player of the session or nullptr
+ * @param cmd: Packet id, decrypted and known to the packet database
+ * @return false if the packet has no handler
+ */
+static inline bool clif_packet_dispatch( int32 fd, map_session_data* sd, uint16 cmd ){
+	const s_packet_db& info = packet_db[cmd];
+
+	if( info.func == nullptr ){
+		return false;
+	}
+
+	if( info.func == clif_parse_debug )
+		info.func(fd, sd);
+	else if( !sd && info.func != clif_parse_WantToConnection )
+		; //Only valid packet when there is no session
+	else if( sd && sd->prev == nullptr && info.func != clif_parse_LoadEndAck )
+		; //Only valid packet when player is not on a map
+	else
+		info.func(fd, sd);
+
+	return true;
+}
+
+/**
+ * Starts or stops recording the client packets parsed by the map-server, for clif_packet_benchmark.
+ * @param file: File to append to or nullptr to stop
+ * @return true if the file could be opened
+ */
+bool clif_packet_record( const char* file ){
+	if( clif_packet_record_fp != nullptr ){
+		fclose( clif_packet_record_fp );
+		clif_packet_record_fp = nullptr;
+		ShowInfo( "Stopped recording client packets.\n" );
+	}
+
+	if( file == nullptr ){
+		return true;
+	}
+
+	if( ( clif_packet_record_fp = fopen( file, "ab" ) ) == nullptr ){
+		ShowError( "clif_packet_record: Failed to open '%s'.\n", file );
+		return false;
+	}
+
+	ShowInfo( "Recording client packets to '%s'.\n", file );
+	return true;
+}
+
+/**
+ * Checks if a handler would log the player in, out or over to another server, which a replay must not do.
+ */
+static inline bool clif_packet_benchmark_skip( void (*func)(int32, map_session_data*) ){
+	return func == clif_parse_WantToConnection || func == clif_parse_LoadEndAck || func == clif_parse_Restart || func == clif_parse_QuitGame;
+}
+
+/**
+ * Replays recorded client packets through the framing of clif_parse.
+ * Without a player the handlers are only looked up. With a player every packet is dispatched
+ * into its real handler on a stub session, that is swapped in as the player's connection
+ * while the replay runs: what is sent to the player is discarded, what is sent to the area
+ * still reaches the other players around. Packets that would log the player in or out are skipped.
+ * @param file: File written by clif_packet_record
+ * @param runs: Number of passes over the file
+ * @param sd: Player to replay the packets as or nullptr
+ */
+void clif_packet_benchmark( const char* file, int32 runs, map_session_data* sd ){
+	FILE* fp = fopen( file, "rb" );
+
+	if( fp == nullptr ){
+		ShowError( "clif_packet_benchmark: Failed to open '%s'.\n", file );
+		return;
+	}
+
+	std::vector<uint8> data;
+	uint8 chunk[4096];
+	size_t read;
+
+	while( ( read = fread( chunk, 1, sizeof( chunk ), fp ) ) > 0 ){
+		data.insert( data.end(), chunk, chunk + read );
+	}
+	fclose( fp );
+
+	if( data.empty() ){
+		ShowWarning( "clif_packet_benchmark: No packets found in '%s'.\n", file );
+		return;
+	}
+
+	int32 fd = -1, sd_fd = 0;
+
+	if( sd != nullptr ){
+		if( ( fd = socket_stub_open() ) < 0 ){
+			ShowError( "clif_packet_benchmark: No free session for the replay.\n" );
+			return;
+		}
+
+		sd_fd = sd->fd;
+		session[fd]->session_data = sd;
+		if( session_isValid( sd_fd ) ){
+			session[fd]->client_addr = session[sd_fd]->client_addr;
+		}
+		sd->fd = fd;
+	}
+
+	size_t packets = 0, handled = 0, skipped = 0, offset = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for( int32 run = 0; run < runs; run++ ){
+		if( fd > 0 ){
+			socket_stub_fill( fd, data.data(), data.size() );
+		}
+
+		for( offset = 0; data.size() - offset >= 2; ){
+			const uint8* buf = &data[offset];
+			uint16 cmd = buf[0] | ( buf[1] << 8 );
+
+			if( cmd < MIN_PACKET_DB || cmd > MAX_PACKET_DB || packet_db[cmd].len == 0 ){
+				break;
+			}
+
+			int32 length = clif_packet_length( cmd, buf, data.size() - offset );
+
+			if( length <= 0 || static_cast<size_t>( length ) > data.size() - offset ){
+				break;
+			}
+
+			packets++;
+
+			if( fd < 0 ){
+				if( packet_db[cmd].func != nullptr ){
+					handled++;
+				}
+			}else if( clif_packet_benchmark_skip( packet_db[cmd].func ) ){
+				skipped++;
+			}else if( clif_packet_dispatch( fd, sd, cmd ) ){
+				handled++;
+			}
+
+			offset += length;
+
+			if( fd > 0 ){
+				RFIFOSKIP( fd, length );
+				socket_stub_discard( fd );
+			}
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	if( fd > 0 ){
+		sd->fd = sd_fd;
+		socket_stub_close( fd );
+	}
+
+	if( packets == 0 ){
+		ShowWarning( "clif_packet_benchmark: No packets found in '%s'.\n", file );
+		return;
+	}
+
+	if( offset != data.size() ){
+		ShowWarning( "clif_packet_benchmark: Stopped at an invalid packet at offset %" PRIuPTR " of '%s'.\n", offset, file );
+	}
+
+	ShowInfo( "%" PRIuPTR " packets (%" PRIuPTR " %s, %" PRIuPTR " skipped) in %d runs: %" PRId64 " ns/packet.\n", packets / runs, handled / runs,
+		fd > 0 ? "dispatched" : "with a handler", skipped / runs, runs,
+		(int64)std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count() / (int64)packets );
+}
+
 /*==========================================
  * Main client packet processing function
  *------------------------------------------*/
@@ -25755,20 +26002,16 @@ static int32 clif_parse(int32 fd)
 	}
 
 	// determine real packet length
-	packet_len = packet_db[cmd].len;
-	if (packet_len == -1) { // variable-length packet
-		if (RFIFOREST(fd) < 4)
-			return 0;
-
-		packet_len = RFIFOW(fd,2);
-		if (packet_len < 4 || packet_len > 32768) {
-			ShowWarning("clif_parse: Received packet 0x%04x specifies invalid packet_len (%d), disconnecting session #%d.\n", cmd, packet_len, fd);
+	packet_len = clif_packet_length( cmd, RFIFOP( fd, 0 ), RFIFOREST( fd ) );
+	if (packet_len == 0)
+		return 0;
+	if (packet_len < 0) {
+		ShowWarning("clif_parse: Received packet 0x%04x specifies invalid packet_len (%d), disconnecting session #%d.\n", cmd, RFIFOW(fd,2), fd);
 #ifdef DUMP_INVALID_PACKET
-			ShowDump(RFIFOP(fd,0), RFIFOREST(fd));
+		ShowDump(RFIFOP(fd,0), RFIFOREST(fd));
 #endif
-			set_eof(fd);
-			return 0;
-		}
+		set_eof(fd);
+		return 0;
 	}
 	if ((int32)RFIFOREST(fd) < packet_len){
 		ShowWarning( "clif_parse: Received packet 0x%04x with expected packet length %d, but only %d bytes remaining, disconnecting session #%d.\n", cmd, packet_len, RFIFOREST( fd ), fd );
@@ -25785,64 +26028,24 @@ static int32 clif_parse(int32 fd)
 		sd->cryptKey = ((sd->cryptKey * clif_cryptKey[1]) + clif_cryptKey[2]) & 0xFFFFFFFF; // Update key for the next packet
 #endif
 
-	if( packet_db[cmd].func == clif_parse_debug )
-		packet_db[cmd].func(fd, sd);
-	else if( packet_db[cmd].func != nullptr ) {
-		if( !sd && packet_db[cmd].func != clif_parse_WantToConnection )
-			; //Only valid packet when there is no session
-		else
-		if( sd && sd->prev == nullptr && packet_db[cmd].func != clif_parse_LoadEndAck )
-			; //Only valid packet when player is not on a map
-		else
-			packet_db[cmd].func(fd, sd);
-	}
+	if( clif_packet_record_fp != nullptr )
+		fwrite( RFIFOP( fd, 0 ), 1, packet_len, clif_packet_record_fp );
+
+	if( !clif_packet_dispatch( fd, sd, cmd ) ){
 #ifdef DUMP_UNKNOWN_PACKET
-	else DumpUnknown(fd,sd,cmd,packet_len);
+		DumpUnknown(fd,sd,cmd,packet_len);
 #endif
+	}
 	RFIFOSKIP(fd, packet_len);
 	}; // main loop end
 
 	return 0;
 }
 
-void packetdb_addpacket( uint16 cmd, uint16 length, void (*func)(int32, map_session_data *), ... ){
-	va_list argp;
-	int32 i;
-
-	if(cmd <= 0 || cmd > MAX_PACKET_DB)
-		return;
-
-	packet_db[cmd].len = length;
-	packet_db[cmd].func = func;
-
-	va_start(argp, func);
-
-	for( i = 0; i < MAX_PACKET_POS; i++ ){
-		int32 offset = va_arg(argp, int32);
-
-		if( offset == 0 ){
-			break;
-		}
-
-		packet_db[cmd].pos[i] = offset;
-	}
-
-	if( i == MAX_PACKET_POS ){
-		ShowError( "Too many positions found for packet 0x%04x (max=%d).\n", cmd, MAX_PACKET_POS );
-	}
-
-	va_end(argp);
-}
-
 /*==========================================
- * Reads packets and setups its array reference
+ * Reports the packet setup, the packet database itself is built at compile time
  *------------------------------------------*/
 void packetdb_readdb(){
-	memset(packet_db,0,sizeof(packet_db));
-
-#include "clif_packetdb.hpp"
-#include "clif_shuffle.hpp"
-
 	ShowStatus("Using packet version: " CL_WHITE "%d" CL_RESET ".\n", PACKETVER);
 
 #ifdef PACKET_OBFUSCATION
@@ -4,6 +4,7 @@
 #ifndef CLIF_HPP
 #define CLIF_HPP
 
+#include <array>
 #include <cstdarg>
 #include <vector>
 
@@ -201,7 +202,10 @@ enum class e_purchase_result : uint8{
 };
 
 #define packet_len(cmd) packet_db[cmd].len
-extern struct s_packet_db packet_db[MAX_PACKET_DB+1];
+extern const std::array<s_packet_db, MAX_PACKET_DB + 1> packet_db;
+
+bool clif_packet_record( const char* file );
+void clif_packet_benchmark( const char* file, int32 runs, map_session_data* sd = nullptr );
 
 // local define
 enum send_target : uint8_t {
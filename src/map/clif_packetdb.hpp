@@ -4,9 +4,6 @@
 #ifndef CLIF_PACKETDB_HPP
 #define CLIF_PACKETDB_HPP
 
-	#define packet(cmd,length) packetdb_addpacket(cmd,length,nullptr,0)
-	#define parseable_packet(cmd,length,func,...) packetdb_addpacket(cmd,length,func,__VA_ARGS__,0)
-
 	packet(0x0064,55);
 	packet(0x0065,17);
 	packet(0x0066,6);
@@ -56,13 +53,13 @@
 	parseable_packet(0x00a7,8,clif_parse_UseItem,2,4);
 	packet( useItemAckType, sizeof( struct PACKET_ZC_USE_ITEM_ACK ) );
 	parseable_packet( HEADER_CZ_REQ_WEAR_EQUIP, sizeof( PACKET_CZ_REQ_WEAR_EQUIP ), clif_parse_EquipItem, 0 );
-	parseable_packet(0x00ab,4,clif_parse_UnequipItem,2);
+	parseable_packet( HEADER_CZ_REQ_TAKEOFF_EQUIP, sizeof( PACKET_CZ_REQ_TAKEOFF_EQUIP ), clif_parse_UnequipItem, 0 );
 	packet(0x00ae,-1);
-	parseable_packet(0x00b2,3,clif_parse_Restart,2);
-	parseable_packet(0x00b8,7,clif_parse_NpcSelectMenu,2,6);
-	parseable_packet(0x00b9,6,clif_parse_NpcNextClicked,2);
+	parseable_packet( HEADER_CZ_RESTART, sizeof( PACKET_CZ_RESTART ), clif_parse_Restart, 0 );
+	parseable_packet( HEADER_CZ_CHOOSE_MENU, sizeof( PACKET_CZ_CHOOSE_MENU ), clif_parse_NpcSelectMenu, 0 );
+	parseable_packet( HEADER_CZ_REQ_NEXT_SCRIPT, sizeof( PACKET_CZ_REQ_NEXT_SCRIPT ), clif_parse_NpcNextClicked, 0 );
 	packet(0x00ba,2);
-	parseable_packet(0x00bb,5,clif_parse_StatusUp,2,4);
+	parseable_packet( HEADER_CZ_STATUS_CHANGE, sizeof( PACKET_CZ_STATUS_CHANGE ), clif_parse_StatusUp, 0 );
 	parseable_packet( HEADER_CZ_REQ_EMOTION, sizeof(  PACKET_CZ_REQ_EMOTION ), clif_parse_Emotion, 0 );
 	parseable_packet(0x00c1,2,clif_parse_HowManyConnections,0);
 	packet(0x00c3,8);
@@ -107,12 +104,12 @@
 	packet(0x0104,79);
 	parseable_packet(0x0108,-1,clif_parse_PartyMessage,2,4);
 	packet(0x0109,-1);
-	parseable_packet(0x0112,4,clif_parse_SkillUp,2);
+	parseable_packet( HEADER_CZ_UPGRADE_SKILLLEVEL, sizeof( PACKET_CZ_UPGRADE_SKILLLEVEL ), clif_parse_SkillUp, 0 );
 	parseable_packet(0x0113,10,clif_parse_UseSkillToId,2,4,6);
 	packet(0x0114,31);
 	packet(0x0115,35);
 	parseable_packet(0x0116,10,clif_parse_UseSkillToPos,2,4,6,8);
-	parseable_packet(0x0118,2,clif_parse_StopAttack,0);
+	parseable_packet( HEADER_CZ_CANCEL_LOCKON, sizeof( PACKET_CZ_CANCEL_LOCKON ), clif_parse_StopAttack, 0 );
 	packet(0x0119,13);
 	parseable_packet( HEADER_CZ_SELECT_WARPPOINT, sizeof( PACKET_CZ_SELECT_WARPPOINT ), clif_parse_UseSkillMap, 0 );
 	parseable_packet(0x011d,2,clif_parse_RequestMemo,0);
@@ -4925,6 +4925,38 @@ static void itemdb_read(void) {
 		itemdb_parse_roulette_db();
 }
 
+/**
+ * Compiles the equipment scripts of items, combos and random options that only
+ * run constant bonus commands into native bonus tables, see script_compile_bonus.
+ * Called once the skill database is loaded, since bonuses may refer to skill names.
+ */
+void itemdb_compile_bonus_scripts(void) {
+	uint32 total = 0, compiled = 0;
+
+	for (const auto &it : item_db) {
+		if (it.second->script != nullptr) {
+			total++;
+			compiled += script_compile_bonus(it.second->script);
+		}
+	}
+
+	for (const auto &it : itemdb_combo) {
+		if (it.second->script != nullptr) {
+			total++;
+			compiled += script_compile_bonus(it.second->script);
+		}
+	}
+
+	for (const auto &it : random_option_db) {
+		if (it.second->script != nullptr) {
+			total++;
+			compiled += script_compile_bonus(it.second->script);
+		}
+	}
+
+	ShowStatus("Compiled '" CL_WHITE "%u" CL_RESET "' of '" CL_WHITE "%u" CL_RESET "' item bonus scripts into native bonus tables.\n", compiled, total);
+}
+
 /*==========================================
  * Initialize / Finalize
  *------------------------------------------*/
@@ -4983,6 +5015,7 @@ void itemdb_reload(void) {
 
 	// read new data
 	itemdb_read();
+	itemdb_compile_bonus_scripts();
 	cashshop_reloaddb();
 
 	mob_reload_itemmob_data();
@@ -5004,6 +5037,7 @@ void itemdb_reload(void) {
 * Finalizing Item DB
 */
 void do_final_itemdb(void) {
+	status_bonus_cache_clear(); // The recorded bonuses refer to the scripts being freed
 	item_db.clear();
 	itemdb_combo.clear();
 	itemdb_group.clear();
@@ -3863,6 +3863,7 @@ bool itemdb_parse_roulette_db(void);
 void itemdb_gen_itemmoveinfo();
 
 void itemdb_reload(void);
+void itemdb_compile_bonus_scripts(void);
 
 void do_final_itemdb(void);
 void do_init_itemdb(void);
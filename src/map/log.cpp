@@ -3,13 +3,26 @@
 
 #include "log.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errmsg.h> // CR_SERVER_GONE_ERROR, CR_SERVER_LOST
 
 #include <common/cbasetypes.hpp>
 #include <common/nullpo.hpp>
 #include <common/showmsg.hpp>
 #include <common/sql.hpp> // SQL_INNODB
 #include <common/strlib.hpp>
+#include <common/timer.hpp>
+#include <common/utils.hpp>
 
 #include "battle.hpp"
 #include "homunculus.hpp"
@@ -54,6 +67,325 @@ struct Log_Config log_config;
 #define LOG_QUERY "INSERT DELAYED"
 #endif
 
+/// Maximum length of a multi-row INSERT built by the asynchronous writer, keeps it below max_allowed_packet
+#define LOG_SQL_ASYNC_STATEMENT_MAX (512*1024)
+
+/// Row waiting for the asynchronous writer
+struct s_log_sql_row {
+	std::string insert; ///< Statement up to the VALUES keyword, rows with the same one are written together
+	std::string values; ///< Values of the row in parentheses
+};
+
+/// Asynchronous SQL log writer, see log_sql_async_start.
+/// The writer thread owns its own MySQL connection and only uses the MySQL client
+/// library and the standard library, since the memory manager is not thread-safe.
+static struct s_log_sql_async {
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wakeup; ///< Wakes up the writer
+	std::condition_variable space; ///< Wakes up the main thread waiting for room in the queue
+	std::deque<s_log_sql_row> queue;
+	std::vector<std::string> errors; ///< Errors of the writer, shown by the main thread
+	MYSQL* handle = nullptr;
+	bool running = false;
+	bool stop = false;
+	bool flush = false; ///< Write the queue now instead of waiting for the flush interval
+
+	// Statistics, see log_sql_async_report
+	uint64 queued = 0; ///< Rows queued
+	uint64 written = 0; ///< Rows written
+	uint64 statements = 0; ///< INSERT statements run
+	uint64 failed = 0; ///< Rows lost to failed statements
+	uint64 dropped = 0; ///< Rows dropped because the queue was full
+	uint64 waits = 0; ///< Times the main thread waited for room in the queue
+	size_t peak = 0; ///< Highest queue depth
+} log_sql_async;
+
+/// Connects the asynchronous writer's MySQL handle to the log database
+/// @return true on success, otherwise the handle is closed and the error is in errmsg
+static bool log_sql_async_connect( std::string& errmsg ){
+	MYSQL* handle = mysql_init( nullptr );
+
+	if( handle == nullptr ){
+		errmsg = "out of memory";
+		return false;
+	}
+
+	if( mysql_real_connect( handle, log_db_ip.c_str(), log_db_id.c_str(), log_db_pw.c_str(), log_db_db.c_str(), log_db_port, nullptr, 0 ) == nullptr
+	||  ( !default_codepage.empty() && mysql_set_character_set( handle, default_codepage.c_str() ) != 0 ) ){
+		errmsg = mysql_error( handle );
+		mysql_close( handle );
+		return false;
+	}
+
+	log_sql_async.handle = handle;
+
+	return true;
+}
+
+/// Runs a statement on the asynchronous writer's connection, reconnecting once if the server went away
+/// @return true on success, otherwise the error is in errmsg
+static bool log_sql_async_query( const std::string& query, std::string& errmsg ){
+	for( int32 attempt = 0; attempt < 2; attempt++ ){
+		if( log_sql_async.handle == nullptr && !log_sql_async_connect( errmsg ) )
+			return false;
+
+		if( mysql_real_query( log_sql_async.handle, query.c_str(), static_cast<unsigned long>( query.length() ) ) == 0 )
+			return true;
+
+		uint32 error = mysql_errno( log_sql_async.handle );
+
+		errmsg = mysql_error( log_sql_async.handle );
+
+		if( error != CR_SERVER_GONE_ERROR && error != CR_SERVER_LOST )
+			return false;
+
+		mysql_close( log_sql_async.handle );
+		log_sql_async.handle = nullptr;
+	}
+
+	return false;
+}
+
+/// Writes rows as multi-row INSERTs, grouped by statement and in queue order within each statement
+/// @param rows: Rows to write
+static void log_sql_async_write( std::deque<s_log_sql_row>& rows ){
+	std::unordered_map<std::string, std::vector<std::string*>> tables;
+	std::vector<const std::string*> order;
+
+	for( s_log_sql_row& row : rows ){
+		auto result = tables.try_emplace( row.insert );
+
+		if( result.second )
+			order.push_back( &result.first->first );
+		result.first->second.push_back( &row.values );
+	}
+
+	uint64 written = 0, statements = 0, failed = 0;
+	std::vector<std::string> errors;
+	std::string query;
+
+	for( const std::string* insert : order ){
+		std::vector<std::string*>& values = tables[*insert];
+
+		for( size_t i = 0; i < values.size(); ){
+			size_t count = 0;
+
+			query = *insert;
+			for( ; i < values.size() && count < static_cast<size_t>( log_config.sql_async_rows ); i++, count++ ){
+				if( count > 0 && query.length() + values[i]->length() + 1 > LOG_SQL_ASYNC_STATEMENT_MAX )
+					break;
+				if( count > 0 )
+					query += ',';
+				query += *values[i];
+			}
+
+			std::string errmsg;
+
+			statements++;
+			if( log_sql_async_query( query, errmsg ) )
+				written += count;
+			else{
+				failed += count;
+				errors.push_back( errmsg );
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock( log_sql_async.mutex );
+
+	log_sql_async.written += written;
+	log_sql_async.statements += statements;
+	log_sql_async.failed += failed;
+	for( std::string& error : errors )
+		log_sql_async.errors.push_back( std::move( error ) );
+}
+
+/// Main function of the asynchronous writer thread.
+/// Waits until the queue holds enough rows for a full statement, a flush is
+/// requested or the flush interval expires, then writes everything queued.
+static void log_sql_async_main(){
+	mysql_thread_init();
+
+	std::unique_lock<std::mutex> lock( log_sql_async.mutex );
+
+	for(;;){
+		log_sql_async.wakeup.wait_for( lock, std::chrono::milliseconds( log_config.sql_async_interval ), []{
+			return log_sql_async.stop || log_sql_async.flush || log_sql_async.queue.size() >= static_cast<size_t>( log_config.sql_async_rows );
+		} );
+
+		std::deque<s_log_sql_row> rows;
+
+		rows.swap( log_sql_async.queue );
+		log_sql_async.flush = false;
+		log_sql_async.space.notify_all();
+
+		if( rows.empty() ){
+			if( log_sql_async.stop )
+				break;
+			continue;
+		}
+
+		lock.unlock();
+		log_sql_async_write( rows );
+		lock.lock();
+	}
+
+	lock.unlock();
+
+	if( log_sql_async.handle != nullptr ){
+		mysql_close( log_sql_async.handle );
+		log_sql_async.handle = nullptr;
+	}
+
+	mysql_thread_end();
+}
+
+/// Shows the errors of the asynchronous writer
+static void log_sql_async_show_errors(){
+	std::vector<std::string> errors;
+
+	{
+		std::lock_guard<std::mutex> lock( log_sql_async.mutex );
+		errors.swap( log_sql_async.errors );
+	}
+
+	for( const std::string& error : errors )
+		ShowSQL( "DB error - %s\n", error.c_str() );
+}
+
+static TIMER_FUNC(log_sql_async_timer){
+	log_sql_async_show_errors();
+	return 0;
+}
+
+/// Starts the asynchronous SQL writer if enabled
+void log_sql_async_start(){
+	if( !log_config.sql_logs || !log_config.sql_async || log_sql_async.running )
+		return;
+
+	std::string errmsg;
+
+	if( !log_sql_async_connect( errmsg ) ){
+		ShowError( "log_sql_async_start: Couldn't connect the asynchronous log writer: %s. Logs are written synchronously.\n", errmsg.c_str() );
+		return;
+	}
+
+	log_sql_async.stop = false;
+	log_sql_async.running = true;
+	log_sql_async.writer = std::thread( log_sql_async_main );
+
+	add_timer_func_list( log_sql_async_timer, "log_sql_async_timer" );
+	add_timer_interval( gettick() + 1000, log_sql_async_timer, 0, 0, 1000 );
+
+	ShowStatus( "Writing SQL logs asynchronously (up to %d rows per statement every %dms, queue of %d rows).\n", log_config.sql_async_rows, log_config.sql_async_interval, log_config.sql_async_queue_max );
+}
+
+/// Writes the queued rows and stops the asynchronous SQL writer
+void log_sql_async_stop(){
+	if( !log_sql_async.running )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( log_sql_async.mutex );
+		log_sql_async.stop = true;
+	}
+	log_sql_async.wakeup.notify_one();
+	log_sql_async.writer.join();
+	log_sql_async.running = false;
+
+	log_sql_async_show_errors();
+	log_sql_async_report( false );
+}
+
+/// Shows the statistics of the asynchronous SQL writer
+/// @param reset: Resets the statistics after showing them
+void log_sql_async_report( bool reset ){
+	std::lock_guard<std::mutex> lock( log_sql_async.mutex );
+	s_log_sql_async& async = log_sql_async;
+
+	if( !async.running && async.queued == 0 ){
+		ShowInfo( "Asynchronous SQL logs are disabled.\n" );
+		return;
+	}
+
+	ShowInfo( "SQL log queue: %" PRIuPTR " rows waiting, peak of %" PRIuPTR " out of %d.\n", async.queue.size(), async.peak, log_config.sql_async_queue_max );
+	ShowInfo( "SQL log rows: %" PRIu64 " queued, %" PRIu64 " written in %" PRIu64 " statements (%.1f rows per statement), %" PRIu64 " failed, %" PRIu64 " dropped, %" PRIu64 " waits for a full queue.\n",
+		async.queued, async.written, async.statements, async.statements ? static_cast<double>( async.written ) / async.statements : 0.0, async.failed, async.dropped, async.waits );
+
+	if( reset ){
+		async.queued = async.written = async.statements = async.failed = async.dropped = async.waits = 0;
+		async.peak = async.queue.size();
+	}
+}
+
+/// Current time as SQL value of a log row.
+/// Rows written by the asynchronous writer keep the time they were logged at.
+static const char* log_sql_time(){
+	static char timestring[32];
+	static time_t last = 0;
+
+	if( !log_sql_async.running )
+		return "NOW()";
+
+	time_t curtime = time( nullptr );
+
+	if( curtime != last ){
+		strftime( timestring, sizeof( timestring ), "'%Y-%m-%d %H:%M:%S'", localtime( &curtime ) );
+		last = curtime;
+	}
+
+	return timestring;
+}
+
+/// Appends an escaped string value in quotes
+/// @param buf: Buffer to append to
+/// @param str: String
+/// @param len: Length of the string
+static void log_sql_escape( StringBuf* buf, const char* str, size_t len ){
+	char* esc = (char*)aMalloc( 2 * len + 1 );
+
+	Sql_EscapeStringLen( logmysql_handle, esc, str, len );
+	StringBuf_Printf( buf, "'%s'", esc );
+	aFree( esc );
+}
+
+/// Writes a row to a log table, through the asynchronous writer if it runs
+/// The queue keeps copies of both strings, the callers' buffers are released when they go out of scope.
+/// @param insert: INSERT statement up to the VALUES keyword
+/// @param values: Values of the row in parentheses
+static void log_sql_insert( StringBuf* insert, StringBuf* values ){
+	if( !log_sql_async.running ){
+		StringBuf_Append( insert, values );
+
+		if( SQL_ERROR == Sql_QueryStr( logmysql_handle, StringBuf_Value( insert ) ) )
+			Sql_ShowDebug( logmysql_handle );
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock( log_sql_async.mutex );
+
+	if( log_sql_async.queue.size() >= static_cast<size_t>( log_config.sql_async_queue_max ) ){
+		if( log_config.sql_async_queue_full == 1 ){
+			log_sql_async.dropped++;
+			return;
+		}
+
+		// Wait for the writer to take the queue
+		log_sql_async.waits++;
+		log_sql_async.flush = true;
+		log_sql_async.wakeup.notify_one();
+		log_sql_async.space.wait( lock, []{ return log_sql_async.queue.size() < static_cast<size_t>( log_config.sql_async_queue_max ); } );
+	}
+
+	log_sql_async.queue.push_back( { StringBuf_Value( insert ), StringBuf_Value( values ) } );
+	log_sql_async.queued++;
+	log_sql_async.peak = std::max( log_sql_async.peak, log_sql_async.queue.size() );
+
+	if( log_sql_async.queue.size() == static_cast<size_t>( log_config.sql_async_rows ) )
+		log_sql_async.wakeup.notify_one();
+}
+
 
 /// obtain log type character for item/zeny logs
 static char log_picktype2char(e_log_pick_type type)
@@ -178,15 +510,15 @@ void log_branch( map_session_data* sd )
 		return;
 
 	if( log_config.sql_logs ) {
-		SqlStmt stmt{ *logmysql_handle };
-
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', ?, '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES ", log_config.log_branch);
+		StringBuf_Printf(&values, "(%s, '%d', '%d', ", log_sql_time(), sd->status.account_id, sd->status.char_id);
+		log_sql_escape(&values, sd->status.name, strnlen(sd->status.name, NAME_LENGTH));
+		StringBuf_Printf(&values, ", '%s')", mapindex_id2name(sd->mapindex));
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -218,29 +550,29 @@ void log_pick( int32 id, int16 m, e_log_pick_type type, int32 amount, const item
 	if( log_config.sql_logs )
 	{
 		int32 i;
-		SqlStmt stmt{ *logmysql_handle };
-		StringBuf buf;
-		StringBuf_Init(&buf);
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
 
-		StringBuf_Printf(&buf, "%s INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `map`, `unique_id`, `bound`, `enchantgrade`", LOG_QUERY, log_config.log_pick);
+		StringBuf_Printf(&insert, "%s INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `map`, `unique_id`, `bound`, `enchantgrade`", LOG_QUERY, log_config.log_pick);
 		for (i = 0; i < MAX_SLOTS; ++i)
-			StringBuf_Printf(&buf, ", `card%d`", i);
+			StringBuf_Printf(&insert, ", `card%d`", i);
 		for (i = 0; i < MAX_ITEM_RDM_OPT; ++i) {
-			StringBuf_Printf(&buf, ", `option_id%d`", i);
-			StringBuf_Printf(&buf, ", `option_val%d`", i);
-			StringBuf_Printf(&buf, ", `option_parm%d`", i);
+			StringBuf_Printf(&insert, ", `option_id%d`", i);
+			StringBuf_Printf(&insert, ", `option_val%d`", i);
+			StringBuf_Printf(&insert, ", `option_parm%d`", i);
 		}
-		StringBuf_Printf(&buf, ") VALUES(NOW(),'%u','%c','%u','%d','%d','%s','%" PRIu64 "','%d','%d'",
-			id, log_picktype2char(type), itm->nameid, amount, itm->refine, map_getmapdata(m)->name[0] ? map_getmapdata(m)->name : "", itm->unique_id, itm->bound, itm->enchantgrade);
+		StringBuf_Printf(&insert, ") VALUES ");
+		StringBuf_Printf(&values, "(%s,'%u','%c','%u','%d','%d','%s','%" PRIu64 "','%d','%d'",
+			log_sql_time(), id, log_picktype2char(type), itm->nameid, amount, itm->refine, map_getmapdata(m)->name[0] ? map_getmapdata(m)->name : "", itm->unique_id, itm->bound, itm->enchantgrade);
 
 		for (i = 0; i < MAX_SLOTS; i++)
-			StringBuf_Printf(&buf, ",'%u'", itm->card[i]);
+			StringBuf_Printf(&values, ",'%u'", itm->card[i]);
 		for (i = 0; i < MAX_ITEM_RDM_OPT; i++)
-			StringBuf_Printf(&buf, ",'%d','%d','%d'", itm->option[i].id, itm->option[i].value, itm->option[i].param);
-		StringBuf_Printf(&buf, ")");
+			StringBuf_Printf(&values, ",'%d','%d','%d'", itm->option[i].id, itm->option[i].value, itm->option[i].param);
+		StringBuf_Printf(&values, ")");
 
-		if (SQL_SUCCESS != stmt.PrepareStr(StringBuf_Value(&buf)) || SQL_SUCCESS != stmt.Execute())
-			SqlStmt_ShowDebug(stmt);
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -281,12 +613,14 @@ void log_zeny( const map_session_data &target_sd, e_log_pick_type type, uint32 s
 
 	if( log_config.sql_logs )
 	{
-		if (SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-			log_config.log_zeny, target_sd.status.char_id, src_id, log_picktype2char(type), amount, mapindex_id2name(target_sd.mapindex)))
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES ", log_config.log_zeny);
+		StringBuf_Printf(&values, "(%s, '%d', '%d', '%c', '%d', '%s')",
+			log_sql_time(), target_sd.status.char_id, src_id, log_picktype2char(type), amount, mapindex_id2name(target_sd.mapindex));
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -314,12 +648,14 @@ void log_mvpdrop( const map_session_data* sd, int32 monster_id, t_itemid nameid,
 
 	if( log_config.sql_logs )
 	{
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%u', '%" PRIu64 "', '%s') ",
-			log_config.log_mvpdrop, sd->status.char_id, monster_id, nameid, exp, mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES ", log_config.log_mvpdrop);
+		StringBuf_Printf(&values, "(%s, '%d', '%d', '%u', '%" PRIu64 "', '%s')",
+			log_sql_time(), sd->status.char_id, monster_id, nameid, exp, mapindex_id2name(sd->mapindex));
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -348,16 +684,17 @@ void log_atcommand( map_session_data* sd, const char* message )
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt stmt{ *logmysql_handle };
-
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_gm, sd->status.account_id, sd->status.char_id, sd->mapindex == 0 ? "" : mapindex_id2name(sd->mapindex))
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES ", log_config.log_gm);
+		StringBuf_Printf(&values, "(%s, '%d', '%d', ", log_sql_time(), sd->status.account_id, sd->status.char_id);
+		log_sql_escape(&values, sd->status.name, strnlen(sd->status.name, NAME_LENGTH));
+		StringBuf_Printf(&values, ", '%s', ", sd->mapindex == 0 ? "" : mapindex_id2name(sd->mapindex));
+		log_sql_escape(&values, message, safestrnlen(message, 255));
+		StringBuf_AppendStr(&values, ")");
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -383,16 +720,17 @@ void log_npc( npc_data* nd, const char* message ){
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt stmt{ *logmysql_handle };
-
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`npc_date`, `char_name`, `map`, `mes`) VALUES (NOW(), ?, '%s', ?)", log_config.log_npc, map_mapid2mapname(nd->m) )
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, nd->name, strnlen(nd->name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`npc_date`, `char_name`, `map`, `mes`) VALUES ", log_config.log_npc);
+		StringBuf_Printf(&values, "(%s, ", log_sql_time());
+		log_sql_escape(&values, nd->name, strnlen(nd->name, NAME_LENGTH));
+		StringBuf_Printf(&values, ", '%s', ", map_mapid2mapname(nd->m));
+		log_sql_escape(&values, message, safestrnlen(message, 255));
+		StringBuf_AppendStr(&values, ")");
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -419,16 +757,17 @@ void log_npc( map_session_data* sd, const char* message )
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt stmt{ *logmysql_handle };
-
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_npc, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES ", log_config.log_npc);
+		StringBuf_Printf(&values, "(%s, '%d', '%d', ", log_sql_time(), sd->status.account_id, sd->status.char_id);
+		log_sql_escape(&values, sd->status.name, strnlen(sd->status.name, NAME_LENGTH));
+		StringBuf_Printf(&values, ", '%s', ", mapindex_id2name(sd->mapindex));
+		log_sql_escape(&values, message, safestrnlen(message, 255));
+		StringBuf_AppendStr(&values, ")");
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -464,16 +803,17 @@ void log_chat( e_log_chat_type type, int32 type_id, int32 src_charid, int32 src_
 	}
 
 	if( log_config.sql_logs ) {
-		SqlStmt stmt{ *logmysql_handle };
-
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', ?, ?)", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y)
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, (char*)dst_charname, safestrnlen(dst_charname, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, CHAT_SIZE_MAX))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES ", log_config.log_chat);
+		StringBuf_Printf(&values, "(%s, '%c', '%d', '%d', '%d', '%s', '%d', '%d', ", log_sql_time(), log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y);
+		log_sql_escape(&values, dst_charname, safestrnlen(dst_charname, NAME_LENGTH));
+		StringBuf_AppendStr(&values, ", ");
+		log_sql_escape(&values, message, safestrnlen(message, CHAT_SIZE_MAX));
+		StringBuf_AppendStr(&values, ")");
+		log_sql_insert(&insert, &values);
 	}
 	else
 	{
@@ -498,12 +838,14 @@ void log_cash( const map_session_data* sd, e_log_pick_type type, e_log_cash_type
 		return;
 
 	if( log_config.sql_logs ){
-		if( SQL_ERROR == Sql_Query( logmysql_handle, LOG_QUERY " INTO `%s` ( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` ) VALUES ( NOW(), '%d', '%c', '%c', '%d', '%s' )",
-			log_config.log_cash, sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) ) )
-		{
-			Sql_ShowDebug( logmysql_handle );
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init( &insert );
+		StringBuf_Init( &values );
+
+		StringBuf_Printf( &insert, LOG_QUERY " INTO `%s` ( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` ) VALUES ", log_config.log_cash );
+		StringBuf_Printf( &values, "( %s, '%d', '%c', '%c', '%d', '%s' )",
+			log_sql_time(), sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) );
+		log_sql_insert( &insert, &values );
 	}else{
 		char timestring[255];
 		time_t curtime;
@@ -551,12 +893,14 @@ void log_feeding( const map_session_data* sd, e_log_feeding_type type, t_itemid
 	}
 
 	if (log_config.sql_logs) {
-		if (SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `target_id`, `target_class`, `type`, `intimacy`, `item_id`, `map`, `x`, `y`) VALUES ( NOW(), '%" PRIu32 "', '%" PRIu32 "', '%hu', '%c', '%" PRIu32 "', '%u', '%s', '%hu', '%hu' )",
-			log_config.log_feeding, sd->status.char_id, target_id, target_class, log_feedingtype2char(type), intimacy, nameid, mapindex_id2name(sd->mapindex), sd->x, sd->y))
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		StringBuf insert, values;
+		StringBuf_Init(&insert);
+		StringBuf_Init(&values);
+
+		StringBuf_Printf(&insert, LOG_QUERY " INTO `%s` (`time`, `char_id`, `target_id`, `target_class`, `type`, `intimacy`, `item_id`, `map`, `x`, `y`) VALUES ", log_config.log_feeding);
+		StringBuf_Printf(&values, "( %s, '%" PRIu32 "', '%" PRIu32 "', '%hu', '%c', '%" PRIu32 "', '%u', '%s', '%hu', '%hu' )",
+			log_sql_time(), sd->status.char_id, target_id, target_class, log_feedingtype2char(type), intimacy, nameid, mapindex_id2name(sd->mapindex), sd->x, sd->y);
+		log_sql_insert(&insert, &values);
 	} else {
 		char timestring[255];
 		time_t curtime;
@@ -581,6 +925,10 @@ void log_set_defaults(void)
 	log_config.price_items_log  = 1000; // 1000z
 	log_config.amount_items_log = 100;
 
+	log_config.sql_async_interval = 1000;
+	log_config.sql_async_rows = 100;
+	log_config.sql_async_queue_max = 10000;
+
 	safestrncpy(log_timestamp_format, "%m/%d/%Y %H:%M:%S", sizeof(log_timestamp_format));
 }
 
@@ -611,6 +959,16 @@ int32 log_config_read( const char* cfgName )
 				log_config.enable_logs = (e_log_pick_type)config_switch(w2);
 			else if( strcmpi(w1, "sql_logs") == 0 )
 				log_config.sql_logs = config_switch(w2) > 0;
+			else if( strcmpi(w1, "sql_logs_async") == 0 )
+				log_config.sql_async = config_switch(w2) > 0;
+			else if( strcmpi(w1, "sql_logs_flush_interval") == 0 )
+				log_config.sql_async_interval = cap_value(atoi(w2), 1, 60000);
+			else if( strcmpi(w1, "sql_logs_flush_rows") == 0 )
+				log_config.sql_async_rows = cap_value(atoi(w2), 1, 10000);
+			else if( strcmpi(w1, "sql_logs_queue_max") == 0 )
+				log_config.sql_async_queue_max = cap_value(atoi(w2), 1, 1000000);
+			else if( strcmpi(w1, "sql_logs_queue_full") == 0 )
+				log_config.sql_async_queue_full = cap_value(atoi(w2), 0, 1);
 //start of common filter settings
 			else if( strcmpi(w1, "rare_items_log") == 0 )
 				log_config.rare_items_log = atoi(w2);
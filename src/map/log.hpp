@@ -93,11 +93,17 @@ void log_mvpdrop( const map_session_data* sd, int32 monster_id, t_itemid nameid,
 
 int32 log_config_read( const char* cfgName );
 
+void log_sql_async_start();
+void log_sql_async_stop();
+void log_sql_async_report( bool reset );
+
 extern struct Log_Config
 {
 	e_log_pick_type enable_logs;
 	int32 filter;
 	bool sql_logs;
+	bool sql_async; ///< Write SQL logs from a background thread
+	int32 sql_async_interval, sql_async_rows, sql_async_queue_max, sql_async_queue_full;
 	bool log_chat_woe_disable;
 	bool cash;
 	int32 rare_items_log,refine_items_log,price_items_log,amount_items_log; //for filter
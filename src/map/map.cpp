@@ -3,8 +3,24 @@
 
 #include "map.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <cmath>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#else
+	#include <process.h> // _getpid
+#endif
 
 #include <config/core.hpp>
 
@@ -43,6 +59,7 @@
 #include "mapreg.hpp"
 #include "mercenary.hpp"
 #include "mob.hpp"
+#include "navgraph.hpp"
 #include "navi.hpp"
 #include "npc.hpp"
 #include "party.hpp"
@@ -117,14 +134,15 @@ static DBMap* map_msg_db=nullptr;
 
 static int32 map_users=0;
 
-#define BLOCK_SIZE 8
 #define block_free_max 1048576
 block_list *block_free[block_free_max];
 static int32 block_free_count = 0, block_free_lock = 0;
 
-#define BL_LIST_MAX 1048576
-static block_list *bl_list[BL_LIST_MAX];
-static int32 bl_list_count = 0;
+/// Objects collected by the map_foreach* functions, nested calls append behind their caller's entries
+static std::vector<block_list*> bl_list;
+
+uint16 map_block_size = BLOCK_SIZE_DEFAULT;
+uint32 map_cell_generation = 0;
 
 #ifndef MAP_MAX_MSG
 	#define MAP_MAX_MSG 1550
@@ -138,6 +156,7 @@ int32 map_port=0;
 int32 autosave_interval = DEFAULT_AUTOSAVE_INTERVAL;
 int32 minsave_interval = 100;
 int16 save_settings = CHARSAVE_ALL;
+bool save_delta = true;
 bool agit_flag = false;
 bool agit2_flag = false;
 bool agit3_flag = false;
@@ -166,6 +185,45 @@ struct map_cache_map_info {
 	int32 len;
 };
 
+/// Maximum number of threads decoding map cells
+#define MAP_LOAD_THREADS_MAX 8
+/// Version of the cell cache, increase it when its layout changes
+#define MAP_CELLS_VERSION 2
+/// Alignment of the cells of each map in the cell cache (a memory page)
+#define MAP_CELLS_ALIGN 4096
+
+// This is the main header of the cell cache, which holds the decoded cells of the loaded maps
+// so that they can be mapped into memory and shared copy-on-write between map-servers
+struct map_cells_main_header {
+	char magic[4];
+	uint32 version;
+	uint32 cell_size; // sizeof(struct mapcell), depends on the build options
+	uint32 source; // hash of the map cache files the cells were decoded from
+	uint32 map_count;
+	uint32 crc; // crc32 of the map headers
+};
+
+// This is the header of every map in the cell cache, the cells start at a page aligned offset
+struct map_cells_map_info {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint32 crc; // crc32 of the cells, checked by the map-servers that load the map
+	uint64 offset;
+};
+
+/// Cell cache mapped into memory, the cells of the maps read from it point into this
+static struct {
+	char* data;
+	size_t size;
+} map_cells;
+
+char map_cells_cache[256] = "db/map_cells.dat"; // Empty if the cell cache is disabled
+
+static void map_cells_close(void);
+static void map_freecells(struct map_data* mapdata);
+static void map_cellplanes_alloc(struct map_data* m);
+
 char motd_txt[256] = "conf/motd.txt";
 char charhelp_txt[256] = "conf/charhelp.txt";
 char channel_conf[256] = "conf/channels.conf";
@@ -400,6 +458,122 @@ static void map_delblcell(block_list *bl)
 }
 #endif
 
+/*==========================================
+ * Spatial index helpers.
+ * Every map is split into square blocks of mapdata->block_size cells.
+ * Each block keeps one contiguous bucket per e_block_class, so a search
+ * only has to scan the buckets of the classes it asks for.
+ *------------------------------------------*/
+
+/// Object types stored in the buckets of each block class
+static const int32 block_class_types[BLOCK_MAX] = {
+	BL_PC, // BLOCK_PC
+	BL_MOB, // BLOCK_MOB
+	BL_NPC, // BLOCK_NPC
+	BL_ITEM, // BLOCK_ITEM
+	BL_SKILL, // BLOCK_SKILL
+	BL_PET|BL_HOM|BL_MER|BL_CHAT|BL_ELEM, // BLOCK_OTHER
+};
+
+static inline e_block_class map_block_class(enum bl_type type)
+{
+	switch( type ){
+		case BL_PC: return BLOCK_PC;
+		case BL_MOB: return BLOCK_MOB;
+		case BL_NPC: return BLOCK_NPC;
+		case BL_ITEM: return BLOCK_ITEM;
+		case BL_SKILL: return BLOCK_SKILL;
+		default: return BLOCK_OTHER;
+	}
+}
+
+/// Returns the bucket of the given class that covers cell (x,y), nullptr if the class was never used on the map
+static inline std::vector<block_list*>* map_block_bucket(const struct map_data* mapdata, e_block_class bc, int16 x, int16 y)
+{
+	if( mapdata->block[bc] == nullptr )
+		return nullptr;
+
+	return &mapdata->block[bc][x / mapdata->block_size + (y / mapdata->block_size) * mapdata->bxs];
+}
+
+/// Sets up the block dimensions of a map for the given block size
+static void map_block_alloc(struct map_data* mapdata, uint16 block_size)
+{
+	mapdata->block_size = block_size;
+	mapdata->bxs = (mapdata->xs + block_size - 1) / block_size;
+	mapdata->bys = (mapdata->ys + block_size - 1) / block_size;
+
+	// Buckets are allocated on first use, most maps never see every object class
+	for( int32 i = 0; i < BLOCK_MAX; i++ )
+		mapdata->block[i] = nullptr;
+}
+
+static void map_block_free(struct map_data* mapdata)
+{
+	for( int32 i = 0; i < BLOCK_MAX; i++ ){
+		delete[] mapdata->block[i];
+		mapdata->block[i] = nullptr;
+	}
+}
+
+/**
+ * Collects all objects of the given types inside the area (x0,y0)-(x1,y1) into bl_list.
+ * Only the buckets of the matching block classes are visited.
+ * Objects are appended class by class and not in the order of the old linked block lists,
+ * searches that stop after a number of hits restore that order with map_block_sort_legacy.
+ * @param mapdata: Map to search
+ * @param x0: West end of area (must be inside the map)
+ * @param y0: South end of area (must be inside the map)
+ * @param x1: East end of area (must be inside the map)
+ * @param y1: North end of area (must be inside the map)
+ * @param type: Types of bl to search for
+ * @param filter: Additional condition an object has to fulfill
+ */
+template <typename F>
+static void map_block_collect(const struct map_data* mapdata, int32 x0, int32 y0, int32 x1, int32 y1, int32 type, F filter)
+{
+	const int32 bs = mapdata->block_size;
+
+	for( int32 bc = 0; bc < BLOCK_MAX; bc++ ){
+		if( !( type&block_class_types[bc] ) || mapdata->block[bc] == nullptr )
+			continue;
+
+		// Only BLOCK_OTHER holds more than one type, every other class is fully matched here
+		bool check_type = ( type&block_class_types[bc] ) != block_class_types[bc];
+
+		for( int32 by = y0 / bs; by <= y1 / bs; by++ ){
+			for( int32 bx = x0 / bs; bx <= x1 / bs; bx++ ){
+				for( block_list* bl : mapdata->block[bc][bx + by * mapdata->bxs] ){
+					if( check_type && !( bl->type&type ) )
+						continue;
+					if( bl->x < x0 || bl->x > x1 || bl->y < y0 || bl->y > y1 )
+						continue;
+					if( filter( bl ) )
+						bl_list.push_back( bl );
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Sorts the objects collected since the given bl_list position into the order of the old
+ * linked block lists: everything but monsters first, then monsters, each walking the
+ * default sized blocks row by row. Within one block the bucket order is kept, the old
+ * lists returned the most recently added object first instead.
+ * @param first: Position in bl_list where the collection started
+ */
+static void map_block_sort_legacy(size_t first)
+{
+	std::stable_sort(bl_list.begin() + first, bl_list.end(), []( const block_list* a, const block_list* b ){
+		if( ( a->type == BL_MOB ) != ( b->type == BL_MOB ) )
+			return b->type == BL_MOB;
+		if( a->y / BLOCK_SIZE_DEFAULT != b->y / BLOCK_SIZE_DEFAULT )
+			return a->y / BLOCK_SIZE_DEFAULT < b->y / BLOCK_SIZE_DEFAULT;
+		return a->x / BLOCK_SIZE_DEFAULT < b->x / BLOCK_SIZE_DEFAULT;
+	});
+}
+
 /*==========================================
  * Adds a block to the map.
  * Returns 0 on success, 1 on failure (illegal coordinates).
@@ -407,7 +581,6 @@ static void map_delblcell(block_list *bl)
 int32 map_addblock(block_list* bl)
 {
 	int16 m, x, y;
-	int32 pos;
 
 	nullpo_ret(bl);
 
@@ -437,19 +610,16 @@ int32 map_addblock(block_list* bl)
 		return 1;
 	}
 
-	pos = x/BLOCK_SIZE+(y/BLOCK_SIZE)*mapdata->bxs;
+	e_block_class bc = map_block_class(bl->type);
 
-	if (bl->type == BL_MOB) {
-		bl->next = mapdata->block_mob[pos];
-		bl->prev = &bl_head;
-		if (bl->next) bl->next->prev = bl;
-		mapdata->block_mob[pos] = bl;
-	} else {
-		bl->next = mapdata->block[pos];
-		bl->prev = &bl_head;
-		if (bl->next) bl->next->prev = bl;
-		mapdata->block[pos] = bl;
-	}
+	if( mapdata->block[bc] == nullptr )
+		mapdata->block[bc] = new std::vector<block_list*>[mapdata->bxs * mapdata->bys];
+
+	std::vector<block_list*>* bucket = map_block_bucket(mapdata, bc, x, y);
+
+	bl->block_pos = static_cast<uint32>(bucket->size());
+	bl->prev = &bl_head;
+	bucket->push_back(bl);
 
 #ifdef CELL_NOSTACK
 	map_addblcell(bl);
@@ -463,15 +633,10 @@ int32 map_addblock(block_list* bl)
  *------------------------------------------*/
 int32 map_delblock(block_list* bl)
 {
-	int32 pos;
 	nullpo_ret(bl);
 
-	// blocklist (2ways chainlist)
 	if (bl->prev == nullptr) {
-		if (bl->next != nullptr) {
-			// can't delete block (already at the beginning of the chain)
-			ShowError("map_delblock error : bl->next!=nullptr\n");
-		}
+		// not on a map
 		return 0;
 	}
 
@@ -483,28 +648,72 @@ int32 map_delblock(block_list* bl)
 
 	nullpo_ret(mapdata);
 
-	pos = bl->x/BLOCK_SIZE+(bl->y/BLOCK_SIZE)*mapdata->bxs;
+	std::vector<block_list*>* bucket = map_block_bucket(mapdata, map_block_class(bl->type), bl->x, bl->y);
 
-	if (bl->next)
-		bl->next->prev = bl->prev;
-	if (bl->prev == &bl_head) {
-	//Since the head of the list, update the block_list map of []
-		if (bl->type == BL_MOB) {
-			nullpo_ret(mapdata->block_mob);
-			mapdata->block_mob[pos] = bl->next;
-		} else {
-			nullpo_ret(mapdata->block);
-			mapdata->block[pos] = bl->next;
-		}
-	} else {
-		bl->prev->next = bl->next;
+	nullpo_ret(bucket);
+
+	if (bl->block_pos >= bucket->size() || (*bucket)[bl->block_pos] != bl) {
+		ShowError("map_delblock: object %d is not in its block (\"%s\",%d,%d)\n", bl->id, mapdata->name, bl->x, bl->y);
+		bl->prev = nullptr;
+		return 0;
 	}
-	bl->next = nullptr;
+
+	// Swap with the last entry, buckets are unordered
+	block_list* last = bucket->back();
+
+	(*bucket)[bl->block_pos] = last;
+	last->block_pos = bl->block_pos;
+	bucket->pop_back();
+
+	bl->block_pos = 0;
 	bl->prev = nullptr;
 
 	return 0;
 }
 
+/**
+ * Changes the block size of a map and rebuilds its spatial index.
+ * @param m: Map ID
+ * @param block_size: New width and height of a block (in cells)
+ * @return true on success, false if the map is not loaded or the size is invalid
+ */
+bool map_setblocksize(int16 m, uint16 block_size)
+{
+	struct map_data *mapdata = map_getmapdata(m);
+
+	if( mapdata == nullptr || mapdata->cell == nullptr || block_size < 1 || block_size > BLOCK_SIZE_MAX )
+		return false;
+
+	if( block_size == mapdata->block_size )
+		return true;
+
+	std::vector<block_list*> objects;
+
+	for( int32 bc = 0; bc < BLOCK_MAX; bc++ ){
+		if( mapdata->block[bc] == nullptr )
+			continue;
+
+		for( int32 b = 0; b < mapdata->bxs * mapdata->bys; b++ )
+			objects.insert(objects.end(), mapdata->block[bc][b].begin(), mapdata->block[bc][b].end());
+	}
+
+	map_block_free(mapdata);
+	map_block_alloc(mapdata, block_size);
+
+	for( block_list* bl : objects ){
+		e_block_class bc = map_block_class(bl->type);
+
+		if( mapdata->block[bc] == nullptr )
+			mapdata->block[bc] = new std::vector<block_list*>[mapdata->bxs * mapdata->bys];
+
+		std::vector<block_list*>* bucket = map_block_bucket(mapdata, bc, bl->x, bl->y);
+
+		bl->block_pos = static_cast<uint32>(bucket->size());
+		bucket->push_back(bl);
+	}
+
+	return true;
+}
 /**
  * Moves a block a x/y target position. [Skotlex]
  * Pass flag as 1 to prevent doing skill_unit_move checks
@@ -521,7 +730,7 @@ int32 map_moveblock(block_list *bl, int32 x1, int32 y1, t_tick tick)
 
 	int32 x0 = bl->x, y0 = bl->y;
 	status_change *sc = nullptr;
-	int32 moveblock = ( x0/BLOCK_SIZE != x1/BLOCK_SIZE || y0/BLOCK_SIZE != y1/BLOCK_SIZE);
+	int32 moveblock;
 
 	if (!bl->prev) {
 		//Block not in map, just update coordinates, but do naught else.
@@ -530,6 +739,12 @@ int32 map_moveblock(block_list *bl, int32 x1, int32 y1, t_tick tick)
 		return 0;
 	}
 
+	struct map_data *mapdata = map_getmapdata(bl->m);
+
+	nullpo_retr(1, mapdata);
+
+	moveblock = ( x0/mapdata->block_size != x1/mapdata->block_size || y0/mapdata->block_size != y1/mapdata->block_size );
+
 	//TODO: Perhaps some outs of bounds checking should be placed here?
 	if (bl->type&BL_CHAR) {
 		sc = status_get_sc(bl);
@@ -640,45 +855,38 @@ int32 map_moveblock(block_list *bl, int32 x1, int32 y1, t_tick tick)
  *------------------------------------------*/
 int32 map_count_oncell(int16 m, int16 x, int16 y, int32 type, int32 flag)
 {
-	int32 bx,by;
-	block_list *bl;
 	int32 count = 0;
 	struct map_data *mapdata = map_getmapdata(m);
 
 	if (x < 0 || y < 0 || (x >= mapdata->xs) || (y >= mapdata->ys))
 		return 0;
 
-	bx = x/BLOCK_SIZE;
-	by = y/BLOCK_SIZE;
+	for (int32 bc = 0; bc < BLOCK_MAX; bc++) {
+		if (!(type&block_class_types[bc]))
+			continue;
 
-	if (type&~BL_MOB)
-		for( bl = mapdata->block[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
-			if(bl->x == x && bl->y == y && bl->type&type) {
-				if (bl->type == BL_NPC) {	// Don't count hidden or invisible npc. Cloaked npc are counted
-					npc_data *nd = BL_CAST(BL_NPC, bl);
-					if (nd->m < 0 || nd->sc.option&OPTION_HIDE || nd->dynamicnpc.owner_char_id != 0)
-						continue;
-				}
-				if(flag&1) {
-					struct unit_data *ud = unit_bl2ud(bl);
-					if(!ud || ud->walktimer == INVALID_TIMER)
-						count++;
-				} else {
-					count++;
-				}
-			}
+		std::vector<block_list*>* bucket = map_block_bucket(mapdata, static_cast<e_block_class>(bc), x, y);
 
-	if (type&BL_MOB)
-		for( bl = mapdata->block_mob[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
-			if(bl->x == x && bl->y == y) {
-				if(flag&1) {
-					struct unit_data *ud = unit_bl2ud(bl);
-					if(!ud || ud->walktimer == INVALID_TIMER)
-						count++;
-				} else {
+		if (bucket == nullptr)
+			continue;
+
+		for (block_list* bl : *bucket) {
+			if (bl->x != x || bl->y != y || !(bl->type&type))
+				continue;
+			if (bl->type == BL_NPC) {	// Don't count hidden or invisible npc. Cloaked npc are counted
+				npc_data *nd = BL_CAST(BL_NPC, bl);
+				if (nd->m < 0 || nd->sc.option&OPTION_HIDE || nd->dynamicnpc.owner_char_id != 0)
+					continue;
+			}
+			if(flag&1) {
+				struct unit_data *ud = unit_bl2ud(bl);
+				if(!ud || ud->walktimer == INVALID_TIMER)
 					count++;
-				}
+			} else {
+				count++;
 			}
+		}
+	}
 
 	return count;
 }
@@ -688,20 +896,20 @@ int32 map_count_oncell(int16 m, int16 x, int16 y, int32 type, int32 flag)
  * flag&1: runs battle_check_target check based on unit->group->target_flag
  */
 skill_unit* map_find_skill_unit_oncell(block_list* target,int16 x,int16 y,uint16 skill_id,skill_unit* out_unit, int32 flag) {
-	int16 bx,by;
-	block_list *bl;
 	skill_unit *unit;
 	struct map_data *mapdata = map_getmapdata(target->m);
 
 	if (x < 0 || y < 0 || (x >= mapdata->xs) || (y >= mapdata->ys))
 		return nullptr;
 
-	bx = x/BLOCK_SIZE;
-	by = y/BLOCK_SIZE;
+	std::vector<block_list*>* bucket = map_block_bucket(mapdata, BLOCK_SKILL, x, y);
+
+	if( bucket == nullptr )
+		return nullptr;
 
-	for( bl = mapdata->block[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
+	for( block_list* bl : *bucket )
 	{
-		if (bl->x != x || bl->y != y || bl->type != BL_SKILL)
+		if (bl->x != x || bl->y != y)
 			continue;
 
 		unit = (skill_unit *) bl;
@@ -713,26 +921,34 @@ skill_unit* map_find_skill_unit_oncell(block_list* target,int16 x,int16 y,uint16
 	return nullptr;
 }
 
-/*==========================================
- * Adapted from foreachinarea for an easier invocation. [Skotlex]
- *------------------------------------------*/
-int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* center, int16 range, int32 type, va_list ap, bool wall_check)
+/// Search list of the map_foreach* functions
+std::vector<block_list*>& map_foreach_list()
 {
-	int32 bx, by, m;
-	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	return bl_list;
+}
+
+/// Whether map_foreachinrange and map_foreachinarea check for walls
+bool map_foreach_wallcheck()
+{
+	return battle_config.skill_wall_check > 0;
+}
+
+/**
+ * Collects all objects of the given type in range of center into the search list.
+ * @return Position in the search list where the collected objects start
+ */
+size_t map_foreach_collectrange(const block_list* center, int16 range, int32 type, bool wall_check)
+{
+	size_t blockcount = bl_list.size();
 	int32 x0, x1, y0, y1;
-	va_list ap_copy;
 
-	m = center->m;
-	if( m < 0 )
-		return 0;
+	if( center->m < 0 )
+		return blockcount;
 
-	struct map_data *mapdata = map_getmapdata(m);
+	struct map_data *mapdata = map_getmapdata(center->m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
-		return 0;
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
+		return blockcount;
 	}
 
 	x0 = i16max(center->x - range, 0);
@@ -740,45 +956,29 @@ int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* c
 	x1 = i16min(center->x + range, mapdata->xs - 1);
 	y1 = i16min(center->y + range, mapdata->ys - 1);
 
-	if ( type&~BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for(bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
+	map_block_collect(mapdata, x0, y0, x1, y1, type, [&]( block_list* bl ){
+		return true
 #ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
+			&& check_distance_bl(center, bl, range)
 #endif
-						&& ( !wall_check || path_search_long(nullptr, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL) )
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-				}
-			}
-		}
-	}
+			&& ( !wall_check || path_search_long(nullptr, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL) );
+	});
 
-	if ( type&BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for(bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& ( !wall_check || path_search_long(nullptr, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL) )
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-				}
-			}
-		}
-	}
+	return blockcount;
+}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinrange: block count too many!\n");
+/*==========================================
+ * Adapted from foreachinarea for an easier invocation. [Skotlex]
+ *------------------------------------------*/
+int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* center, int16 range, int32 type, va_list ap, bool wall_check)
+{
+	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
+	size_t blockcount = map_foreach_collectrange(center, range, type, wall_check), i;
+	va_list ap_copy;
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_copy(ap_copy, ap);
 			returnCount += func(bl_list[i], ap_copy);
@@ -786,7 +986,7 @@ int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* c
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;	//[Skotlex]
 }
 
@@ -834,16 +1034,13 @@ int32 map_foreachinshootrange(int32 (*func)(block_list*,va_list), const block_li
  * @param y1: North end of area
  * @param type: Type of bl to search for
 *------------------------------------------*/
-int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, va_list ap, bool wall_check)
+size_t map_foreach_collectarea(int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, bool wall_check)
 {
-	int32 bx, by, cx, cy;
-	int32 returnCount = 0;	//total sum of returned values of func()
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
-	va_list ap_copy;
+	size_t blockcount = bl_list.size();
+	int32 cx = 0, cy = 0;
 
 	if (m < 0)
-		return 0;
+		return blockcount;
 
 	if (x1 < x0)
 		std::swap(x0, x1);
@@ -852,8 +1049,8 @@ int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0,
 
 	struct map_data *mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
-		return 0;
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
+		return blockcount;
 	}
 
 	x0 = i16max(x0, 0);
@@ -866,39 +1063,22 @@ int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0,
 		cy = y0 + (y1 - y0) / 2;
 	}
 
-	if( type&~BL_MOB ) {
-		for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++) {
-			for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++) {
-				for(bl = mapdata->block[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if ( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-						&& ( !wall_check || path_search_long(nullptr, m, cx, cy, bl->x, bl->y, CELL_CHKWALL) )
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
+	map_block_collect(mapdata, x0, y0, x1, y1, type, [&]( block_list* bl ){
+		return !wall_check || path_search_long(nullptr, m, cx, cy, bl->x, bl->y, CELL_CHKWALL);
+	});
 
-	if( type&BL_MOB ) {
-		for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++) {
-			for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++) {
-				for(bl = mapdata->block_mob[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if ( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-						&& ( !wall_check || path_search_long(nullptr, m, cx, cy, bl->x, bl->y, CELL_CHKWALL) )
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
+	return blockcount;
+}
 
-	if (bl_list_count >= BL_LIST_MAX)
-		ShowWarning("map_foreachinarea: block count too many!\n");
+int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, va_list ap, bool wall_check)
+{
+	int32 returnCount = 0;	//total sum of returned values of func()
+	size_t blockcount = map_foreach_collectarea(m, x0, y0, x1, y1, type, wall_check), i;
+	va_list ap_copy;
 
 	FreeBlockLock freeLock;
 
-	for (i = blockcount; i < bl_list_count; i++) {
+	for (i = blockcount; i < bl_list.size(); i++) {
 		if (bl_list[i]->prev) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_copy(ap_copy, ap);
 			returnCount += func(bl_list[i], ap_copy);
@@ -906,7 +1086,7 @@ int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0,
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;
 }
 
@@ -944,10 +1124,9 @@ int32 map_foreachinarea(int32 (*func)(block_list*, va_list), int16 m, int16 x0,
  *------------------------------------------*/
 int32 map_forcountinrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 count, int32 type, ...)
 {
-	int32 bx, by, m;
+	int32 m;
 	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	int32 x0, x1, y0, y1;
 	struct map_data *mapdata;
 	va_list ap;
@@ -955,7 +1134,7 @@ int32 map_forcountinrange(int32 (*func)(block_list*,va_list), const block_list*
 	m = center->m;
 	mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
@@ -964,40 +1143,20 @@ int32 map_forcountinrange(int32 (*func)(block_list*,va_list), const block_list*
 	x1 = i16min(center->x + range, mapdata->xs - 1);
 	y1 = i16min(center->y + range, mapdata->ys - 1);
 
-	if ( type&~BL_MOB )
-		for ( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
+	map_block_collect(mapdata, x0, y0, x1, y1, type, [&]( block_list* bl ){
 #ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-				}
-			}
-		}
-	if( type&BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ){
-				for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
+		return check_distance_bl(center, bl, range);
+#else
+		return true;
 #endif
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-				}
-			}
-		}
+	});
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_forcountinrange: block count too many!\n");
+	if( count ) // Capped searches pick the same targets as before
+		map_block_sort_legacy(blockcount);
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1007,15 +1166,13 @@ int32 map_forcountinrange(int32 (*func)(block_list*,va_list), const block_list*
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;	//[Skotlex]
 }
 int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 count, int32 type, ...)
 {
-	int32 bx, by;
 	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	va_list ap;
 
 	if ( m < 0 )
@@ -1028,7 +1185,7 @@ int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0,
 
 	struct map_data *mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
@@ -1037,26 +1194,14 @@ int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0,
 	x1 = i16min(x1, mapdata->xs - 1);
 	y1 = i16min(y1, mapdata->ys - 1);
 
-	if ( type&~BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
-					if( bl->type&type && bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
+	map_block_collect(mapdata, x0, y0, x1, y1, type, []( block_list* bl ){ return true; });
 
-	if( type&BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_forcountinarea: block count too many!\n");
+	if( count ) // Capped searches pick the same targets as before
+		map_block_sort_legacy(blockcount);
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if(bl_list[ i ]->prev) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1066,7 +1211,7 @@ int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0,
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;	//[Skotlex]
 }
 
@@ -1076,10 +1221,9 @@ int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0,
  *------------------------------------------*/
 int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int16 dx, int16 dy, int32 type, ...)
 {
-	int32 bx, by, m;
+	int32 m;
 	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	int16 x0, x1, y0, y1;
 	va_list ap;
 
@@ -1090,7 +1234,7 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 
 	struct map_data *mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
@@ -1123,71 +1267,24 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 		x1 = i16min(x1, mapdata->xs - 1);
 		y1 = i16min(y1, mapdata->ys - 1);
 
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				if ( type&~BL_MOB ) {
-					for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-						if( bl->type&type &&
-							bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-							bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-				if ( type&BL_MOB ) {
-					for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-						if( bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-							bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-			}
-		}
+		map_block_collect(mapdata, x0, y0, x1, y1, type, []( block_list* bl ){ return true; });
 	} else { // Diagonal movement
 		x0 = i16max(x0, 0);
 		y0 = i16max(y0, 0);
 		x1 = i16min(x1, mapdata->xs - 1);
 		y1 = i16min(y1, mapdata->ys - 1);
 
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				if ( type & ~BL_MOB ) {
-					for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-						if( bl->type&type &&
-							bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-						if( ( dx > 0 && bl->x < x0 + dx) ||
-							( dx < 0 && bl->x > x1 + dx) ||
-							( dy > 0 && bl->y < y0 + dy) ||
-							( dy < 0 && bl->y > y1 + dy) )
-							bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-				if ( type&BL_MOB ) {
-					for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-						if( bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX)
-						if( ( dx > 0 && bl->x < x0 + dx) ||
-							( dx < 0 && bl->x > x1 + dx) ||
-							( dy > 0 && bl->y < y0 + dy) ||
-							( dy < 0 && bl->y > y1 + dy) )
-							bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-			}
-		}
-
+		map_block_collect(mapdata, x0, y0, x1, y1, type, [&]( block_list* bl ){
+			return ( dx > 0 && bl->x < x0 + dx) ||
+				( dx < 0 && bl->x > x1 + dx) ||
+				( dy > 0 && bl->y < y0 + dy) ||
+				( dy < 0 && bl->y > y1 + dy);
+		});
 	}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinmovearea: block count too many!\n");
-
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1195,7 +1292,7 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;
 }
 
@@ -1205,37 +1302,22 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 //
 int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, int16 y, int32 type, ...)
 {
-	int32 bx, by;
 	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	struct map_data *mapdata = map_getmapdata(m);
 	va_list ap;
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
 	if ( x < 0 || y < 0 || x >= mapdata->xs || y >= mapdata->ys ) return 0;
 
-	by = y / BLOCK_SIZE;
-	bx = x / BLOCK_SIZE;
+	map_block_collect(mapdata, x, y, x, y, type, []( block_list* bl ){ return true; });
 
-	if( type&~BL_MOB )
-		for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
-			if( bl->type&type && bl->x == x && bl->y == y && bl_list_count < BL_LIST_MAX )
-				bl_list[ bl_list_count++ ] = bl;
-	if( type&BL_MOB )
-		for( bl = mapdata->block_mob[ bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next )
-			if( bl->x == x && bl->y == y && bl_list_count < BL_LIST_MAX)
-				bl_list[ bl_list_count++ ] = bl;
-
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachincell: block count too many!\n");
-	
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1243,7 +1325,7 @@ int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, in
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;
 }
 
@@ -1287,9 +1369,7 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 // kRO.
 
 	//Generic map_foreach* variables.
-	int32 i, blockcount = bl_list_count;
-	block_list *bl;
-	int32 bx, by;
+	size_t i, blockcount = bl_list.size();
 	//method specific variables
 	int32 magnitude2, len_limit; //The square of the magnitude
 	int32 k, xi, yi, xu, yu;
@@ -1337,89 +1417,50 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 
 	struct map_data *mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
-	mx0 = max(mx0, 0);
-	my0 = max(my0, 0);
-	mx1 = min(mx1, mapdata->xs - 1);
-	my1 = min(my1, mapdata->ys - 1);
+	// The old search tested every object of the touched default sized blocks, not only the ones inside the
+	// area, so widen the area to those blocks to keep the same candidates whatever the map's block size is.
+	mx0 = max(mx0, 0) / BLOCK_SIZE_DEFAULT * BLOCK_SIZE_DEFAULT;
+	my0 = max(my0, 0) / BLOCK_SIZE_DEFAULT * BLOCK_SIZE_DEFAULT;
+	mx1 = min(mx1 / BLOCK_SIZE_DEFAULT * BLOCK_SIZE_DEFAULT + BLOCK_SIZE_DEFAULT - 1, mapdata->xs - 1);
+	my1 = min(my1 / BLOCK_SIZE_DEFAULT * BLOCK_SIZE_DEFAULT + BLOCK_SIZE_DEFAULT - 1, mapdata->ys - 1);
 
 	range *= range << 8; //Values are shifted later on for higher precision using int32 math.
 
-	if ( type&~BL_MOB )
-		for ( by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++ ) {
-			for( bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++ ) {
-				for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->prev && bl->type&type && bl_list_count < BL_LIST_MAX ) {
-						xi = bl->x;
-						yi = bl->y;
-
-						k = ( xi - x0 ) * ( x1 - x0 ) + ( yi - y0 ) * ( y1 - y0 );
+	map_block_collect(mapdata, mx0, my0, mx1, my1, type, [&]( block_list* bl ){
+		xi = bl->x;
+		yi = bl->y;
 
-						if ( k < 0 || k > len_limit ) //Since more skills use this, check for ending point as well.
-							continue;
+		k = ( xi - x0 ) * ( x1 - x0 ) + ( yi - y0 ) * ( y1 - y0 );
 
-						if ( k > magnitude2 && !path_search_long(nullptr, m, x0, y0, xi, yi, CELL_CHKWALL) )
-							continue; //Targets beyond the initial ending point need the wall check.
+		if ( k < 0 || k > len_limit ) //Since more skills use this, check for ending point as well.
+			return false;
 
-						//All these shifts are to increase the precision of the intersection point and distance considering how it's
-						//int32 math.
-						k  = ( k << 4 ) / magnitude2; //k will be between 1~16 instead of 0~1
-						xi <<= 4;
-						yi <<= 4;
-						xu = ( x0 << 4 ) + k * ( x1 - x0 );
-						yu = ( y0 << 4 ) + k * ( y1 - y0 );
-						k  = MAGNITUDE2(xi, yi, xu, yu);
+		if ( k > magnitude2 && !path_search_long(nullptr, m, x0, y0, xi, yi, CELL_CHKWALL) )
+			return false; //Targets beyond the initial ending point need the wall check.
 
-						//If all dot coordinates were <<4 the square of the magnitude is <<8
-						if ( k > range )
-							continue;
+		//All these shifts are to increase the precision of the intersection point and distance considering how it's
+		//int32 math.
+		k  = ( k << 4 ) / magnitude2; //k will be between 1~16 instead of 0~1
+		xi <<= 4;
+		yi <<= 4;
+		xu = ( x0 << 4 ) + k * ( x1 - x0 );
+		yu = ( y0 << 4 ) + k * ( y1 - y0 );
+		k  = MAGNITUDE2(xi, yi, xu, yu);
 
-						bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-			}
-		}
-	 if( type&BL_MOB )
-		for( by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++ ) {
-			for( bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++ ) {
-				for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->prev && bl_list_count < BL_LIST_MAX ) {
-						xi = bl->x;
-						yi = bl->y;
-						k = ( xi - x0 ) * ( x1 - x0 ) + ( yi - y0 ) * ( y1 - y0 );
-
-						if ( k < 0 || k > len_limit )
-							continue;
-
-						if ( k > magnitude2 && !path_search_long(nullptr, m, x0, y0, xi, yi, CELL_CHKWALL) )
-							continue; //Targets beyond the initial ending point need the wall check.
-
-						k  = ( k << 4 ) / magnitude2; //k will be between 1~16 instead of 0~1
-						xi <<= 4;
-						yi <<= 4;
-						xu = ( x0 << 4 ) + k * ( x1 - x0 );
-						yu = ( y0 << 4 ) + k * ( y1 - y0 );
-						k  = MAGNITUDE2(xi, yi, xu, yu);
-
-						//If all dot coordinates were <<4 the square of the magnitude is <<8
-						if ( k > range )
-							continue;
-
-						bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-			}
-		}
+		//If all dot coordinates were <<4 the square of the magnitude is <<8
+		return k <= range;
+	});
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinpath: block count too many!\n");
+	// Path skills hit their targets in the same order as before
+	map_block_sort_legacy(blockcount);
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1427,7 +1468,7 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;	//[Skotlex]
 
 }
@@ -1451,10 +1492,8 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 {
 	int32 returnCount = 0;  //Total sum of returned values of func()
 
-	int32 i, blockcount = bl_list_count;
-	block_list *bl;
-	int32 bx, by;
-	int32 mx0, mx1, my0, my1, rx, ry;
+	size_t i, blockcount = bl_list.size();
+	int32 mx0, mx1, my0, my1;
 	uint8 dir = map_calc_dir_xy( x0, y0, x1, y1, DIR_EAST );
 	int16 dx = dirx[dir];
 	int16 dy = diry[dir];
@@ -1480,7 +1519,7 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 
 	struct map_data *mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
@@ -1507,85 +1546,32 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 	mx1 = min(mx1, mapdata->xs - 1);
 	my1 = min(my1, mapdata->ys - 1);
 
-	if (type&~BL_MOB) {
-		for (by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++) {
-			for (bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++) {
-				for (bl = mapdata->block[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if (bl->prev && bl->type&type && bl_list_count < BL_LIST_MAX) {
-						//Check if inside search area
-						if (bl->x < mx0 || bl->x > mx1 || bl->y < my0 || bl->y > my1)
-							continue;
-						//What matters now is the relative x and y from the start point
-						rx = (bl->x - x0);
-						ry = (bl->y - y0);
-						//Do not hit source cell
-						if (battle_config.skill_eightpath_same_cell == 0 && rx == 0 && ry == 0)
-							continue;
-						//This turns it so that the area that is hit is always with positive rx and ry
-						rx *= dx;
-						ry *= dy;
-						//These checks only need to be done for diagonal paths
-						if( direction_diagonal( (directions)dir ) ){
-							//Check for length
-							if ((rx + ry < offset) || (rx + ry > 2 * (length + (offset/2) - 1)))
-								continue;
-							//Check for width
-							if (abs(rx - ry) > 2 * range)
-								continue;
-						}
-						//Everything else ok, check for line of sight from source
-						if (!path_search_long(nullptr, m, x0, y0, bl->x, bl->y, CELL_CHKWALL))
-							continue;
-						//All checks passed, add to list
-						bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
-		}
-	}
-	if (type&BL_MOB) {
-		for (by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++) {
-			for (bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++) {
-				for (bl = mapdata->block_mob[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if (bl->prev && bl_list_count < BL_LIST_MAX) {
-						//Check if inside search area
-						if (bl->x < mx0 || bl->x > mx1 || bl->y < my0 || bl->y > my1)
-							continue;
-						//What matters now is the relative x and y from the start point
-						rx = (bl->x - x0);
-						ry = (bl->y - y0);
-						//Do not hit source cell
-						if (battle_config.skill_eightpath_same_cell == 0 && rx == 0 && ry == 0)
-							continue;
-						//This turns it so that the area that is hit is always with positive rx and ry
-						rx *= dx;
-						ry *= dy;
-						//These checks only need to be done for diagonal paths
-						if( direction_diagonal( (directions)dir ) ){
-							//Check for length
-							if ((rx + ry < offset) || (rx + ry > 2 * (length + (offset / 2) - 1)))
-								continue;
-							//Check for width
-							if (abs(rx - ry) > 2 * range)
-								continue;
-						}
-						//Everything else ok, check for line of sight from source
-						if (!path_search_long(nullptr, m, x0, y0, bl->x, bl->y, CELL_CHKWALL))
-							continue;
-						//All checks passed, add to list
-						bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
+	map_block_collect(mapdata, mx0, my0, mx1, my1, type, [&]( block_list* bl ){
+		//What matters now is the relative x and y from the start point
+		int32 rx = (bl->x - x0);
+		int32 ry = (bl->y - y0);
+		//Do not hit source cell
+		if (battle_config.skill_eightpath_same_cell == 0 && rx == 0 && ry == 0)
+			return false;
+		//This turns it so that the area that is hit is always with positive rx and ry
+		rx *= dx;
+		ry *= dy;
+		//These checks only need to be done for diagonal paths
+		if( direction_diagonal( (directions)dir ) ){
+			//Check for length
+			if ((rx + ry < offset) || (rx + ry > 2 * (length + (offset/2) - 1)))
+				return false;
+			//Check for width
+			if (abs(rx - ry) > 2 * range)
+				return false;
 		}
-	}
-
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachindir: block count too many!\n");
+		//Everything else ok, check for line of sight from source
+		return path_search_long(nullptr, m, x0, y0, bl->x, bl->y, CELL_CHKWALL);
+	});
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1593,44 +1579,34 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;
 }
 
-// Copy of map_foreachincell, but applied to the whole map. [Skotlex]
-int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type,...)
+size_t map_foreach_collectmap(int16 m, int32 type)
 {
-	int32 b, bsize;
-	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size();
 	struct map_data *mapdata = map_getmapdata(m);
-	va_list ap;
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
-		return 0;
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
+		return blockcount;
 	}
 
-	bsize = mapdata->bxs * mapdata->bys;
+	map_block_collect(mapdata, 0, 0, mapdata->xs - 1, mapdata->ys - 1, type, []( block_list* bl ){ return true; });
 
-	if( type&~BL_MOB )
-		for( b = 0; b < bsize; b++ )
-			for( bl = mapdata->block[ b ]; bl != nullptr; bl = bl->next )
-				if( bl->type&type && bl_list_count < BL_LIST_MAX )
-					bl_list[ bl_list_count++ ] = bl;
-
-	if( type&BL_MOB )
-		for( b = 0; b < bsize; b++ )
-			for( bl = mapdata->block_mob[ b ]; bl != nullptr; bl = bl->next )
-				if( bl_list_count < BL_LIST_MAX )
-					bl_list[ bl_list_count++ ] = bl;
+	return blockcount;
+}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinmap: block count too many!\n");
+// Copy of map_foreachincell, but applied to the whole map. [Skotlex]
+int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type,...)
+{
+	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
+	size_t blockcount = map_foreach_collectmap(m, type), i;
+	va_list ap;
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count ; i++ ) {
+	for( i = blockcount; i < bl_list.size() ; i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1638,11 +1614,10 @@ int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type,.
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize(blockcount);
 	return returnCount;
 }
 
-
 /// Generates a new flooritem object id from the interval [MIN_FLOORITEM, MAX_FLOORITEM).
 /// Used for floor items, skill units and chatroom objects.
 /// @return The new object id
@@ -1724,7 +1699,7 @@ void map_clearflooritem(block_list *bl) {
 bool map_cell_free(int16 m, int16 x, int16 y, int32 type)
 {
 	struct map_data* mapdata = map_getmapdata(m);
-	if (mapdata == nullptr || mapdata->block == nullptr) {
+	if (mapdata == nullptr || mapdata->cell == nullptr) {
 		return false;
 	}
 
@@ -1823,12 +1798,13 @@ int32 map_search_freecell(block_list *src, int16 m, int16 *x, int16 *y, int16 rx
 
 	struct map_data *mapdata = map_getmapdata(m);
 
-	if( mapdata == nullptr || mapdata->block == nullptr ){
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
 		return 0;
 	}
 
 	int16 edge = battle_config.map_edge_size;
 	int16 edge_valid = std::min(edge, (int16)5);
+	bool counted = false;
 	// In most situations there are 50 tries officially (default value)
 	while(tries--) {
 		// For map-wide search, the configured tiles from the edge are not considered (default: 15)
@@ -1860,6 +1836,26 @@ int32 map_search_freecell(block_list *src, int16 m, int16 *x, int16 *y, int16 rx
 			}
 			return 1;
 		}
+		else if (!counted)
+		{
+			// Stop early if the area has no reachable cell at all, instead of using up the tries
+			int16 x0 = (rx >= 0) ? bx - rx : edge, x1 = (rx >= 0) ? bx + rx : mapdata->xs - edge - 1;
+			int16 y0 = (ry >= 0) ? by - ry : edge, y1 = (ry >= 0) ? by + ry : mapdata->ys - edge - 1;
+
+			x0 = std::max(x0, edge_valid);
+			y0 = std::max(y0, edge_valid);
+			x1 = std::min<int16>(x1, mapdata->xs - edge_valid);
+			y1 = std::min<int16>(y1, mapdata->ys - edge_valid);
+			counted = true;
+
+			int32 free = (x0 <= x1 && y0 <= y1) ? map_countcells(mapdata, x0, y0, x1, y1, CELL_CHKREACH) : 0;
+
+			if (bx >= x0 && bx <= x1 && by >= y0 && by <= y1 && map_getcellp(mapdata, bx, by, CELL_CHKREACH))
+				free--; // The target tile itself is never picked
+
+			if (free <= 0)
+				break;
+		}
 	}
 	*x = bx;
 	*y = by;
@@ -2028,7 +2024,7 @@ int32 map_addflooritem(struct item *item, int32 amount, int16 m, int16 x, int16
 
 	CREATE(fitem, flooritem_data, 1);
 	fitem->type=BL_ITEM;
-	fitem->prev = fitem->next = nullptr;
+	fitem->prev = nullptr;
 	fitem->m=m;
 	fitem->x=x;
 	fitem->y=y;
@@ -2810,6 +2806,8 @@ bool map_addnpc(int16 m,npc_data *nd)
 	}
 	mapdata->npc_num++;
 	idb_put(id_db,nd->id,nd);
+	if (nd->subtype == NPCTYPE_WARP)
+		navgraph_warps_changed(m);
 	return true;
 }
 
@@ -2858,8 +2856,6 @@ int32 map_addinstancemap(int32 src_m, int32 instance_id, bool no_mapflag)
 	dst_map->users = 0;
 	dst_map->xs = src_map->xs;
 	dst_map->ys = src_map->ys;
-	dst_map->bxs = src_map->bxs;
-	dst_map->bys = src_map->bys;
 	dst_map->iwall_num = src_map->iwall_num;
 
 	memset(dst_map->npc, 0, sizeof(dst_map->npc));
@@ -2872,11 +2868,13 @@ int32 map_addinstancemap(int32 src_m, int32 instance_id, bool no_mapflag)
 
 	CREATE( dst_map->cell, struct mapcell, num_cell );
 	memcpy( dst_map->cell, src_map->cell, num_cell * sizeof(struct mapcell) );
+	map_cellplanes_alloc( dst_map );
+	if( src_map->cell_planes != nullptr )
+		memcpy( dst_map->cell_planes, src_map->cell_planes, (size_t)CELL_PLANE_MAX * dst_map->ys * dst_map->cell_stride * sizeof(uint64) );
+	map_cell_generation++;
+	dst_map->cell_generation = map_cell_generation;
 
-	size_t size = dst_map->bxs * dst_map->bys * sizeof(block_list*);
-
-	dst_map->block = (block_list **)aCalloc(1,size);
-	dst_map->block_mob = (block_list **)aCalloc(1,size);
+	map_block_alloc(dst_map, src_map->block_size);
 
 	dst_map->index = mapindex_addmap(-1, dst_map->name);
 	dst_map->channel = nullptr;
@@ -2958,15 +2956,10 @@ int32 map_delinstancemap(int32 m)
 	mapdata->mob_delete_timer = INVALID_TIMER;
 
 	// Free memory
-	if (mapdata->cell)
-		aFree(mapdata->cell);
-	mapdata->cell = nullptr;
-	if (mapdata->block)
-		aFree(mapdata->block);
-	mapdata->block = nullptr;
-	if (mapdata->block_mob)
-		aFree(mapdata->block_mob);
-	mapdata->block_mob = nullptr;
+	map_freecells(mapdata);
+	map_cell_generation++;
+	mapdata->cell_generation = map_cell_generation;
+	map_block_free(mapdata);
 
 	map_free_questinfo(mapdata);
 	mapdata->damage_adjust = {};
@@ -3394,24 +3387,231 @@ int32 map_getcellp(struct map_data* m,int16 x,int16 y,cell_chk cellchk)
 	}
 }
 
-/*==========================================
- * Change the type/flags of a map cell
- * 'cell' - which flag to modify
- * 'flag' - true = on, false = off
- *------------------------------------------*/
-void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag)
+/// Returns the number of set bits of a word
+static inline int32 map_popcount(uint64 bits)
 {
-	int32 j;
-	struct map_data *mapdata = map_getmapdata(m);
-
-	if( m < 0 || x < 0 || x >= mapdata->xs || y < 0 || y >= mapdata->ys )
+#if defined(__GNUC__)
+	return __builtin_popcountll(bits);
+#else
+	bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+	bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+	bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int32)((bits * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/// Returns a mask of the lowest 'count' bits
+static inline uint64 map_cellmask(int32 count)
+{
+	return (count >= 64) ? ~(uint64)0 : ((uint64)1 << count) - 1;
+}
+
+/// Returns a row of a cell plane
+static inline uint64* map_cellplane(struct map_data* m, e_cell_plane plane, int32 y)
+{
+	return m->cell_planes + ((size_t)plane * m->ys + y) * m->cell_stride;
+}
+
+/// Reads 'count' bits of a cell plane row, starting at cell x.
+/// Rows end with a spare word, so the word after x can always be read.
+static inline uint64 map_cellplane_bits(const uint64* row, int32 x, int32 count)
+{
+	int32 word = x >> 6;
+	int32 shift = x & 63;
+	uint64 bits = row[word] >> shift;
+
+	if (shift != 0)
+		bits |= row[word + 1] << (64 - shift);
+
+	return bits & map_cellmask(count);
+}
+
+/**
+ * Checks up to 64 cells of a row at once.
+ * The walkable and shootable checks are read from the cell planes, 64 cells per word,
+ * the others fall back to map_getcellp.
+ * @param m: Map data
+ * @param x: First cell of the row
+ * @param y: Row
+ * @param count: Number of cells (1-64)
+ * @param cellchk: Check to do, like map_getcellp
+ * @return Bit i is set if the check is true for cell x+i
+ */
+uint64 map_getcellbits(struct map_data* m, int16 x, int16 y, int32 count, cell_chk cellchk)
+{
+	bool planes = false;
+
+	nullpo_ret(m);
+
+	switch (cellchk) {
+#ifndef CELL_NOSTACK
+		case CELL_CHKPASS:
+		case CELL_CHKNOPASS:
+#endif
+		case CELL_CHKREACH:
+		case CELL_CHKNOREACH:
+		case CELL_CHKWALL:
+		case CELL_CHKCLIFF:
+			planes = (m->cell_planes != nullptr);
+			break;
+		default:
+			break;
+	}
+
+	if (!planes) {
+		uint64 bits = 0;
+
+		for (int32 i = 0; i < count; i++) {
+			if (map_getcellp(m, x + i, y, cellchk))
+				bits |= (uint64)1 << i;
+		}
+
+		return bits;
+	}
+
+	//NOTE: like map_getcellp, this intentionally overrides the last row and column
+	uint64 edge = (cellchk == CELL_CHKNOPASS) ? map_cellmask(count) : 0;
+
+	if (y < 0 || y >= m->ys - 1)
+		return edge;
+
+	int32 lo = std::max<int32>(x, 0);
+	int32 hi = std::min<int32>(x + count, m->xs - 1);
+
+	if (lo >= hi)
+		return edge;
+
+	uint64 walkable = map_cellplane_bits(map_cellplane(m, CELL_PLANE_WALKABLE, y), lo, hi - lo);
+	uint64 shootable = map_cellplane_bits(map_cellplane(m, CELL_PLANE_SHOOTABLE, y), lo, hi - lo);
+	uint64 bits;
+
+	switch (cellchk) {
+		case CELL_CHKPASS:
+		case CELL_CHKREACH:
+			bits = walkable;
+			break;
+		case CELL_CHKNOPASS:
+		case CELL_CHKNOREACH:
+			bits = ~walkable;
+			break;
+		case CELL_CHKWALL:
+			bits = ~walkable & ~shootable;
+			break;
+		default: // CELL_CHKCLIFF
+			bits = ~walkable & shootable;
+			break;
+	}
+
+	uint64 valid = map_cellmask(hi - lo);
+
+	return ((bits & valid) << (lo - x)) | (edge & ~(valid << (lo - x)));
+}
+
+/**
+ * Checks if any cell of a row segment matches a check, such as a non-walkable cell on a straight walk.
+ * @param m: Map data
+ * @param x0: First cell of the segment
+ * @param x1: Last cell of the segment
+ * @param y: Row
+ * @param cellchk: Check to do, like map_getcellp
+ * @return True if the check is true for any cell
+ */
+bool map_getcellrow(struct map_data* m, int16 x0, int16 x1, int16 y, cell_chk cellchk)
+{
+	for (int32 x = x0; x <= x1; x += 64) {
+		if (map_getcellbits(m, x, y, std::min<int32>(x1 - x + 1, 64), cellchk) != 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Counts the cells of a rectangle that match a check, such as the free cells of an area.
+ * @param m: Map data
+ * @param x0: Left column
+ * @param y0: Bottom row
+ * @param x1: Right column
+ * @param y1: Top row
+ * @param cellchk: Check to do, like map_getcellp
+ * @return Number of cells the check is true for
+ */
+int32 map_countcells(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk)
+{
+	int32 count = 0;
+
+	for (int32 y = y0; y <= y1; y++) {
+		for (int32 x = x0; x <= x1; x += 64)
+			count += map_popcount(map_getcellbits(m, x, y, std::min<int32>(x1 - x + 1, 64), cellchk));
+	}
+
+	return count;
+}
+
+/// Allocates the cell planes of a map, filled by map_cellplanes_fill
+static void map_cellplanes_alloc(struct map_data* m)
+{
+	m->cell_stride = (m->xs + 63) / 64 + 1;
+	CREATE(m->cell_planes, uint64, (size_t)CELL_PLANE_MAX * m->ys * m->cell_stride);
+}
+
+/// Fills the cell planes of a map from its cells.
+/// Only touches the given memory, so the maps can be filled in parallel.
+static void map_cellplanes_fill(const struct mapcell* cell, uint64* planes, int16 xs, int16 ys, int32 stride)
+{
+	uint64* walkable = planes + (size_t)CELL_PLANE_WALKABLE * ys * stride;
+	uint64* shootable = planes + (size_t)CELL_PLANE_SHOOTABLE * ys * stride;
+
+	for (int32 y = 0; y < ys; y++) {
+		for (int32 x = 0; x < xs; x += 64) {
+			int32 count = std::min<int32>(xs - x, 64);
+			uint64 walkable_bits = 0, shootable_bits = 0;
+
+			for (int32 i = 0; i < count; i++, cell++) {
+				walkable_bits |= (uint64)cell->walkable << i;
+				shootable_bits |= (uint64)cell->shootable << i;
+			}
+
+			walkable[y * stride + (x >> 6)] = walkable_bits;
+			shootable[y * stride + (x >> 6)] = shootable_bits;
+		}
+	}
+}
+
+/// Updates a cell in a cell plane
+static void map_cellplanes_set(struct map_data* m, e_cell_plane plane, int16 x, int16 y, bool flag)
+{
+	if (m->cell_planes == nullptr)
+		return;
+
+	uint64* word = map_cellplane(m, plane, y) + (x >> 6);
+	uint64 bit = (uint64)1 << (x & 63);
+
+	if (flag)
+		*word |= bit;
+	else
+		*word &= ~bit;
+}
+
+/*==========================================
+ * Change the type/flags of a map cell
+ * 'cell' - which flag to modify
+ * 'flag' - true = on, false = off
+ *------------------------------------------*/
+void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag)
+{
+	int32 j;
+	struct map_data *mapdata = map_getmapdata(m);
+
+	if( m < 0 || x < 0 || x >= mapdata->xs || y < 0 || y >= mapdata->ys )
 		return;
 
 	j = x + y*mapdata->xs;
+	map_cell_generation++;
 
 	switch( cell ) {
-		case CELL_WALKABLE:      mapdata->cell[j].walkable = flag;      break;
-		case CELL_SHOOTABLE:     mapdata->cell[j].shootable = flag;     break;
+		case CELL_WALKABLE:      mapdata->cell[j].walkable = flag;      map_cellplanes_set(mapdata, CELL_PLANE_WALKABLE, x, y, flag);  mapdata->cell_generation = map_cell_generation; break;
+		case CELL_SHOOTABLE:     mapdata->cell[j].shootable = flag;     map_cellplanes_set(mapdata, CELL_PLANE_SHOOTABLE, x, y, flag); mapdata->cell_generation = map_cell_generation; break;
 		case CELL_WATER:         mapdata->cell[j].water = flag;         break;
 
 		case CELL_NPC:           mapdata->cell[j].npc = flag;           break;
@@ -3440,9 +3640,13 @@ void map_setgatcell(int16 m, int16 x, int16 y, int32 gat)
 	j = x + y*mapdata->xs;
 
 	cell = map_gat2cell(gat);
+	map_cell_generation++;
 	mapdata->cell[j].walkable = cell.walkable;
 	mapdata->cell[j].shootable = cell.shootable;
 	mapdata->cell[j].water = cell.water;
+	map_cellplanes_set(mapdata, CELL_PLANE_WALKABLE, x, y, cell.walkable);
+	map_cellplanes_set(mapdata, CELL_PLANE_SHOOTABLE, x, y, cell.shootable);
+	mapdata->cell_generation = map_cell_generation;
 }
 
 /*==========================================
@@ -3665,55 +3869,334 @@ static char *map_init_mapcache(FILE *fp)
 	return buffer;
 }
 
+/// Maps of the map cache files by name, in the order the files are searched
+typedef std::unordered_map<std::string, std::vector<const struct map_cache_map_info*>> map_cache_index;
+
+/// Cells of a map waiting to be decoded and copied into the cell planes
+struct s_map_cells_job {
+	struct mapcell* cell;
+	uint64* planes;
+	int16 xs, ys;
+	int32 stride;
+	const struct map_cache_map_info* info; // nullptr if the cells are already loaded
+	const struct map_cells_map_info* cached; // Cell cache entry the cells are mapped from, checked before they are used
+	const struct map_cache_map_info* source; // Map cache entry to decode the cells from if the cell cache entry is corrupt
+	int32 unknown; // Cells with an unrecognized gat type
+	bool failed;
+	bool corrupt; // The cell cache entry did not match its crc
+};
+
 /*==========================================
- * Map cache reading
- * [Shinryo]: Optimized some behaviour to speed this up
- *==========================================*/
-int32 map_readfromcache(struct map_data *m, char *buffer, char *decode_buffer)
+ * Map cache indexing
+ *------------------------------------------*/
+static void map_indexmapcache(char *buffer, map_cache_index& index)
 {
-	int32 i;
 	struct map_cache_main_header *header = (struct map_cache_main_header *)buffer;
-	struct map_cache_map_info *info = nullptr;
 	char *p = buffer + sizeof(struct map_cache_main_header);
 
-	for(i = 0; i < header->map_count; i++) {
-		info = (struct map_cache_map_info *)p;
+	for( int32 i = 0; i < header->map_count; i++ ){
+		struct map_cache_map_info *info = (struct map_cache_map_info *)p;
 
-		if( strcmp(m->name, info->name) == 0 )
-			break; // Map found
+		index[info->name].push_back( info );
 
 		// Jump to next entry..
 		p += sizeof(struct map_cache_map_info) + info->len;
 	}
+}
 
-	if( info && i < header->map_count ) {
-		unsigned long size, xy;
+/*==========================================
+ * Map cache reading
+ * [Shinryo]: Optimized some behaviour to speed this up
+ * The cells are only allocated here, map_decodecells decodes them.
+ *==========================================*/
+static const struct map_cache_map_info* map_readfromcache(struct map_data *m, const map_cache_index& index)
+{
+	auto it = index.find( m->name );
+
+	if( it == index.end() )
+		return nullptr; // Not found
+
+	for( const struct map_cache_map_info* info : it->second ){
+		unsigned long size;
 
 		if( info->xs <= 0 || info->ys <= 0 )
-			return 0;// Invalid
+			continue;// Invalid
 
-		m->xs = info->xs;
-		m->ys = info->ys;
 		size = (unsigned long)info->xs*(unsigned long)info->ys;
 
 		if(size > MAX_MAP_SIZE) {
 			ShowWarning("map_readfromcache: %s exceeded MAX_MAP_SIZE of %d\n", info->name, MAX_MAP_SIZE);
-			return 0; // Say not found to remove it from list.. [Shinryo]
+			continue; // Say not found to remove it from list.. [Shinryo]
 		}
 
-		// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
-		decode_zip(decode_buffer, &size, p+sizeof(struct map_cache_map_info), info->len);
-
+		m->xs = info->xs;
+		m->ys = info->ys;
 		CREATE(m->cell, struct mapcell, size);
 
+		return info;
+	}
 
-		for( xy = 0; xy < size; ++xy )
-			m->cell[xy] = map_gat2cell(decode_buffer[xy]);
+	return nullptr;
+}
 
-		return 1;
+/**
+ * Decodes the cells of a map from the map cache.
+ * Runs on the map loading threads, so it only reports through the job.
+ * @param job: map to decode
+ * @param gat2cell: cell of every gat type
+ * @param decode_buffer: buffer of MAX_MAP_SIZE bytes
+ */
+static void map_decodecells(s_map_cells_job& job, const struct mapcell* gat2cell, uint8* decode_buffer)
+{
+	unsigned long size = (unsigned long)job.info->xs*(unsigned long)job.info->ys;
+	unsigned long decoded = size;
+
+	// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
+	if( decode_zip(decode_buffer, &decoded, (const char*)job.info + sizeof(struct map_cache_map_info), job.info->len) != 0 ){
+		job.failed = true;
+		return;
 	}
 
-	return 0; // Not found
+	for( unsigned long xy = 0; xy < size; ++xy ){
+		if( decode_buffer[xy] > 6 )
+			job.unknown++; // Left as a blocked cell, like map_gat2cell
+		else
+			job.cell[xy] = gat2cell[decode_buffer[xy]];
+	}
+}
+
+/*==========================================
+ * Cell cache
+ *------------------------------------------*/
+
+/// Hashes the map cache files the cell cache is built from
+static uint32 map_cells_source(const std::vector<char*>& buffers)
+{
+	uint32 hash = MAP_CELLS_VERSION;
+
+	for( char* buffer : buffers ){
+		struct map_cache_main_header *header = (struct map_cache_main_header *)buffer;
+
+		hash = hash * 31 + (uint32)grfio_crc32( (const unsigned char*)buffer, header->file_size );
+	}
+
+	return hash;
+}
+
+/**
+ * Maps the cell cache into memory, pages are only copied when a map-server changes them.
+ * @param source: hash of the map cache files
+ * @param index: maps in the cell cache by name
+ * @return true if the cell cache is up to date
+ */
+static bool map_cells_open(uint32 source, std::unordered_map<std::string, const struct map_cells_map_info*>& index)
+{
+	if( map_cells_cache[0] == '\0' )
+		return false;
+
+#ifndef WIN32
+	int32 fd = open(map_cells_cache, O_RDONLY);
+	struct stat st;
+
+	if( fd < 0 )
+		return false;
+
+	if( fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct map_cells_main_header) ){
+		close(fd);
+		return false;
+	}
+
+	// Private and writable, so the cells can be changed without touching the file
+	void* data = mmap(nullptr, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if( data == MAP_FAILED )
+		return false;
+
+	map_cells.data = (char*)data;
+	map_cells.size = st.st_size;
+#else
+	FILE* fp = fopen(map_cells_cache, "rb");
+
+	if( fp == nullptr )
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	map_cells.size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	CREATE(map_cells.data, char, map_cells.size);
+
+	if( map_cells.size < sizeof(struct map_cells_main_header) || fread(map_cells.data, 1, map_cells.size, fp) != map_cells.size ){
+		fclose(fp);
+		map_cells_close();
+		return false;
+	}
+
+	fclose(fp);
+#endif
+
+	struct map_cells_main_header* header = (struct map_cells_main_header*)map_cells.data;
+
+	if( memcmp(header->magic, "RACC", 4) != 0 || header->version != MAP_CELLS_VERSION || header->cell_size != sizeof(struct mapcell) || header->source != source
+		|| sizeof(struct map_cells_main_header) + (size_t)header->map_count * sizeof(struct map_cells_map_info) > map_cells.size ){
+		map_cells_close();
+		return false;
+	}
+
+	struct map_cells_map_info* info = (struct map_cells_map_info*)( map_cells.data + sizeof(struct map_cells_main_header) );
+
+	if( (uint32)grfio_crc32( (const unsigned char*)info, header->map_count * sizeof(struct map_cells_map_info) ) != header->crc ){
+		ShowWarning("map_cells_open: Cell cache '%s' is corrupt, rebuilding it.\n", map_cells_cache);
+		map_cells_close();
+		return false;
+	}
+
+	for( uint32 i = 0; i < header->map_count; i++, info++ ){
+		size_t size = (size_t)info->xs * (size_t)info->ys * sizeof(struct mapcell);
+
+		if( info->xs <= 0 || info->ys <= 0 || info->offset % MAP_CELLS_ALIGN != 0 || info->offset + size > map_cells.size ){
+			map_cells_close();
+			index.clear();
+			return false;
+		}
+
+		index[info->name] = info;
+	}
+
+	return true;
+}
+
+/// Checks the cells of a map in the cell cache against its crc
+static bool map_cells_check(const struct map_cells_map_info* info)
+{
+	size_t size = (size_t)info->xs * (size_t)info->ys * sizeof(struct mapcell);
+
+	return (uint32)grfio_crc32( (const unsigned char*)( map_cells.data + info->offset ), (uint32)size ) == info->crc;
+}
+
+/// Checks if the cells of a map are in the cell cache
+static bool map_cells_ismapped(struct mapcell* cell)
+{
+	return map_cells.data != nullptr && (char*)cell >= map_cells.data && (char*)cell < map_cells.data + map_cells.size;
+}
+
+/**
+ * Releases the cell cache.
+ */
+static void map_cells_close(void)
+{
+	if( map_cells.data == nullptr )
+		return;
+
+#ifndef WIN32
+	munmap(map_cells.data, map_cells.size);
+#else
+	aFree(map_cells.data);
+#endif
+	map_cells.data = nullptr;
+	map_cells.size = 0;
+}
+
+/**
+ * Writes the cells of the loaded maps to the cell cache.
+ * Must be called before anything changes the cells.
+ * Maps of the current cell cache that are not loaded are kept, so map-servers with different map lists share one file.
+ * The file is written under a name of this process and replaced by renaming, so map-servers that mapped the
+ * old one or write at the same time are not affected.
+ * @param source: hash of the map cache files
+ * @param cached: maps of the current cell cache, see map_cells_open
+ */
+static void map_cells_write(uint32 source, const std::unordered_map<std::string, const struct map_cells_map_info*>& cached)
+{
+	// Cells of every map in the file, the loaded maps first
+	std::vector<std::pair<struct map_cells_map_info, const struct mapcell*>> maps;
+	std::unordered_map<std::string, bool> loaded;
+
+	for( int32 i = 0; i < map_num; i++ ){
+		struct map_cells_map_info info = {};
+
+		safestrncpy(info.name, map[i].name, sizeof(info.name));
+		info.xs = map[i].xs;
+		info.ys = map[i].ys;
+		info.crc = (uint32)grfio_crc32( (const unsigned char*)map[i].cell, (uint32)( (size_t)map[i].xs * map[i].ys * sizeof(struct mapcell) ) );
+		maps.emplace_back(info, map[i].cell);
+		loaded[map[i].name] = true;
+	}
+
+	for( const auto& it : cached ){
+		if( loaded.find(it.first) != loaded.end() || !map_cells_check(it.second) )
+			continue;
+
+		maps.emplace_back(*it.second, (const struct mapcell*)( map_cells.data + it.second->offset ));
+	}
+
+#ifndef WIN32
+	std::string tmp = std::string(map_cells_cache) + "." + std::to_string(getpid()) + ".tmp";
+#else
+	std::string tmp = std::string(map_cells_cache) + "." + std::to_string(_getpid()) + ".tmp";
+#endif
+	FILE* fp = fopen(tmp.c_str(), "wb");
+
+	if( fp == nullptr ){
+		ShowWarning("map_cells_write: Unable to create cell cache '%s'.\n", tmp.c_str());
+		return;
+	}
+
+	struct map_cells_main_header header = {};
+	std::vector<struct map_cells_map_info> infos;
+	uint64 offset = sizeof(struct map_cells_main_header) + (uint64)maps.size() * sizeof(struct map_cells_map_info);
+
+	for( auto& it : maps ){
+		offset = ( offset + MAP_CELLS_ALIGN - 1 ) / MAP_CELLS_ALIGN * MAP_CELLS_ALIGN;
+
+		it.first.offset = offset;
+		infos.push_back(it.first);
+		offset += (uint64)it.first.xs * it.first.ys * sizeof(struct mapcell);
+	}
+
+	memcpy(header.magic, "RACC", 4);
+	header.version = MAP_CELLS_VERSION;
+	header.cell_size = sizeof(struct mapcell);
+	header.source = source;
+	header.map_count = (uint32)infos.size();
+	header.crc = (uint32)grfio_crc32( (const unsigned char*)infos.data(), (uint32)( infos.size() * sizeof(struct map_cells_map_info) ) );
+
+	bool success = fwrite(&header, sizeof(header), 1, fp) == 1 && ( infos.empty() || fwrite(infos.data(), sizeof(struct map_cells_map_info), infos.size(), fp) == infos.size() );
+
+	for( size_t i = 0; success && i < maps.size(); i++ ){
+		size_t cells = (size_t)infos[i].xs * infos[i].ys;
+
+		success = fseek(fp, (long)infos[i].offset, SEEK_SET) == 0 && fwrite(maps[i].second, sizeof(struct mapcell), cells, fp) == cells;
+	}
+
+	if( fclose(fp) != 0 )
+		success = false;
+
+	if( !success ){
+		ShowWarning("map_cells_write: Failed to write cell cache '%s'.\n", tmp.c_str());
+		remove(tmp.c_str());
+		return;
+	}
+
+#ifdef WIN32
+	remove(map_cells_cache); // rename does not replace files on Windows
+#endif
+	if( rename(tmp.c_str(), map_cells_cache) != 0 ){
+		ShowWarning("map_cells_write: Failed to replace cell cache '%s'.\n", map_cells_cache);
+		remove(tmp.c_str());
+	}
+}
+
+/// Frees the cells of a map
+static void map_freecells(struct map_data* mapdata)
+{
+	if( mapdata->cell != nullptr && !map_cells_ismapped(mapdata->cell) )
+		aFree(mapdata->cell);
+	mapdata->cell = nullptr;
+	if( mapdata->cell_planes != nullptr )
+		aFree(mapdata->cell_planes);
+	mapdata->cell_planes = nullptr;
 }
 
 int32 map_addmap(char* mapname)
@@ -3913,6 +4396,17 @@ int32 map_readallmaps (void)
 	FILE* fp;
 	// Has the uncompressed gat data of all maps, so just one allocation has to be made
 	std::vector<char *> map_cache_buffer = {};
+	map_cache_index map_cache_maps;
+	std::unordered_map<std::string, const struct map_cells_map_info*> map_cells_maps;
+	std::vector<s_map_cells_job> jobs;
+	uint32 source = 0;
+	bool cells_outdated = false;
+	bool broken = false; // Some cells failed to decode
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration time_read{}, time_decode{}, time_write{};
+	size_t threads = 0;
+	size_t cells_mapped = 0;
+	size_t cells_decoded = 0;
 
 	if( enable_grf )
 		ShowStatus("Loading maps (using GRF files)...\n");
@@ -3941,19 +4435,28 @@ int32 map_readallmaps (void)
 			}
 
 			fclose(fp);
+
+			map_indexmapcache(map_cache_buffer.back(), map_cache_maps);
 		}
+
+		source = map_cells_source(map_cache_buffer);
+
+		if( map_cells_cache[0] != '\0' && !map_cells_open(source, map_cells_maps) )
+			cells_outdated = true;
 	}
 
+	time_read = std::chrono::steady_clock::now() - start;
+
 	int32 maps_removed = 0;
 
 	ShowStatus("Loading %d maps.\n", map_num);
 
 	for (int32 i = 0; i < map_num; i++) {
-		size_t size;
 		bool success = false;
 		uint16 idx = 0;
 		struct map_data *mapdata = &map[i];
-		char map_cache_decode_buffer[MAX_MAP_SIZE];
+		const struct map_cache_map_info* info = nullptr;
+		const struct map_cells_map_info* cached = nullptr;
 
 #ifdef DETAILED_LOADING_OUTPUT
 		// show progress
@@ -3963,16 +4466,22 @@ int32 map_readallmaps (void)
 		if( enable_grf ){
 			// try to load the map
 			success = map_readgat(mapdata) != 0;
+		}else if( auto it = map_cells_maps.find(mapdata->name); it != map_cells_maps.end() ){
+			// already decoded in the cell cache, checked by the decoding threads
+			mapdata->xs = it->second->xs;
+			mapdata->ys = it->second->ys;
+			mapdata->cell = (struct mapcell*)( map_cells.data + it->second->offset );
+			cached = it->second;
+			success = true;
+			cells_mapped++;
 		}else{
-			// try to load the map
-			for (const auto &cache : map_cache_buffer) {
-				if ((success = map_readfromcache(mapdata, cache, map_cache_decode_buffer)) != 0)
-					break;
-			}
+			// try to load the map, the cells are decoded once all maps are known
+			success = ( info = map_readfromcache(mapdata, map_cache_maps) ) != nullptr;
 		}
 
 		// The map was not found - remove it
 		if (!(idx = mapindex_name2id(mapdata->name)) || !success) {
+			map_freecells(mapdata);
 			map_delmapid(i);
 			maps_removed++;
 			i--;
@@ -3983,34 +4492,109 @@ int32 map_readallmaps (void)
 
 		if (uidb_get(map_db,(uint32)mapdata->index) != nullptr) {
 			ShowWarning("Map %s already loaded!" CL_CLL "\n", mapdata->name);
-			if (mapdata->cell) {
-				aFree(mapdata->cell);
-				mapdata->cell = nullptr;
-			}
+			map_freecells(mapdata);
 			map_delmapid(i);
 			maps_removed++;
 			i--;
 			continue;
 		}
 
+		map_cellplanes_alloc(mapdata);
+		const struct map_cache_map_info* source_info = nullptr;
+
+		if( cached != nullptr ){
+			if( auto it = map_cache_maps.find(mapdata->name); it != map_cache_maps.end() ){
+				for( const struct map_cache_map_info* candidate : it->second ){
+					if( candidate->xs == cached->xs && candidate->ys == cached->ys ){
+						source_info = candidate;
+						break;
+					}
+				}
+			}
+		}
+
+		jobs.push_back({ mapdata->cell, mapdata->cell_planes, mapdata->xs, mapdata->ys, mapdata->cell_stride, info, cached, source_info, 0, false, false });
+
+		if( info != nullptr ){
+			cells_decoded++;
+			if( map_cells_cache[0] != '\0' )
+				cells_outdated = true;
+		}
+
 		map_addmap2db(mapdata);
 
 		mapdata->m = i;
 		memset(mapdata->moblist, 0, sizeof(mapdata->moblist));	//Initialize moblist [Skotlex]
 		mapdata->mob_delete_timer = INVALID_TIMER;	//Initialize timer [Skotlex]
 
-		mapdata->bxs = (mapdata->xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
-		mapdata->bys = (mapdata->ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-		size = mapdata->bxs * mapdata->bys * sizeof(block_list*);
-		mapdata->block = (block_list**)aCalloc(size, 1);
-		mapdata->block_mob = (block_list**)aCalloc(size, 1);
+		map_block_alloc(mapdata, map_block_size);
 
 		memset(&mapdata->save, 0, sizeof(struct point));
 		mapdata->damage_adjust = {};
 		mapdata->channel = nullptr;
 	}
 
+	if( !jobs.empty() ){
+		// Decoding the maps is independent of each other, the cells were allocated above
+		std::chrono::steady_clock::time_point decode_start = std::chrono::steady_clock::now();
+		std::vector<std::thread> decoders;
+		std::atomic<size_t> next( 0 );
+		struct mapcell gat2cell[7];
+
+		for( int32 gat = 0; gat < ARRAYLENGTH(gat2cell); gat++ )
+			gat2cell[gat] = map_gat2cell(gat);
+
+		threads = std::min<size_t>( jobs.size(), std::clamp<size_t>( std::thread::hardware_concurrency(), 1, MAP_LOAD_THREADS_MAX ) );
+
+		for( size_t t = 0; t < threads; t++ ){
+			decoders.emplace_back( [&](){
+				std::vector<uint8> decode_buffer( MAX_MAP_SIZE );
+
+				for( size_t j = next++; j < jobs.size(); j = next++ ){
+					if( jobs[j].cached != nullptr && !map_cells_check( jobs[j].cached ) ){
+						// Decoded again into the private mapping
+						jobs[j].corrupt = true;
+						jobs[j].info = jobs[j].source;
+						if( jobs[j].info == nullptr ){
+							memset( jobs[j].cell, 0, (size_t)jobs[j].xs * jobs[j].ys * sizeof(struct mapcell) );
+							jobs[j].failed = true;
+						}
+					}
+					if( jobs[j].info != nullptr )
+						map_decodecells( jobs[j], gat2cell, decode_buffer.data() );
+					map_cellplanes_fill( jobs[j].cell, jobs[j].planes, jobs[j].xs, jobs[j].ys, jobs[j].stride );
+				}
+			} );
+		}
+
+		for( std::thread& decoder : decoders )
+			decoder.join();
+
+		for( const s_map_cells_job& job : jobs ){
+			if( job.corrupt ){
+				ShowWarning("map_readallmaps: Cells of map %s in the cell cache are corrupt, rebuilding it.\n", job.cached->name);
+				cells_outdated = true;
+			}
+			if( job.failed ){
+				ShowWarning("map_readallmaps: Failed to decode the cells of map %s, leaving them blocked.\n", job.info != nullptr ? job.info->name : job.cached->name);
+				broken = true;
+			}
+			if( job.info == nullptr )
+				continue;
+			if( job.unknown > 0 )
+				ShowWarning("map_gat2cell: unrecognized gat type in '%d' cells of map %s\n", job.unknown, job.info->name);
+		}
+
+		time_decode = std::chrono::steady_clock::now() - decode_start;
+	}
+
+	if( cells_outdated && !broken ){ // Do not cache broken cells
+		std::chrono::steady_clock::time_point write_start = std::chrono::steady_clock::now();
+
+		map_cells_write(source, map_cells_maps);
+		time_write = std::chrono::steady_clock::now() - write_start;
+	}
+
 	// intialization and configuration-dependent adjustments of mapflags
 	map_flags_init();
 
@@ -4030,6 +4614,18 @@ int32 map_readallmaps (void)
 	// finished map loading
 	ShowInfo("Successfully loaded '" CL_WHITE "%d" CL_RESET "' maps." CL_CLL "\n",map_num);
 
+	auto ms = []( std::chrono::steady_clock::duration duration ){
+		return static_cast<int64>( std::chrono::duration_cast<std::chrono::milliseconds>( duration ).count() );
+	};
+
+	ShowInfo("Map loading took '" CL_WHITE "%" PRId64 CL_RESET "' ms:\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms reading the map caches\n"
+		"\t-'" CL_WHITE "%" PRIuPTR CL_RESET "' maps from the cell cache\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms decoding '" CL_WHITE "%" PRIuPTR CL_RESET "' maps and building the cell planes on %" PRIuPTR " threads\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms writing the cell cache\n",
+		ms( std::chrono::steady_clock::now() - start ), ms( time_read ), cells_mapped,
+		ms( time_decode ), cells_decoded, threads, ms( time_write ));
+
 	return 0;
 }
 
@@ -4037,6 +4633,127 @@ int32 map_readallmaps (void)
 static int32 map_ip_set = 0;
 static int32 char_ip_set = 0;
 
+static int32 map_block_benchmark_sub(block_list* bl, va_list ap)
+{
+	return 1;
+}
+
+/// Same work as a typical area callback: skip the source and filter by type
+static int32 map_block_benchmark_dispatch(block_list* bl, const block_list* src, int32 type)
+{
+	return ( bl != src && bl->type&type ) ? 1 : 0;
+}
+
+static int32 map_block_benchmark_dispatch_sub(block_list* bl, va_list ap)
+{
+	const block_list* src = va_arg(ap, const block_list*);
+	int32 type = va_arg(ap, int32);
+
+	return map_block_benchmark_dispatch(bl, src, type);
+}
+
+/**
+ * Measures the cost of area searches on a map for different block sizes.
+ * Temporary objects are spread over the walkable cells first, so that the
+ * density of a crowded town can be reproduced on any map. They are removed
+ * again and the original block size is restored before returning.
+ * @param m: Map ID
+ * @param objects: Amount of temporary objects to add
+ */
+static void map_block_benchmark(int16 m, int32 objects)
+{
+	struct map_data* mapdata = map_getmapdata(m);
+
+	if( mapdata == nullptr || mapdata->cell == nullptr ){
+		ShowWarning("Console: Unknown map.\n");
+		return;
+	}
+
+	// Rough mix of a populated town: players, mobs, npcs, floor items and skill units
+	static const enum bl_type types[] = { BL_PC, BL_PC, BL_PC, BL_MOB, BL_NPC, BL_NPC, BL_ITEM, BL_SKILL, BL_SKILL, BL_PET };
+	static const uint16 block_sizes[] = { 4, 8, 16, 32 };
+	const int32 iterations = 20000;
+	std::vector<block_list> dummies(objects);
+	std::vector<block_list*> centers;
+	uint16 block_size = mapdata->block_size;
+
+	for( size_t i = 0; i < dummies.size(); i++ ){
+		block_list& bl = dummies[i];
+
+		bl.prev = nullptr;
+		bl.id = 0;
+		bl.m = m;
+		bl.type = types[i % ARRAYLENGTH(types)];
+
+		// Find a walkable cell, give up after a few tries on maps without many of them
+		for( int32 tries = 0; tries < 100; tries++ ){
+			bl.x = rnd_value<int16>(0, mapdata->xs - 1);
+			bl.y = rnd_value<int16>(0, mapdata->ys - 1);
+
+			if( map_getcell(m, bl.x, bl.y, CELL_CHKPASS) )
+				break;
+		}
+
+		if( map_addblock(&bl) == 0 && bl.type == BL_PC )
+			centers.push_back(&bl);
+	}
+
+	if( centers.empty() ){
+		ShowWarning("map_block_benchmark: No search centers on map %s.\n", mapdata->name);
+	}else{
+		ShowInfo("Benchmarking area searches on map %s (%dx%d) with %d additional objects...\n", mapdata->name, mapdata->xs, mapdata->ys, objects);
+
+		for( uint16 size : block_sizes ){
+			map_setblocksize(m, size);
+
+			auto start = std::chrono::steady_clock::now();
+			int64 hits_pc = 0;
+
+			for( int32 i = 0; i < iterations; i++ )
+				hits_pc += map_foreachinallrange(map_block_benchmark_sub, centers[i % centers.size()], AREA_SIZE, BL_PC);
+
+			auto middle = std::chrono::steady_clock::now();
+			int64 hits_all = 0;
+
+			for( int32 i = 0; i < iterations; i++ )
+				hits_all += map_foreachinallrange(map_block_benchmark_sub, centers[i % centers.size()], AREA_SIZE, BL_ALL);
+
+			auto end = std::chrono::steady_clock::now();
+
+			ShowInfo("block_size %2hu: BL_PC %6" PRId64 " ns/search (%" PRId64 " hits), BL_ALL %6" PRId64 " ns/search (%" PRId64 " hits)\n", size,
+				(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / iterations, hits_pc / iterations,
+				(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / iterations, hits_all / iterations);
+		}
+
+		map_setblocksize(m, block_size);
+
+		// Compare the va_list callbacks against the callable map_foreach* versions
+		auto start = std::chrono::steady_clock::now();
+
+		for( int32 i = 0; i < iterations; i++ )
+			map_foreachinallrange(map_block_benchmark_dispatch_sub, centers[i % centers.size()], AREA_SIZE, BL_ALL, centers[i % centers.size()], BL_CHAR);
+
+		auto middle = std::chrono::steady_clock::now();
+
+		for( int32 i = 0; i < iterations; i++ ){
+			const block_list* src = centers[i % centers.size()];
+
+			map_foreachinallrange([src]( block_list* bl ){ return map_block_benchmark_dispatch( bl, src, BL_CHAR ); }, src, AREA_SIZE, BL_ALL);
+		}
+
+		auto end = std::chrono::steady_clock::now();
+
+		ShowInfo("block_size %2hu: BL_ALL va_list callback %6" PRId64 " ns/search, callable %6" PRId64 " ns/search\n", block_size,
+			(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / iterations,
+			(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / iterations);
+	}
+
+	map_setblocksize(m, block_size);
+
+	for( block_list& bl : dummies )
+		map_delblock(&bl);
+}
+
 /*==========================================
  * Console Command Parser [Wizputer]
  *------------------------------------------*/
@@ -4097,12 +4814,152 @@ int32 parse_console(const char* buf){
 	else if( strcmpi("ers_report", type) == 0 ){
 		ers_report();
 	}
+	else if( n == 2 && strcmpi("blockbench", type) == 0 ){
+		int32 objects = 1500;
+
+		if( sscanf(command, "%11s %11d", mapname, &objects) < 1 || objects < 0 ){
+			ShowInfo("Usage: blockbench:<map> {<objects>}\n");
+			return 0;
+		}
+
+		map_block_benchmark(map_mapname2mapid(mapname), objects);
+	}
+	else if( n == 2 && strcmpi("path", type) == 0 ){
+		int32 searches = 10000;
+
+		char file[256];
+
+		if( sscanf(command, "bench %11s %11d", mapname, &searches) >= 1 && searches > 0 )
+			path_benchmark(map_mapname2mapid(mapname), searches);
+		else if( sscanf(command, "record %255[^\n]", file) == 1 )
+			path_record(file);
+		else if( strcmpi("stop", command) == 0 )
+			path_record(nullptr);
+		else if( sscanf(command, "replay %255[^\n]", file) == 1 )
+			path_replay(file);
+		else if( strcmpi("cache", command) == 0 )
+			path_cache_report(false);
+		else if( strcmpi("cache reset", command) == 0 )
+			path_cache_report(true);
+		else if( strcmpi("routes", command) == 0 )
+			unit_walkroute_report(false);
+		else if( strcmpi("routes reset", command) == 0 )
+			unit_walkroute_report(true);
+		else
+			ShowInfo("Usage: path:bench <map> {<searches>} | path:record <file> | path:stop | path:replay <file> | path:cache {reset} | path:routes {reset}\n");
+	}
+	else if( n == 2 && strcmpi("navi", type) == 0 ){
+		char mapname2[MAP_NAME_LENGTH];
+		int16 x0, y0, x1 = 0, y1 = 0;
+		int32 queries = 10000;
+
+		if( sscanf(command, "route %11s %6hd %6hd %11s %6hd %6hd", mapname, &x0, &y0, mapname2, &x1, &y1) >= 4 )
+			navgraph_print_route(map_mapname2mapid(mapname), x0, y0, map_mapname2mapid(mapname2), x1, y1);
+		else if( strncmpi(command, "bench", 5) == 0 && ( sscanf(command + 5, "%11d", &queries) < 1 || queries > 0 ) )
+			navgraph_benchmark(queries);
+		else
+			ShowInfo("Usage: navi:route <map> <x> <y> <map> {<x> <y>} | navi:bench {<queries>}\n");
+	}
+	else if( n == 2 && strcmpi("packet", type) == 0 ){
+		char file[256], name[NAME_LENGTH] = "";
+		int32 runs = 100;
+		int32 args;
+
+		if( sscanf(command, "record %255[^\n]", file) == 1 )
+			clif_packet_record(file);
+		else if( strcmpi("stop", command) == 0 )
+			clif_packet_record(nullptr);
+		else if( ( args = sscanf(command, "bench %255s %11d %23[^\n]", file, &runs, name) ) >= 1 && runs > 0 ){
+			map_session_data* sd = nullptr;
+
+			if( args == 3 && ( sd = map_nick2sd(name, false) ) == nullptr )
+				ShowError("packet:bench: Player '%s' is not online.\n", name);
+			else
+				clif_packet_benchmark(file, runs, sd);
+		}else
+			ShowInfo("Usage: packet:record <file> | packet:stop | packet:bench <file> {<runs> {<player>}}\n");
+	}
+	else if( n == 2 && strcmpi("timer", type) == 0 ){
+		char file[256];
+
+		if( sscanf(command, "record %255[^\n]", file) == 1 )
+			timer_record(file);
+		else if( strcmpi("stop", command) == 0 )
+			timer_record(nullptr);
+		else if( sscanf(command, "bench %255[^\n]", file) == 1 )
+			timer_benchmark(file);
+		else
+			ShowInfo("Usage: timer:record <file> | timer:stop | timer:bench <file>\n");
+	}
+	else if( n == 2 && strcmpi("status", type) == 0 ){
+		if( strcmpi("counters", command) == 0 )
+			status_calc_counters_report(false);
+		else if( strcmpi("counters reset", command) == 0 )
+			status_calc_counters_report(true);
+		else
+			ShowInfo("Usage: status:counters {reset}\n");
+	}
+	else if( n == 2 && strcmpi("log", type) == 0 ){
+		if( strcmpi("stats", command) == 0 )
+			log_sql_async_report(false);
+		else if( strcmpi("stats reset", command) == 0 )
+			log_sql_async_report(true);
+		else
+			ShowInfo("Usage: log:stats {reset}\n");
+	}
+	else if( n == 2 && strcmpi("save", type) == 0 ){
+		if( strcmpi("stats", command) == 0 )
+			chrif_save_report(false);
+		else if( strcmpi("stats reset", command) == 0 )
+			chrif_save_report(true);
+		else
+			ShowInfo("Usage: save:stats {reset}\n");
+	}
+	else if( n == 2 && strcmpi("script", type) == 0 ){
+		char file[256];
+		int32 runs = 1000;
+
+		if( sscanf(command, "bench %255s %11d", file, &runs) < 1 || runs < 0 ){
+			ShowInfo("Usage: script:bench <file> {<runs>}\n");
+			return 0;
+		}
+
+		script_benchmark(file, runs);
+	}
+	else if( n == 2 && strcmpi("db", type) == 0 ){
+		uint32 count = 100000;
+
+		if( strncmpi(command, "bench", 5) != 0 ){
+			ShowInfo("Usage: db:bench {<entries>}\n");
+			return 0;
+		}
+
+		sscanf(command + 5, "%10u", &count);
+		db_benchmark(count);
+	}
 	else if( strcmpi("help", type) == 0 ) {
 		ShowInfo("Available commands:\n");
 		ShowInfo("\t admin:@<atcommand> => Uses an atcommand. Do NOT use commands requiring an attached player.\n");
 		ShowInfo("\t admin:map:<map> <x> <y> => Changes the map from which console commands are executed.\n");
 		ShowInfo("\t server:shutdown => Stops the server.\n");
 		ShowInfo("\t ers_report => Displays database usage.\n");
+		ShowInfo("\t blockbench:<map> {<objects>} => Benchmarks area searches on a map for several block sizes.\n");
+		ShowInfo("\t path:bench <map> {<searches>} => Compares path searches reading the cell planes with ones reading each cell.\n");
+		ShowInfo("\t path:record <file> => Records all full walk path searches to a file until path:stop.\n");
+		ShowInfo("\t path:replay <file> => Replays recorded walk path searches with A*, jump point search and the path cache.\n");
+		ShowInfo("\t path:cache {reset} => Displays how many walk path searches were answered by the path cache.\n");
+		ShowInfo("\t path:routes {reset} => Displays how many long walk paths were walked and the path searches of their segments.\n");
+		ShowInfo("\t navi:route <map> <x> <y> <map> {<x> <y>} => Finds the warps leading from one cell to another with the navigation graph.\n");
+		ShowInfo("\t navi:bench {<queries>} => Times route queries between random warp exits.\n");
+		ShowInfo("\t packet:record <file> => Records all parsed client packets to a file until packet:stop.\n");
+		ShowInfo("\t packet:bench <file> {<runs> {<player>}} => Replays recorded client packets through the packet parser, and into the handlers as an online player.\n");
+		ShowInfo("\t timer:record <file> => Records all timer operations to a file until timer:stop.\n");
+		ShowInfo("\t timer:bench <file> => Replays recorded timer operations against all timer backends.\n");
+		ShowInfo("\t db:bench {<entries>} => Compares the tree and the flat database implementations.\n");
+		ShowInfo("\t script:bench <file> {<runs>} => Compiles a script body from a file and times repeated runs of it.\n");
+		ShowInfo("\t status:counters {reset} => Displays how many status recalculations and equipment scripts were avoided.\n");
+		ShowInfo("\t log:stats {reset} => Displays the queue depth and throughput of the asynchronous SQL log writer.\n");
+		ShowInfo("\t save:stats {reset} => Displays how many character saves were sent as deltas and the bytes they saved.\n");
 	}
 
 	return 0;
@@ -4183,6 +5040,8 @@ int32 map_config_read(const char *cfgName)
 				minsave_interval = 1;
 		} else if (strcmpi(w1, "save_settings") == 0)
 			save_settings = cap_value(atoi(w2),CHARSAVE_NONE,CHARSAVE_ALL);
+		else if (strcmpi(w1, "save_delta") == 0)
+			save_delta = config_switch(w2) != 0;
 		else if (strcmpi(w1, "motd_txt") == 0)
 			safestrncpy(motd_txt, w2, sizeof(motd_txt));
 		else if (strcmpi(w1, "charhelp_txt") == 0)
@@ -4199,6 +5058,14 @@ int32 map_config_read(const char *cfgName)
 			enable_spy = config_switch(w2);
 		else if (strcmpi(w1, "use_grf") == 0)
 			enable_grf = config_switch(w2);
+		else if (strcmpi(w1, "map_cells_cache") == 0) {
+			if (strcmpi(w2, "no") == 0)
+				map_cells_cache[0] = '\0';
+			else
+				safestrncpy(map_cells_cache, w2, sizeof(map_cells_cache));
+		}
+		else if (strcmpi(w1, "block_size") == 0)
+			map_block_size = cap_value(atoi(w2), 1, BLOCK_SIZE_MAX);
 		else if (strcmpi(w1, "console_msg_log") == 0)
 			console_msg_log = atoi(w2);//[Ind]
 		else if (strcmpi(w1, "console_log_filepath") == 0)
@@ -4432,6 +5299,7 @@ int32 map_sql_close(void)
 
 	if (log_config.sql_logs)
 	{
+		log_sql_async_stop();
 		ShowStatus("Close Log DB Connection....\n");
 		Sql_Free(logmysql_handle);
 		logmysql_handle = nullptr;
@@ -4459,6 +5327,8 @@ int32 log_sql_init(void)
 		if ( SQL_ERROR == Sql_SetEncoding(logmysql_handle, default_codepage.c_str()) )
 			Sql_ShowDebug(logmysql_handle);
 
+	log_sql_async_start();
+
 	return 0;
 }
 
@@ -5047,6 +5917,7 @@ void MapServer::finalize(){
 	do_final_clif();
 #endif
 	do_final_npc();
+	do_final_navgraph();
 	do_final_quest();
 	do_final_achievement();
 	do_final_script();
@@ -5078,9 +5949,8 @@ void MapServer::finalize(){
 	for (int32 i = 0; i < map_num; i++) {
 		struct map_data *mapdata = map_getmapdata(i);
 
-		if(mapdata->cell) aFree(mapdata->cell);
-		if(mapdata->block) aFree(mapdata->block);
-		if(mapdata->block_mob) aFree(mapdata->block_mob);
+		map_freecells(mapdata);
+		map_block_free(mapdata);
 		if(battle_config.dynamic_mobs) { //Dynamic mobs flag by [random]
 			if(mapdata->mob_delete_timer != INVALID_TIMER)
 				delete_timer(mapdata->mob_delete_timer, map_removemobs_timer);
@@ -5090,6 +5960,8 @@ void MapServer::finalize(){
 		mapdata->damage_adjust = {};
 	}
 
+	map_cells_close();
+
 	mapindex_final();
 	if(enable_grf)
 		grfio_final();
@@ -5390,13 +6262,13 @@ bool MapServer::initialize( int32 argc, char *argv[] ){
 	inter_config_read(INTER_CONF_NAME);
 	log_config_read(LOG_CONF_NAME);
 
-	id_db = idb_alloc(DB_OPT_BASE);
-	pc_db = idb_alloc(DB_OPT_BASE);	//Added for reliable map_id2sd() use. [Skotlex]
-	mobid_db = idb_alloc(DB_OPT_BASE);	//Added to lower the load of the lazy mob ai. [Skotlex]
+	id_db = idb_alloc(DB_OPT_FLAT);
+	pc_db = idb_alloc(DB_OPT_FLAT);	//Added for reliable map_id2sd() use. [Skotlex]
+	mobid_db = idb_alloc(DB_OPT_FLAT);	//Added to lower the load of the lazy mob ai. [Skotlex]
 	bossid_db = idb_alloc(DB_OPT_BASE); // Used for Convex Mirror quick MVP search
 	map_db = uidb_alloc(DB_OPT_BASE);
 	nick_db = idb_alloc(DB_OPT_BASE);
-	charid_db = uidb_alloc(DB_OPT_BASE);
+	charid_db = uidb_alloc(DB_OPT_FLAT);
 	regen_db = idb_alloc(DB_OPT_BASE); // efficient status_natural_heal processing
 	iwall_db = strdb_alloc(DB_OPT_RELEASE_DATA,2*NAME_LENGTH+2+1); // [Zephyrus] Invisible Walls
 
@@ -5446,6 +6318,7 @@ bool MapServer::initialize( int32 argc, char *argv[] ){
 	do_init_duel();
 	do_init_vending();
 	do_init_buyingstore();
+	do_init_navgraph();
 
 	npc_event_do_oninit();	// Init npcs (OnInit)
 
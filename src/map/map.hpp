@@ -308,6 +308,21 @@ enum bl_type : uint16{
 /// For common mapforeach calls. Since pets cannot be affected, they aren't included here yet.
 #define BL_CHAR (BL_PC|BL_MOB|BL_HOM|BL_MER|BL_ELEM)
 
+/// Object classes that are kept in separate block buckets of a map
+/// A search only visits the buckets of the classes matching its bl_type mask
+enum e_block_class : uint8{
+	BLOCK_PC = 0,
+	BLOCK_MOB,
+	BLOCK_NPC,
+	BLOCK_ITEM,
+	BLOCK_SKILL,
+	BLOCK_OTHER, // BL_PET, BL_HOM, BL_MER, BL_CHAT and BL_ELEM
+	BLOCK_MAX
+};
+
+#define BLOCK_SIZE_DEFAULT 8
+#define BLOCK_SIZE_MAX 64
+
 /// NPC Subtype
 enum npc_subtype : uint8{
 	NPCTYPE_WARP, /// Warp
@@ -459,7 +474,8 @@ enum auto_trigger_flag {
 };
 
 struct block_list {
-	struct block_list *next,*prev;
+	struct block_list *prev; // Not nullptr while the object is on a map
+	uint32 block_pos; // Index inside the block bucket the object is currently stored in
 	int32 id;
 	int16 m,x,y;
 	enum bl_type type;
@@ -760,6 +776,13 @@ enum cell_t{
 	CELL_NOBUYINGSTORE,
 };
 
+// Terrain flags that are also kept as bitsets, one bit per cell
+enum e_cell_plane : uint8 {
+	CELL_PLANE_WALKABLE = 0,
+	CELL_PLANE_SHOOTABLE,
+	CELL_PLANE_MAX
+};
+
 // used by map_getcell()
 enum cell_chk : uint8 {
 	CELL_GETTYPE,			// Retrieves a cell's 'gat' type
@@ -820,11 +843,14 @@ struct map_data {
 	char name[MAP_NAME_LENGTH];
 	uint16 index; // The map index used by the mapindex* functions.
 	struct mapcell* cell; // Holds the information of each map cell (nullptr if the map is not on this map-server).
-	block_list **block;
-	block_list **block_mob;
+	uint64* cell_planes; // Bitsets of the terrain flags of the cells, CELL_PLANE_MAX planes of ys rows (see map_getcellbits)
+	int32 cell_stride; // Number of words per row of the cell planes
+	uint32 cell_generation; // map_cell_generation of the last change to the walkable or shootable flags, see path_search
+	std::vector<block_list*>* block[BLOCK_MAX]; // Objects per block, one bucket array per e_block_class (allocated on first use)
 	int16 m;
 	int16 xs,ys; // map dimensions (in cells)
 	int16 bxs,bys; // map dimensions (in blocks)
+	uint16 block_size; // width and height of a block (in cells)
 	int16 bgscore_lion, bgscore_eagle; // Battleground ScoreBoard
 	int32 npc_num; // number total of npc on the map
 	int32 npc_num_area; // number of npc with a trigger area on the map
@@ -906,8 +932,12 @@ extern struct inter_conf inter_config;
 
 int32 map_getcell(int16 m,int16 x,int16 y,cell_chk cellchk);
 int32 map_getcellp(struct map_data* m,int16 x,int16 y,cell_chk cellchk);
+uint64 map_getcellbits(struct map_data* m, int16 x, int16 y, int32 count, cell_chk cellchk);
+bool map_getcellrow(struct map_data* m, int16 x0, int16 x1, int16 y, cell_chk cellchk);
+int32 map_countcells(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk);
 void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag);
 void map_setgatcell(int16 m, int16 x, int16 y, int32 gat);
+extern uint32 map_cell_generation; // Increased whenever any map cell changes
 
 extern struct map_data map[];
 extern int32 map_num;
@@ -915,8 +945,10 @@ extern int32 map_num;
 extern int32 autosave_interval;
 extern int32 minsave_interval;
 extern int16 save_settings;
+extern bool save_delta;
 extern int32 night_flag; // 0=day, 1=night [Yor]
 extern int32 enable_spy; //Determines if @spy commands are active.
+extern uint16 map_block_size; // Default block size of the spatial index (in cells)
 
 // Agit Flags
 extern bool agit_flag;
@@ -1145,6 +1177,7 @@ int32 map_freeblock_unlock(void);
 int32 map_addblock(block_list* bl);
 int32 map_delblock(block_list* bl);
 int32 map_moveblock(block_list *, int32, int32, t_tick);
+bool map_setblocksize(int16 m, uint16 block_size);
 int32 map_foreachinrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 type, ...);
 int32 map_foreachinallrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 type, ...);
 int32 map_foreachinshootrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 type, ...);
@@ -1158,6 +1191,72 @@ int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, in
 int32 map_foreachinpath(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int16 range, int32 length, int32 type, ...);
 int32 map_foreachindir(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int16 range, int32 length, int32 offset, int32 type, ...);
 int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type, ...);
+
+// Building blocks of the callable map_foreach* versions below, not meant to be used directly
+std::vector<block_list*>& map_foreach_list();
+bool map_foreach_wallcheck();
+size_t map_foreach_collectrange(const block_list* center, int16 range, int32 type, bool wall_check);
+size_t map_foreach_collectarea(int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, bool wall_check);
+size_t map_foreach_collectmap(int16 m, int32 type);
+
+/// Calls func for every object collected behind blockcount and drops them from the search list again
+template <typename F>
+int32 map_foreach_call(size_t blockcount, F& func){
+	std::vector<block_list*>& list = map_foreach_list();
+	int32 returnCount = 0;
+
+	FreeBlockLock freeLock;
+
+	for( size_t i = blockcount; i < list.size(); i++ ){
+		if( list[i]->prev ) // func() may delete this slot, checking for prev ensures it wasn't queued for deletion.
+			returnCount += func( list[i] );
+	}
+
+	list.resize( blockcount );
+	return returnCount;
+}
+
+/// Objects a callable map_foreach* function accepts: anything that can be called as int32 func(block_list*)
+template <typename F>
+using map_foreach_func = std::enable_if_t<std::is_invocable_r_v<int32, F&, block_list*>, int32>;
+
+/// Callable versions of the map_foreach* functions.
+/// The callback receives its context through captures instead of a va_list, so it can be type checked and inlined.
+template <typename F>
+map_foreach_func<F> map_foreachinrange(F func, const block_list* center, int16 range, int32 type){
+	return map_foreach_call( map_foreach_collectrange( center, range, type, map_foreach_wallcheck() ), func );
+}
+
+template <typename F>
+map_foreach_func<F> map_foreachinallrange(F func, const block_list* center, int16 range, int32 type){
+	return map_foreach_call( map_foreach_collectrange( center, range, type, false ), func );
+}
+
+template <typename F>
+map_foreach_func<F> map_foreachinshootrange(F func, const block_list* center, int16 range, int32 type){
+	return map_foreach_call( map_foreach_collectrange( center, range, type, true ), func );
+}
+
+template <typename F>
+map_foreach_func<F> map_foreachinarea(F func, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type){
+	return map_foreach_call( map_foreach_collectarea( m, x0, y0, x1, y1, type, map_foreach_wallcheck() ), func );
+}
+
+template <typename F>
+map_foreach_func<F> map_foreachinallarea(F func, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type){
+	return map_foreach_call( map_foreach_collectarea( m, x0, y0, x1, y1, type, false ), func );
+}
+
+template <typename F>
+map_foreach_func<F> map_foreachinshootarea(F func, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type){
+	return map_foreach_call( map_foreach_collectarea( m, x0, y0, x1, y1, type, true ), func );
+}
+
+template <typename F>
+map_foreach_func<F> map_foreachinmap(F func, int16 m, int32 type){
+	return map_foreach_call( map_foreach_collectmap( m, type ), func );
+}
+
 //blocklist nb in one cell
 int32 map_count_oncell(int16 m,int16 x,int16 y,int32 type,int32 flag);
 skill_unit *map_find_skill_unit_oncell(block_list *,int16 x,int16 y,uint16 skill_id,skill_unit *, int32 flag);
@@ -1321,6 +1420,13 @@ extern int32 db_use_sqldbs;
 extern Sql* mmysql_handle;
 extern Sql* qsmysql_handle;
 extern Sql* logmysql_handle;
+
+extern std::string log_db_ip;
+extern uint16 log_db_port;
+extern std::string log_db_id;
+extern std::string log_db_pw;
+extern std::string log_db_db;
+extern std::string default_codepage;
 #endif
 
 extern char barter_table[32];
@@ -4,9 +4,13 @@
 #include "mob.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
 #include <cstdlib>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -34,6 +38,7 @@
 #include "log.hpp"
 #include "map.hpp"
 #include "mercenary.hpp"
+#include "navgraph.hpp"
 #include "npc.hpp"
 #include "party.hpp"
 #include "path.hpp"
@@ -1308,20 +1313,240 @@ int32 mob_target(mob_data *md,block_list *bl,int32 dist)
 	return 0;
 }
 
+#ifdef ACTIVEPATHSEARCH
+/*==========================================
+ * Path prefetching for the hard AI [monster_ai_threads]
+ * Each monster near a player is collected once per tick. The range, line of sight and walk
+ * path checks of its target search only depend on the map cells and positions, so they are
+ * done on worker threads before the AI runs and reused while nothing they depend on moved.
+ * The decisions stay on the main thread in the order of mob_ai_sub_foreachclient: they draw
+ * from the shared random generator, change state the next monsters read (targets, damage
+ * logs, spawned slaves) and look up DBMaps, which are not thread safe. Running them on the
+ * workers could not give the same results as the single-threaded AI.
+ *------------------------------------------*/
+
+/// Checks from a monster to a possible target cell
+struct s_mob_ai_path {
+	int16 x, y;
+	const block_list* bl; ///< First possible target on the cell
+	bool in_range; ///< battle_check_range with the view range of the monster
+	bool found;
+	uint8 path_len;
+};
+
+/// Paths searched ahead for one monster, valid as long as it stays on this cell
+struct s_mob_ai_prefetch {
+	const mob_data* md;
+	int16 m, x, y;
+	std::vector<s_mob_ai_path> paths;
+};
+
+static std::unordered_map<int32, s_mob_ai_prefetch> mob_ai_prefetch_db; // Monster ID -> prefetched paths
+static std::vector<s_mob_ai_prefetch*> mob_ai_prefetch_jobs;
+static std::atomic<size_t> mob_ai_prefetch_next;
+static uint32 mob_ai_prefetch_generation = 0; // map_cell_generation the paths were searched with
+
+static std::vector<std::thread> mob_ai_workers;
+static std::mutex mob_ai_worker_mutex;
+static std::condition_variable mob_ai_worker_cv;
+static std::condition_variable mob_ai_worker_done_cv;
+static uint32 mob_ai_worker_round = 0;
+static size_t mob_ai_worker_busy = 0;
+static bool mob_ai_worker_stop = false;
+
+/// Searches the paths of the queued monsters until all of them are taken.
+/// Only the range checks and path searches run here, which just read positions and map cells.
+static void mob_ai_prefetch_run(){
+	for( size_t i = mob_ai_prefetch_next++; i < mob_ai_prefetch_jobs.size(); i = mob_ai_prefetch_next++ ){
+		s_mob_ai_prefetch* prefetch = mob_ai_prefetch_jobs[i];
+
+		for( s_mob_ai_path& path : prefetch->paths ){
+			struct walkpath_data wpd;
+
+			path.in_range = battle_check_range( prefetch->md, path.bl, prefetch->md->db->range2 );
+			path.found = path.in_range && path_search(&wpd, prefetch->m, prefetch->x, prefetch->y, path.x, path.y, 0, CELL_CHKWALL);
+			path.path_len = path.found ? wpd.path_len : 0;
+		}
+	}
+}
+
+static void mob_ai_worker_main( uint32 round ){
+	std::unique_lock<std::mutex> lock( mob_ai_worker_mutex );
+
+	for(;;){
+		mob_ai_worker_cv.wait( lock, [&round]{ return mob_ai_worker_stop || mob_ai_worker_round != round; } );
+
+		if( mob_ai_worker_stop )
+			return;
+
+		round = mob_ai_worker_round;
+		lock.unlock();
+		mob_ai_prefetch_run();
+		lock.lock();
+
+		if( --mob_ai_worker_busy == 0 )
+			mob_ai_worker_done_cv.notify_one();
+	}
+}
+
+/// Starts or stops worker threads until there are exactly count of them
+static void mob_ai_workers_resize( size_t count ){
+	if( mob_ai_workers.size() == count )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mob_ai_worker_mutex );
+		mob_ai_worker_stop = true;
+	}
+	mob_ai_worker_cv.notify_all();
+	for( std::thread& worker : mob_ai_workers )
+		worker.join();
+	mob_ai_workers.clear();
+	mob_ai_worker_stop = false;
+
+	for( size_t i = 0; i < count; i++ )
+		mob_ai_workers.emplace_back( mob_ai_worker_main, mob_ai_worker_round );
+}
+
+/// Queues the paths an aggressive monster may check in its next target search
+static void mob_ai_prefetch_add( mob_data* md ){
+	if( md->prev == nullptr || md->status.hp == 0 || md->ud.state.force_walk )
+		return;
+	if( !(status_get_mode(md)&MD_AGGRESSIVE) && md->state.skillstate != MSS_FOLLOW )
+		return;
+
+	auto result = mob_ai_prefetch_db.try_emplace( md->id );
+
+	if( !result.second )
+		return; // Already seen by another player
+
+	s_mob_ai_prefetch& prefetch = result.first->second;
+	int32 view_range = md->sc.getSCE(SC_BLIND) ? 1 : md->db->range2;
+
+	prefetch.md = md;
+	prefetch.m = md->m;
+	prefetch.x = md->x;
+	prefetch.y = md->y;
+
+	map_foreachinallrange( [md, &prefetch]( block_list* bl ){
+		if( bl == md )
+			return 0;
+		for( const s_mob_ai_path& path : prefetch.paths ){
+			if( path.x == bl->x && path.y == bl->y )
+				return 0;
+		}
+		prefetch.paths.push_back( { bl->x, bl->y, bl, false, false, 0 } );
+		return 1;
+	}, md, view_range, DEFAULT_ENEMY_TYPE(md) );
+
+	if( !prefetch.paths.empty() )
+		mob_ai_prefetch_jobs.push_back( &prefetch );
+}
+
+static int32 mob_ai_prefetch_sub_client( map_session_data* sd, va_list ap ){
+	std::vector<mob_data*>* mobs = va_arg( ap, std::vector<mob_data*>* );
+
+	map_foreachinallrange( [mobs]( block_list* bl ){
+		mobs->push_back( (mob_data*)bl );
+		return 1;
+	}, sd, AREA_SIZE+ACTIVE_AI_RANGE, BL_MOB );
+
+	return 0;
+}
+
+/// Searches the target paths of all monsters the hard AI will process this tick on the worker threads
+static void mob_ai_prefetch(){
+	mob_ai_workers_resize( battle_config.mob_ai_threads );
+
+	if( mob_ai_workers.empty() )
+		return;
+
+	std::vector<mob_data*> mobs;
+
+	map_foreachpc( mob_ai_prefetch_sub_client, &mobs );
+
+	for( mob_data* md : mobs )
+		mob_ai_prefetch_add( md );
+
+	if( mob_ai_prefetch_jobs.empty() )
+		return;
+
+	mob_ai_prefetch_generation = map_cell_generation;
+	mob_ai_prefetch_next = 0;
+	{
+		std::lock_guard<std::mutex> lock( mob_ai_worker_mutex );
+		mob_ai_worker_round++;
+		mob_ai_worker_busy = mob_ai_workers.size();
+	}
+	mob_ai_worker_cv.notify_all();
+
+	// The main thread helps out instead of idling
+	mob_ai_prefetch_run();
+
+	std::unique_lock<std::mutex> lock( mob_ai_worker_mutex );
+	mob_ai_worker_done_cv.wait( lock, []{ return mob_ai_worker_busy == 0; } );
+}
+
+static void mob_ai_prefetch_clear(){
+	mob_ai_prefetch_jobs.clear();
+	mob_ai_prefetch_db.clear();
+}
+
+/// Returns the checks prefetched from a monster to the cell of a target, as long as they are still valid
+static const s_mob_ai_path* mob_ai_prefetched( const mob_data* md, const block_list* bl ){
+	if( mob_ai_prefetch_db.empty() || mob_ai_prefetch_generation != map_cell_generation || bl->m != md->m )
+		return nullptr;
+
+	auto it = mob_ai_prefetch_db.find( md->id );
+
+	if( it == mob_ai_prefetch_db.end() || it->second.m != md->m || it->second.x != md->x || it->second.y != md->y )
+		return nullptr;
+
+	for( const s_mob_ai_path& path : it->second.paths ){
+		if( path.x == bl->x && path.y == bl->y )
+			return &path;
+	}
+
+	return nullptr;
+}
+
+/// Checks if a target is within the view range of a monster, using the prefetched check while it is still valid
+static bool mob_ai_check_range( mob_data* md, block_list* bl ){
+	const s_mob_ai_path* path = mob_ai_prefetched( md, bl );
+
+	if( path != nullptr )
+		return path->in_range;
+
+	return battle_check_range( md, bl, md->db->range2 );
+}
+
+/// Counts the walk path cells from a monster to a target, using the prefetched path while it is still valid
+static bool mob_ai_path_search( mob_data* md, block_list* bl, uint8& path_len ){
+	const s_mob_ai_path* path = mob_ai_prefetched( md, bl );
+
+	if( path != nullptr && path->in_range ){
+		path_len = path->path_len;
+		return path->found;
+	}
+
+	struct walkpath_data wpd;
+
+	if( !path_search(&wpd, md->m, md->x, md->y, bl->x, bl->y, 0, CELL_CHKWALL) )
+		return false;
+
+	path_len = wpd.path_len;
+	return true;
+}
+#endif
+
 /*==========================================
  * The ?? routine of an active monster
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_activesearch(block_list *bl,va_list ap)
+static int32 mob_ai_sub_hard_activesearch(block_list *bl, mob_data *md, block_list **target, int32 mode)
 {
-	mob_data *md;
-	block_list **target;
-	enum e_mode mode;
 	int32 dist;
 
 	nullpo_ret(bl);
-	md=va_arg(ap,mob_data *);
-	target= va_arg(ap,block_list**);
-	mode= static_cast<enum e_mode>(va_arg(ap, int32));
 
 	//If can't seek yet, not an enemy, or you can't attack it, skip.
 	if ((*target) == bl || !status_check_skilluse(md, bl, 0, 0))
@@ -1344,15 +1569,19 @@ static int32 mob_ai_sub_hard_activesearch(block_list *bl,va_list ap)
 	dist = distance_bl(md, bl);
 	if(
 		((*target) == nullptr || !check_distance_bl(md, *target, dist)) &&
+#ifdef ACTIVEPATHSEARCH
+		mob_ai_check_range(md, bl)
+#else
 		battle_check_range(md,bl,md->db->range2)
+#endif
 	) { //Pick closest target?
 #ifdef ACTIVEPATHSEARCH
-		struct walkpath_data wpd;
-		if (!path_search(&wpd, md->m, md->x, md->y, bl->x, bl->y, 0, CELL_CHKWALL)) // Count walk path cells
+		uint8 path_len;
+		if (!mob_ai_path_search(md, bl, path_len)) // Count walk path cells
 			return 0;
 		//Standing monsters use range2, walking monsters use range3
-		if ((md->ud.walktimer == INVALID_TIMER && wpd.path_len > md->db->range2)
-			|| (md->ud.walktimer != INVALID_TIMER && wpd.path_len > md->db->range3))
+		if ((md->ud.walktimer == INVALID_TIMER && path_len > md->db->range2)
+			|| (md->ud.walktimer != INVALID_TIMER && path_len > md->db->range3))
 			return 0;
 #endif
 		(*target) = bl;
@@ -1366,14 +1595,9 @@ static int32 mob_ai_sub_hard_activesearch(block_list *bl,va_list ap)
 /*==========================================
  * chase target-change routine.
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_changechase(block_list *bl,va_list ap)
+static int32 mob_ai_sub_hard_changechase(block_list *bl, mob_data *md, block_list **target)
 {
-	mob_data *md;
-	block_list **target;
-
 	nullpo_ret(bl);
-	md=va_arg(ap,mob_data *);
-	target= va_arg(ap,block_list**);
 
 	//If can't seek yet, not an enemy, or you can't attack it, skip.
 	if ((*target) == bl ||
@@ -1392,13 +1616,8 @@ static int32 mob_ai_sub_hard_changechase(block_list *bl,va_list ap)
 /*==========================================
  * finds nearby bg ally for guardians looking for users to follow.
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_bg_ally(block_list *bl,va_list ap) {
-	mob_data *md;
-	block_list **target;
-
+static int32 mob_ai_sub_hard_bg_ally(block_list *bl, mob_data *md, block_list **target) {
 	nullpo_ret(bl);
-	md=va_arg(ap,mob_data *);
-	target= va_arg(ap,block_list**);
 
 	if( status_check_skilluse(md, bl, 0, 0) && battle_check_target(md,bl,BCT_ENEMY)<=0 ) {
 		(*target) = bl;
@@ -1409,15 +1628,10 @@ static int32 mob_ai_sub_hard_bg_ally(block_list *bl,va_list ap) {
 /*==========================================
  * loot monster item search
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_lootsearch(block_list *bl,va_list ap)
+static int32 mob_ai_sub_hard_lootsearch(block_list *bl, mob_data* md, block_list **target)
 {
-	mob_data* md;
-	block_list **target;
 	int32 dist;
 
-	md = va_arg(ap,mob_data *);
-	target = va_arg(ap,block_list**);
-
 	dist = distance_bl(md, bl);
 	if (mob_can_reach(md, bl, battle_config.loot_range) && (
 		(*target) == nullptr ||
@@ -1773,6 +1987,36 @@ int32 mob_randomwalk(mob_data *md,t_tick tick)
  * @param target: Target the mob should follow
  * @return 0: Do not warp chase, 1: Do warp chase, 2: Already warp chasing
  */
+/**
+ * Looks up the warp NPC that starts the route to a target on another map, for targets
+ * that no warp in sight leads to directly.
+ * @param md: Monster chasing
+ * @param target: Target on another map
+ * @return Warp NPC within the monster's view range or nullptr
+ */
+static npc_data* mob_warpchase_route(mob_data* md, block_list* target)
+{
+	s_navgraph_route route;
+
+	if (!navgraph_route(md->m, md->x, md->y, target->m, target->x, target->y, route) || route.hops.empty())
+		return nullptr;
+
+	// Every map on the way must be accessible through warp chase
+	if (battle_config.mob_warp&4) {
+		for (const s_navgraph_hop& hop : route.hops) {
+			if (hop.to_m != hop.m && map_getmapflag(hop.to_m, MF_NOBRANCH))
+				return nullptr;
+		}
+	}
+
+	npc_data* nd = map_id2nd(route.hops.front().npc_id);
+
+	if (nd == nullptr || nd->m != md->m || !check_distance_bl(md, nd, md->db->range2))
+		return nullptr;
+
+	return nd;
+}
+
 int32 mob_warpchase(mob_data *md, block_list *target)
 {
 	if ((battle_config.mob_ai&0x40) == 0)
@@ -1807,6 +2051,10 @@ int32 mob_warpchase(mob_data *md, block_list *target)
 	map_foreachinallrange(mob_warpchase_sub, md,
 		md->db->range2, type, target, &warp, &distance);
 
+	// No warp in sight leads to the target's map, follow the route over several maps instead
+	if (warp == nullptr && (type&BL_NPC) && target->m != md->m)
+		warp = mob_warpchase_route(md, target);
+
 	if (warp != nullptr && unit_walktobl(md, warp, 0, 0))
 		return 1;
 	return 0;
@@ -2011,20 +2259,20 @@ static bool mob_ai_sub_hard(mob_data *md, t_tick tick)
 	{
 		if (tbl == nullptr) {
 			// Search for items in loot range
-			map_foreachinshootrange(mob_ai_sub_hard_lootsearch, md, battle_config.loot_range, BL_ITEM, md, &tbl);
+			map_foreachinshootrange([&]( block_list* bl ){ return mob_ai_sub_hard_lootsearch( bl, md, &tbl ); }, md, battle_config.loot_range, BL_ITEM);
 		}
 		else if (tbl->type == BL_ITEM && battle_config.monster_loot_search_type == 0) {
 			// Looter already has a target item, but we want to check if there is an item that's closer
 			int16 dist = distance_bl(md, tbl) - 1;
 			if (dist > 0)
-				map_foreachinshootrange(mob_ai_sub_hard_lootsearch, md, dist, BL_ITEM, md, &tbl);
+				map_foreachinshootrange([&]( block_list* bl ){ return mob_ai_sub_hard_lootsearch( bl, md, &tbl ); }, md, dist, BL_ITEM);
 		}
 	}
 
 	if ((mode&MD_AGGRESSIVE && (!tbl || slave_lost_target)) || md->state.skillstate == MSS_FOLLOW)
 	{
 		int32 prev_id = md->target_id;
-		map_foreachinallrange (mob_ai_sub_hard_activesearch, md, view_range, DEFAULT_ENEMY_TYPE(md), md, &tbl, mode);
+		map_foreachinallrange([&]( block_list* bl ){ return mob_ai_sub_hard_activesearch( bl, md, &tbl, mode ); }, md, view_range, DEFAULT_ENEMY_TYPE(md));
 		// If a monster finds a new target that is already in attack range it immediately switches to rush mode
 		// This behavior overrides even angry mode and other mode-specific behavior
 		if (tbl != nullptr && prev_id != md->target_id && battle_check_range(md, tbl, md->status.rhw.range)) {
@@ -2037,7 +2285,7 @@ static bool mob_ai_sub_hard(mob_data *md, t_tick tick)
 	{
 		int32 search_size;
 		search_size = view_range<md->status.rhw.range ? view_range:md->status.rhw.range;
-		map_foreachinallrange (mob_ai_sub_hard_changechase, md, search_size, DEFAULT_ENEMY_TYPE(md), md, &tbl);
+		map_foreachinallrange([&]( block_list* bl ){ return mob_ai_sub_hard_changechase( bl, md, &tbl ); }, md, search_size, DEFAULT_ENEMY_TYPE(md));
 	}
 
 	if (!tbl) { //No targets available.
@@ -2045,7 +2293,7 @@ static bool mob_ai_sub_hard(mob_data *md, t_tick tick)
 		if( md->bg_id && mode&MD_CANATTACK ) {
 			if( md->ud.walktimer != INVALID_TIMER )
 				return true;/* we are already moving */
-			map_foreachinallrange (mob_ai_sub_hard_bg_ally, md, view_range, BL_PC, md, &tbl, mode);
+			map_foreachinallrange([&]( block_list* bl ){ return mob_ai_sub_hard_bg_ally( bl, md, &tbl ); }, md, view_range, BL_PC);
 			if( tbl ) {
 				if( distance_blxy(md, tbl->x, tbl->y) <= 3 || unit_walktobl(md, tbl, 1, 1) )
 					return true;/* we're moving or close enough don't unlock the target. */
@@ -2329,11 +2577,9 @@ TIMER_FUNC(mob_norm_attacked) {
 	return 0;
 }
 
-static int32 mob_ai_sub_hard_timer(block_list *bl,va_list ap)
+static int32 mob_ai_sub_hard_timer(block_list *bl, uint32 char_id, t_tick tick)
 {
 	mob_data *md = (mob_data*)bl;
-	uint32 char_id = va_arg(ap, uint32);
-	t_tick tick = va_arg(ap, t_tick);
 	mob_add_spotted(md, char_id);
 	if (mob_ai_sub_hard(md, tick))
 	{	//Hard AI triggered.
@@ -2348,7 +2594,9 @@ static int32 mob_ai_sub_hard_timer(block_list *bl,va_list ap)
 static int32 mob_ai_sub_foreachclient(map_session_data *sd,va_list ap)
 {
 	t_tick tick=va_arg(ap,t_tick);
-	map_foreachinallrange(mob_ai_sub_hard_timer,sd, AREA_SIZE+ACTIVE_AI_RANGE, BL_MOB, sd->status.char_id, tick);
+	uint32 char_id = sd->status.char_id;
+
+	map_foreachinallrange([char_id, tick]( block_list* bl ){ return mob_ai_sub_hard_timer( bl, char_id, tick ); }, sd, AREA_SIZE+ACTIVE_AI_RANGE, BL_MOB);
 
 	return 0;
 }
@@ -2469,8 +2717,15 @@ static TIMER_FUNC(mob_ai_hard){
 
 	if (battle_config.mob_ai&0x20)
 		map_foreachmob(mob_ai_sub_lazy,tick);
-	else
+	else {
+#ifdef ACTIVEPATHSEARCH
+		mob_ai_prefetch();
+#endif
 		map_foreachpc(mob_ai_sub_foreachclient,tick);
+#ifdef ACTIVEPATHSEARCH
+		mob_ai_prefetch_clear();
+#endif
+	}
 
 	return 0;
 }
@@ -7375,6 +7630,9 @@ void do_final_mob(bool is_reload){
 	mob_summon_db.clear();
 	map_drop_db.clear();
 	if( !is_reload ) {
+#ifdef ACTIVEPATHSEARCH
+		mob_ai_workers_resize( 0 );
+#endif
 		mob_delayed_drops.clear();
 	}
 }
@@ -0,0 +1,713 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "navgraph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+#include <common/cbasetypes.hpp>
+#include <common/mmo.hpp>
+#include <common/random.hpp>
+#include <common/showmsg.hpp>
+
+#include "map.hpp"
+#include "npc.hpp"
+#include "path.hpp"
+#include "status.hpp"
+
+/// Cost of stepping through a warp
+#define NAVGRAPH_WARP_COST (5 * MOVE_COST)
+
+/// Region index of cells that are not walkable
+#define NAVGRAPH_NONE UINT32_MAX
+
+/// Octile distance between two cells
+#define navgraph_octile(x0, y0, x1, y1) (MOVE_COST * std::max(abs((x1) - (x0)), abs((y1) - (y0))) + (MOVE_DIAGONAL_COST - MOVE_COST) * std::min(abs((x1) - (x0)), abs((y1) - (y0))))
+
+/// A connected walkable area inside a cluster
+struct s_navgraph_region {
+	int16 x, y; ///< Walkable cell closest to the middle of the region
+};
+
+/// Edge of the region graph, to a region of a neighbouring cluster
+struct s_navgraph_edge {
+	uint32 to;
+	int32 cost;
+};
+
+/// Warp NPC leaving a map
+struct s_navgraph_portal {
+	npc_data* nd; ///< Read for its current state, the portals are rebuilt when a warp is added or removed
+	int16 x, y;
+	uint32 region;
+	int16 to_m, to_x, to_y;
+	const std::vector<int32>* arrival; ///< Walk cost from the exit to each portal of to_m, valid while arrival_version matches
+	uint32 arrival_version;
+	// State of the last route query that reached the portal
+	uint32 stamp;
+	int32 cost;
+	int16 prev_m, prev_portal;
+};
+
+/// Two level graph of a map.
+/// Each map is cut into NAVGRAPH_CLUSTER x NAVGRAPH_CLUSTER clusters, each cluster is split into the
+/// regions its walkable cells form and regions of neighbouring clusters that touch are linked.
+/// The warps of the map link the region graphs of all maps together.
+struct s_navgraph_map {
+	bool built; ///< Regions and edges are valid for the cells of generation
+	bool warps_dirty; ///< Portals need to be read again from the warps of the map
+	uint32 generation; ///< map_data::cell_generation the regions were built for
+	uint32 version; ///< Increased whenever the portals change
+	int16 cxs, cys; ///< Clusters per row and column
+	std::vector<uint32> cluster_first; ///< First region of each cluster, one more entry than clusters
+	std::vector<s_navgraph_region> regions;
+	std::vector<uint32> edge_first; ///< First edge of each region, one more entry than regions
+	std::vector<s_navgraph_edge> edges;
+	std::vector<s_navgraph_portal> portals;
+	/// Walk cost from a cell to each portal, for the cells warps lead to.
+	/// Keyed by x << 16 | y, cleared whenever regions or portals change.
+	std::unordered_map<uint32, std::vector<int32>> arrivals;
+};
+
+static std::vector<s_navgraph_map> navgraph_maps;
+
+/// Walk cost from the source region of the last navgraph_dijkstra call to each region of its map
+static std::vector<int32> navgraph_dist;
+
+/// Index of the lowest set bit, bits must not be 0
+static inline int32 navgraph_lowest_bit(uint64 bits)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(bits);
+#else
+	int32 i = 0;
+
+	for (; !(bits & 1); bits >>= 1)
+		i++;
+	return i;
+#endif
+}
+
+/**
+ * Splits the walkable cells of a cluster into 4-connected regions.
+ * Diagonal steps are only allowed when both straight cells are walkable, so the 4-connected areas
+ * are exactly the areas a unit can walk through. The labels only depend on the cells, so they
+ * can be computed again later and still match the regions built from them.
+ * @param mapdata: Map data
+ * @param cx: Cluster column
+ * @param cy: Cluster row
+ * @param labels: Receives NAVGRAPH_CLUSTER*NAVGRAPH_CLUSTER labels, 0 for blocked cells, region+1 otherwise
+ * @param centers: Receives the cell closest to the middle of each region, can be nullptr
+ * @return Number of regions
+ */
+static int32 navgraph_label(map_data* mapdata, int16 cx, int16 cy, uint8* labels, std::vector<s_navgraph_region>* centers)
+{
+	struct s_run {
+		uint8 row, lo, hi, parent;
+	} runs[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER / 2];
+	int32 run_count = 0;
+	int16 x0 = cx * NAVGRAPH_CLUSTER, y0 = cy * NAVGRAPH_CLUSTER;
+	int32 w = std::min<int32>(NAVGRAPH_CLUSTER, mapdata->xs - x0);
+	int32 h = std::min<int32>(NAVGRAPH_CLUSTER, mapdata->ys - y0);
+
+	auto find = [&runs](int32 i) {
+		while (runs[i].parent != i)
+			i = runs[i].parent = runs[runs[i].parent].parent;
+		return i;
+	};
+
+	memset(labels, 0, NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER);
+
+	// Runs of walkable cells, joined with the runs of the previous row they touch
+	for (int32 r = 0, prev = 0; r < h; r++) {
+		uint64 bits = map_getcellbits(mapdata, x0, y0 + r, w, CELL_CHKREACH);
+		int32 first = run_count;
+
+		while (bits != 0) {
+			s_run& run = runs[run_count];
+			int32 lo = navgraph_lowest_bit(bits);
+			int32 len = navgraph_lowest_bit(~(bits >> lo));
+
+			bits &= ~((((uint64)1 << len) - 1) << lo);
+			run.row = r;
+			run.lo = lo;
+			run.hi = lo + len - 1;
+			run.parent = run_count;
+
+			for (int32 i = prev; i < first; i++) {
+				if (runs[i].lo <= run.hi && runs[i].hi >= run.lo) {
+					int32 a = find(i), b = find(run_count);
+
+					if (a != b)
+						runs[std::max(a, b)].parent = std::min(a, b);
+				}
+			}
+			run_count++;
+		}
+		prev = first;
+	}
+
+	// Number the regions in the order of their first run
+	uint8 region_of[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER / 2];
+	int32 sum_x[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER / 2], sum_y[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER / 2], cells[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER / 2];
+	int32 count = 0;
+
+	for (int32 i = 0; i < run_count; i++) {
+		int32 root = find(i);
+
+		if (root == i) {
+			sum_x[count] = sum_y[count] = cells[count] = 0;
+			region_of[i] = count++;
+		}
+
+		const s_run& run = runs[i];
+		uint8 region = region_of[root];
+		int32 len = run.hi - run.lo + 1;
+
+		memset(labels + run.row * NAVGRAPH_CLUSTER + run.lo, region + 1, len);
+		sum_x[region] += (run.lo + run.hi) * len / 2;
+		sum_y[region] += run.row * len;
+		cells[region] += len;
+	}
+
+	if (centers == nullptr)
+		return count;
+
+	size_t base = centers->size();
+
+	centers->resize(base + count);
+
+	int32 best[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER / 2];
+
+	std::fill_n(best, count, INT32_MAX);
+
+	for (int32 i = 0; i < run_count; i++) {
+		const s_run& run = runs[i];
+		uint8 region = region_of[find(i)];
+		int32 mx = sum_x[region] / cells[region], my = sum_y[region] / cells[region];
+		int32 x = std::clamp<int32>(mx, run.lo, run.hi);
+		int32 d = (x - mx) * (x - mx) + (run.row - my) * (run.row - my);
+
+		if (d < best[region]) {
+			best[region] = d;
+			(*centers)[base + region].x = x0 + x;
+			(*centers)[base + region].y = y0 + run.row;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Finds the region of a cell.
+ * Blocked cells fall back to the closest walkable cell of their cluster, warps and NPCs
+ * often stand on cells that cannot be walked on.
+ * @return Region index or NAVGRAPH_NONE if the cluster has no walkable cell
+ */
+static uint32 navgraph_region(const s_navgraph_map& g, map_data* mapdata, int16 x, int16 y)
+{
+	if (x < 0 || y < 0 || x >= mapdata->xs || y >= mapdata->ys)
+		return NAVGRAPH_NONE;
+
+	uint8 labels[NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER];
+	int16 cx = x / NAVGRAPH_CLUSTER, cy = y / NAVGRAPH_CLUSTER;
+	int32 lx = x % NAVGRAPH_CLUSTER, ly = y % NAVGRAPH_CLUSTER;
+
+	if (navgraph_label(mapdata, cx, cy, labels, nullptr) == 0)
+		return NAVGRAPH_NONE;
+
+	int32 label = labels[ly * NAVGRAPH_CLUSTER + lx];
+
+	if (label == 0) {
+		int32 best = INT32_MAX;
+
+		for (int32 i = 0; i < NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER; i++) {
+			int32 d = abs(i % NAVGRAPH_CLUSTER - lx) + abs(i / NAVGRAPH_CLUSTER - ly);
+
+			if (labels[i] != 0 && d < best) {
+				best = d;
+				label = labels[i];
+			}
+		}
+	}
+
+	return g.cluster_first[cy * g.cxs + cx] + label - 1;
+}
+
+/// Reads the warps of a map into its portals
+static void navgraph_build_warps(s_navgraph_map& g, map_data* mapdata)
+{
+	g.portals.clear();
+	g.arrivals.clear();
+	g.warps_dirty = false;
+	g.version++;
+
+	for (int32 i = 0; i < mapdata->npc_num_warp; i++) {
+		npc_data* nd = mapdata->npc[i];
+
+		if (nd->subtype != NPCTYPE_WARP)
+			continue;
+
+		s_navgraph_portal portal = {};
+
+		portal.to_m = map_mapindex2mapid(nd->u.warp.mapindex);
+		if (portal.to_m < 0)
+			continue; // Leads to another map-server
+		portal.region = navgraph_region(g, mapdata, nd->x, nd->y);
+		if (portal.region == NAVGRAPH_NONE)
+			continue;
+
+		portal.nd = nd;
+		portal.x = nd->x;
+		portal.y = nd->y;
+		portal.to_x = nd->u.warp.x;
+		portal.to_y = nd->u.warp.y;
+		g.portals.push_back(portal);
+	}
+}
+
+/// Adds a link between two regions, skipping the repeats of neighbouring border cells
+static inline void navgraph_link(std::vector<std::pair<uint32, uint32>>& links, uint32 a, uint32 b)
+{
+	if (links.empty() || links.back().first != a || links.back().second != b)
+		links.emplace_back(a, b);
+}
+
+/// Builds the regions, edges and portals of a map
+static void navgraph_build(s_navgraph_map& g, map_data* mapdata)
+{
+	g.cxs = (mapdata->xs + NAVGRAPH_CLUSTER - 1) / NAVGRAPH_CLUSTER;
+	g.cys = (mapdata->ys + NAVGRAPH_CLUSTER - 1) / NAVGRAPH_CLUSTER;
+
+	int32 clusters = g.cxs * g.cys;
+	std::vector<uint8> labels(clusters * NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER);
+
+	g.cluster_first.resize(clusters + 1);
+	g.regions.clear();
+
+	for (int16 cy = 0; cy < g.cys; cy++) {
+		for (int16 cx = 0; cx < g.cxs; cx++) {
+			int32 c = cy * g.cxs + cx;
+
+			g.cluster_first[c] = static_cast<uint32>(g.regions.size());
+			navgraph_label(mapdata, cx, cy, &labels[c * NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER], &g.regions);
+		}
+	}
+	g.cluster_first[clusters] = static_cast<uint32>(g.regions.size());
+
+	// Regions that touch across the border of two clusters
+	std::vector<std::pair<uint32, uint32>> links;
+
+	for (int16 cy = 0; cy < g.cys; cy++) {
+		for (int16 cx = 0; cx < g.cxs; cx++) {
+			int32 c = cy * g.cxs + cx;
+			const uint8* here = &labels[c * NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER];
+
+			// A cluster that has a neighbour is always full width or height towards it
+			if (cx + 1 < g.cxs) {
+				const uint8* right = here + NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER;
+
+				for (int32 r = 0; r < NAVGRAPH_CLUSTER; r++) {
+					uint8 a = here[r * NAVGRAPH_CLUSTER + NAVGRAPH_CLUSTER - 1], b = right[r * NAVGRAPH_CLUSTER];
+
+					if (a != 0 && b != 0)
+						navgraph_link(links, g.cluster_first[c] + a - 1, g.cluster_first[c + 1] + b - 1);
+				}
+			}
+
+			if (cy + 1 < g.cys) {
+				const uint8* below = here + g.cxs * NAVGRAPH_CLUSTER * NAVGRAPH_CLUSTER;
+
+				for (int32 x = 0; x < NAVGRAPH_CLUSTER; x++) {
+					uint8 a = here[(NAVGRAPH_CLUSTER - 1) * NAVGRAPH_CLUSTER + x], b = below[x];
+
+					if (a != 0 && b != 0)
+						navgraph_link(links, g.cluster_first[c] + a - 1, g.cluster_first[c + g.cxs] + b - 1);
+				}
+			}
+		}
+	}
+
+	size_t count = links.size();
+
+	for (size_t i = 0; i < count; i++)
+		links.emplace_back(links[i].second, links[i].first);
+	std::sort(links.begin(), links.end());
+	links.erase(std::unique(links.begin(), links.end()), links.end());
+
+	g.edge_first.assign(g.regions.size() + 1, 0);
+	g.edges.resize(links.size());
+
+	for (size_t i = 0; i < links.size(); i++) {
+		const s_navgraph_region& a = g.regions[links[i].first];
+		const s_navgraph_region& b = g.regions[links[i].second];
+
+		g.edge_first[links[i].first + 1]++;
+		g.edges[i].to = links[i].second;
+		g.edges[i].cost = navgraph_octile(a.x, a.y, b.x, b.y);
+	}
+	for (size_t i = 1; i < g.edge_first.size(); i++)
+		g.edge_first[i] += g.edge_first[i - 1];
+
+	g.generation = mapdata->cell_generation;
+	g.built = true;
+	navgraph_build_warps(g, mapdata);
+}
+
+/**
+ * Returns the graph of a map, rebuilding the parts that changed since it was last used.
+ * @return Graph or nullptr if the map is not on this map-server
+ */
+static s_navgraph_map* navgraph_get(int16 m)
+{
+	if (m < 0 || m >= map_num || m >= static_cast<int16>(navgraph_maps.size()))
+		return nullptr;
+
+	map_data* mapdata = map_getmapdata(m);
+
+	if (mapdata == nullptr || mapdata->cell == nullptr)
+		return nullptr;
+
+	s_navgraph_map& g = navgraph_maps[m];
+
+	if (!g.built || g.generation != mapdata->cell_generation)
+		navgraph_build(g, mapdata);
+	else if (g.warps_dirty)
+		navgraph_build_warps(g, mapdata);
+
+	return &g;
+}
+
+/// Computes the walk cost from a region to every region of its map into navgraph_dist
+static void navgraph_dijkstra(const s_navgraph_map& g, uint32 source)
+{
+	std::priority_queue<std::pair<int32, uint32>, std::vector<std::pair<int32, uint32>>, std::greater<std::pair<int32, uint32>>> open;
+
+	navgraph_dist.assign(g.regions.size(), INT32_MAX);
+	navgraph_dist[source] = 0;
+	open.emplace(0, source);
+
+	while (!open.empty()) {
+		std::pair<int32, uint32> top = open.top();
+
+		open.pop();
+		if (top.first > navgraph_dist[top.second])
+			continue;
+
+		for (uint32 i = g.edge_first[top.second]; i < g.edge_first[top.second + 1]; i++) {
+			int32 cost = top.first + g.edges[i].cost;
+
+			if (cost < navgraph_dist[g.edges[i].to]) {
+				navgraph_dist[g.edges[i].to] = cost;
+				open.emplace(cost, g.edges[i].to);
+			}
+		}
+	}
+}
+
+/// Computes the walk cost from a cell to each portal of its map
+static void navgraph_portal_costs(const s_navgraph_map& g, map_data* mapdata, int16 x, int16 y, std::vector<int32>& costs)
+{
+	uint32 region = navgraph_region(g, mapdata, x, y);
+
+	costs.assign(g.portals.size(), INT32_MAX);
+	if (region == NAVGRAPH_NONE || g.portals.empty())
+		return;
+
+	navgraph_dijkstra(g, region);
+	for (size_t i = 0; i < g.portals.size(); i++)
+		costs[i] = navgraph_dist[g.portals[i].region];
+}
+
+/// Returns the walk cost from a cell warps lead to to each portal of its map, computed once per cell
+static const std::vector<int32>& navgraph_arrival(s_navgraph_map& g, map_data* mapdata, int16 x, int16 y)
+{
+	uint32 key = (static_cast<uint32>(x) << 16) | static_cast<uint16>(y);
+	auto it = g.arrivals.find(key);
+
+	if (it != g.arrivals.end())
+		return it->second;
+
+	std::vector<int32>& costs = g.arrivals[key];
+
+	navgraph_portal_costs(g, mapdata, x, y, costs);
+	return costs;
+}
+
+/// Whether a unit walking into a warp is moved by it right now
+static bool navgraph_portal_open(const s_navgraph_portal& portal)
+{
+	const npc_data* nd = portal.nd;
+
+	return !nd->is_invisible && !(nd->sc.option & OPTION_CLOAK) && nd->dynamicnpc.owner_char_id == 0;
+}
+
+/**
+ * Finds the warps leading from one cell to another, possibly on another map.
+ * The region graphs only estimate the walk costs, the cells in between are left to the walk path
+ * searches. Maps and warps that changed since the last query are rebuilt first.
+ * Not thread-safe, only call from the main thread.
+ * @param m0: Source map
+ * @param x0: Source x
+ * @param y0: Source y
+ * @param m1: Destination map
+ * @param x1: Destination x, (0,0) accepts any cell of m1
+ * @param y1: Destination y
+ * @param route: Receives the warps to take
+ * @return true if the destination can be reached
+ */
+bool navgraph_route(int16 m0, int16 x0, int16 y0, int16 m1, int16 x1, int16 y1, s_navgraph_route& route)
+{
+	static std::vector<int32> goal, start;
+	static uint32 stamp = 0;
+	std::priority_queue<std::pair<int32, uint32>, std::vector<std::pair<int32, uint32>>, std::greater<std::pair<int32, uint32>>> open;
+
+	route.hops.clear();
+	route.cost = 0;
+
+	s_navgraph_map* g0 = navgraph_get(m0);
+	s_navgraph_map* g1 = navgraph_get(m1);
+
+	if (g0 == nullptr || g1 == nullptr)
+		return false;
+
+	map_data* goal_mapdata = map_getmapdata(m1);
+	bool anywhere = (x1 == 0 && y1 == 0);
+
+	if (!anywhere) {
+		uint32 region = navgraph_region(*g1, goal_mapdata, x1, y1);
+
+		if (region == NAVGRAPH_NONE)
+			return false;
+		navgraph_dijkstra(*g1, region);
+		goal.swap(navgraph_dist);
+	}
+
+	// Walk cost from a cell of m1 to the destination
+	auto goal_cost = [&](int16 x, int16 y) {
+		if (anywhere)
+			return 0;
+
+		uint32 region = navgraph_region(*g1, goal_mapdata, x, y);
+
+		return (region == NAVGRAPH_NONE) ? INT32_MAX : goal[region];
+	};
+
+	int32 best = (m0 == m1) ? goal_cost(x0, y0) : INT32_MAX;
+	int16 best_m = -1, best_portal = -1;
+
+	// Each portal is a node, reached with the cost of arriving at its exit
+	stamp++;
+	navgraph_portal_costs(*g0, map_getmapdata(m0), x0, y0, start);
+
+	auto relax = [&](int16 from_m, int16 from_portal, int16 m, const std::vector<int32>& costs, int32 cost) {
+		s_navgraph_map& g = navgraph_maps[m];
+
+		for (size_t i = 0; i < g.portals.size(); i++) {
+			s_navgraph_portal& portal = g.portals[i];
+
+			if (costs[i] == INT32_MAX)
+				continue;
+
+			int32 total = cost + costs[i] + NAVGRAPH_WARP_COST;
+
+			if (total >= best || (portal.stamp == stamp && portal.cost <= total))
+				continue;
+			if (!navgraph_portal_open(portal) || navgraph_get(portal.to_m) == nullptr)
+				continue;
+
+			portal.stamp = stamp;
+			portal.cost = total;
+			portal.prev_m = from_m;
+			portal.prev_portal = from_portal;
+
+			if (portal.to_m == m1) {
+				int32 rest = goal_cost(portal.to_x, portal.to_y);
+
+				if (rest != INT32_MAX && total + rest < best) {
+					best = total + rest;
+					best_m = m;
+					best_portal = static_cast<int16>(i);
+				}
+			}
+
+			open.emplace(total, (static_cast<uint32>(m) << 16) | static_cast<uint32>(i));
+		}
+	};
+
+	relax(-1, -1, m0, start, 0);
+
+	while (!open.empty()) {
+		std::pair<int32, uint32> top = open.top();
+
+		open.pop();
+		if (top.first >= best)
+			break;
+
+		int16 m = top.second >> 16, i = top.second & 0xffff;
+		s_navgraph_portal& portal = navgraph_maps[m].portals[i];
+
+		if (portal.cost < top.first)
+			continue;
+
+		// The cost from the exit of a warp is kept for the next queries
+		s_navgraph_map& to = navgraph_maps[portal.to_m];
+
+		if (portal.arrival == nullptr || portal.arrival_version != to.version) {
+			portal.arrival = &navgraph_arrival(to, map_getmapdata(portal.to_m), portal.to_x, portal.to_y);
+			portal.arrival_version = to.version;
+		}
+
+		relax(m, i, portal.to_m, *portal.arrival, top.first);
+	}
+
+	if (best == INT32_MAX)
+		return false;
+
+	for (int16 m = best_m, i = best_portal; m >= 0; ) {
+		const s_navgraph_portal& portal = navgraph_maps[m].portals[i];
+
+		route.hops.push_back({ m, portal.x, portal.y, portal.to_m, portal.to_x, portal.to_y, portal.nd->id });
+		m = portal.prev_m;
+		i = portal.prev_portal;
+	}
+	std::reverse(route.hops.begin(), route.hops.end());
+	route.cost = best;
+
+	return true;
+}
+
+/**
+ * Marks the warps of a map as changed, they are read again before the next route query that needs them.
+ * Called whenever a warp NPC is added to or removed from a map. Warps that are only
+ * enabled or disabled keep their portal, its state is checked on each query.
+ */
+void navgraph_warps_changed(int16 m)
+{
+	if (m < 0 || m >= static_cast<int16>(navgraph_maps.size()))
+		return;
+
+	navgraph_maps[m].warps_dirty = true;
+}
+
+void navgraph_print_route(int16 m0, int16 x0, int16 y0, int16 m1, int16 x1, int16 y1)
+{
+	if (navgraph_get(m0) == nullptr || navgraph_get(m1) == nullptr) {
+		ShowWarning("Console: Unknown map.\n");
+		return;
+	}
+
+	s_navgraph_route route;
+	auto start = std::chrono::steady_clock::now();
+	bool found = navgraph_route(m0, x0, y0, m1, x1, y1, route);
+	auto end = std::chrono::steady_clock::now();
+	int64 us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+	if (!found) {
+		ShowInfo("No route from %s (%d,%d) to %s (%d,%d), searched in %" PRId64 " us.\n", map_mapid2mapname(m0), x0, y0, map_mapid2mapname(m1), x1, y1, us);
+		return;
+	}
+
+	ShowInfo("Route from %s (%d,%d) to %s (%d,%d): %d warps, cost %d, found in %" PRId64 " us.\n", map_mapid2mapname(m0), x0, y0, map_mapid2mapname(m1), x1, y1, static_cast<int32>(route.hops.size()), route.cost, us);
+	for (const s_navgraph_hop& hop : route.hops)
+		ShowInfo("\t%s (%d,%d) -> %s (%d,%d)\n", map_mapid2mapname(hop.m), hop.x, hop.y, map_mapid2mapname(hop.to_m), hop.to_x, hop.to_y);
+}
+
+void navgraph_benchmark(int32 queries)
+{
+	struct s_cell {
+		int16 m, x, y;
+	};
+	std::vector<s_cell> cells;
+
+	// Warp exits are cells players actually arrive at and are spread over all connected maps
+	for (int16 m = 0; m < map_num; m++) {
+		s_navgraph_map* g = navgraph_get(m);
+
+		if (g == nullptr)
+			continue;
+		for (const s_navgraph_portal& portal : g->portals)
+			cells.push_back({ portal.to_m, portal.to_x, portal.to_y });
+	}
+
+	if (cells.empty() || queries <= 0) {
+		ShowWarning("Console: No warps to benchmark.\n");
+		return;
+	}
+
+	std::vector<std::pair<s_cell, s_cell>> pairs(queries);
+
+	for (auto& pair : pairs) {
+		pair.first = cells[rnd_value<size_t>(0, cells.size() - 1)];
+		pair.second = cells[rnd_value<size_t>(0, cells.size() - 1)];
+	}
+
+	s_navgraph_route route;
+	int32 found = 0;
+	int64 hops = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (const auto& pair : pairs) {
+		if (navgraph_route(pair.first.m, pair.first.x, pair.first.y, pair.second.m, pair.second.x, pair.second.y, route)) {
+			found++;
+			hops += route.hops.size();
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	ShowInfo("%d route queries: %" PRId64 " us/query, %d found, %.1f warps per route.\n", queries,
+		(int64)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / queries,
+		found, found > 0 ? static_cast<double>(hops) / found : 0.);
+}
+
+void do_init_navgraph()
+{
+	auto start = std::chrono::steady_clock::now();
+	size_t regions = 0, portals = 0;
+
+	navgraph_maps.resize(MAX_MAP_PER_SERVER);
+
+	for (int16 m = 0; m < map_num; m++) {
+		s_navgraph_map* g = navgraph_get(m);
+
+		if (g == nullptr)
+			continue;
+		regions += g->regions.size();
+		portals += g->portals.size();
+	}
+
+	// The costs from the warp exits are what route queries use, have them ready
+	for (int16 m = 0; m < map_num; m++) {
+		s_navgraph_map* g = navgraph_get(m);
+
+		if (g == nullptr)
+			continue;
+		for (s_navgraph_portal& portal : g->portals) {
+			s_navgraph_map* to = navgraph_get(portal.to_m);
+
+			if (to == nullptr)
+				continue;
+			portal.arrival = &navgraph_arrival(*to, map_getmapdata(portal.to_m), portal.to_x, portal.to_y);
+			portal.arrival_version = to->version;
+		}
+	}
+
+	ShowStatus("Done building the navigation graph: '" CL_WHITE "%" PRIuPTR CL_RESET "' regions and '" CL_WHITE "%" PRIuPTR CL_RESET "' warps in %" PRId64 " ms.\n",
+		regions, portals, (int64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void do_final_navgraph()
+{
+	navgraph_maps.clear();
+	navgraph_maps.shrink_to_fit();
+	navgraph_dist.clear();
+	navgraph_dist.shrink_to_fit();
+}
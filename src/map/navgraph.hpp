@@ -0,0 +1,45 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef NAVGRAPH_HPP
+#define NAVGRAPH_HPP
+
+#include <vector>
+
+#include <common/cbasetypes.hpp>
+
+/// Width and height of the clusters the maps are cut into
+#define NAVGRAPH_CLUSTER 16
+
+/// A warp on a cross-map route
+struct s_navgraph_hop {
+	int16 m; ///< Map of the warp
+	int16 x, y; ///< Cell of the warp
+	int16 to_m; ///< Map the warp leads to
+	int16 to_x, to_y; ///< Cell the warp leads to
+	int32 npc_id; ///< Warp NPC
+};
+
+/// Result of navgraph_route
+struct s_navgraph_route {
+	std::vector<s_navgraph_hop> hops; ///< Warps to take in order, empty when the destination is on the same map
+	int32 cost; ///< Estimated walk cost, MOVE_COST per cell
+};
+
+// finds the warps leading from (m0,x0,y0) to (m1,x1,y1), (x1,y1) = (0,0) means anywhere on m1
+bool navgraph_route(int16 m0, int16 x0, int16 y0, int16 m1, int16 x1, int16 y1, s_navgraph_route& route);
+
+// marks the warps of a map as changed
+void navgraph_warps_changed(int16 m);
+
+// prints a route between two cells
+void navgraph_print_route(int16 m0, int16 x0, int16 y0, int16 m1, int16 x1, int16 y1);
+
+// times random route queries between warp cells
+void navgraph_benchmark(int32 queries);
+
+//
+void do_init_navgraph();
+void do_final_navgraph();
+
+#endif /* NAVGRAPH_HPP */
@@ -3,14 +3,26 @@
 
 #include "npc.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <common/cbasetypes.hpp>
 #include <common/db.hpp>
 #include <common/ers.hpp>
+#include <common/grfio.hpp> // grfio_crc32
 #include <common/malloc.hpp>
 #include <common/nullpo.hpp>
 #include <common/showmsg.hpp>
@@ -30,6 +42,7 @@
 #include "log.hpp"
 #include "map.hpp"
 #include "mob.hpp"
+#include "navgraph.hpp"
 #include "navi.hpp"
 #include "pc.hpp"
 #include "pet.hpp"
@@ -42,6 +55,62 @@ npc_data* fake_nd;
 
 std::vector<std::string> npc_src_files;
 
+/// Maximum number of threads loading npc source files, see npc_loadsrcfiles
+#define NPC_LOAD_THREADS_MAX 8
+
+/// Result of reading a npc source file
+enum e_npc_src_read : uint8 {
+	NPC_SRC_PENDING = 0,
+	NPC_SRC_OK,
+	NPC_SRC_NOT_FILE,
+	NPC_SRC_NOT_FOUND,
+	NPC_SRC_READ_ERROR,
+};
+
+/// Script of a npc source file, see npc_scansrcfile
+struct s_npc_src_script {
+	size_t offset; ///< Start of the script in the file
+	int32 line;
+	int32 options; ///< Options npc_parsesrcbuffer compiles it with
+	std::string function; ///< Name of the global function it defines
+	std::string map; ///< Map of the npc, empty for floating npcs and functions
+};
+
+/// Npc source file read ahead of parsing.
+/// Filled by worker threads, so it only uses the standard library.
+struct s_npc_src_buffer {
+	e_npc_src_read result;
+	int32 error; ///< errno of a failed read
+	std::string data;
+	std::vector<size_t> newlines; ///< Offsets of the line breaks, to find line numbers without rescanning the file
+	uint32 crc; ///< Set by npc_scansrcfile
+	std::vector<s_npc_src_script> scripts; ///< Scripts found by npc_scansrcfile
+	std::shared_ptr<s_script_precompiled_file> compiled; ///< Scripts compiled by the worker threads
+};
+
+/// Source file being parsed, see npc_src_line
+static const s_npc_src_buffer* npc_src_current = nullptr;
+
+/// Time spent in each stage of npc loading, see npc_loadsrcfiles
+static struct s_npc_load_stats {
+	size_t files;
+	size_t bytes;
+	size_t threads;
+	int32 scripts;
+	int32 precompiled;
+	std::chrono::steady_clock::duration read;
+	std::chrono::steady_clock::duration scan;
+	std::chrono::steady_clock::duration precompile;
+	std::chrono::steady_clock::duration wait;
+	std::chrono::steady_clock::duration compile;
+} npc_load_stats;
+
+static void npc_readsrcfile( const char* filepath, s_npc_src_buffer& src );
+static void npc_scansrcfile( s_npc_src_buffer& src );
+static int32 npc_parsesrcbuffer( const char* filepath, const s_npc_src_buffer& src );
+static int32 npc_src_line( const char* buffer, const char* p );
+static int32 npc_src_line( const s_npc_src_buffer& src, const char* p );
+
 static int32 npc_id=START_NPC_NUM;
 static int32 npc_warp=0;
 static int32 npc_shop=0;
@@ -3436,6 +3505,8 @@ int32 npc_remove_map(npc_data* nd)
 		mapdata->npc[ mapdata->npc_num_area ] = mapdata->npc[ mapdata->npc_num ];
 	}
 	mapdata->npc[ mapdata->npc_num ] = nullptr;
+	if (nd->subtype == NPCTYPE_WARP)
+		navgraph_warps_changed(nd->m);
 	return 0;
 }
 
@@ -3642,15 +3713,185 @@ void npc_delsrcfile(const char* name)
 
 /**
  * Load all npc files
+ * Worker threads read the files and compile their scripts, the main thread parses them in file order
+ * and takes the compiled scripts that still match the global functions defined by then.
  */
 void npc_loadsrcfiles() {
 	ShowStatus("Loading NPCs...\n");
-	for (const auto& file : npc_src_files) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	npc_load_stats = {};
+
+	script_cache_open();
+	script_precompile_open();
+
+	// The worker threads first read and scan all files, because a script compiles differently depending on the
+	// global functions defined before it. Once the functions are known they compile the scripts of the files in order,
+	// while this thread creates the npcs of each file as soon as it is compiled.
+	size_t count = npc_src_files.size();
+	std::vector<s_npc_src_buffer> sources( count );
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable cond_scanned, cond_functions, cond_compiled;
+	std::atomic<size_t> next( 0 ), next_compile( 0 );
+	size_t scanned = 0;
+	bool functions_ready = false;
+	std::vector<bool> compiled( count, false );
+	size_t threads = std::min<size_t>( count, std::clamp<size_t>( std::thread::hardware_concurrency(), 1, NPC_LOAD_THREADS_MAX ) );
+	std::atomic<size_t> bytes( 0 );
+	std::atomic<int32> precompiled( 0 );
+	std::atomic<int64> read_ns( 0 ), scan_ns( 0 ), precompile_ns( 0 );
+	// Global functions defined before loading and the first definition of the others by file and offset
+	std::unordered_set<std::string> functions_loaded;
+	std::unordered_map<std::string, std::pair<size_t, size_t>> functions_declared;
+
+	DBIterator* iter = db_iterator( script_get_userfunc_db() );
+	DBKey key;
+
+	for( iter->first( iter, &key ); dbi_exists( iter ); iter->next( iter, &key ) ){
+		functions_loaded.insert( key.str );
+	}
+	dbi_destroy( iter );
+
+	for( size_t t = 0; t < threads; t++ ){
+		workers.emplace_back( [&](){
+			script_precompile_thread_begin();
+
+			for( size_t i = next++; i < count; i = next++ ){
+				std::chrono::steady_clock::time_point read_start = std::chrono::steady_clock::now();
+				s_npc_src_buffer& src = sources[i];
+
+				npc_readsrcfile( npc_src_files[i].c_str(), src );
+				bytes += src.data.size();
+
+				std::chrono::steady_clock::time_point scan_start = std::chrono::steady_clock::now();
+
+				npc_scansrcfile( src );
+				read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( scan_start - read_start ).count();
+				scan_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - scan_start ).count();
+
+				std::lock_guard<std::mutex> lock( mutex );
+
+				if( ++scanned == count ){
+					cond_scanned.notify_one();
+				}
+			}
+
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+
+				cond_functions.wait( lock, [&](){ return functions_ready; } );
+			}
+
+			for( size_t i = next_compile++; i < count; i = next_compile++ ){
+				std::chrono::steady_clock::time_point compile_start = std::chrono::steady_clock::now();
+				s_npc_src_buffer& src = sources[i];
+
+				if( !src.scripts.empty() ){
+					src.compiled = script_precompile_file();
+				}
+
+				for( const s_npc_src_script& script : src.scripts ){
+					size_t offset = script.offset;
+					// Same global functions npc_parsesrcbuffer will have defined when it reaches the script
+					std::function<bool( const char* )> function_defined = [&, i, offset]( const char* name ){
+						if( functions_loaded.find( name ) != functions_loaded.end() ){
+							return true;
+						}
+
+						auto it = functions_declared.find( name );
+
+						return it != functions_declared.end() && ( it->second.first < i || ( it->second.first == i && it->second.second < offset ) );
+					};
+
+					script_precompile( *src.compiled, src.data.c_str(), src.data.c_str() + offset, npc_src_files[i].c_str(), script.line, script.options, function_defined );
+					precompiled++;
+				}
+
+				precompile_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - compile_start ).count();
+
+				std::lock_guard<std::mutex> lock( mutex );
+
+				compiled[i] = true;
+				cond_compiled.notify_one();
+			}
+
+			script_precompile_thread_end();
+		} );
+	}
+
+	{
+		std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> lock( mutex );
+
+		cond_scanned.wait( lock, [&](){ return scanned == count; } );
+		npc_load_stats.wait += std::chrono::steady_clock::now() - wait_start;
+	}
+
+	for( size_t i = 0; i < count; i++ ){
+		s_npc_src_buffer& src = sources[i];
+
+		for( const s_npc_src_script& script : src.scripts ){
+			if( !script.function.empty() ){
+				functions_declared.emplace( script.function, std::make_pair( i, script.offset ) );
+			}
+		}
+
+		// Left to the bytecode cache
+		if( script_cache_stored( npc_src_files[i].c_str(), src.crc, src.data.size() ) ){
+			src.scripts.clear();
+			continue;
+		}
+
+		// Npcs on maps of other map-servers are skipped
+		src.scripts.erase( std::remove_if( src.scripts.begin(), src.scripts.end(), []( const s_npc_src_script& script ){
+			return !script.map.empty() && map_mapindex2mapid( mapindex_name2idx( script.map.c_str(), nullptr ) ) < 0;
+		} ), src.scripts.end() );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+
+		functions_ready = true;
+		cond_functions.notify_all();
+	}
+
+	for( size_t i = 0; i < count; i++ ){
+		const char* file = npc_src_files[i].c_str();
+
 #ifdef DETAILED_LOADING_OUTPUT
-		ShowStatus("Loading NPC file: %s" CL_CLL "\r", file.c_str());
+		ShowStatus("Loading NPC file: %s" CL_CLL "\r", file);
 #endif
-		npc_parsesrcfile(file.c_str());
+		{
+			std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+			std::unique_lock<std::mutex> lock( mutex );
+
+			cond_compiled.wait( lock, [&](){ return compiled[i]; } );
+			npc_load_stats.wait += std::chrono::steady_clock::now() - wait_start;
+		}
+
+		npc_parsesrcbuffer( file, sources[i] );
+
+		// Release the file and the scripts this thread did not take
+		sources[i] = {};
+	}
+
+	for( std::thread& worker : workers ){
+		worker.join();
 	}
+
+	npc_load_stats.files = count;
+	npc_load_stats.bytes = bytes;
+	npc_load_stats.threads = threads;
+	npc_load_stats.precompiled = precompiled;
+	npc_load_stats.read = std::chrono::nanoseconds( read_ns );
+	npc_load_stats.scan = std::chrono::nanoseconds( scan_ns );
+	npc_load_stats.precompile = std::chrono::nanoseconds( precompile_ns );
+
+	script_precompile_close();
+	script_cache_close();
+
 	int32 npc_total = npc_warp + npc_shop + npc_script;
 
 	ShowInfo ("Done loading '" CL_WHITE "%d" CL_RESET "' NPCs:" CL_CLL "\n"
@@ -3661,6 +3902,23 @@ void npc_loadsrcfiles() {
 		"\t-'" CL_WHITE "%d" CL_RESET "' Mobs Cached\n"
 		"\t-'" CL_WHITE "%d" CL_RESET "' Mobs Not Cached\n",
 		npc_total, npc_warp, npc_shop, npc_script, npc_mob, npc_cache_mob, npc_delay_mob);
+
+	auto ms = []( std::chrono::steady_clock::duration duration ){
+		return static_cast<int64>( std::chrono::duration_cast<std::chrono::milliseconds>( duration ).count() );
+	};
+	std::chrono::steady_clock::duration total = std::chrono::steady_clock::now() - start;
+
+	ShowInfo( "NPC loading took '" CL_WHITE "%" PRId64 CL_RESET "' ms:\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms reading '" CL_WHITE "%" PRIuPTR CL_RESET "' files (%" PRIuPTR " KB) on %" PRIuPTR " worker threads\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms scanning the files for scripts\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms compiling '" CL_WHITE "%d" CL_RESET "' scripts on the worker threads\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms waiting for the worker threads\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms loading '" CL_WHITE "%d" CL_RESET "' scripts on the main thread\n"
+		"\t-'" CL_WHITE "%" PRId64 CL_RESET "' ms parsing\n",
+		ms( total ), ms( npc_load_stats.read ), npc_load_stats.files, npc_load_stats.bytes / 1024, npc_load_stats.threads,
+		ms( npc_load_stats.scan ), ms( npc_load_stats.precompile ), npc_load_stats.precompiled,
+		ms( npc_load_stats.wait ), ms( npc_load_stats.compile ), npc_load_stats.scripts,
+		ms( total - npc_load_stats.wait - npc_load_stats.compile ) );
 }
 
 /// Parses and sets the name and exname of a npc.
@@ -3799,7 +4057,7 @@ npc_data *npc_create_npc(int16 m, int16 x, int16 y){
 	new (nd) npc_data();
 
 	nd->id = npc_get_new_npc_id();
-	nd->prev = nd->next = nullptr;
+	nd->prev = nullptr;
 	nd->m = m;
 	nd->x = x;
 	nd->y = y;
@@ -4308,7 +4566,8 @@ int32 npc_convertlabel_db(DBKey key, DBData *data, va_list ap)
 }
 
 // Skip the contents of a script.
-static const char* npc_skip_script(const char* start, const char* buffer, const char* filepath)
+// report: whether errors are shown
+static const char* npc_skip_script(const char* start, const char* buffer, const char* filepath, bool report = true)
 {
 	const char* p;
 	int32 curly_count;
@@ -4320,7 +4579,8 @@ static const char* npc_skip_script(const char* start, const char* buffer, const
 	p = strchr(start,'{');
 	if( p == nullptr )
 	{
-		ShowError("npc_skip_script: Missing left curly in file '%s', line'%d'.", filepath, strline(buffer,start-buffer));
+		if( report )
+			ShowError("npc_skip_script: Missing left curly in file '%s', line'%d'.", filepath, strline(buffer,start-buffer));
 		return nullptr;// can't continue
 	}
 
@@ -4344,19 +4604,22 @@ static const char* npc_skip_script(const char* start, const char* buffer, const
 					++p;// escape sequence (not part of a multibyte character)
 				else if( *p == '\0' )
 				{
-					script_error(buffer, filepath, 0, "Unexpected end of string.", p);
+					if( report )
+						script_error(buffer, filepath, 0, "Unexpected end of string.", p);
 					return nullptr;// can't continue
 				}
 				else if( *p == '\n' )
 				{
-					script_error(buffer, filepath, 0, "Unexpected newline at string.", p);
+					if( report )
+						script_error(buffer, filepath, 0, "Unexpected newline at string.", p);
 					return nullptr;// can't continue
 				}
 			}
 		}
 		else if( *p == '\0' )
 		{// end of buffer
-			ShowError("Missing %d right curlys at file '%s', line '%d'.\n", curly_count, filepath, strline(buffer,p-buffer));
+			if( report )
+				ShowError("Missing %d right curlys at file '%s', line '%d'.\n", curly_count, filepath, strline(buffer,p-buffer));
 			return nullptr;// can't continue
 		}
 	}
@@ -4421,7 +4684,10 @@ static const char* npc_parse_script(char* w1, char* w2, char* w3, char* w4, cons
 	if( end == nullptr )
 		return nullptr;// (simple) parse error, don't continue
 
-	script = parse_script(script_start, filepath, strline(buffer,script_start-buffer), SCRIPT_USE_LABEL_DB);
+	std::chrono::steady_clock::time_point compile_start = std::chrono::steady_clock::now();
+	script = parse_script(script_start, filepath, npc_src_line(buffer, script_start), SCRIPT_USE_LABEL_DB);
+	npc_load_stats.compile += std::chrono::steady_clock::now() - compile_start;
+	npc_load_stats.scripts++;
 	label_list = nullptr;
 	label_list_num = 0;
 	if( script )
@@ -5174,7 +5440,10 @@ static const char* npc_parse_function(char* w1, char* w2, char* w3, char* w4, co
 	if( end == nullptr )
 		return nullptr;// (simple) parse error, don't continue
 
-	script = parse_script(script_start, filepath, strline(buffer,start-buffer), SCRIPT_RETURN_EMPTY_SCRIPT);
+	std::chrono::steady_clock::time_point compile_start = std::chrono::steady_clock::now();
+	script = parse_script(script_start, filepath, npc_src_line(buffer, start), SCRIPT_RETURN_EMPTY_SCRIPT);
+	npc_load_stats.compile += std::chrono::steady_clock::now() - compile_start;
+	npc_load_stats.scripts++;
 	if( script == nullptr )// parse error, continue
 		return end;
 
@@ -5637,6 +5906,170 @@ static const char* npc_parse_mapflag(char* w1, char* w2, char* w3, char* w4, con
 	return strchr(start,'\n');// continue
 }
 
+/**
+ * Reads a npc source file and indexes its lines.
+ * Runs on the worker threads of npc_loadsrcfiles, so errors are only recorded and reported by npc_parsesrcbuffer.
+ * @param filepath : Relative path of file from map-serv bin
+ * @param src : Buffer to fill
+ */
+static void npc_readsrcfile( const char* filepath, s_npc_src_buffer& src ){
+	if( check_filepath( filepath ) != 2 ){
+		src.result = NPC_SRC_NOT_FILE;
+		return;
+	}
+
+	FILE* fp = fopen( filepath, "rb" );
+
+	if( fp == nullptr ){
+		src.result = NPC_SRC_NOT_FOUND;
+		return;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	src.data.resize( ftell( fp ) );
+	fseek( fp, 0, SEEK_SET );
+	src.data.resize( fread( &src.data[0], 1, src.data.size(), fp ) );
+
+	if( ferror( fp ) ){
+		src.result = NPC_SRC_READ_ERROR;
+		src.error = errno;
+		src.data.clear();
+		fclose( fp );
+		return;
+	}
+	fclose( fp );
+
+	// Same lines as strline, which stops at the first nul character
+	for( const char* p = strchr( src.data.c_str(), '\n' ); p != nullptr; p = strchr( p + 1, '\n' ) ){
+		src.newlines.push_back( p - src.data.c_str() );
+	}
+
+	src.result = NPC_SRC_OK;
+}
+
+/**
+ * Finds the scripts of a npc source file, so the worker threads can compile them before npc_parsesrcbuffer gets to them.
+ * Follows npc_parsesrcbuffer without showing errors, a script it does not find is compiled by the main thread.
+ * Runs on the worker threads of npc_loadsrcfiles.
+ * @param src : File read by npc_readsrcfile
+ */
+static void npc_scansrcfile( s_npc_src_buffer& src ){
+	if( src.result != NPC_SRC_OK ){
+		return;
+	}
+
+	const char* buffer = src.data.c_str();
+	size_t len = src.data.size();
+
+	src.crc = static_cast<uint32>( grfio_crc32( reinterpret_cast<const unsigned char*>( buffer ), static_cast<uint32>( len ) ) );
+
+	// UTF-8 BOM, see npc_parsesrcbuffer
+	if( len >= 3 && (unsigned char)buffer[0] == 0xEF && (unsigned char)buffer[1] == 0xBB && (unsigned char)buffer[2] == 0xBF ){
+		return;
+	}
+
+	for( const char* p = skip_space( buffer ); p != nullptr && *p != '\0'; p = skip_space( p ) ){
+		size_t pos[9];
+		bool error;
+		size_t count = sv_parse( p, len + buffer - p, 0, '\t', pos, ARRAYLENGTH( pos ), SV_TERMINATE_LF|SV_TERMINATE_CRLF, error );
+
+		if( error || count < 3 ){
+			break;
+		}
+
+		const char* w2 = p + pos[4];
+		size_t w2_length = pos[5] - pos[4];
+
+		if( count == 3 || strncasecmp( w2, "script", 6 ) != 0 ){
+			p = strchr( p, '\n' );
+			continue;
+		}
+
+		std::string w1( p + pos[2], pos[3] - pos[2] );
+		const char* w4 = ( pos[8] != -1 ) ? p + pos[8] : nullptr;
+		const char* end = strchr( p, '\n' );
+		const char* script_start;
+		s_npc_src_script script = {};
+
+		if( strcasecmp( w1.c_str(), "function" ) == 0 ){
+			// see npc_parse_function
+			if( w2_length != 6 ){
+				p = end;
+				continue;
+			}
+
+			script_start = strstr( p, "\t{" );
+
+			if( w4 == nullptr || *w4 != '{' || script_start == nullptr || ( end != nullptr && script_start > end ) ){
+				break;
+			}
+
+			script.line = npc_src_line( src, p );
+			script.options = SCRIPT_RETURN_EMPTY_SCRIPT;
+			script.function.assign( p + pos[6], pos[7] - pos[6] );
+		}else{
+			// see npc_parse_script
+			if( w1 != "-" ){
+				char mapname[MAP_NAME_LENGTH_EXT];
+				int16 x, y, dir;
+				int32 fields = sscanf( w1.c_str(), "%15[^,],%6hd,%6hd,%4hd", mapname, &x, &y, &dir );
+
+				if( fields < 1 ){
+					if( ( p = npc_skip_script( p, buffer, nullptr, false ) ) == nullptr )
+						break;
+					p = strchr( p, '\n' );
+					continue;
+				}
+
+				if( fields != 4 ){
+					break;
+				}
+
+				script.map = mapname;
+			}
+
+			script_start = strstr( p, ",{" );
+
+			if( w4 == nullptr || script_start == nullptr || script_start < w4 || ( end != nullptr && script_start > end ) ){
+				break;
+			}
+
+			script.line = npc_src_line( src, script_start + 1 );
+			script.options = SCRIPT_USE_LABEL_DB;
+		}
+
+		script.offset = script_start + 1 - buffer;
+
+		if( ( p = npc_skip_script( script_start + 1, buffer, nullptr, false ) ) == nullptr ){
+			break;
+		}
+
+		src.scripts.push_back( std::move( script ) );
+	}
+}
+
+/**
+ * Returns the line of a position in a source file.
+ * Same as strline, but uses the line index of the file.
+ */
+static int32 npc_src_line( const s_npc_src_buffer& src, const char* p ){
+	const std::vector<size_t>& newlines = src.newlines;
+
+	return 1 + static_cast<int32>( std::lower_bound( newlines.begin(), newlines.end(), static_cast<size_t>( p - src.data.c_str() ) ) - newlines.begin() );
+}
+
+/**
+ * Returns the line of a position in the source file being parsed.
+ * Same as strline, but uses the line index of the file if it has one.
+ */
+static int32 npc_src_line( const char* buffer, const char* p ){
+	if( npc_src_current == nullptr || buffer != npc_src_current->data.c_str() ){
+		return strline( buffer, p - buffer );
+	}
+
+	return npc_src_line( *npc_src_current, p );
+}
+
 /**
  * Read file and create npc/func/mapflag/monster... accordingly.
  * @param filepath : Relative path of file from map-serv bin
@@ -5645,30 +6078,37 @@ static const char* npc_parse_mapflag(char* w1, char* w2, char* w3, char* w4, con
  */
 int32 npc_parsesrcfile(const char* filepath)
 {
-	if (check_filepath(filepath) != 2) { //this is not a file 
-		ShowDebug("npc_parsesrcfile: Path doesn't seem to be a file skipping it : '%s'.\n", filepath);
-		return 0;
-	} 
-            
-	// read whole file to buffer
-	FILE* fp = fopen(filepath, "rb");
-	if (fp == nullptr) {
-		ShowError("npc_parsesrcfile: File not found '%s'.\n", filepath);
-		return 0;
-	}
-	fseek(fp, 0, SEEK_END);
-	size_t len = ftell(fp);
-	char* buffer = (char*)aMalloc(len+1);
-	fseek(fp, 0, SEEK_SET);
-	len = fread(buffer, 1, len, fp);
-	buffer[len] = '\0';
-	if (ferror(fp)) {
-		ShowError("npc_parsesrcfile: Failed to read file '%s' - %s\n", filepath, strerror(errno));
-		aFree(buffer);
-		fclose(fp);
-		return 0;
+	s_npc_src_buffer src = {};
+
+	npc_readsrcfile(filepath, src);
+
+	return npc_parsesrcbuffer(filepath, src);
+}
+
+/**
+ * Create npc/func/mapflag/monster... from a source file that was read by npc_readsrcfile.
+ * @param filepath : Relative path of file from map-serv bin
+ * @param src : File contents
+ * @return 0:error, 1:success
+ */
+static int32 npc_parsesrcbuffer(const char* filepath, const s_npc_src_buffer& src)
+{
+	switch( src.result ){
+		case NPC_SRC_NOT_FILE: //this is not a file 
+			ShowDebug("npc_parsesrcfile: Path doesn't seem to be a file skipping it : '%s'.\n", filepath);
+			return 0;
+		case NPC_SRC_NOT_FOUND:
+			ShowError("npc_parsesrcfile: File not found '%s'.\n", filepath);
+			return 0;
+		case NPC_SRC_READ_ERROR:
+			ShowError("npc_parsesrcfile: Failed to read file '%s' - %s\n", filepath, strerror(src.error));
+			return 0;
+		default:
+			break;
 	}
-	fclose(fp);
+
+	const char* buffer = src.data.c_str();
+	size_t len = src.data.size();
 
 	if ((unsigned char)buffer[0] == 0xEF && (unsigned char)buffer[1] == 0xBB && (unsigned char)buffer[2] == 0xBF) {
 		// UTF-8 BOM. This is most likely an error on the user's part, because:
@@ -5677,10 +6117,12 @@ int32 npc_parsesrcfile(const char* filepath)
 		// - If the user really wants to use UTF-8 (instead of latin1, EUC-KR, SJIS, etc), then they can still do it <without BOM>.
 		// More info at http://unicode.org/faq/utf_bom.html#bom5 and http://en.wikipedia.org/wiki/Byte_order_mark#UTF-8
 		ShowError("npc_parsesrcfile: Detected unsupported UTF-8 BOM in file '%s'. Stopping (please consider using another character set).\n", filepath);
-		aFree(buffer);
 		return 0;
 	}
 
+	npc_src_current = &src;
+	script_cache_begin(filepath, buffer, len, src.compiled.get());
+
 	int32 lines = 0;
 
 	// parse buffer
@@ -5816,7 +6258,8 @@ int32 npc_parsesrcfile(const char* filepath)
 			p = strchr(p,'\n');// skip and continue
 		}
 	}
-	aFree(buffer);
+	script_cache_end();
+	npc_src_current = nullptr;
 
 	return 1;
 }
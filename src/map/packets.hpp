@@ -1409,6 +1409,49 @@ struct PACKET_CZ_REQ_EMOTION {
 } __attribute__((packed));
 DEFINE_PACKET_HEADER(CZ_REQ_EMOTION, 0xbf);
 
+struct PACKET_CZ_REQ_TAKEOFF_EQUIP{
+	int16 packetType;
+	uint16 index;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_REQ_TAKEOFF_EQUIP, 0xab);
+
+struct PACKET_CZ_RESTART{
+	int16 packetType;
+	uint8 type;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_RESTART, 0xb2);
+
+struct PACKET_CZ_CHOOSE_MENU{
+	int16 packetType;
+	uint32 GID;
+	uint8 select;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_CHOOSE_MENU, 0xb8);
+
+struct PACKET_CZ_REQ_NEXT_SCRIPT{
+	int16 packetType;
+	uint32 GID;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_REQ_NEXT_SCRIPT, 0xb9);
+
+struct PACKET_CZ_STATUS_CHANGE{
+	int16 packetType;
+	uint16 type;
+	uint8 amount;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_STATUS_CHANGE, 0xbb);
+
+struct PACKET_CZ_UPGRADE_SKILLLEVEL{
+	int16 packetType;
+	uint16 skill_id;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_UPGRADE_SKILLLEVEL, 0x112);
+
+struct PACKET_CZ_CANCEL_LOCKON{
+	int16 packetType;
+} __attribute__((packed));
+DEFINE_PACKET_HEADER(CZ_CANCEL_LOCKON, 0x118);
+
 #if PACKETVER >= 20131223
 struct PACKET_ZC_NOTIFY_ACT{
 	int16 packetType;
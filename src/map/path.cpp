@@ -3,10 +3,16 @@
 
 #include "path.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <list>
+#include <queue>
+#include <unordered_map>
+#include <vector>
 
 #include <common/cbasetypes.hpp>
 #include <common/db.hpp>
@@ -17,6 +23,7 @@
 
 #include "battle.hpp"
 #include "map.hpp"
+#include "unit.hpp"
 
 #define SET_OPEN 0
 #define SET_CLOSED 1
@@ -40,9 +47,9 @@ struct path_node {
 };
 
 /// Binary heap of path nodes
+/// Each node is in the open set at most once, so a path search never holds more than
+/// MAX_WALKPATH*MAX_WALKPATH entries and the heap storage can live on the stack.
 BHEAP_STRUCT_DECL(node_heap, struct path_node*);
-static BHEAP_STRUCT_VAR(node_heap, g_open_set);	// use static heap for all path calculations
-												// it get's initialized in do_init_path, freed in do_final_path.
 
 
 /// Comparator for binary heap of path nodes (minimum cost at top)
@@ -53,6 +60,9 @@ static BHEAP_STRUCT_VAR(node_heap, g_open_set);	// use static heap for all path
 /// Estimates the cost from (x0,y0) to (x1,y1).
 /// This is inadmissible (overestimating) heuristic used by game client.
 #define heuristic(x0, y0, x1, y1)	(MOVE_COST * (abs((x1) - (x0)) + abs((y1) - (y0)))) // Manhattan distance
+/// Octile distance, which never overestimates the cost and keeps the found path shortest.
+/// Used by the searches that do not need to match the client.
+#define heuristic_octile(x0, y0, x1, y1) (MOVE_COST * max(abs((x1) - (x0)), abs((y1) - (y0))) + (MOVE_DIAGONAL_COST - MOVE_COST) * min(abs((x1) - (x0)), abs((y1) - (y0))))
 /// @}
 
 // Translates dx,dy into walking direction
@@ -65,11 +75,9 @@ static enum directions walk_choices [3][3] =
 
 
 void do_init_path(){
-	BHEAP_INIT(g_open_set);	// [fwi]: BHEAP_STRUCT_VAR already initialized the heap, this is rudendant & just for code-conformance/readability
 }//
 
 void do_final_path(){
-	BHEAP_CLEAR(g_open_set);
 }//
 
 
@@ -196,12 +204,14 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 /// @{
 
 /// Pushes path_node to the binary node_heap.
-/// Ensures there is enough space in array to store new element.
-
+/// The heap storage is fixed-size, see node_heap.
 static void heap_push_node(struct node_heap *heap, struct path_node *node)
 {
 #ifndef __clang_analyzer__ // TODO: Figure out why clang's static analyzer doesn't like this
-	BHEAP_ENSURE2(*heap, 1, 256, struct path_node **);
+	if (BHEAP_LENGTH(*heap) >= BHEAP_CAPACITY(*heap)) {
+		ShowError("heap_push_node: open set is full\n");
+		return;
+	}
 	BHEAP_PUSH2(*heap, node, NODE_MINTOPCMP);
 #endif // __clang_analyzer__
 }
@@ -257,6 +267,606 @@ static int32 add_path(struct node_heap *heap, struct path_node *tp, int16 x, int
 }
 ///@}
 
+/// A* search of a walk path from (x0,y0) to (x1,y1), see path_search.
+/// Finds the same path as the game client.
+static bool path_search_astar(struct walkpath_data *wpd, struct map_data *mapdata, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	int32 i, x, y, dx, dy;
+
+	// FIXME: This array is too small to ensure all paths shorter than MAX_WALKPATH
+	// can be found without node collision: calc_index(node1) = calc_index(node2).
+	// Figure out more proper size or another way to keep track of known nodes.
+	struct path_node tp[MAX_WALKPATH * MAX_WALKPATH];
+	struct path_node *open_set_data[MAX_WALKPATH * MAX_WALKPATH];
+	struct node_heap open_set = { ARRAYLENGTH(open_set_data), 0, open_set_data };
+	struct path_node *current, *it;
+	int32 xs = mapdata->xs - 1;
+	int32 ys = mapdata->ys - 1;
+	int32 len = 0;
+	int32 j;
+
+	// A* (A-star) pathfinding
+	// We always use A* for finding walkpaths because it is what game client uses.
+	// Easy pathfinding cuts corners of non-walkable cells, but client always walks around it.
+	memset(tp, 0, sizeof(tp));
+
+	// Start node
+	i = calc_index(x0, y0);
+	tp[i].parent = nullptr;
+	tp[i].x      = x0;
+	tp[i].y      = y0;
+	tp[i].g_cost = 0;
+	tp[i].f_cost = heuristic(x0, y0, x1, y1);
+	tp[i].flag   = SET_OPEN;
+
+	heap_push_node(&open_set, &tp[i]); // Put start node to 'open' set
+
+	for(;;) {
+		int32 e = 0; // error flag
+
+		// Saves allowed directions for the current cell. Diagonal directions
+		// are only allowed if both directions around it are allowed. This is
+		// to prevent cutting corner of nearby wall.
+		// For example, you can only go NW from the current cell, if you can
+		// go N *and* you can go W. Otherwise you need to walk around the
+		// (corner of the) non-walkable cell.
+		int32 allowed_dirs = 0;
+
+		int32 g_cost;
+
+		if (BHEAP_LENGTH(open_set) == 0) {
+			return false;
+		}
+
+		current = BHEAP_PEEK(open_set); // Look for the lowest f_cost node in the 'open' set
+		BHEAP_POP2(open_set, NODE_MINTOPCMP); // Remove it from 'open' set
+
+		x      = current->x;
+		y      = current->y;
+		g_cost = current->g_cost;
+
+		current->flag = SET_CLOSED; // Add current node to 'closed' set
+
+		if (x == x1 && y == y1) {
+			break;
+		}
+
+		// Obstructed cells of the rows below, at and above the current cell, bit 0 is x-1
+		uint64 south = map_getcellbits(mapdata, x-1, y-1, 3, cell);
+		uint64 row = map_getcellbits(mapdata, x-1, y, 3, cell);
+		uint64 north = map_getcellbits(mapdata, x-1, y+1, 3, cell);
+#define obstructed(bits, dx) (((bits) >> ((dx) + 1)) & 1)
+
+		if (y < ys && !obstructed(north, 0)) allowed_dirs |= PATH_DIR_NORTH;
+		if (y >  0 && !obstructed(south, 0)) allowed_dirs |= PATH_DIR_SOUTH;
+		if (x < xs && !obstructed(row, 1)) allowed_dirs |= PATH_DIR_EAST;
+		if (x >  0 && !obstructed(row, -1)) allowed_dirs |= PATH_DIR_WEST;
+
+#define chk_dir(d) ((allowed_dirs & (d)) == (d))
+		// Process neighbors of current node
+		if (chk_dir(PATH_DIR_SOUTH|PATH_DIR_EAST) && !obstructed(south, 1))
+			e += add_path(&open_set, tp, x+1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y-1, x1, y1)); // (x+1, y-1) 5
+		if (chk_dir(PATH_DIR_EAST))
+			e += add_path(&open_set, tp, x+1, y, g_cost + MOVE_COST, current, heuristic(x+1, y, x1, y1)); // (x+1, y) 6
+		if (chk_dir(PATH_DIR_NORTH|PATH_DIR_EAST) && !obstructed(north, 1))
+			e += add_path(&open_set, tp, x+1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y+1, x1, y1)); // (x+1, y+1) 7
+		if (chk_dir(PATH_DIR_NORTH))
+			e += add_path(&open_set, tp, x, y+1, g_cost + MOVE_COST, current, heuristic(x, y+1, x1, y1)); // (x, y+1) 0
+		if (chk_dir(PATH_DIR_NORTH|PATH_DIR_WEST) && !obstructed(north, -1))
+			e += add_path(&open_set, tp, x-1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y+1, x1, y1)); // (x-1, y+1) 1
+		if (chk_dir(PATH_DIR_WEST))
+			e += add_path(&open_set, tp, x-1, y, g_cost + MOVE_COST, current, heuristic(x-1, y, x1, y1)); // (x-1, y) 2
+		if (chk_dir(PATH_DIR_SOUTH|PATH_DIR_WEST) && !obstructed(south, -1))
+			e += add_path(&open_set, tp, x-1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y-1, x1, y1)); // (x-1, y-1) 3
+		if (chk_dir(PATH_DIR_SOUTH))
+			e += add_path(&open_set, tp, x, y-1, g_cost + MOVE_COST, current, heuristic(x, y-1, x1, y1)); // (x, y-1) 4
+#undef chk_dir
+#undef obstructed
+		if (e) {
+			return false;
+		}
+	}
+
+	for (it = current; it->parent != nullptr; it = it->parent, len++);
+	if (len > sizeof(wpd->path))
+		return false;
+
+	// Recreate path
+	wpd->path_len = len;
+	wpd->path_pos = 0;
+
+	for (it = current, j = len-1; j >= 0; it = it->parent, j--) {
+		dx = it->x - it->parent->x;
+		dy = it->y - it->parent->y;
+		wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+	}
+
+	return true;
+}
+
+/// @name Jump point search
+/// Finds a shortest walk path with the same movement rules as A* (no corner cutting), but only
+/// keeps the cells where the path can turn in its open set. Straight runs are scanned instead.
+/// @{
+
+/// Jump point of a running search, in window coordinates
+struct jps_node {
+	int8 x, y;
+	int16 parent; ///< Index of the parent node, -1 for the start node
+	uint8 steps; ///< Number of steps from the start node
+	uint8 flag; ///< SET_OPEN / SET_CLOSED
+	int32 g_cost; ///< Actual cost from start to this node
+	int32 f_cost; ///< g_cost + heuristic(this, goal)
+};
+
+BHEAP_STRUCT_DECL(jps_heap, int16);
+
+/// Width and height of the window of cells a path of at most MAX_WALKPATH steps can visit:
+/// any cell c of it has |c-start| + |c-goal| <= MAX_WALKPATH on both axes.
+#define JPS_WINDOW (MAX_WALKPATH + 1)
+
+/// State of a jump point search
+struct s_jps_search {
+	int32 x1, y1; ///< Goal in window coordinates
+	/// Walkable cells of the window, row y+1 bit x+1 is window cell (x,y).
+	/// Everything outside of the window is an obstacle.
+	uint64 rows[JPS_WINDOW + 2];
+	struct jps_node nodes[MAX_WALKPATH * MAX_WALKPATH];
+	int16 node_count;
+	int16 index[JPS_WINDOW * JPS_WINDOW]; ///< Window cell -> node index + 1, 0 if unknown
+	int16 open_set_data[MAX_WALKPATH * MAX_WALKPATH];
+	struct jps_heap open_set;
+
+	/// Whether window cell (x,y) can be stood on, x and y may be one cell outside of the window
+	bool walkable( int32 x, int32 y ) const{
+		return ( this->rows[y + 1] >> ( x + 1 ) ) & 1;
+	}
+};
+
+#define JPS_MINTOPCMP(i,j) (search.nodes[i].f_cost - search.nodes[j].f_cost)
+
+/// Index of the lowest set bit, bits must not be 0
+static inline int32 jps_lowest_bit( uint64 bits ){
+#if defined(__GNUC__)
+	return __builtin_ctzll(bits);
+#else
+	int32 i = 0;
+
+	for( ; !( bits & 1 ); bits >>= 1 )
+		i++;
+	return i;
+#endif
+}
+
+/// Index of the highest set bit, bits must not be 0
+static inline int32 jps_highest_bit( uint64 bits ){
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(bits);
+#else
+	int32 i = 0;
+
+	while( bits >>= 1 )
+		i++;
+	return i;
+#endif
+}
+
+/// Scans from (x,y) in the straight direction (dx,dy) for the goal or a cell where the path has to turn.
+/// Returns false if an obstacle comes first.
+static bool jps_jump_straight( const s_jps_search& search, int32 x, int32 y, int32 dx, int32 dy, int32& jx, int32& jy ){
+	if( dy == 0 ){
+		// Whole rows at once, bit x+1 is cell x
+		uint64 row = search.rows[y + 1];
+		uint64 south = search.rows[y];
+		uint64 north = search.rows[y + 2];
+		uint64 stops;
+		int32 blocked, stop;
+
+		if( dx > 0 ){
+			// A neighbor that could not be reached diagonally from the previous cell without cutting a corner
+			stops = ( south & ~( south << 1 ) ) | ( north & ~( north << 1 ) );
+			if( y == search.y1 )
+				stops |= (uint64)1 << ( search.x1 + 1 );
+
+			uint64 ahead = ~( ( (uint64)2 << ( x + 1 ) ) - 1 );
+
+			// The bits above the window are 0, so there always is an obstacle ahead
+			blocked = jps_lowest_bit(~row & ahead);
+			stops &= ahead;
+			if( stops == 0 || ( stop = jps_lowest_bit(stops) ) >= blocked )
+				return false;
+		}else{
+			stops = ( south & ~( south >> 1 ) ) | ( north & ~( north >> 1 ) );
+			if( y == search.y1 )
+				stops |= (uint64)1 << ( search.x1 + 1 );
+
+			uint64 ahead = ( (uint64)1 << ( x + 1 ) ) - 1;
+
+			// Bit 0 is left of the window and always 0
+			blocked = jps_highest_bit(~row & ahead);
+			stops &= ahead;
+			if( stops == 0 || ( stop = jps_highest_bit(stops) ) <= blocked )
+				return false;
+		}
+
+		jx = stop - 1;
+		jy = y;
+		return true;
+	}
+
+	for(;;){
+		y += dy;
+
+		if( !search.walkable(x, y) )
+			return false;
+
+		if( ( x == search.x1 && y == search.y1 ) || ( search.walkable(x - 1, y) && !search.walkable(x - 1, y - dy) ) || ( search.walkable(x + 1, y) && !search.walkable(x + 1, y - dy) ) ){
+			jx = x;
+			jy = y;
+			return true;
+		}
+	}
+}
+
+/// Scans from (x,y) in direction (dx,dy) for the next jump point.
+/// A diagonal cell is a jump point if a straight scan from it finds one.
+static bool jps_jump( const s_jps_search& search, int32 x, int32 y, int32 dx, int32 dy, int32& jx, int32& jy ){
+	if( dx == 0 || dy == 0 )
+		return jps_jump_straight(search, x, y, dx, dy, jx, jy);
+
+	for(;;){
+		// Diagonal steps must not cut corners
+		if( !search.walkable(x + dx, y) || !search.walkable(x, y + dy) )
+			return false;
+
+		x += dx;
+		y += dy;
+
+		if( !search.walkable(x, y) )
+			return false;
+
+		if( ( x == search.x1 && y == search.y1 ) || jps_jump_straight(search, x, y, dx, 0, jx, jy) || jps_jump_straight(search, x, y, 0, dy, jx, jy) ){
+			jx = x;
+			jy = y;
+			return true;
+		}
+	}
+}
+
+/// Adds or improves the jump point (x,y) reached from parent.
+/// Returns false if the node storage is full.
+static bool jps_add_node( s_jps_search& search, int32 x, int32 y, int16 parent ){
+	const struct jps_node& from = search.nodes[parent];
+	int32 n = max(abs(x - from.x), abs(y - from.y));
+	int32 steps = from.steps + n;
+
+	// The rest of the path can not be shorter than the straight distance
+	if( steps + max(abs(search.x1 - x), abs(search.y1 - y)) > MAX_WALKPATH )
+		return true;
+
+	int32 g_cost = from.g_cost + n * ( ( x != from.x && y != from.y ) ? MOVE_DIAGONAL_COST : MOVE_COST );
+	int16& index = search.index[x + y * JPS_WINDOW];
+
+	if( index != 0 ){
+		struct jps_node& node = search.nodes[index - 1];
+
+		if( node.flag == SET_CLOSED || g_cost >= node.g_cost )
+			return true;
+
+		node.parent = parent;
+		node.steps = steps;
+		node.f_cost += g_cost - node.g_cost;
+		node.g_cost = g_cost;
+
+		int32 i;
+
+		ARR_FIND(0, BHEAP_LENGTH(search.open_set), i, BHEAP_DATA(search.open_set)[i] == index - 1);
+		if( i < BHEAP_LENGTH(search.open_set) )
+			BHEAP_UPDATE(search.open_set, i, JPS_MINTOPCMP);
+		return true;
+	}
+
+	if( search.node_count >= ARRAYLENGTH(search.nodes) )
+		return false;
+
+	struct jps_node& node = search.nodes[search.node_count];
+
+	node.x = x;
+	node.y = y;
+	node.parent = parent;
+	node.steps = steps;
+	node.flag = SET_OPEN;
+	node.g_cost = g_cost;
+	node.f_cost = g_cost + heuristic_octile(x, y, search.x1, search.y1);
+	index = ++search.node_count;
+	BHEAP_PUSH2(search.open_set, index - 1, JPS_MINTOPCMP);
+	return true;
+}
+
+/// Jump point search of a walk path from (x0,y0) to (x1,y1), see path_search.
+/// Falls back to A* on the rare searches that need more jump points than it can hold.
+static bool path_search_jps(struct walkpath_data *wpd, struct map_data *mapdata, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	s_jps_search search;
+
+	// Clip the window to the map, cells on a path of at most MAX_WALKPATH steps stay inside of it
+	int32 x_min = max(0, ( x0 + x1 - MAX_WALKPATH + 1 ) / 2);
+	int32 y_min = max(0, ( y0 + y1 - MAX_WALKPATH + 1 ) / 2);
+	int32 x_max = min(mapdata->xs - 1, ( x0 + x1 + MAX_WALKPATH ) / 2);
+	int32 y_max = min(mapdata->ys - 1, ( y0 + y1 + MAX_WALKPATH ) / 2);
+
+	if( x0 < x_min || x0 > x_max || y0 < y_min || y0 > y_max )
+		return false; // More than MAX_WALKPATH cells apart
+
+	int32 width = x_max - x_min + 1;
+
+	search.rows[0] = 0;
+	for( int32 y = y_min; y <= y_max; y++ )
+		search.rows[y - y_min + 1] = ( ~map_getcellbits(mapdata, x_min, y, width, cell) & ( ( (uint64)1 << width ) - 1 ) ) << 1;
+	for( int32 y = y_max - y_min + 2; y < ARRAYLENGTH(search.rows); y++ )
+		search.rows[y] = 0;
+
+	search.x1 = x1 - x_min;
+	search.y1 = y1 - y_min;
+	search.open_set = { ARRAYLENGTH(search.open_set_data), 0, search.open_set_data };
+	memset(search.index, 0, sizeof(search.index));
+
+	// Start node
+	search.nodes[0] = { static_cast<int8>( x0 - x_min ), static_cast<int8>( y0 - y_min ), -1, 0, SET_CLOSED, 0, 0 };
+	search.node_count = 1;
+	search.index[( x0 - x_min ) + ( y0 - y_min ) * JPS_WINDOW] = 1;
+
+	int16 current = 0;
+
+	while( search.nodes[current].x != search.x1 || search.nodes[current].y != search.y1 ){
+		const struct jps_node& node = search.nodes[current];
+		int32 x = node.x;
+		int32 y = node.y;
+		// Directions worth scanning from this node, index is (dx+1)+(dy+1)*3
+		bool dirs[9] = {};
+
+		if( node.parent < 0 ){
+			for( int32 i = 0; i < 9; i++ )
+				dirs[i] = ( i != 4 );
+		}else{
+			const struct jps_node& parent = search.nodes[node.parent];
+			int32 dx = ( x > parent.x ) - ( x < parent.x );
+			int32 dy = ( y > parent.y ) - ( y < parent.y );
+
+			if( dx != 0 && dy != 0 ){
+				dirs[( dx + 1 ) + 3] = true;
+				dirs[1 + ( dy + 1 ) * 3] = true;
+				dirs[( dx + 1 ) + ( dy + 1 ) * 3] = true;
+			}else{
+				// Forward, the diagonals next to it and both sides
+				int32 sx = dy, sy = dx;
+
+				dirs[( dx + 1 ) + ( dy + 1 ) * 3] = true;
+				dirs[( dx + sx + 1 ) + ( dy + sy + 1 ) * 3] = true;
+				dirs[( dx - sx + 1 ) + ( dy - sy + 1 ) * 3] = true;
+				dirs[( sx + 1 ) + ( sy + 1 ) * 3] = true;
+				dirs[( -sx + 1 ) + ( -sy + 1 ) * 3] = true;
+			}
+		}
+
+		for( int32 i = 0; i < 9; i++ ){
+			int32 jx, jy;
+
+			if( dirs[i] && jps_jump(search, x, y, i % 3 - 1, i / 3 - 1, jx, jy) && !jps_add_node(search, jx, jy, current) ){
+				// Out of node storage
+				return path_search_astar(wpd, mapdata, x0, y0, x1, y1, cell);
+			}
+		}
+
+		if( BHEAP_LENGTH(search.open_set) == 0 )
+			return false;
+
+		current = BHEAP_PEEK(search.open_set);
+		BHEAP_POP2(search.open_set, JPS_MINTOPCMP);
+		search.nodes[current].flag = SET_CLOSED;
+	}
+
+	int32 len = search.nodes[current].steps;
+
+	if( len > ARRAYLENGTH(wpd->path) )
+		return false;
+
+	// Recreate path, every jump is a straight or diagonal line
+	wpd->path_len = len;
+	wpd->path_pos = 0;
+
+	for( int16 i = current; search.nodes[i].parent >= 0; i = search.nodes[i].parent ){
+		const struct jps_node& node = search.nodes[i];
+		const struct jps_node& parent = search.nodes[node.parent];
+		int32 dx = ( node.x > parent.x ) - ( node.x < parent.x );
+		int32 dy = ( node.y > parent.y ) - ( node.y < parent.y );
+
+		for( int32 j = node.steps - 1; j >= parent.steps; j-- )
+			wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+	}
+
+	return true;
+}
+#undef JPS_MINTOPCMP
+///@}
+
+/// @name Walk path cache
+/// @{
+
+/// Parameters of a cached walk path search
+struct s_path_cache_key {
+	int16 m, x0, y0, x1, y1;
+	uint8 cell;
+	uint8 algorithm;
+
+	bool operator==( const s_path_cache_key& other ) const{
+		return this->m == other.m && this->x0 == other.x0 && this->y0 == other.y0 && this->x1 == other.x1 && this->y1 == other.y1 && this->cell == other.cell && this->algorithm == other.algorithm;
+	}
+};
+
+struct s_path_cache_hash {
+	size_t operator()( const s_path_cache_key& key ) const{
+		uint64 coords = static_cast<uint16>( key.x0 ) | static_cast<uint64>( static_cast<uint16>( key.y0 ) ) << 16 | static_cast<uint64>( static_cast<uint16>( key.x1 ) ) << 32 | static_cast<uint64>( static_cast<uint16>( key.y1 ) ) << 48;
+
+		return std::hash<uint64>()( coords ^ ( ( static_cast<uint64>( key.m ) << 16 | key.cell << 8 | key.algorithm ) * 0x9E3779B97F4A7C15ULL ) );
+	}
+};
+
+/// Result of a cached walk path search
+struct s_path_cache_entry {
+	s_path_cache_key key;
+	uint32 generation; ///< cell_generation of the map when it was searched
+	bool found;
+	struct walkpath_data wpd;
+};
+
+/// Least recently used walk path searches of one thread, up to path_cache_size of them
+struct s_path_cache {
+	std::list<s_path_cache_entry> entries; ///< Most recently used first
+	std::unordered_map<s_path_cache_key, std::list<s_path_cache_entry>::iterator, s_path_cache_hash> index;
+
+	/// Returns the search result if it is still valid for the given cell generation
+	const s_path_cache_entry* find( const s_path_cache_key& key, uint32 generation ){
+		auto it = this->index.find(key);
+
+		if( it == this->index.end() )
+			return nullptr;
+
+		if( it->second->generation != generation ){
+			// A cell of the map changed since
+			this->entries.erase(it->second);
+			this->index.erase(it);
+			return nullptr;
+		}
+
+		this->entries.splice(this->entries.begin(), this->entries, it->second);
+		return &this->entries.front();
+	}
+
+	void store( const s_path_cache_key& key, uint32 generation, bool found, const struct walkpath_data& wpd, size_t capacity ){
+		while( this->entries.size() >= capacity ){
+			this->index.erase(this->entries.back().key);
+			this->entries.pop_back();
+		}
+
+		this->entries.push_front({ key, generation, found, wpd });
+		this->index[key] = this->entries.begin();
+	}
+
+	void clear(){
+		this->entries.clear();
+		this->index.clear();
+	}
+};
+
+static thread_local s_path_cache path_cache;
+static std::atomic<uint64> path_cache_hits;
+static std::atomic<uint64> path_cache_misses;
+
+/// Whether the result of a search only depends on the walkable and shootable flags, see map_data::cell_generation
+static bool path_cache_allowed( cell_chk cell ){
+	switch( cell ){
+#ifndef CELL_NOSTACK
+		case CELL_CHKPASS:
+		case CELL_CHKNOPASS:
+#endif
+		case CELL_CHKREACH:
+		case CELL_CHKNOREACH:
+		case CELL_CHKWALL:
+		case CELL_CHKCLIFF:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Displays how many walk path searches were answered by the cache.
+ * @param reset: Resets the counters afterwards
+ */
+void path_cache_report(bool reset)
+{
+	uint64 hits = path_cache_hits.load();
+	uint64 misses = path_cache_misses.load();
+
+	ShowInfo("Path cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%%), %" PRIuPTR " entries on this thread, path_cache_size %d.\n",
+		hits, misses, ( hits + misses ) ? 100. * hits / ( hits + misses ) : 0., path_cache.entries.size(), battle_config.path_cache_size);
+
+	if( reset ){
+		path_cache_hits = 0;
+		path_cache_misses = 0;
+	}
+}
+///@}
+
+/// @name Walk path search recording for path_replay
+/// @{
+static FILE* path_record_fp = nullptr;
+
+/**
+ * Starts recording all full walk path searches to a file for path_replay.
+ * Stops a running recording first, passing nullptr only stops it.
+ * @param file: File to write to
+ * @return True if the recording was started
+ */
+bool path_record(const char* file)
+{
+	if( path_record_fp != nullptr ){
+		fclose(path_record_fp);
+		path_record_fp = nullptr;
+		ShowStatus("Stopped recording path searches.\n");
+	}
+
+	if( file == nullptr )
+		return false;
+
+	if( ( path_record_fp = fopen(file, "w") ) == nullptr ){
+		ShowError("path_record: Could not open '%s' for writing.\n", file);
+		return false;
+	}
+
+	ShowStatus("Recording path searches to '%s'...\n", file);
+	return true;
+}
+///@}
+
+/// Searches a full walk path with the configured algorithm, answering repeated searches from the cache
+static bool path_search_full(struct walkpath_data *wpd, int16 m, struct map_data *mapdata, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cell)
+{
+	// The lines are written by single stdio calls, so searches of the worker threads do not interleave
+	if( path_record_fp != nullptr )
+		fprintf(path_record_fp, "%s %d %d %d %d %d\n", mapdata->name, x0, y0, x1, y1, (int32)cell);
+
+	bool cached = battle_config.path_cache_size > 0 && path_cache_allowed(cell);
+	s_path_cache_key key = { m, x0, y0, x1, y1, static_cast<uint8>( cell ), static_cast<uint8>( battle_config.path_search_algorithm ) };
+
+	if( cached ){
+		const s_path_cache_entry* entry = path_cache.find(key, mapdata->cell_generation);
+
+		if( entry != nullptr ){
+			path_cache_hits.fetch_add(1, std::memory_order_relaxed);
+
+			if( entry->found )
+				*wpd = entry->wpd;
+			return entry->found;
+		}
+
+		path_cache_misses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool found;
+
+	if( battle_config.path_search_algorithm == 1 )
+		found = path_search_jps(wpd, mapdata, x0, y0, x1, y1, cell);
+	else
+		found = path_search_astar(wpd, mapdata, x0, y0, x1, y1, cell);
+
+	if( cached )
+		path_cache.store(key, mapdata->cell_generation, found, found ? *wpd : walkpath_data{}, battle_config.path_cache_size);
+
+	return found;
+}
+
 /*==========================================
  * path search (x0,y0)->(x1,y1)
  * wpd: path info will be written here
@@ -264,7 +874,7 @@ static int32 add_path(struct node_heap *heap, struct path_node *tp, int16 x, int
  * flag: &2 = call path_search_long instead
  * cell: type of obstruction to check for
  *
- * Note: uses global g_open_set, therefore this method can't be called in parallel or recursivly.
+ * Note: only reads the map cells, so it may be called from worker threads while the main thread waits.
  *------------------------------------------*/
 bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 flag, cell_chk cell)
 {
@@ -323,114 +933,406 @@ bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x
 		}
 
 		return false; // easy path unsuccessful
-	} else { // !(flag&1)
-		// FIXME: This array is too small to ensure all paths shorter than MAX_WALKPATH
-		// can be found without node collision: calc_index(node1) = calc_index(node2).
-		// Figure out more proper size or another way to keep track of known nodes.
-		struct path_node tp[MAX_WALKPATH * MAX_WALKPATH];
-		struct path_node *current, *it;
-		int32 xs = mapdata->xs - 1;
-		int32 ys = mapdata->ys - 1;
-		int32 len = 0;
-		int32 j;
-
-		// A* (A-star) pathfinding
-		// We always use A* for finding walkpaths because it is what game client uses.
-		// Easy pathfinding cuts corners of non-walkable cells, but client always walks around it.
-		BHEAP_RESET(g_open_set);
-
-		memset(tp, 0, sizeof(tp));
-
-		// Start node
-		i = calc_index(x0, y0);
-		tp[i].parent = nullptr;
-		tp[i].x      = x0;
-		tp[i].y      = y0;
-		tp[i].g_cost = 0;
-		tp[i].f_cost = heuristic(x0, y0, x1, y1);
-		tp[i].flag   = SET_OPEN;
-
-		heap_push_node(&g_open_set, &tp[i]); // Put start node to 'open' set
-
-		for(;;) {
-			int32 e = 0; // error flag
-
-			// Saves allowed directions for the current cell. Diagonal directions
-			// are only allowed if both directions around it are allowed. This is
-			// to prevent cutting corner of nearby wall.
-			// For example, you can only go NW from the current cell, if you can
-			// go N *and* you can go W. Otherwise you need to walk around the
-			// (corner of the) non-walkable cell.
-			int32 allowed_dirs = 0;
-
-			int32 g_cost;
-
-			if (BHEAP_LENGTH(g_open_set) == 0) {
-				return false;
-			}
+	}
+
+	return path_search_full(wpd, m, mapdata, x0, y0, x1, y1, cell);
+}
 
-			current = BHEAP_PEEK(g_open_set); // Look for the lowest f_cost node in the 'open' set
-			BHEAP_POP2(g_open_set, NODE_MINTOPCMP); // Remove it from 'open' set
 
-			x      = current->x;
-			y      = current->y;
-			g_cost = current->g_cost;
+/*==========================================
+ * Long walk path search (x0,y0)->(x1,y1)
+ * Finds a shortest path of up to max_len steps with the same movement rules as path_search.
+ * It is walked in segments of normal walk paths, see unit_walkroute_next.
+ * wrd: path will be written here, may be nullptr to only check for one
+ * cell: type of obstruction to check for
+ *
+ * Note: keeps its search state in static buffers, so it must only be called from the main thread.
+ *------------------------------------------*/
+bool path_search_route(struct walkroute_data *wrd, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 max_len, cell_chk cell)
+{
+	struct map_data *mapdata = map_getmapdata(m);
 
-			current->flag = SET_CLOSED; // Add current node to 'closed' set
+	if( mapdata == nullptr || mapdata->cell == nullptr || max_len <= 0 )
+		return false;
 
-			if (x == x1 && y == y1) {
-				break;
-			}
+	max_len = min(max_len, MAX_WALKROUTE);
 
-			if (y < ys && !map_getcellp(mapdata, x, y+1, cell)) allowed_dirs |= PATH_DIR_NORTH;
-			if (y >  0 && !map_getcellp(mapdata, x, y-1, cell)) allowed_dirs |= PATH_DIR_SOUTH;
-			if (x < xs && !map_getcellp(mapdata, x+1, y, cell)) allowed_dirs |= PATH_DIR_EAST;
-			if (x >  0 && !map_getcellp(mapdata, x-1, y, cell)) allowed_dirs |= PATH_DIR_WEST;
+	if( x0 < 0 || x0 >= mapdata->xs || y0 < 0 || y0 >= mapdata->ys )
+		return false;
+	if( x1 < 0 || x1 >= mapdata->xs || y1 < 0 || y1 >= mapdata->ys || map_getcellp(mapdata, x1, y1, cell) )
+		return false;
 
-#define chk_dir(d) ((allowed_dirs & (d)) == (d))
-			// Process neighbors of current node
-			if (chk_dir(PATH_DIR_SOUTH|PATH_DIR_EAST) && !map_getcellp(mapdata, x+1, y-1, cell))
-				e += add_path(&g_open_set, tp, x+1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y-1, x1, y1)); // (x+1, y-1) 5
-			if (chk_dir(PATH_DIR_EAST))
-				e += add_path(&g_open_set, tp, x+1, y, g_cost + MOVE_COST, current, heuristic(x+1, y, x1, y1)); // (x+1, y) 6
-			if (chk_dir(PATH_DIR_NORTH|PATH_DIR_EAST) && !map_getcellp(mapdata, x+1, y+1, cell))
-				e += add_path(&g_open_set, tp, x+1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x+1, y+1, x1, y1)); // (x+1, y+1) 7
-			if (chk_dir(PATH_DIR_NORTH))
-				e += add_path(&g_open_set, tp, x, y+1, g_cost + MOVE_COST, current, heuristic(x, y+1, x1, y1)); // (x, y+1) 0
-			if (chk_dir(PATH_DIR_NORTH|PATH_DIR_WEST) && !map_getcellp(mapdata, x-1, y+1, cell))
-				e += add_path(&g_open_set, tp, x-1, y+1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y+1, x1, y1)); // (x-1, y+1) 1
-			if (chk_dir(PATH_DIR_WEST))
-				e += add_path(&g_open_set, tp, x-1, y, g_cost + MOVE_COST, current, heuristic(x-1, y, x1, y1)); // (x-1, y) 2
-			if (chk_dir(PATH_DIR_SOUTH|PATH_DIR_WEST) && !map_getcellp(mapdata, x-1, y-1, cell))
-				e += add_path(&g_open_set, tp, x-1, y-1, g_cost + MOVE_DIAGONAL_COST, current, heuristic(x-1, y-1, x1, y1)); // (x-1, y-1) 3
-			if (chk_dir(PATH_DIR_SOUTH))
-				e += add_path(&g_open_set, tp, x, y-1, g_cost + MOVE_COST, current, heuristic(x, y-1, x1, y1)); // (x, y-1) 4
-#undef chk_dir
-			if (e) {
-				return false;
-			}
+	// Cells on a path of at most max_len steps, clipped to the map like in path_search_jps
+	int32 x_min = max(0, ( x0 + x1 - max_len + 1 ) / 2);
+	int32 y_min = max(0, ( y0 + y1 - max_len + 1 ) / 2);
+	int32 x_max = min(mapdata->xs - 1, ( x0 + x1 + max_len ) / 2);
+	int32 y_max = min(mapdata->ys - 1, ( y0 + y1 + max_len ) / 2);
+
+	if( x0 < x_min || x0 > x_max || y0 < y_min || y0 > y_max )
+		return false;
+
+	int32 width = x_max - x_min + 1;
+	size_t cells = static_cast<size_t>( width ) * ( y_max - y_min + 1 );
+
+	// Window cell -> cost and direction it was entered from, valid if its stamp matches the search
+	static std::vector<uint32> stamps;
+	static std::vector<int32> costs;
+	static std::vector<uint8> dirs;
+	static uint32 stamp = 0;
+
+	if( stamps.size() < cells ){
+		stamps.assign(cells, 0);
+		costs.resize(cells);
+		dirs.resize(cells);
+		stamp = 0;
+	}
+
+	// Closed cells use the next stamp
+	if( ( stamp += 2 ) < 2 ){
+		std::fill(stamps.begin(), stamps.end(), 0);
+		stamp = 2;
+	}
+
+	typedef std::pair<int32, int32> t_open_node; // f_cost, window cell
+	std::priority_queue<t_open_node, std::vector<t_open_node>, std::greater<t_open_node>> open_set;
+	int32 start = ( x0 - x_min ) + ( y0 - y_min ) * width;
+	int32 goal = ( x1 - x_min ) + ( y1 - y_min ) * width;
+
+	stamps[start] = stamp;
+	costs[start] = 0;
+	dirs[start] = DIR_CENTER;
+	open_set.push({ heuristic_octile(x0, y0, x1, y1), start });
+
+	while( !open_set.empty() ){
+		int32 current = open_set.top().second;
+
+		open_set.pop();
+
+		if( stamps[current] != stamp )
+			continue; // Closed, reached again on a cheaper path before
+		stamps[current] = stamp + 1;
+
+		if( current == goal )
+			break;
+
+		int32 x = x_min + current % width;
+		int32 y = y_min + current / width;
+
+		// Obstructed cells of the rows below, at and above the current cell, bit 0 is x-1
+		uint64 rows[3] = {
+			map_getcellbits(mapdata, x - 1, y - 1, 3, cell),
+			map_getcellbits(mapdata, x - 1, y, 3, cell),
+			map_getcellbits(mapdata, x - 1, y + 1, 3, cell),
+		};
+#define obstructed(dx, dy) ((rows[(dy) + 1] >> ((dx) + 1)) & 1)
+
+		for( int32 dir = DIR_NORTH; dir < DIR_MAX; dir++ ){
+			int32 dx = dirx[dir];
+			int32 dy = diry[dir];
+			int32 nx = x + dx;
+			int32 ny = y + dy;
+
+			if( nx < x_min || nx > x_max || ny < y_min || ny > y_max || obstructed(dx, dy) )
+				continue;
+			// Diagonal steps must not cut corners
+			if( dx != 0 && dy != 0 && ( obstructed(dx, 0) || obstructed(0, dy) ) )
+				continue;
+
+			int32 next = ( nx - x_min ) + ( ny - y_min ) * width;
+			int32 g_cost = costs[current] + ( ( dx != 0 && dy != 0 ) ? MOVE_DIAGONAL_COST : MOVE_COST );
+
+			if( stamps[next] == stamp + 1 || ( stamps[next] == stamp && g_cost >= costs[next] ) )
+				continue;
+
+			stamps[next] = stamp;
+			costs[next] = g_cost;
+			dirs[next] = dir;
+			open_set.push({ g_cost + heuristic_octile(nx, ny, x1, y1), next });
 		}
+#undef obstructed
+	}
 
-		for (it = current; it->parent != nullptr; it = it->parent, len++);
-		if (len > sizeof(wpd->path))
-			return false;
+	if( stamps[goal] != stamp + 1 )
+		return false;
 
-		// Recreate path
-		wpd->path_len = len;
-		wpd->path_pos = 0;
+	int32 len = 0;
 
-		for (it = current, j = len-1; j >= 0; it = it->parent, j--) {
-			dx = it->x - it->parent->x;
-			dy = it->y - it->parent->y;
-			wpd->path[j] = walk_choices[-dy + 1][dx + 1];
+	for( int32 i = goal; i != start; len++ )
+		i -= dirx[dirs[i]] + diry[dirs[i]] * width;
+
+	if( len > max_len )
+		return false;
+
+	if( wrd != nullptr ){
+		wrd->len = len;
+		wrd->pos = 0;
+		wrd->m = m;
+		wrd->x0 = x0;
+		wrd->y0 = y0;
+		wrd->x1 = x1;
+		wrd->y1 = y1;
+
+		for( int32 i = goal, j = len - 1; i != start; j-- ){
+			wrd->path[j] = static_cast<enum directions>( dirs[i] );
+			i -= dirx[dirs[i]] + diry[dirs[i]] * width;
 		}
+	}
 
-		return true;
-	} // A* end
+	return true;
+}
 
-	return false;
+/**
+ * Compares path searches and free cell counts that read the cell planes with ones that read each cell.
+ * @param m: Map to search on
+ * @param searches: Number of random searches
+ */
+void path_benchmark(int16 m, int32 searches)
+{
+	struct map_data* mapdata = map_getmapdata(m);
+
+	if( mapdata == nullptr || mapdata->cell == nullptr || mapdata->cell_planes == nullptr ){
+		ShowWarning("Console: Unknown map.\n");
+		return;
+	}
+
+	struct s_search {
+		int16 x0, y0, x1, y1;
+		bool found;
+		struct walkpath_data wpd;
+	};
+	std::vector<s_search> planes, cells;
+
+	// Random walkable start and end cells up to 15 cells apart, give up after a few tries on maps without many of them
+	for( int32 tries = 0; tries < searches * 10 && static_cast<int32>( planes.size() ) < searches; tries++ ){
+		s_search search = {};
+
+		search.x0 = rnd_value<int16>(0, mapdata->xs - 1);
+		search.y0 = rnd_value<int16>(0, mapdata->ys - 1);
+		search.x1 = search.x0 + rnd_value<int16>(-15, 15);
+		search.y1 = search.y0 + rnd_value<int16>(-15, 15);
+
+		if( map_getcellp(mapdata, search.x0, search.y0, CELL_CHKPASS) && map_getcellp(mapdata, search.x1, search.y1, CELL_CHKPASS) )
+			planes.push_back(search);
+	}
+
+	if( planes.empty() ){
+		ShowWarning("path_benchmark: No walkable cells on map %s.\n", mapdata->name);
+		return;
+	}
+
+	cells = planes;
+	ShowInfo("Benchmarking %d path searches on map %s (%dx%d)...\n", (int32)planes.size(), mapdata->name, mapdata->xs, mapdata->ys);
+
+	uint64* cell_planes = mapdata->cell_planes;
+	int64 counted[2] = {};
+	auto start = std::chrono::steady_clock::now();
+
+	for( s_search& search : planes )
+		search.found = path_search(&search.wpd, m, search.x0, search.y0, search.x1, search.y1, 0, CELL_CHKNOPASS);
+
+	auto middle = std::chrono::steady_clock::now();
+
+	for( s_search& search : planes )
+		counted[0] += map_countcells(mapdata, search.x0 - AREA_SIZE, search.y0 - AREA_SIZE, search.x0 + AREA_SIZE, search.y0 + AREA_SIZE, CELL_CHKREACH);
+
+	auto end = std::chrono::steady_clock::now();
+
+	ShowInfo("cell planes: %6" PRId64 " ns/path search, %6" PRId64 " ns/free cell count\n",
+		(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / (int64)planes.size(),
+		(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / (int64)planes.size());
+
+	// Without the planes every check falls back to map_getcellp
+	mapdata->cell_planes = nullptr;
+	start = std::chrono::steady_clock::now();
+
+	for( s_search& search : cells )
+		search.found = path_search(&search.wpd, m, search.x0, search.y0, search.x1, search.y1, 0, CELL_CHKNOPASS);
+
+	middle = std::chrono::steady_clock::now();
+
+	for( s_search& search : cells )
+		counted[1] += map_countcells(mapdata, search.x0 - AREA_SIZE, search.y0 - AREA_SIZE, search.x0 + AREA_SIZE, search.y0 + AREA_SIZE, CELL_CHKREACH);
+
+	end = std::chrono::steady_clock::now();
+	mapdata->cell_planes = cell_planes;
+
+	ShowInfo("cells:       %6" PRId64 " ns/path search, %6" PRId64 " ns/free cell count\n",
+		(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / (int64)cells.size(),
+		(int64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / (int64)cells.size());
+
+	int32 mismatches = (counted[0] != counted[1]);
+	int32 found = 0;
+
+	for( size_t i = 0; i < planes.size(); i++ ){
+		const struct walkpath_data& a = planes[i].wpd;
+		const struct walkpath_data& b = cells[i].wpd;
+
+		if( planes[i].found != cells[i].found || ( planes[i].found && ( a.path_len != b.path_len || memcmp(a.path, b.path, a.path_len * sizeof(a.path[0])) != 0 ) ) )
+			mismatches++;
+		if( planes[i].found )
+			found++;
+	}
+
+	ShowInfo("%d paths found, %" PRId64 " free cells counted, %d mismatches.\n", found, counted[0], mismatches);
 }
 
+/// Walks a found path and returns its cost, or -1 if it leaves the walkable cells or cuts a corner
+static int32 path_replay_cost( struct map_data* mapdata, int16 x, int16 y, int16 x1, int16 y1, cell_chk cell, const struct walkpath_data& wpd )
+{
+	int32 cost = 0;
+
+	for( int32 i = 0; i < wpd.path_len; i++ ){
+		int32 dx = dirx[wpd.path[i]];
+		int32 dy = diry[wpd.path[i]];
+
+		if( map_getcellp(mapdata, x + dx, y + dy, cell) || ( dx != 0 && dy != 0 && ( map_getcellp(mapdata, x + dx, y, cell) || map_getcellp(mapdata, x, y + dy, cell) ) ) )
+			return -1;
+
+		x += dx;
+		y += dy;
+		cost += ( dx != 0 && dy != 0 ) ? MOVE_DIAGONAL_COST : MOVE_COST;
+	}
+
+	return ( x == x1 && y == y1 ) ? cost : -1;
+}
+
+/**
+ * Replays walk path searches recorded by path_record against the loaded maps.
+ * Compares A* with jump point search and the configured algorithm behind an empty path cache.
+ * @param file: File with the recorded searches
+ */
+void path_replay(const char* file)
+{
+	FILE* fp = fopen(file, "r");
+
+	if( fp == nullptr ){
+		ShowError("path_replay: Could not open '%s'.\n", file);
+		return;
+	}
+
+	struct s_replay_search {
+		int16 m, x0, y0, x1, y1;
+		cell_chk cell;
+		bool found[3]; // A*, jump points, configured with cache
+		struct walkpath_data wpd[3];
+	};
+	std::vector<s_replay_search> searches;
+	char line[128];
+	int32 skipped = 0;
+
+	while( fgets(line, sizeof(line), fp) ){
+		char mapname[MAP_NAME_LENGTH_EXT];
+		int32 x0, y0, x1, y1, cell;
+
+		if( sscanf(line, "%15s %11d %11d %11d %11d %11d", mapname, &x0, &y0, &x1, &y1, &cell) != 6 ){
+			ShowWarning("path_replay: Skipping invalid line '%s'.\n", line);
+			continue;
+		}
+
+		int16 m = map_mapname2mapid(mapname);
+		struct map_data* mapdata = map_getmapdata(m);
+
+		// Instances and maps of other map-servers
+		if( mapdata == nullptr || mapdata->cell == nullptr || x0 < 0 || x0 >= mapdata->xs || y0 < 0 || y0 >= mapdata->ys || x1 < 0 || x1 >= mapdata->xs || y1 < 0 || y1 >= mapdata->ys ){
+			skipped++;
+			continue;
+		}
+
+		s_replay_search search = {};
+
+		search.m = m;
+		search.x0 = x0;
+		search.y0 = y0;
+		search.x1 = x1;
+		search.y1 = y1;
+		search.cell = static_cast<cell_chk>( cell );
+		searches.push_back(search);
+	}
+
+	fclose(fp);
+
+	if( searches.empty() ){
+		ShowError("path_replay: '%s' does not contain any path searches on the loaded maps.\n", file);
+		return;
+	}
+
+	ShowStatus("Replaying %" PRIuPTR " path searches from '%s' (%d on maps that are not loaded skipped)...\n", searches.size(), file, skipped);
+
+	// Do not record the replay itself
+	FILE* record_fp = path_record_fp;
+	int64 duration[3];
+	uint64 hits = 0;
+
+	path_record_fp = nullptr;
+
+	for( int32 pass = 0; pass < 3; pass++ ){
+		uint64 hits_before = path_cache_hits;
+
+		path_cache.clear();
+		auto start = std::chrono::steady_clock::now();
+
+		for( s_replay_search& search : searches ){
+			struct map_data* mapdata = map_getmapdata(search.m);
+
+			switch( pass ){
+				case 0: search.found[0] = path_search_astar(&search.wpd[0], mapdata, search.x0, search.y0, search.x1, search.y1, search.cell); break;
+				case 1: search.found[1] = path_search_jps(&search.wpd[1], mapdata, search.x0, search.y0, search.x1, search.y1, search.cell); break;
+				case 2: search.found[2] = path_search_full(&search.wpd[2], search.m, mapdata, search.x0, search.y0, search.x1, search.y1, search.cell); break;
+			}
+		}
+
+		duration[pass] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		if( pass == 2 )
+			hits = path_cache_hits - hits_before;
+	}
+
+	path_record_fp = record_fp;
+
+	int32 found[2] = {}, invalid[2] = {}, mismatches = 0, shorter = 0, only_jps = 0, only_astar = 0;
+	int64 cost[2] = {};
+	int32 configured = ( battle_config.path_search_algorithm == 1 ) ? 1 : 0;
+
+	for( const s_replay_search& search : searches ){
+		struct map_data* mapdata = map_getmapdata(search.m);
+		int32 costs[2] = {};
+
+		for( int32 i = 0; i < 2; i++ ){
+			if( !search.found[i] )
+				continue;
+
+			found[i]++;
+			if( ( costs[i] = path_replay_cost(mapdata, search.x0, search.y0, search.x1, search.y1, search.cell, search.wpd[i]) ) < 0 )
+				invalid[i]++;
+		}
+
+		if( search.found[0] && search.found[1] ){
+			cost[0] += costs[0];
+			cost[1] += costs[1];
+			if( costs[1] < costs[0] )
+				shorter++;
+		}else if( search.found[1] )
+			only_jps++;
+		else if( search.found[0] )
+			only_astar++;
+
+		// The cache must not change any result
+		const struct walkpath_data& a = search.wpd[configured];
+		const struct walkpath_data& b = search.wpd[2];
+
+		if( search.found[configured] != search.found[2] || ( search.found[2] && ( a.path_len != b.path_len || memcmp(a.path, b.path, a.path_len * sizeof(a.path[0])) != 0 ) ) )
+			mismatches++;
+	}
+
+	int64 count = static_cast<int64>( searches.size() );
+
+	ShowInfo("A*:           %6" PRId64 " ns/search, %d paths found, %d invalid\n", duration[0] / count, found[0], invalid[0]);
+	ShowInfo("jump points:  %6" PRId64 " ns/search, %d paths found, %d invalid, %d shorter than A*, %d not found by A*, %d only found by A*\n",
+		duration[1] / count, found[1], invalid[1], shorter, only_jps, only_astar);
+	ShowInfo("path cost of paths found by both: A* %" PRId64 ", jump points %" PRId64 "\n", cost[0], cost[1]);
+	ShowInfo("%s + cache: %6" PRId64 " ns/search, %.1f%% cache hits with path_cache_size %d, %d mismatches\n",
+		configured ? "jump points" : "A*", duration[2] / count, 100. * hits / count, battle_config.path_cache_size, mismatches);
+}
 
 //Distance functions, taken from http://www.flipcode.com/articles/article_fastdistance.shtml
 bool check_distance(int32 dx, int32 dy, int32 distance)
@@ -31,6 +31,18 @@ struct walkpath_data {
 	enum directions path[MAX_WALKPATH];
 };
 
+/// Longest walk path that is walked in segments, see max_walk_route
+#define MAX_WALKROUTE 1024
+
+struct walkroute_data {
+	uint16 len; ///< Number of steps
+	uint16 pos; ///< Steps covered by the segments walked so far
+	int16 m; ///< Map
+	int16 x0, y0; ///< Start
+	int16 x1, y1; ///< Destination
+	enum directions path[MAX_WALKROUTE];
+};
+
 struct shootpath_data {
 	int32 rx,ry,len;
 	int32 x[MAX_WALKPATH];
@@ -63,9 +75,24 @@ int32 path_blownpos(int16 m,int16 x0,int16 y0,int16 dx,int16 dy,int32 count);
 // tries to find a walkable path
 bool path_search(struct walkpath_data *wpd,int16 m,int16 x0,int16 y0,int16 x1,int16 y1,int32 flag,cell_chk cell);
 
+// tries to find a walkable path longer than MAX_WALKPATH
+bool path_search_route(struct walkroute_data *wrd,int16 m,int16 x0,int16 y0,int16 x1,int16 y1,int32 max_len,cell_chk cell);
+
 // tries to find a shootable path
 bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16 x1,int16 y1,cell_chk cell);
 
+// compares path searches with and without the cell planes
+void path_benchmark(int16 m, int32 searches);
+
+// displays the hit rate of the walk path cache
+void path_cache_report(bool reset);
+
+// records full walk path searches for path_replay
+bool path_record(const char* file);
+
+// replays recorded walk path searches with all algorithms
+void path_replay(const char* file);
+
 // distance related functions
 bool check_distance(int32 dx, int32 dy, int32 distance);
 uint32 distance(int32 dx, int32 dy);
@@ -2189,6 +2189,9 @@ bool pc_authok(map_session_data *sd, uint32 login_id2, time_t expiration_time, i
 	sd->guild_y = -1;
 
 	sd->delayed_damage = 0;
+	sd->calc_batch = 0;
+	sd->calc_batch_opt = SCO_NONE;
+	sd->calc_batch_pending = false;
 
 	// Event Timers
 	for( int32 i = 0; i < MAX_EVENTTIMER; i++ )
@@ -12008,6 +12011,36 @@ int32 pc_load_combo(map_session_data *sd) {
 	return ret;
 }
 
+/**
+ * Checks if an equipped item or one of its cards runs a script when it is equipped or unequipped
+ * @param sd: Player data
+ * @param n: Item inventory index
+ * @param unequip: Checks the unequip scripts instead of the equip scripts
+ * @return True if there is a script to run
+ */
+static bool pc_equip_has_script(map_session_data *sd, int32 n, bool unequip) {
+	item_data* id = sd->inventory_data[n];
+
+	if (id == nullptr)
+		return false;
+	if ((unequip ? id->unequip_script : id->equip_script) != nullptr)
+		return true;
+	if (itemdb_isspecial(sd->inventory.u.items_inventory[n].card[0]))
+		return false;
+
+	for (int32 i = 0; i < MAX_SLOTS; i++) {
+		if (!sd->inventory.u.items_inventory[n].card[i])
+			continue;
+
+		std::shared_ptr<item_data> data = item_db.find(sd->inventory.u.items_inventory[n].card[i]);
+
+		if (data != nullptr && (unequip ? data->unequip_script : data->equip_script) != nullptr)
+			return true;
+	}
+
+	return false;
+}
+
 /*==========================================
  * Equip item on player sd at req_pos from inventory index n
  * return: false - fail; true - success
@@ -12149,6 +12182,9 @@ bool pc_equipitem(map_session_data *sd,int16 n,int32 req_pos,bool equipswitch)
 		clif_equipswitch_add( sd, n, pos, ITEM_EQUIP_ACK_OK );
 		return true;
 	}else{
+		// Recalculate once for the replaced items and the new one
+		status_calc_pc_batch_begin(*sd);
+
 		for(i=0;i<EQI_MAX;i++) {
 			if(pos & equip_bitmask[i]) {
 				if(sd->equip_index[i] >= 0) //Slot taken, remove item from there.
@@ -12252,9 +12288,14 @@ bool pc_equipitem(map_session_data *sd,int16 n,int32 req_pos,bool equipswitch)
 	}
 
 	status_calc_pc(sd,SCO_NONE);
+	status_calc_pc_batch_end(*sd);
 	if (flag) //Update skill data
 		clif_skillinfoblock(*sd);
 
+	// Still inside an outer batch, like an equip switch, but the scripts below read the status
+	if (pc_equip_has_script(sd, n, false))
+		status_calc_pc_batch_flush(*sd);
+
 	//OnEquip script [Skotlex]
 	if (id) {
 		current_equip_item_index = n;
@@ -12351,6 +12392,10 @@ static void pc_unequipitem_sub(map_session_data *sd, int32 n, int32 flag) {
 		status_calc_pc(sd, SCO_FORCE);
 	}
 
+	// A batch only recalculates at its end, but the check and the scripts below read the status
+	if (sd->sc.getSCE(SC_SIGNUMCRUCIS) || pc_equip_has_script(sd, n, true))
+		status_calc_pc_batch_flush(*sd);
+
 	if (sd->sc.getSCE(SC_SIGNUMCRUCIS) && !battle_check_undead(sd->battle_status.race, sd->battle_status.def_ele))
 		status_change_end(sd, SC_SIGNUMCRUCIS);
 
@@ -12513,6 +12558,9 @@ int32 pc_equipswitch( map_session_data* sd, int32 index ){
 
 		return position;
 	}else{
+		// Recalculate once after all items were exchanged
+		status_calc_pc_batch_begin( *sd );
+
 		std::map<int32, int32> unequipped;
 		int32 unequipped_position = 0;
 
@@ -12573,6 +12621,8 @@ int32 pc_equipswitch( map_session_data* sd, int32 index ){
 			clif_equipswitch_add( sd, unequipped_index, unequipped_position, ITEM_EQUIP_ACK_OK );
 		}
 
+		status_calc_pc_batch_end( *sd );
+
 		return all_position;
 	}
 }
@@ -483,6 +483,8 @@ public:
 
 	int32 langtype;
 	struct mmo_charstatus status;
+	std::unique_ptr<struct mmo_charstatus> save_base; ///< Status as last sent to the char-server, base of delta saves
+	uint64 save_base_hash; ///< hash_fnv64 of save_base
 
 	// Item Storages
 	struct s_storage storage, premiumStorage;
@@ -873,6 +875,9 @@ public:
 	unsigned char sc_display_count;
 
 	unsigned char delayed_damage; //[Ind]
+	uint8 calc_batch; ///< Nesting of status_calc_pc_batch_begin, full recalculations wait for the last status_calc_pc_batch_end
+	uint8 calc_batch_opt; ///< Options of the full recalculations requested during the batch
+	bool calc_batch_pending; ///< A full recalculation was requested during the batch
 
 	/**
 	 * Account/Char variables & array control of those variables
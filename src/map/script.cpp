@@ -9,17 +9,33 @@
 
 #include "script.hpp"
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <csetjmp>
 #include <cstdlib> // atoi, strtol, strtoll, exit
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #ifdef PCRE_SUPPORT
 #include <pcre.h> // preg_match
 #endif
 
+#ifndef WIN32
+	#include <unistd.h> // getpid
+#else
+	#include <process.h> // _getpid
+#endif
+
 #include <common/cbasetypes.hpp>
 #include <common/ers.hpp>  // ers_destroy
+#include <common/grfio.hpp> // grfio_crc32
 #include <common/malloc.hpp>
 #include <common/md5calc.hpp>
 #include <common/nullpo.hpp>
@@ -54,6 +70,7 @@
 #include "mapreg.hpp"
 #include "mercenary.hpp"
 #include "mob.hpp"
+#include "navgraph.hpp"
 #include "npc.hpp"
 #include "party.hpp"
 #include "path.hpp"
@@ -192,10 +209,18 @@ static bool script_rid2bl_(struct script_state *st, uint8 loc, block_list **bl,
 #define script_rid2sd(sd) script_rid2sd_(st,&(sd),__FUNCTION__)
 #define script_rid2bl(loc,bl) script_rid2bl_(st,(loc),&(bl),__FUNCTION__)
 
+// The parser state is thread local, so worker threads can compile npc scripts with their own copy
+// of the symbol table while the main thread loads the npcs, see script_precompile.
+
 /// temporary buffer for passing around compiled bytecode
 /// @see add_scriptb, set_label, parse_script
-static unsigned char* script_buf = nullptr;
-static int32 script_pos = 0, script_size = 0;
+static thread_local unsigned char* script_buf = nullptr;
+static thread_local int32 script_pos = 0, script_size = 0;
+
+/// slots given to the scope (.@) and npc (.) variables of the script being parsed
+/// @see add_scriptl, parse_script
+static thread_local std::unordered_map<int32, int32> parse_slots[2];
+static thread_local std::vector<int32> parse_slot_ids[2];
 
 static inline int32 GETVALUE(const unsigned char* buf, int32 i)
 {
@@ -210,7 +235,7 @@ static inline void SETVALUE(unsigned char* buf, int32 i, int32 n)
 
 // String buffer structures.
 // str_data stores string information
-static struct str_data_struct {
+struct str_data_struct {
 	enum c_op type;
 	int32 str;
 	int32 backpatch;
@@ -220,19 +245,20 @@ static struct str_data_struct {
 	int32 next;
 	const char *name;
 	bool deprecated;
-} *str_data = nullptr;
-static int32 str_data_size = 0; // size of the data
-static int32 str_num = LABEL_START; // next id to be assigned
+};
+static thread_local struct str_data_struct *str_data = nullptr;
+static thread_local int32 str_data_size = 0; // size of the data
+static thread_local int32 str_num = LABEL_START; // next id to be assigned
 
 // str_buf holds the strings themselves
-static char *str_buf;
-static int32 str_size = 0; // size of the buffer
-static int32 str_pos = 0; // next position to be assigned
+static thread_local char *str_buf;
+static thread_local int32 str_size = 0; // size of the buffer
+static thread_local int32 str_pos = 0; // next position to be assigned
 
 
 // Using a prime number for SCRIPT_HASH_SIZE should give better distributions
 #define SCRIPT_HASH_SIZE 1021
-int32 str_hash[SCRIPT_HASH_SIZE];
+static thread_local int32 str_hash[SCRIPT_HASH_SIZE];
 // Specifies which string hashing method to use
 //#define SCRIPT_HASH_DJB2
 //#define SCRIPT_HASH_SDBM
@@ -240,7 +266,7 @@ int32 str_hash[SCRIPT_HASH_SIZE];
 
 static DBMap* scriptlabel_db = nullptr; // const char* label_name -> int32 script_pos
 static DBMap* userfunc_db = nullptr; // const char* func_name -> struct script_code*
-static int32 parse_options = 0;
+static thread_local int32 parse_options = 0;
 DBMap* script_get_label_db(void) { return scriptlabel_db; }
 DBMap* script_get_userfunc_db(void) { return userfunc_db; }
 
@@ -256,7 +282,7 @@ static DBMap* autobonus_db = nullptr; // char* script -> char* bytecode
 
 struct Script_Config script_config = {
 	1, // warn_func_mismatch_argtypes
-	1, 65535, 2048, //warn_func_mismatch_paramnum/check_cmdcount/check_gotocount
+	1, 1, 65535, 2048, //warn_func_mismatch_paramnum/variable_slots/check_cmdcount/check_gotocount
 	0, INT_MAX, // input_min_value/input_max_value
 	// NOTE: None of these event labels should be longer than <EVENT_NAME_LENGTH> characters
 	// PC related
@@ -312,14 +338,56 @@ struct Script_Config script_config = {
 	"OnNaviGenerate", //navi_generate_name (is executed right before navi generation)
 };
 
-static jmp_buf     error_jump;
-static char*       error_msg;
-static const char* error_pos;
-static int32         error_report; // if the error should produce output
+static thread_local jmp_buf     error_jump;
+static thread_local char*       error_msg;
+static thread_local const char* error_pos;
+static thread_local int32         error_report; // if the error should produce output
 // Used by disp_warning_message
-static const char* parser_current_src;
-static const char* parser_current_file;
-static int32         parser_current_line;
+static thread_local const char* parser_current_src;
+static thread_local const char* parser_current_file;
+static thread_local int32         parser_current_line;
+
+/// Script being compiled on a worker thread, see script_precompile
+struct s_script_precompile_state {
+	const std::function<bool( const char* )>* function_defined; ///< Whether a global function is defined when the main thread loads the script
+	std::vector<std::pair<std::string, bool>> functions; ///< Global functions looked up and whether they were defined
+	std::vector<std::pair<int32, int32>> labels; ///< Labels put in scriptlabel_db on the main thread
+	bool diagnostics; ///< The script showed a warning, which only the main thread may show
+};
+static thread_local s_script_precompile_state* parse_precompile = nullptr;
+/// Set on worker threads, see script_precompile_thread_begin
+static thread_local bool parse_worker = false;
+
+/// Whether the parser may show a warning now.
+/// Worker threads only take note, the main thread compiles the script again to show it in file order.
+static bool parse_report(){
+	if( !parse_worker )
+		return true;
+
+	if( parse_precompile != nullptr )
+		parse_precompile->diagnostics = true;
+	return false;
+}
+
+/// Whether a global function is defined.
+/// Worker threads ask for the functions defined by the time the main thread loads the script and note the answer.
+static bool parse_userfunc_exists( const char* name ){
+	if( parse_precompile == nullptr )
+		return strdb_get( userfunc_db, name ) != nullptr;
+
+	bool defined = ( *parse_precompile->function_defined )( name );
+
+	parse_precompile->functions.emplace_back( name, defined );
+	return defined;
+}
+
+/// Puts a label in scriptlabel_db, see SCRIPT_USE_LABEL_DB
+static void parse_label_put( int32 l, int32 pos ){
+	if( parse_precompile == nullptr )
+		strdb_iput( scriptlabel_db, get_str( l ), pos );
+	else
+		parse_precompile->labels.emplace_back( l, pos );
+}
 
 // for advanced scripting support ( nested if, switch, while, for, do-while, function, etc )
 // [Eoe / jA 1080, 1081, 1094, 1164]
@@ -341,7 +409,7 @@ enum e_arglist
 	ARGLIST_PAREN     = 2,
 };
 
-static struct {
+static thread_local struct {
 	struct {
 		enum curly_type type;
 		int32 index;
@@ -357,7 +425,7 @@ const char* parse_curly_close(const char* p);
 const char* parse_syntax_close(const char* p);
 const char* parse_syntax_close_sub(const char* p,int32* flag);
 const char* parse_syntax(const char* p);
-static int32 parse_syntax_for_flag = 0;
+static thread_local int32 parse_syntax_for_flag = 0;
 
 extern int16 current_equip_item_index; //for New CARDS Scripts. It contains Inventory Index of the EQUIP_SCRIPT caller item. [Lupus]
 extern uint32 current_equip_combo_pos;
@@ -367,6 +435,7 @@ int32 potion_hp=0, potion_per_hp=0, potion_sp=0, potion_per_sp=0;
 int32 potion_target = 0;
 uint32 *generic_ui_array = nullptr;
 uint32 generic_ui_array_size = 0;
+struct s_script_bonus_record* script_bonus_record = nullptr; ///< Recording of the equipment script being run, if any
 
 
 c_op get_com(unsigned char *script,int32 *pos);
@@ -410,6 +479,7 @@ const char* script_op2name(int32 op)
 	RETURN_OP_NAME(C_USERFUNC_POS);
 
 	RETURN_OP_NAME(C_REF);
+	RETURN_OP_NAME(C_SLOT);
 
 	// operators
 	RETURN_OP_NAME(C_OP3);
@@ -610,7 +680,8 @@ static void disp_error_message2(const char *mes,const char *pos,int32 report)
 #define disp_error_message(mes,pos) disp_error_message2(mes,pos,1)
 
 static void disp_warning_message(const char *mes, const char *pos) {
-	script_warning(parser_current_src,parser_current_file,parser_current_line,mes,pos);
+	if( parse_report() )
+		script_warning(parser_current_src,parser_current_file,parser_current_line,mes,pos);
 }
 
 /// Checks event parameter validity
@@ -796,6 +867,33 @@ static void add_scripti(int64 a){
 	add_scriptb(((a & (int64)0x3f)|(int64)0x80));
 }
 
+/// Appends the slot of a scope (.@) or npc (.) variable to the script buffer.
+/// The first use of a variable in a script assigns it the next free slot of its scope.
+///
+/// @param l The id of the str_data entry
+static void add_scriptslot(int32 l)
+{
+	const char* name = str_buf + str_data[l].str;
+
+	if( !script_config.variable_slots || name[0] != '.' || name[1] == '\0' )
+		return;
+
+	int32 scope = ( name[1] == '@' ) ? 0 : 1;
+	auto it = parse_slots[scope].find( l );
+	int32 slot;
+
+	if( it != parse_slots[scope].end() ){
+		slot = it->second;
+	}else{
+		slot = static_cast<int32>( parse_slot_ids[scope].size() );
+		parse_slots[scope][l] = slot;
+		parse_slot_ids[scope].push_back( l );
+	}
+
+	add_scriptc(C_SLOT);
+	add_scripti(slot);
+}
+
 /// Appends a str_data object (label/function/variable/integer) to the script buffer.
 
 ///
@@ -815,6 +913,8 @@ static void add_scriptl(int32 l)
 		break;
 	case C_NOP:
 	case C_USERFUNC:
+		if( str_data[l].type == C_NOP )
+			add_scriptslot(l);
 		// Embedded data backpatch there is a possibility of label
 		add_scriptc(C_NAME);
 		str_data[l].backpatch = script_pos;
@@ -828,6 +928,7 @@ static void add_scriptl(int32 l)
 			add_scriptc(C_NEG);
 		break;
 	default: // assume C_NAME
+		add_scriptslot(l);
 		add_scriptc(C_NAME);
 		add_scriptb(l);
 		add_scriptb(l>>8);
@@ -970,7 +1071,7 @@ const char* parse_callfunc(const char* p, int32 require_paren, int32 is_custom)
 		add_scriptc(C_ARG);
 		arg = buildin_func[str_data[func].val].arg;
 #if defined(SCRIPT_COMMAND_DEPRECATION)
-		if( str_data[func].deprecated ){
+		if( str_data[func].deprecated && parse_report() ){
 			ShowWarning( "Usage of deprecated script function '%s'.\n", get_str(func) );
 			ShowWarning( "This function was deprecated on '%s' and could become unavailable anytime soon.\n", buildin_func[str_data[func].val].deprecated );
 		}
@@ -987,7 +1088,7 @@ const char* parse_callfunc(const char* p, int32 require_paren, int32 is_custom)
 			++arg; // count func as argument
 	} else {
 		const char* name = get_str(func);
-		if( !is_custom && strdb_get(userfunc_db, name) == nullptr ) {
+		if( !is_custom && !parse_userfunc_exists( name ) ) {
 			disp_error_message("parse_line: expect command, missing function name or calling undeclared function",p);
 		} else {;
 			add_scriptl(buildin_callfunc_ref);
@@ -1344,7 +1445,7 @@ const char* parse_simpleexpr(const char *p)
 				char buf[8];
 				size_t len = skip_escaped_c(p) - p;
 				size_t n = sv_unescape_c(buf, p, len);
-				if( n != 1 )
+				if( n != 1 && parse_report() )
 					ShowDebug("parse_simpleexpr: unexpected length %d after unescape (\"%.*s\" -> %.*s)\n", (int32)n, (int32)len, p, (int32)n, buf);
 				p += len;
 				add_scriptb(*buf);
@@ -1371,7 +1472,7 @@ const char* parse_simpleexpr(const char *p)
 			return parse_callfunc(p,1,0);
 		else {
 			const char* name = get_str(l);
-			if( strdb_get(userfunc_db,name) != nullptr ) {
+			if( parse_userfunc_exists( name ) ) {
 				return parse_callfunc(p,1,1);
 			}
 		}
@@ -1382,7 +1483,7 @@ const char* parse_simpleexpr(const char *p)
 		}
 
 #if defined(SCRIPT_CONSTANT_DEPRECATION)
-		if( str_data[l].type == C_INT && str_data[l].deprecated ){
+		if( str_data[l].type == C_INT && str_data[l].deprecated && parse_report() ){
 			ShowWarning( "Usage of deprecated constant '%s'.\n", get_str(l) );
 			ShowWarning( "This constant was deprecated and could become unavailable anytime soon.\n" );
 			if (str_data[l].name)
@@ -1938,7 +2039,7 @@ const char* parse_syntax(const char* p)
 					str_data[l].type = C_USERFUNC;
 					set_label(l, script_pos, p);
 					if( parse_options&SCRIPT_USE_LABEL_DB )
-						strdb_iput(scriptlabel_db, get_str(l), script_pos);
+						parse_label_put(l, script_pos);
 				}
 				else
 					disp_error_message("parse_syntax:function: function name is invalid", func_name);
@@ -2323,7 +2424,7 @@ bool script_get_constant(const char* name, int64* value)
 	value[0] = str_data[n].val;
 
 #if defined(SCRIPT_CONSTANT_DEPRECATION)
-	if( str_data[n].deprecated ){
+	if( str_data[n].deprecated && parse_report() ){
 		ShowWarning( "Usage of deprecated constant '%s'.\n", name );
 		ShowWarning( "This constant was deprecated and could become unavailable anytime soon.\n" );
 		if (str_data[n].name)
@@ -2469,13 +2570,748 @@ void script_warning(const char* src, const char* file, int32 start_line, const c
 	ShowWarning("%s", StringBuf_Value(&buf));
 }
 
+/**
+ * Creates the slot layout of the variables the compiler gave a slot to.
+ * @param ids: variable id of each slot
+ * @return layout or nullptr if no variable has a slot
+ */
+static struct script_slot_layout* script_slot_layout_create( const std::vector<int32>& ids ){
+	if( ids.empty() ){
+		return nullptr;
+	}
+
+	struct script_slot_layout* layout = new script_slot_layout();
+
+	layout->ids = ids;
+	layout->strings.resize( ids.size() );
+	layout->index.reserve( ids.size() );
+
+	for( int32 slot = 0; slot < static_cast<int32>( ids.size() ); slot++ ){
+		layout->strings[slot] = is_string_variable( get_str( ids[slot] ) );
+		layout->index.emplace_back( ids[slot], slot );
+	}
+
+	std::sort( layout->index.begin(), layout->index.end() );
+
+	return layout;
+}
+
+/**
+ * Allocates zeroed values for a slot layout.
+ * @param layout: slot layout (can be nullptr)
+ * @return slot values or nullptr if there is nothing to store
+ */
+static union script_slot* script_slots_alloc( const struct script_slot_layout* layout ){
+	if( layout == nullptr ){
+		return nullptr;
+	}
+
+	return (union script_slot*)aCalloc( layout->ids.size(), sizeof( union script_slot ) );
+}
+
+/**
+ * Frees slot values, including the strings they hold.
+ * @param layout: slot layout the values were allocated for
+ * @param slots: slot values (can be nullptr)
+ */
+static void script_slots_free( const struct script_slot_layout* layout, union script_slot* slots ){
+	if( slots == nullptr ){
+		return;
+	}
+
+	for( size_t slot = 0; slot < layout->ids.size(); slot++ ){
+		if( layout->strings[slot] && slots[slot].str != nullptr ){
+			aFree( slots[slot].str );
+		}
+	}
+
+	aFree( slots );
+}
+
+/**
+ * Finds the slot of a scope/npc variable.
+ * @param src: variable container
+ * @param uid: variable uid, only array index 0 can have a slot
+ * @param hint: slot emitted by the compiler, checked before searching the layout
+ * @return slot or -1 if the variable is stored in the variable database
+ */
+static inline int32 script_slot_find( const struct reg_db* src, int64 uid, int32 hint ){
+	if( src->slots == nullptr || script_getvaridx( uid ) != 0 ){
+		return -1;
+	}
+
+	const struct script_slot_layout* layout = src->slot_layout;
+	int32 id = script_getvarid( uid );
+
+	if( hint >= 0 && hint < static_cast<int32>( layout->ids.size() ) && layout->ids[hint] == id ){
+		return hint;
+	}
+
+	auto it = std::lower_bound( layout->index.begin(), layout->index.end(), std::make_pair( id, INT32_MIN ) );
+
+	if( it != layout->index.end() && it->first == id ){
+		return it->second;
+	}
+
+	return -1;
+}
+
+/**
+ * Sets up the variables of a new scope.
+ * @param scope: scope to initialize (arrays are left to the caller)
+ * @param code: script running in the scope
+ */
+static void script_scope_alloc( struct reg_db* scope, struct script_code* code ){
+	scope->vars = i64db_alloc(DB_OPT_RELEASE_DATA);
+	scope->slot_layout = code->scope_layout;
+	scope->slots = script_slots_alloc( code->scope_layout );
+}
+
+/// Version of the bytecode cache file, increase it when the compiler output changes
+#define SCRIPT_CACHE_VERSION 1
+
+/// Compiled script of a npc source file, see script_cache_begin
+struct s_script_cache_entry {
+	int32 options;
+	std::string code;
+	std::vector<std::string> names; ///< Names of the str_data entries the script refers to
+	std::vector<std::pair<int32, uint32>> references; ///< Position of a str_data id in the bytecode and the index of its name
+	std::vector<std::pair<uint32, int32>> labels; ///< Index of the name and position of the labels put in scriptlabel_db
+	std::vector<uint32> slots[2]; ///< Index of the names of the slotted scope and npc variables
+	int64 compile_ns; ///< Time the script took to compile
+};
+
+/// Compiled scripts of a npc source file
+struct s_script_cache_file {
+	uint32 crc;
+	uint64 size;
+	uint32 functions; ///< Hash of the global functions that were defined when the file was loaded
+	std::map<uint32, s_script_cache_entry> entries; ///< Scripts by offset in the file
+};
+
+/// Script compiled on a worker thread, see script_precompile
+struct s_script_precompiled {
+	s_script_cache_entry entry;
+	std::vector<std::pair<std::string, bool>> functions; ///< Global functions looked up and whether they were defined
+};
+
+/// Scripts of a npc source file compiled on worker threads
+struct s_script_precompiled_file {
+	std::unordered_map<uint32, s_script_precompiled> scripts; ///< Scripts by offset in the file
+};
+
+/// Symbol table the worker threads start from and how many of their scripts were used, see script_precompile_open
+static struct s_script_precompile {
+	std::vector<str_data_struct> data;
+	std::vector<char> buf;
+	std::vector<int32> hash;
+	int32 used;
+	int32 compiled; ///< Scripts compiled again on the main thread
+} script_precompile_symbols;
+
+/// Bytecode cache of the npc source files.
+/// A script compiles the same as long as its file, the symbol table (constants, parameters and
+/// buildins) and the defined global functions are the same, so its bytecode is stored with the
+/// names of the str_data entries it refers to and relocated when it is loaded again.
+static struct s_script_cache {
+	bool active; ///< Npc files are being loaded, see script_cache_open
+	uint32 symbols; ///< Hash of the symbol table and compiler settings
+	std::unordered_map<std::string, s_script_cache_file> stored; ///< Files read from the cache file
+	std::unordered_map<std::string, s_script_cache_file> loaded; ///< Files loaded since the cache was opened
+	s_script_cache_file* cached; ///< Stored entries matching the file being loaded
+	s_script_cache_file* current; ///< Entries of the file being loaded
+	s_script_precompiled_file* precompiled; ///< Scripts of the file being loaded compiled on worker threads
+	const char* buffer; ///< Contents of the file being loaded
+	size_t length;
+	int32 hits;
+	int32 misses;
+	int64 saved_ns;
+} script_cache;
+
+/// File of the bytecode cache, empty if disabled
+static char script_cache_path[256] = "db/npc_cache.dat";
+
+static struct script_code* script_compile( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func );
+
+static void script_cache_putint( std::string& out, uint64 value, size_t size ){
+	for( size_t i = 0; i < size; i++ ){
+		out.push_back( static_cast<char>( value >> ( i * 8 ) ) );
+	}
+}
+
+static void script_cache_putstr( std::string& out, const std::string& value ){
+	script_cache_putint( out, value.size(), 4 );
+	out.append( value );
+}
+
+/// Reads the cache file, stops at the first malformed value
+struct s_script_cache_reader {
+	const char* p;
+	const char* end;
+	bool ok;
+
+	uint64 getint( size_t size ){
+		uint64 value = 0;
+
+		if( !ok || static_cast<size_t>( end - p ) < size ){
+			ok = false;
+			return 0;
+		}
+
+		for( size_t i = 0; i < size; i++ ){
+			value |= static_cast<uint64>( static_cast<uint8>( *p++ ) ) << ( i * 8 );
+		}
+
+		return value;
+	}
+
+	std::string getstr(){
+		size_t size = static_cast<size_t>( getint( 4 ) );
+
+		if( !ok || static_cast<size_t>( end - p ) < size ){
+			ok = false;
+			return {};
+		}
+
+		std::string value( p, size );
+
+		p += size;
+
+		return value;
+	}
+};
+
+/// Hashes the build, the symbol table and the settings a script compiles with
+static uint32 script_cache_symbols(){
+	std::string symbols;
+
+	script_cache_putint( symbols, SCRIPT_CACHE_VERSION, 4 );
+
+	// A rebuilt server may compile differently without any symbol changing
+	const char* revision = get_git_hash();
+
+	if( revision[0] == UNKNOWN_VERSION ){
+		revision = get_svn_revision();
+	}
+	symbols.append( revision );
+#if defined(_MSC_FULL_VER)
+	script_cache_putint( symbols, _MSC_FULL_VER, 4 );
+#elif defined(__VERSION__)
+	symbols.append( __VERSION__ );
+#endif
+	symbols.append( __DATE__ " " __TIME__ );
+	script_cache_putint( symbols, script_config.variable_slots, 1 );
+	script_cache_putint( symbols, script_config.warn_func_mismatch_paramnum, 1 );
+
+	for( int32 i = LABEL_START; i < str_num; i++ ){
+		if( str_data[i].type != C_INT && str_data[i].type != C_PARAM && str_data[i].type != C_FUNC ){
+			continue;
+		}
+
+		symbols.append( get_str( i ) );
+		script_cache_putint( symbols, str_data[i].type, 1 );
+		script_cache_putint( symbols, str_data[i].val, 8 );
+		script_cache_putint( symbols, str_data[i].deprecated, 1 );
+
+		if( str_data[i].type == C_FUNC ){
+			symbols.append( buildin_func[str_data[i].val].arg );
+		}
+	}
+
+	return static_cast<uint32>( grfio_crc32( reinterpret_cast<const unsigned char*>( symbols.c_str() ), static_cast<uint32>( symbols.size() ) ) );
+}
+
+/// Hashes the names of the defined global functions, which decide if a call compiles to callfunc
+static uint32 script_cache_functions(){
+	DBIterator* iter = db_iterator( userfunc_db );
+	uint32 hash = 0;
+	DBKey key;
+
+	for( iter->first( iter, &key ); dbi_exists( iter ); iter->next( iter, &key ) ){
+		hash += static_cast<uint32>( grfio_crc32( reinterpret_cast<const unsigned char*>( key.str ), static_cast<uint32>( strlen( key.str ) ) ) );
+	}
+	dbi_destroy( iter );
+
+	return hash;
+}
+
+/**
+ * Starts loading npc source files with the bytecode cache.
+ */
+void script_cache_open(){
+	script_cache.active = false;
+	script_cache.stored.clear();
+	script_cache.loaded.clear();
+	script_cache.cached = nullptr;
+	script_cache.current = nullptr;
+	script_cache.hits = 0;
+	script_cache.misses = 0;
+	script_cache.saved_ns = 0;
+
+	if( script_cache_path[0] == '\0' ){
+		return;
+	}
+
+	script_cache.active = true;
+	script_cache.symbols = script_cache_symbols();
+
+	FILE* fp = fopen( script_cache_path, "rb" );
+
+	if( fp == nullptr ){
+		return;
+	}
+
+	std::string data;
+
+	fseek( fp, 0, SEEK_END );
+	data.resize( ftell( fp ) );
+	fseek( fp, 0, SEEK_SET );
+	data.resize( fread( &data[0], 1, data.size(), fp ) );
+	fclose( fp );
+
+	s_script_cache_reader reader = { data.c_str(), data.c_str() + data.size(), true };
+
+	if( reader.getint( 4 ) != SCRIPT_CACHE_VERSION || reader.getint( 4 ) != script_cache.symbols ){
+		// Outdated, every file is compiled again
+		return;
+	}
+
+	for( uint32 files = static_cast<uint32>( reader.getint( 4 ) ); reader.ok && files > 0; files-- ){
+		std::string name = reader.getstr();
+		s_script_cache_file& file = script_cache.stored[name];
+
+		file.crc = static_cast<uint32>( reader.getint( 4 ) );
+		file.size = reader.getint( 8 );
+		file.functions = static_cast<uint32>( reader.getint( 4 ) );
+
+		for( uint32 entries = static_cast<uint32>( reader.getint( 4 ) ); reader.ok && entries > 0; entries-- ){
+			s_script_cache_entry& entry = file.entries[static_cast<uint32>( reader.getint( 4 ) )];
+
+			entry.options = static_cast<int32>( reader.getint( 4 ) );
+			entry.compile_ns = static_cast<int64>( reader.getint( 8 ) );
+			entry.code = reader.getstr();
+
+			for( uint32 i = static_cast<uint32>( reader.getint( 4 ) ); reader.ok && i > 0; i-- ){
+				entry.names.push_back( reader.getstr() );
+			}
+
+			for( uint32 i = static_cast<uint32>( reader.getint( 4 ) ); reader.ok && i > 0; i-- ){
+				int32 pos = static_cast<int32>( reader.getint( 4 ) );
+				uint32 name = static_cast<uint32>( reader.getint( 4 ) );
+
+				entry.references.emplace_back( pos, name );
+			}
+
+			for( uint32 i = static_cast<uint32>( reader.getint( 4 ) ); reader.ok && i > 0; i-- ){
+				uint32 name = static_cast<uint32>( reader.getint( 4 ) );
+				int32 pos = static_cast<int32>( reader.getint( 4 ) );
+
+				entry.labels.emplace_back( name, pos );
+			}
+
+			for( std::vector<uint32>& slots : entry.slots ){
+				for( uint32 i = static_cast<uint32>( reader.getint( 4 ) ); reader.ok && i > 0; i-- ){
+					slots.push_back( static_cast<uint32>( reader.getint( 4 ) ) );
+				}
+			}
+
+			// Everything must refer to the bytecode and names of the entry
+			for( const auto& reference : entry.references ){
+				if( reference.first < 0 || static_cast<size_t>( reference.first ) + 3 > entry.code.size() || reference.second >= entry.names.size() ){
+					reader.ok = false;
+				}
+			}
+			for( const auto& label : entry.labels ){
+				if( label.first >= entry.names.size() ){
+					reader.ok = false;
+				}
+			}
+			for( const std::vector<uint32>& slots : entry.slots ){
+				for( uint32 name : slots ){
+					if( name >= entry.names.size() ){
+						reader.ok = false;
+					}
+				}
+			}
+		}
+	}
+
+	if( !reader.ok ){
+		ShowWarning( "script_cache_open: Ignoring malformed bytecode cache '%s'.\n", script_cache_path );
+		script_cache.stored.clear();
+	}
+}
+
+/**
+ * Stops loading npc source files with the bytecode cache.
+ * Writes the scripts of the loaded files to the cache file and reports how many were reused.
+ */
+void script_cache_close(){
+	if( !script_cache.active ){
+		return;
+	}
+
+	script_cache.active = false;
+	script_cache.stored.clear();
+
+	if( script_cache.misses > 0 || script_cache.hits == 0 ){
+		std::string data;
+
+		script_cache_putint( data, SCRIPT_CACHE_VERSION, 4 );
+		script_cache_putint( data, script_cache.symbols, 4 );
+		script_cache_putint( data, script_cache.loaded.size(), 4 );
+
+		for( const auto& it : script_cache.loaded ){
+			const s_script_cache_file& file = it.second;
+
+			script_cache_putstr( data, it.first );
+			script_cache_putint( data, file.crc, 4 );
+			script_cache_putint( data, file.size, 8 );
+			script_cache_putint( data, file.functions, 4 );
+			script_cache_putint( data, file.entries.size(), 4 );
+
+			for( const auto& it2 : file.entries ){
+				const s_script_cache_entry& entry = it2.second;
+
+				script_cache_putint( data, it2.first, 4 );
+				script_cache_putint( data, entry.options, 4 );
+				script_cache_putint( data, entry.compile_ns, 8 );
+				script_cache_putstr( data, entry.code );
+				script_cache_putint( data, entry.names.size(), 4 );
+				for( const std::string& name : entry.names ){
+					script_cache_putstr( data, name );
+				}
+				script_cache_putint( data, entry.references.size(), 4 );
+				for( const auto& reference : entry.references ){
+					script_cache_putint( data, reference.first, 4 );
+					script_cache_putint( data, reference.second, 4 );
+				}
+				script_cache_putint( data, entry.labels.size(), 4 );
+				for( const auto& label : entry.labels ){
+					script_cache_putint( data, label.first, 4 );
+					script_cache_putint( data, label.second, 4 );
+				}
+				for( const std::vector<uint32>& slots : entry.slots ){
+					script_cache_putint( data, slots.size(), 4 );
+					for( uint32 name : slots ){
+						script_cache_putint( data, name, 4 );
+					}
+				}
+			}
+		}
+
+		// Write to a temporary file first, so that a crash or a second server never leaves a partial cache behind
+#ifndef WIN32
+		std::string tmp = std::string( script_cache_path ) + "." + std::to_string( getpid() ) + ".tmp";
+#else
+		std::string tmp = std::string( script_cache_path ) + "." + std::to_string( _getpid() ) + ".tmp";
+#endif
+		FILE* fp = fopen( tmp.c_str(), "wb" );
+		bool success = fp != nullptr && fwrite( data.c_str(), 1, data.size(), fp ) == data.size();
+
+		if( fp != nullptr && fclose( fp ) != 0 ){
+			success = false;
+		}
+
+		if( success ){
+#ifdef WIN32
+			remove( script_cache_path ); // rename does not replace files on Windows
+#endif
+			success = rename( tmp.c_str(), script_cache_path ) == 0;
+		}
+
+		if( !success ){
+			ShowWarning( "script_cache_close: Failed to write bytecode cache '%s'.\n", script_cache_path );
+			remove( tmp.c_str() );
+		}
+	}
+
+	script_cache.loaded.clear();
+
+	ShowInfo( "Bytecode cache: '" CL_WHITE "%d" CL_RESET "' scripts loaded, '" CL_WHITE "%d" CL_RESET "' compiled, '" CL_WHITE "%" PRId64 CL_RESET "' ms saved.\n",
+		script_cache.hits, script_cache.misses, script_cache.saved_ns / 1000000 );
+}
+
+/**
+ * Whether the cache holds the scripts of a npc source file.
+ * @param file: path of the file
+ * @param crc: crc32 of the contents
+ * @param length: size of the contents
+ */
+bool script_cache_stored( const char* file, uint32 crc, size_t length ){
+	if( !script_cache.active ){
+		return false;
+	}
+
+	auto it = script_cache.stored.find( file );
+
+	return it != script_cache.stored.end() && it->second.crc == crc && it->second.size == length;
+}
+
+/**
+ * Starts loading a npc source file, its scripts are taken from the cache if it did not change.
+ * @param file: path of the file
+ * @param buffer: contents of the file, the scripts are identified by their offset in it
+ * @param length: size of the contents
+ * @param precompiled: scripts of the file compiled on worker threads, see script_precompile
+ */
+void script_cache_begin( const char* file, const char* buffer, size_t length, s_script_precompiled_file* precompiled ){
+	script_cache.current = nullptr;
+	script_cache.cached = nullptr;
+	script_cache.precompiled = precompiled;
+	script_cache.buffer = buffer;
+	script_cache.length = length;
+
+	if( !script_cache.active ){
+		return;
+	}
+
+	s_script_cache_file& current = script_cache.loaded[file];
+
+	current.crc = static_cast<uint32>( grfio_crc32( reinterpret_cast<const unsigned char*>( buffer ), static_cast<uint32>( length ) ) );
+	current.size = length;
+	current.functions = script_cache_functions();
+	current.entries.clear();
+
+	script_cache.current = &current;
+
+	auto it = script_cache.stored.find( file );
+
+	if( it != script_cache.stored.end() && it->second.crc == current.crc && it->second.size == current.size && it->second.functions == current.functions ){
+		script_cache.cached = &it->second;
+	}
+}
+
+/**
+ * Ends loading the current npc source file.
+ */
+void script_cache_end(){
+	script_cache.current = nullptr;
+	script_cache.cached = nullptr;
+	script_cache.precompiled = nullptr;
+	script_cache.buffer = nullptr;
+	script_cache.length = 0;
+}
+
+/**
+ * Loads a script from the cache, relocating its references to the str_data entries.
+ * @param entry: cached script
+ * @return script code
+ */
+static struct script_code* script_cache_load( const s_script_cache_entry& entry, const char* src_file, int32 src_line, const char* src_func ){
+	std::vector<int32> ids( entry.names.size() );
+
+	for( size_t i = 0; i < ids.size(); i++ ){
+		ids[i] = add_str( entry.names[i].c_str() );
+	}
+
+	struct script_code* code;
+	unsigned char* buf = (unsigned char *)aMalloc( entry.code.size() );
+
+	memcpy( buf, entry.code.c_str(), entry.code.size() );
+
+	for( const auto& reference : entry.references ){
+		int32 id = ids[reference.second];
+
+		// Same as the default of unknown references after compiling
+		if( str_data[id].type != C_INT && str_data[id].type != C_PARAM && str_data[id].type != C_FUNC ){
+			str_data[id].type = C_NAME;
+			str_data[id].label = id;
+		}
+
+		SETVALUE( buf, reference.first, id );
+	}
+
+	if( parse_options&SCRIPT_USE_LABEL_DB ){
+		for( const auto& label : entry.labels ){
+			strdb_iput( scriptlabel_db, get_str( ids[label.first] ), label.second );
+		}
+	}
+
+	std::vector<int32> slots[2];
+
+	for( int32 i = 0; i < ARRAYLENGTH( slots ); i++ ){
+		for( uint32 name : entry.slots[i] ){
+			slots[i].push_back( ids[name] );
+		}
+	}
+
+	CREATE2( code, struct script_code, 1, src_file, src_line, src_func );
+	code->script_buf  = buf;
+	code->script_size = static_cast<int32>( entry.code.size() );
+	code->local.vars = nullptr;
+	code->local.arrays = nullptr;
+	code->scope_layout = script_slot_layout_create( slots[0] );
+	code->local_layout = script_slot_layout_create( slots[1] );
+	code->local.slot_layout = code->local_layout;
+	code->local.slots = script_slots_alloc( code->local_layout );
+	return code;
+}
+
+/**
+ * Stores a compiled script in the cache.
+ * @param entry: entry to fill
+ * @param buf: bytecode of the script
+ * @param size: size of the bytecode
+ */
+static void script_cache_store( s_script_cache_entry& entry, unsigned char* buf, int32 size ){
+	std::unordered_map<int32, uint32> names;
+	auto name = [&]( int32 id ){
+		auto it = names.find( id );
+
+		if( it != names.end() ){
+			return it->second;
+		}
+
+		uint32 index = static_cast<uint32>( entry.names.size() );
+
+		entry.names.push_back( get_str( id ) );
+		names[id] = index;
+
+		return index;
+	};
+
+	entry.code.assign( reinterpret_cast<const char*>( buf ), size );
+
+	// Find the str_data ids in the bytecode, see run_script_main
+	for( int32 pos = 0; pos < size; ){
+		switch( get_com( buf, &pos ) ){
+			case C_INT:
+			case C_SLOT:
+				get_num( buf, &pos );
+				break;
+			case C_NAME:
+				entry.references.emplace_back( pos, name( GETVALUE( buf, pos ) ) );
+				pos += 3;
+				break;
+			case C_POS:
+				pos += 3;
+				break;
+			case C_STR:
+				while( buf[pos++] );
+				break;
+			default:
+				break;
+		}
+	}
+
+	if( ( parse_options&SCRIPT_USE_LABEL_DB ) && parse_precompile != nullptr ){
+		std::unordered_map<int32, size_t> labels;
+
+		// Same order as they were put in, a label put again only replaces its position
+		for( const auto& label : parse_precompile->labels ){
+			auto it = labels.find( label.first );
+
+			if( it != labels.end() ){
+				entry.labels[it->second].second = label.second;
+			}else{
+				labels[label.first] = entry.labels.size();
+				entry.labels.emplace_back( name( label.first ), label.second );
+			}
+		}
+	}else if( parse_options&SCRIPT_USE_LABEL_DB ){
+		DBIterator* iter = db_iterator( scriptlabel_db );
+		DBKey key;
+
+		for( DBData* data = iter->first( iter, &key ); dbi_exists( iter ); data = iter->next( iter, &key ) ){
+			entry.labels.emplace_back( name( add_str( key.str ) ), db_data2i( data ) );
+		}
+		dbi_destroy( iter );
+
+		// Same order as they were compiled in
+		std::stable_sort( entry.labels.begin(), entry.labels.end(), []( const auto& a, const auto& b ){ return a.second < b.second; } );
+	}
+
+	for( int32 i = 0; i < ARRAYLENGTH( entry.slots ); i++ ){
+		for( int32 id : parse_slot_ids[i] ){
+			entry.slots[i].push_back( name( id ) );
+		}
+	}
+}
+
 /*==========================================
  * Analysis of the script
  *------------------------------------------*/
 struct script_code* parse_script_( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func ){
+	if( script_cache.buffer == nullptr || src == nullptr || src < script_cache.buffer || src >= script_cache.buffer + script_cache.length ){
+		return script_compile( src, file, line, options, src_file, src_line, src_func );
+	}
+
+	uint32 offset = static_cast<uint32>( src - script_cache.buffer );
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if( script_cache.cached != nullptr ){
+		auto it = script_cache.cached->entries.find( offset );
+
+		if( it != script_cache.cached->entries.end() && it->second.options == options ){
+			if( options&SCRIPT_USE_LABEL_DB )
+				db_clear(scriptlabel_db);
+			parse_options = options;
+
+			struct script_code* code = script_cache_load( it->second, src_file, src_line, src_func );
+
+			script_cache.hits++;
+			script_cache.saved_ns += it->second.compile_ns - std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+			script_cache.current->entries[offset] = std::move( it->second );
+			script_cache.cached->entries.erase( it );
+			return code;
+		}
+	}
+
+	if( script_cache.precompiled != nullptr ){
+		auto it = script_cache.precompiled->scripts.find( offset );
+
+		if( it != script_cache.precompiled->scripts.end() ){
+			s_script_precompiled& script = it->second;
+			// The worker thread must have seen the same global functions as this thread
+			bool valid = script.entry.options == options && std::all_of( script.functions.begin(), script.functions.end(), []( const auto& function ){
+				return ( strdb_get( userfunc_db, function.first.c_str() ) != nullptr ) == function.second;
+			} );
+
+			if( valid ){
+				if( options&SCRIPT_USE_LABEL_DB )
+					db_clear(scriptlabel_db);
+				parse_options = options;
+
+				struct script_code* code = script_cache_load( script.entry, src_file, src_line, src_func );
+
+				script_precompile_symbols.used++;
+
+				if( script_cache.current != nullptr ){
+					script_cache.current->entries[offset] = std::move( script.entry );
+					script_cache.misses++;
+				}
+				script_cache.precompiled->scripts.erase( it );
+				return code;
+			}
+
+			script_cache.precompiled->scripts.erase( it );
+		}
+
+		script_precompile_symbols.compiled++;
+	}
+
+	struct script_code* code = script_compile( src, file, line, options, src_file, src_line, src_func );
+
+	if( code != nullptr && script_cache.current != nullptr ){
+		s_script_cache_entry& entry = script_cache.current->entries[offset];
+
+		entry.options = options;
+		entry.compile_ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+		script_cache_store( entry, code->script_buf, code->script_size );
+		script_cache.misses++;
+	}
+
+	return code;
+}
+
+/**
+ * Compiles a script into script_buf.
+ * @return True if it compiled, script_buf then holds the script_size bytes of bytecode
+ */
+static bool script_compile_sub( const char *src, const char *file, int32 line, int32 options ){
 	const char *p,*tmpp;
 	int32 i;
-	struct script_code* code = nullptr;
 	char end;
 	bool unresolved_names = false;
 
@@ -2484,7 +3320,7 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 	parser_current_line = line;
 
 	if( src == nullptr )
-		return nullptr;// empty script
+		return false;// empty script
 
 	memset(&syntax,0,sizeof(syntax));
 
@@ -2494,15 +3330,24 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 	parse_nextline(true, nullptr);
 
 	// who called parse_script is responsible for clearing the database after using it, but just in case... lets clear it here
-	if( options&SCRIPT_USE_LABEL_DB )
-		db_clear(scriptlabel_db);
+	if( options&SCRIPT_USE_LABEL_DB ){
+		if( parse_precompile == nullptr )
+			db_clear(scriptlabel_db);
+		else
+			parse_precompile->labels.clear();
+	}
 	parse_options = options;
 
+	for( i = 0; i < ARRAYLENGTH(parse_slots); i++ ){
+		parse_slots[i].clear();
+		parse_slot_ids[i].clear();
+	}
+
 	if( setjmp( error_jump ) != 0 ) {
 		//Restore program state when script has problems. [from jA]
 		int32 j;
 		const int32 size = ARRAYLENGTH(syntax.curly);
-		if( error_report )
+		if( error_report && parse_report() )
 			script_error(src,file,line,error_msg,error_pos);
 		aFree( error_msg );
 		aFree( script_buf );
@@ -2513,7 +3358,7 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 			if(str_data[j].type == C_NOP) str_data[j].type = C_NAME;
 		for(j=0; j<size; j++)
 			linkdb_final(&syntax.curly[j].case_label);
-		return nullptr;
+		return false;
 	}
 
 	parse_syntax_for_flag=0;
@@ -2527,7 +3372,7 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 			script_pos  = 0;
 			script_size = 0;
 			script_buf  = nullptr;
-			return nullptr;
+			return false;
 		}
 		end = '\0';
 	}
@@ -2542,7 +3387,7 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 			script_pos  = 0;
 			script_size = 0;
 			script_buf  = nullptr;
-			return nullptr;
+			return false;
 		}
 		end = '}';
 	}
@@ -2569,7 +3414,7 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 			i=add_word(p);
 			set_label(i,script_pos,p);
 			if( parse_options&SCRIPT_USE_LABEL_DB )
-				strdb_iput(scriptlabel_db, get_str(i), script_pos);
+				parse_label_put(i, script_pos);
 			p=tmpp+1;
 			p=skip_space(p);
 			continue;
@@ -2602,7 +3447,8 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 		}
 		else if( str_data[i].type == C_USERFUNC )
 		{// 'function name;' without follow-up code
-			ShowError("parse_script: function '%s' declared but not defined.\n", str_buf+str_data[i].str);
+			if( parse_report() )
+				ShowError("parse_script: function '%s' declared but not defined.\n", str_buf+str_data[i].str);
 			unresolved_names = true;
 		}
 	}
@@ -2630,6 +3476,7 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 			j = i;
 			switch(op) {
 			case C_INT:
+			case C_SLOT:
 				ShowMessage(" %d", get_num(script_buf,&i));
 				break;
 			case C_POS:
@@ -2652,14 +3499,142 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 	}
 #endif
 
+	return true;
+}
+
+/**
+ * Compiles a script.
+ */
+static struct script_code* script_compile( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func ){
+	if( !script_compile_sub( src, file, line, options ) )
+		return nullptr;
+
+	struct script_code* code;
+
 	CREATE2( code, struct script_code, 1, src_file, src_line, src_func );
 	code->script_buf  = script_buf;
 	code->script_size = script_size;
 	code->local.vars = nullptr;
 	code->local.arrays = nullptr;
+	code->scope_layout = script_slot_layout_create( parse_slot_ids[0] );
+	code->local_layout = script_slot_layout_create( parse_slot_ids[1] );
+	code->local.slot_layout = code->local_layout;
+	code->local.slots = script_slots_alloc( code->local_layout );
 	return code;
 }
 
+/**
+ * Creates the container of the scripts a worker thread compiles from a npc source file.
+ */
+std::shared_ptr<s_script_precompiled_file> script_precompile_file(){
+	return std::make_shared<s_script_precompiled_file>();
+}
+
+/**
+ * Starts compiling npc scripts on worker threads, see script_precompile.
+ * The workers start from a copy of the current symbol table.
+ */
+void script_precompile_open(){
+	s_script_precompile& symbols = script_precompile_symbols;
+
+	symbols.data.assign( str_data, str_data + str_num );
+	symbols.buf.assign( str_buf, str_buf + str_pos );
+	symbols.hash.assign( str_hash, str_hash + SCRIPT_HASH_SIZE );
+	symbols.used = 0;
+	symbols.compiled = 0;
+}
+
+/**
+ * Ends compiling npc scripts on worker threads.
+ */
+void script_precompile_close(){
+	s_script_precompile& symbols = script_precompile_symbols;
+
+	symbols.data = {};
+	symbols.buf = {};
+	symbols.hash = {};
+
+	ShowInfo( "Worker threads: '" CL_WHITE "%d" CL_RESET "' scripts used, '" CL_WHITE "%d" CL_RESET "' compiled again on the main thread.\n", symbols.used, symbols.compiled );
+}
+
+/**
+ * Makes the calling thread a worker thread that compiles npc scripts.
+ * It gets its own symbol table and allocates from the system, see malloc_thread_direct.
+ */
+void script_precompile_thread_begin(){
+	const s_script_precompile& symbols = script_precompile_symbols;
+
+	malloc_thread_direct( true );
+	parse_worker = true;
+
+	str_num = static_cast<int32>( symbols.data.size() );
+	str_data_size = str_num + 128;
+	CREATE( str_data, struct str_data_struct, str_data_size );
+	std::copy( symbols.data.begin(), symbols.data.end(), str_data );
+
+	str_pos = static_cast<int32>( symbols.buf.size() );
+	str_size = str_pos + 256;
+	CREATE( str_buf, char, str_size );
+	std::copy( symbols.buf.begin(), symbols.buf.end(), str_buf );
+
+	std::copy( symbols.hash.begin(), symbols.hash.end(), str_hash );
+}
+
+/**
+ * Ends compiling npc scripts on the calling thread.
+ */
+void script_precompile_thread_end(){
+	aFree( str_data );
+	str_data = nullptr;
+	str_data_size = 0;
+	str_num = LABEL_START;
+
+	aFree( str_buf );
+	str_buf = nullptr;
+	str_size = 0;
+	str_pos = 0;
+
+	parse_worker = false;
+	malloc_thread_direct( false );
+}
+
+/**
+ * Compiles a script of a npc source file on a worker thread, parse_script takes it instead of compiling it.
+ * Scripts that show a warning or an error are left to the main thread, so they are shown in file order.
+ * @param file: scripts compiled from the source file
+ * @param buffer: contents of the source file
+ * @param src: start of the script in buffer
+ * @param filepath: path of the source file
+ * @param line: line of the script
+ * @param options: options the main thread compiles the script with
+ * @param function_defined: whether a global function is defined by the time the main thread compiles the script
+ */
+void script_precompile( s_script_precompiled_file& file, const char* buffer, const char* src, const char* filepath, int32 line, int32 options, const std::function<bool( const char* )>& function_defined ){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	s_script_precompile_state state = {};
+
+	state.function_defined = &function_defined;
+	parse_precompile = &state;
+
+	if( script_compile_sub( src, filepath, line, options ) ){
+		if( !state.diagnostics ){
+			s_script_precompiled& script = file.scripts[static_cast<uint32>( src - buffer )];
+
+			script.entry.options = options;
+			script_cache_store( script.entry, script_buf, script_size );
+			script.entry.compile_ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+			script.functions = std::move( state.functions );
+		}
+
+		aFree( script_buf );
+		script_buf = nullptr;
+		script_pos = 0;
+		script_size = 0;
+	}
+
+	parse_precompile = nullptr;
+}
+
 /// Returns the player attached to this script, identified by the rid.
 /// If there is no player attached, the script is terminated.
 static bool script_rid2sd_( struct script_state *st, map_session_data** sd, const char *func ){
@@ -2695,6 +3670,9 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 	prefix = name[0];
 	postfix = name[strlen(name) - 1];
 
+	if( script_bonus_record != nullptr && !reference_toconstant(data) && !( prefix == '.' && name[1] == '@' ) )
+		script_bonus_record->pure = false; // depends on the player or the server
+
 	//##TODO use reference_tovariable(data) when it's confirmed that it works [FlavioJS]
 	if( !reference_toconstant(data) && not_server_variable(prefix) ) {
 		if( sd == nullptr && !script_rid2sd(sd) ) {// needs player attached
@@ -2728,12 +3706,16 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 				break;
 			case '.':
 				{
-					struct DBMap* n = data->ref ?
-							data->ref->vars : name[1] == '@' ?
-							st->stack->scope.vars : // instance/scope variable
-							st->script->local.vars; // npc variable
-					if( n )
-						data->u.str = (char*)i64db_get(n,reference_getuid(data));
+					struct reg_db* n = data->ref ?
+							data->ref : name[1] == '@' ?
+							&st->stack->scope : // instance/scope variable
+							&st->script->local; // npc variable
+					int32 slot = script_slot_find(n, reference_getuid(data), data->slot);
+
+					if( slot >= 0 )
+						data->u.str = n->slots[slot].str;
+					else if( n->vars )
+						data->u.str = (char*)i64db_get(n->vars,reference_getuid(data));
 					else
 						data->u.str = nullptr;
 				}
@@ -2794,12 +3776,16 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 					break;
 				case '.':
 					{
-						struct DBMap* n = data->ref ?
-								data->ref->vars : name[1] == '@' ?
-								st->stack->scope.vars : // instance/scope variable
-								st->script->local.vars; // npc variable
-						if( n )
-							data->u.num = i64db_i64get(n,reference_getuid(data));
+						struct reg_db* n = data->ref ?
+								data->ref : name[1] == '@' ?
+								&st->stack->scope : // instance/scope variable
+								&st->script->local; // npc variable
+						int32 slot = script_slot_find(n, reference_getuid(data), data->slot);
+
+						if( slot >= 0 )
+							data->u.num = n->slots[slot].num;
+						else if( n->vars )
+							data->u.num = i64db_i64get(n->vars,reference_getuid(data));
 						else
 							data->u.num = 0;
 					}
@@ -3141,6 +4127,9 @@ bool set_reg_str( struct script_state* st, map_session_data* sd, int64 num, cons
 	char prefix = name[0];
 	size_t vlen = 0;
 
+	if( script_bonus_record != nullptr && !( prefix == '.' && name[1] == '@' ) )
+		script_bonus_record->pure = false; // changes the player or the server
+
 	if( !script_check_RegistryVariableLength( 0, name, &vlen ) ){
 		ShowError( "set_reg: Variable name length is too long (aid: %d, cid: %d): '%s' sz=%" PRIuPTR "\n", sd ? sd->status.account_id : -1, sd ? sd->status.char_id : -1, name, vlen );
 		return false;
@@ -3162,7 +4151,15 @@ bool set_reg_str( struct script_state* st, map_session_data* sd, int64 num, cons
 		case '.': {
 				struct reg_db *n = ( ref ) ? ref : ( name[1] == '@' ) ? &st->stack->scope : &st->script->local;
 
-				if( n ){
+				int32 slot = script_slot_find( n, num, -1 );
+
+				if( slot >= 0 ){
+					if( n->slots[slot].str != nullptr ){
+						aFree( n->slots[slot].str );
+					}
+
+					n->slots[slot].str = value[0] ? aStrdup( value ) : nullptr;
+				}else if( n ){
 					if( value[0] ){
 						i64db_put( n->vars, num, aStrdup( value ) );
 
@@ -3221,6 +4218,9 @@ bool set_reg_num( struct script_state* st, map_session_data* sd, int64 num, cons
 	char prefix = name[0];
 	size_t vlen = 0;
 
+	if( script_bonus_record != nullptr && !( prefix == '.' && name[1] == '@' ) )
+		script_bonus_record->pure = false; // changes the player or the server
+
 	if( !script_check_RegistryVariableLength( 0, name, &vlen ) ){
 		ShowError( "set_reg: Variable name length is too long (aid: %d, cid: %d): '%s' sz=%" PRIuPTR "\n", sd ? sd->status.account_id : -1, sd ? sd->status.char_id : -1, name, vlen );
 		return false;
@@ -3256,7 +4256,11 @@ bool set_reg_num( struct script_state* st, map_session_data* sd, int64 num, cons
 		case '.': {
 				struct reg_db *n = ( ref ) ? ref : ( name[1] == '@' ) ? &st->stack->scope : &st->script->local;
 
-				if( n ){
+				int32 slot = script_slot_find( n, num, -1 );
+
+				if( slot >= 0 ){
+					n->slots[slot].num = value;
+				}else if( n ){
 					if( value != 0 ){
 						i64db_i64put( n->vars, num, value );
 
@@ -3464,6 +4468,7 @@ struct script_data* push_val2(struct script_stack* stack, enum c_op type, int64
 	if( stack->sp >= stack->sp_max )
 		stack_expand(stack);
 	stack->stack_data[stack->sp].type  = type;
+	stack->stack_data[stack->sp].slot  = -1;
 	stack->stack_data[stack->sp].u.num = val;
 	stack->stack_data[stack->sp].ref   = ref;
 	stack->sp++;
@@ -3476,6 +4481,7 @@ struct script_data* push_str(struct script_stack* stack, enum c_op type, char* s
 	if( stack->sp >= stack->sp_max )
 		stack_expand(stack);
 	stack->stack_data[stack->sp].type  = type;
+	stack->stack_data[stack->sp].slot  = -1;
 	stack->stack_data[stack->sp].u.str = str;
 	stack->stack_data[stack->sp].ref   = nullptr;
 	stack->sp++;
@@ -3488,6 +4494,7 @@ struct script_data* push_retinfo(struct script_stack* stack, struct script_retin
 	if( stack->sp >= stack->sp_max )
 		stack_expand(stack);
 	stack->stack_data[stack->sp].type = C_RETINFO;
+	stack->stack_data[stack->sp].slot = -1;
 	stack->stack_data[stack->sp].u.ri = ri;
 	stack->stack_data[stack->sp].ref  = ref;
 	stack->sp++;
@@ -3508,13 +4515,16 @@ struct script_data* push_copy(struct script_stack* stack, int32 pos)
 			ShowFatalError("script:push_copy: can't create copies of C_RETINFO. Exiting...\n");
 			exit(1);
 			break;
-		default:
-			return push_val2(
-				stack,stack->stack_data[pos].type,
-				stack->stack_data[pos].u.num,
-				stack->stack_data[pos].ref
-			);
-			break;
+		default: {
+				struct script_data* data = push_val2(
+					stack,stack->stack_data[pos].type,
+					stack->stack_data[pos].u.num,
+					stack->stack_data[pos].ref
+				);
+
+				data->slot = stack->stack_data[pos].slot;
+				return data;
+			}
 	}
 }
 
@@ -3526,80 +4536,336 @@ void pop_stack(struct script_state* st, int32 start, int32 end)
 	struct script_data* data;
 	int32 i;
 
-	if( start < 0 )
-		start = 0;
-	if( end > stack->sp )
-		end = stack->sp;
-	if( start >= end )
-		return;// nothing to pop
+	if( start < 0 )
+		start = 0;
+	if( end > stack->sp )
+		end = stack->sp;
+	if( start >= end )
+		return;// nothing to pop
+
+	// free stack elements
+	for( i = start; i < end; i++ )
+	{
+		data = &stack->stack_data[i];
+		if( data->type == C_STR )
+			aFree(data->u.str);
+		if( data->type == C_RETINFO ) {
+			struct script_retinfo* ri = data->u.ri;
+
+			if (ri->scope.vars) {
+				script_free_vars(ri->scope.vars);
+				ri->scope.vars = nullptr;
+			}
+			script_slots_free(ri->scope.slot_layout, ri->scope.slots);
+			ri->scope.slots = nullptr;
+			if (ri->scope.arrays) {
+				ri->scope.arrays->destroy(ri->scope.arrays, script_free_array_db);
+				ri->scope.arrays = nullptr;
+			}
+			if( data->ref )
+				aFree(data->ref);
+			aFree(ri);
+		}
+		data->type = C_NOP;
+	}
+
+	// move the rest of the elements
+	if( stack->sp > end )
+	{
+		memmove(&stack->stack_data[start], &stack->stack_data[end], sizeof(stack->stack_data[0])*(stack->sp - end));
+		for( i = start + stack->sp - end; i < stack->sp; ++i )
+			stack->stack_data[i].type = C_NOP;
+	}
+
+	// adjust stack pointers
+	if( st->start > end ){
+		st->start -= end - start;
+	}else if( st->start > start ){
+		st->start = start;
+	}
+	
+	if( st->end > end ){
+		st->end -= end - start;
+	}else if( st->end > start ){
+		st->end = start;
+	}
+	
+	if( stack->defsp > end ){
+		stack->defsp -= end - start;
+	}else if( stack->defsp > start ){
+		stack->defsp = start;
+	}
+	
+	stack->sp -= end - start;
+}
+
+///
+///
+///
+
+/*==========================================
+ * Release script dependent variable, dependent variable of function
+ *------------------------------------------*/
+void script_free_vars(struct DBMap* storage)
+{
+	if( storage ) {
+		// destroy the storage construct containing the variables
+		db_destroy(storage);
+	}
+}
+
+/// Profiling counters of a buildin called from a profiled entry point
+struct s_script_profile_func {
+	uint64 calls = 0;
+	uint64 time = 0; ///< nanoseconds
+};
+
+/// Profiling counters of a script entry point (npc and label)
+struct s_script_profile {
+	std::string npc;
+	std::string label;
+	uint64 runs = 0; ///< script states started here
+	uint64 entries = 0; ///< interpreter runs of these states, including continuations after sleep/sleep2/dialogs
+	uint64 ops = 0; ///< executed opcodes
+	uint64 calls = 0; ///< buildin calls
+	uint64 time = 0; ///< interpreter wall time in nanoseconds, including scripts run from buildins
+	std::unordered_map<int32, s_script_profile_func> funcs; ///< buildin id -> counters
+};
+
+static bool script_profiling = false;
+/// All profiles, including the ones of freed scripts that states may still point to
+static std::vector<std::unique_ptr<s_script_profile>> script_profiles;
+/// (script, position, npc id) -> profile
+static std::map<std::tuple<const struct script_code*, int32, int32>, s_script_profile*> script_profile_db;
+
+/**
+ * Returns the profile of a script entry point, creating it on first use.
+ * @param code: script code the state starts with
+ * @param pos: position the state starts at
+ * @param oid: npc running the script
+ */
+static struct s_script_profile* script_profile_get( const struct script_code* code, int32 pos, int32 oid ){
+	auto key = std::make_tuple( code, pos, oid );
+	auto it = script_profile_db.find( key );
+
+	if( it != script_profile_db.end() ){
+		return it->second;
+	}
+
+	std::unique_ptr<s_script_profile> profile = std::make_unique<s_script_profile>();
+	npc_data* nd = map_id2nd( oid );
+
+	profile->npc = nd ? nd->exname : "-";
+
+	if( nd != nullptr && nd->subtype == NPCTYPE_SCRIPT && nd->u.scr.script == code ){
+		for( int32 i = 0; i < nd->u.scr.label_list_num; i++ ){
+			if( nd->u.scr.label_list[i].pos == pos ){
+				profile->label = nd->u.scr.label_list[i].name;
+				break;
+			}
+		}
+
+		if( profile->label.empty() && pos == 0 ){
+			profile->label = "(main)";
+		}
+	}else{
+		DBIterator* iter = db_iterator( userfunc_db );
+		DBKey name;
+
+		for( DBData* data = iter->first( iter, &name ); dbi_exists( iter ); data = iter->next( iter, &name ) ){
+			if( db_data2ptr( data ) == code ){
+				profile->label = name.str;
+				break;
+			}
+		}
+		dbi_destroy( iter );
+	}
+
+	if( profile->label.empty() ){
+		profile->label = "pos " + std::to_string( pos );
+	}
+
+	s_script_profile* result = profile.get();
+
+	script_profiles.push_back( std::move( profile ) );
+	script_profile_db[key] = result;
+
+	return result;
+}
+
+/**
+ * Stops attributing new states to the profiles of a script that is being freed.
+ * The profiles themselves stay until the next reset, since states may still point to them.
+ */
+static void script_profile_forget( const struct script_code* code ){
+	if( script_profile_db.empty() ){
+		return;
+	}
+
+	auto first = script_profile_db.lower_bound( std::make_tuple( code, INT32_MIN, INT32_MIN ) );
+	auto last = first;
+
+	while( last != script_profile_db.end() && std::get<0>( last->first ) == code ){
+		last++;
+	}
+
+	script_profile_db.erase( first, last );
+}
+
+/**
+ * Adds the time spent in a buildin to the profile of the running state.
+ * @param profile: profile of the state
+ * @param func: buildin id
+ * @param start: time the buildin was called
+ */
+static void script_profile_func( struct s_script_profile* profile, int32 func, std::chrono::steady_clock::time_point start ){
+	uint64 time = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+	s_script_profile_func& counters = profile->funcs[func];
+
+	counters.calls++;
+	counters.time += time;
+	profile->calls++;
+}
+
+/// Enables or disables profiling of newly started script states.
+void script_profile_enable( bool enable ){
+	script_profiling = enable;
+}
+
+bool script_profile_enabled( void ){
+	return script_profiling;
+}
 
-	// free stack elements
-	for( i = start; i < end; i++ )
-	{
-		data = &stack->stack_data[i];
-		if( data->type == C_STR )
-			aFree(data->u.str);
-		if( data->type == C_RETINFO ) {
-			struct script_retinfo* ri = data->u.ri;
+/// Clears all profiling counters.
+void script_profile_reset( void ){
+	for( std::unique_ptr<s_script_profile>& profile : script_profiles ){
+		profile->runs = 0;
+		profile->entries = 0;
+		profile->ops = 0;
+		profile->calls = 0;
+		profile->time = 0;
+		profile->funcs.clear();
+	}
+}
 
-			if (ri->scope.vars) {
-				script_free_vars(ri->scope.vars);
-				ri->scope.vars = nullptr;
-			}
-			if (ri->scope.arrays) {
-				ri->scope.arrays->destroy(ri->scope.arrays, script_free_array_db);
-				ri->scope.arrays = nullptr;
-			}
-			if( data->ref )
-				aFree(data->ref);
-			aFree(ri);
+/// Returns the profiles that were used, most expensive first.
+static std::vector<const s_script_profile*> script_profile_sorted( void ){
+	std::vector<const s_script_profile*> profiles;
+
+	for( std::unique_ptr<s_script_profile>& profile : script_profiles ){
+		if( profile->entries > 0 ){
+			profiles.push_back( profile.get() );
 		}
-		data->type = C_NOP;
 	}
 
-	// move the rest of the elements
-	if( stack->sp > end )
-	{
-		memmove(&stack->stack_data[start], &stack->stack_data[end], sizeof(stack->stack_data[0])*(stack->sp - end));
-		for( i = start + stack->sp - end; i < stack->sp; ++i )
-			stack->stack_data[i].type = C_NOP;
-	}
+	std::sort( profiles.begin(), profiles.end(), []( const s_script_profile* a, const s_script_profile* b ){
+		return a->time > b->time;
+	} );
 
-	// adjust stack pointers
-	if( st->start > end ){
-		st->start -= end - start;
-	}else if( st->start > start ){
-		st->start = start;
+	return profiles;
+}
+
+/**
+ * Displays the most expensive script entry points.
+ * @param fd: target of the messages
+ * @param sd: player the messages are translated for
+ * @param count: number of entry points to display
+ */
+void script_profile_show( int32 fd, map_session_data* sd, int32 count ){
+	std::vector<const s_script_profile*> profiles = script_profile_sorted();
+	char output[CHAT_SIZE_MAX];
+
+	if( profiles.empty() ){
+		clif_displaymessage( fd, msg_txt( sd, 1547 ) ); // No script has been profiled yet.
+		return;
 	}
-	
-	if( st->end > end ){
-		st->end -= end - start;
-	}else if( st->end > start ){
-		st->end = start;
+
+	for( int32 i = 0; i < count && i < static_cast<int32>( profiles.size() ); i++ ){
+		const s_script_profile* profile = profiles[i];
+
+		safesnprintf( output, sizeof( output ), msg_txt( sd, 1548 ), profile->time / 1000000., // %.2f ms | %llu runs | %llu resumes | %llu ops | %llu calls | %s::%s
+			(unsigned long long)profile->runs, (unsigned long long)( profile->entries - std::min( profile->runs, profile->entries ) ),
+			(unsigned long long)profile->ops, (unsigned long long)profile->calls, profile->npc.c_str(), profile->label.c_str() );
+		clif_displaymessage( fd, output );
 	}
-	
-	if( stack->defsp > end ){
-		stack->defsp -= end - start;
-	}else if( stack->defsp > start ){
-		stack->defsp = start;
+}
+
+/// Quotes a CSV field.
+static std::string script_profile_csv( const std::string& value ){
+	std::string result = "\"";
+
+	for( char c : value ){
+		if( c == '"' ){
+			result += '"';
+		}
+		result += c;
 	}
-	
-	stack->sp -= end - start;
+
+	return result + "\"";
 }
 
-///
-///
-///
+/// Replaces the separators of the folded stack format in a frame name.
+static std::string script_profile_frame( const std::string& value ){
+	std::string result = value;
 
-/*==========================================
- * Release script dependent variable, dependent variable of function
- *------------------------------------------*/
-void script_free_vars(struct DBMap* storage)
-{
-	if( storage ) {
-		// destroy the storage construct containing the variables
-		db_destroy(storage);
+	std::replace( result.begin(), result.end(), ';', '_' );
+	std::replace( result.begin(), result.end(), ' ', '_' );
+
+	return result;
+}
+
+/**
+ * Writes the profiling counters to <file>.csv and, as folded stacks for flamegraph tools, to <file>.folded.
+ * Folded stacks are npc;label;buildin with the time in microseconds, the time outside of buildins is attributed to npc;label.
+ * @param file: path without extension
+ * @return true on success
+ */
+bool script_profile_dump( const char* file ){
+	std::vector<const s_script_profile*> profiles = script_profile_sorted();
+	std::string path = file;
+	FILE* csv = fopen( ( path + ".csv" ).c_str(), "w" );
+	FILE* folded = fopen( ( path + ".folded" ).c_str(), "w" );
+
+	if( csv == nullptr || folded == nullptr ){
+		if( csv != nullptr ){
+			fclose( csv );
+		}
+		if( folded != nullptr ){
+			fclose( folded );
+		}
+		ShowError( "script_profile_dump: Could not open '%s' for writing.\n", file );
+		return false;
+	}
+
+	fprintf( csv, "npc,label,buildin,runs,resumes,ops,calls,time_us\n" );
+
+	for( const s_script_profile* profile : profiles ){
+		std::string npc = script_profile_csv( profile->npc );
+		std::string label = script_profile_csv( profile->label );
+		std::string frame = script_profile_frame( profile->npc ) + ";" + script_profile_frame( profile->label );
+		uint64 buildin_time = 0;
+
+		fprintf( csv, "%s,%s,,%llu,%llu,%llu,%llu,%llu\n", npc.c_str(), label.c_str(),
+			(unsigned long long)profile->runs, (unsigned long long)( profile->entries - std::min( profile->runs, profile->entries ) ),
+			(unsigned long long)profile->ops, (unsigned long long)profile->calls, (unsigned long long)( profile->time / 1000 ) );
+
+		for( const auto& pair : profile->funcs ){
+			const char* name = get_str( pair.first );
+
+			fprintf( csv, "%s,%s,%s,,,,%llu,%llu\n", npc.c_str(), label.c_str(), name, (unsigned long long)pair.second.calls, (unsigned long long)( pair.second.time / 1000 ) );
+			fprintf( folded, "%s;%s %llu\n", frame.c_str(), name, (unsigned long long)( pair.second.time / 1000 ) );
+			buildin_time += pair.second.time;
+		}
+
+		if( profile->time > buildin_time ){
+			fprintf( folded, "%s %llu\n", frame.c_str(), (unsigned long long)( ( profile->time - buildin_time ) / 1000 ) );
+		}
 	}
+
+	fclose( csv );
+	fclose( folded );
+
+	return true;
 }
 
 void script_free_code(struct script_code* code)
@@ -3611,6 +4877,11 @@ void script_free_code(struct script_code* code)
 	script_free_vars(code->local.vars);
 	if (code->local.arrays)
 		code->local.arrays->destroy(code->local.arrays, script_free_array_db);
+	script_slots_free(code->local_layout, code->local.slots);
+	script_profile_forget(code);
+	delete code->scope_layout;
+	delete code->local_layout;
+	delete code->bonuses;
 	aFree(code->script_buf);
 	aFree(code);
 }
@@ -3632,7 +4903,7 @@ struct script_state* script_alloc_state(struct script_code* rootscript, int32 po
 	st->stack->sp_max = 64;
 	CREATE(st->stack->stack_data, struct script_data, st->stack->sp_max);
 	st->stack->defsp = st->stack->sp;
-	st->stack->scope.vars = i64db_alloc(DB_OPT_RELEASE_DATA);
+	script_scope_alloc(&st->stack->scope, rootscript);
 	st->stack->scope.arrays = nullptr;
 	st->state = RUN;
 	st->script = rootscript;
@@ -3641,6 +4912,12 @@ struct script_state* script_alloc_state(struct script_code* rootscript, int32 po
 	st->oid = oid;
 	st->sleep.timer = INVALID_TIMER;
 	st->npc_item_flag = battle_config.item_enabled_npc;
+	st->profile = nullptr;
+
+	if( script_profiling ){
+		st->profile = script_profile_get(rootscript, pos, oid);
+		st->profile->runs++;
+	}
 	
 	if( st->script->instances != USHRT_MAX )
 		st->script->instances++;
@@ -3685,6 +4962,7 @@ void script_free_state(struct script_state* st)
 			delete_timer(st->sleep.timer, run_script_timer);
 		if (st->stack) {
 			script_free_vars(st->stack->scope.vars);
+			script_slots_free(st->stack->scope.slot_layout, st->stack->scope.slots);
 			if (st->stack->scope.arrays)
 				st->stack->scope.arrays->destroy(st->stack->scope.arrays, script_free_array_db);
 			pop_stack(st, 0, st->stack->sp);
@@ -4087,6 +5365,170 @@ static void script_check_buildin_argtype(struct script_state* st, int32 func)
 
 /// Executes a buildin command.
 /// Stack: C_NAME(<command>) C_ARG <arg0> <arg1> ... <argN>
+/**
+ * Checks if an equipment script being recorded keeps only depending on its
+ * own item when running a command.
+ * @param name: Name of the command
+ * @param args: Number of arguments given to the command
+ * @return true if the command can be replayed from the recorded bonuses
+ */
+static bool script_bonus_record_allows( const char* name, int32 args ){
+	static const char* commands[] = { "bonus", "bonus2", "bonus3", "bonus4", "bonus5", "set", "jump_zero", "goto", "end" };
+
+	for( const char* command : commands ){
+		if( strcmp( name, command ) == 0 )
+			return true;
+	}
+
+	// Only read the equipment that is being calculated
+	if( strcmp( name, "getrefine" ) == 0 || strcmp( name, "getenchantgrade" ) == 0 )
+		return args == 0;
+	if( strcmp( name, "getrandomoptinfo" ) == 0 )
+		return args == 1;
+
+	return false;
+}
+
+/**
+ * Checks if a bonus type takes a skill as its first value, given either as
+ * skill name or as skill ID.
+ * @param type: Bonus type
+ * @return true if the first value is a skill
+ */
+static bool script_bonus_takes_skill( int32 type ){
+	switch( type ){
+		case SP_AUTOSPELL:
+		case SP_AUTOSPELL_WHENHIT:
+		case SP_AUTOSPELL_ONSKILL:
+		case SP_SKILL_ATK:
+		case SP_SKILL_HEAL:
+		case SP_SKILL_HEAL2:
+		case SP_ADD_SKILL_BLOW:
+		case SP_CASTRATE:
+		case SP_ADDEFF_ONSKILL:
+		case SP_SKILL_USE_SP_RATE:
+		case SP_SKILL_COOLDOWN:
+		case SP_SKILL_FIXEDCAST:
+		case SP_SKILL_VARIABLECAST:
+		case SP_VARCASTRATE:
+		case SP_FIXCASTRATE:
+		case SP_SKILL_DELAY:
+		case SP_SKILL_USE_SP:
+		case SP_SUB_SKILL:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Compiles an equipment script into a native bonus table.
+ * Only scripts made of bonus commands with constant values are compiled, the
+ * values are resolved like buildin_bonus does. Every other script is left to
+ * the script engine, including scripts with invalid skills so their errors
+ * are still reported when they are run.
+ * @param code: Script to compile, a previously compiled table is replaced
+ * @return true if the script was compiled
+ */
+bool script_compile_bonus( struct script_code* code ){
+	nullpo_retr( false, code );
+
+	delete code->bonuses;
+	code->bonuses = nullptr;
+
+	unsigned char* buf = code->script_buf;
+	int32 pos = 0;
+	int32 bonus_func = search_str( "bonus" ); // bonus2 to bonus5 share its builtin function
+	std::vector<s_script_bonus_call> calls;
+
+	while( pos < code->script_size ){
+		c_op op = get_com( buf, &pos );
+
+		if( op == C_NOP )
+			break;
+		if( op != C_NAME )
+			return false;
+
+		int32 func = GETVALUE( buf, pos );
+
+		pos += 3;
+
+		if( str_data[func].type != C_FUNC || get_com( buf, &pos ) != C_ARG )
+			return false;
+
+		const char* name = buildin_func[str_data[func].val].name;
+		int32 values[6];
+		const char* strings[6] = {};
+		int32 count = 0;
+
+		// Arguments are constants, constant names were already replaced by their value
+		while( ( op = get_com( buf, &pos ) ) != C_FUNC ){
+			if( count == ARRAYLENGTH( values ) )
+				return false;
+
+			if( op == C_INT ){
+				int64 value = get_num( buf, &pos );
+				int32 next = pos;
+
+				if( get_com( buf, &next ) == C_NEG ){
+					value = -value;
+					pos = next;
+				}
+				if( value < INT_MIN || value > INT_MAX )
+					return false;
+				values[count] = static_cast<int32>( value );
+			}else if( op == C_STR ){
+				strings[count] = reinterpret_cast<const char*>( buf + pos );
+				values[count] = 0;
+				pos += static_cast<int32>( strlen( strings[count] ) ) + 1;
+			}else
+				return false;
+			count++;
+		}
+
+		if( get_com( buf, &pos ) != C_EOL )
+			return false;
+
+		if( strcmp( name, "end" ) == 0 && count == 0 )
+			break;
+		if( str_data[func].func != str_data[bonus_func].func || count == 0 || strings[0] != nullptr )
+			return false;
+
+		s_script_bonus_call call = { static_cast<uint8>( count - 1 ), values[0], {} };
+
+		if( script_bonus_takes_skill( call.type ) && count < 2 )
+			return false;
+
+		for( int32 i = 1; i < count; i++ ){
+			if( strings[i] == nullptr ){
+				call.val[i - 1] = values[i];
+				continue;
+			}
+
+			// Skill names, see buildin_bonus
+			if( i == 1 && script_bonus_takes_skill( call.type ) )
+				call.val[0] = skill_name2id( strings[i] );
+			else if( i == 2 && call.type == SP_AUTOSPELL_ONSKILL && count >= 5 )
+				call.val[1] = skill_name2id( strings[i] );
+			else
+				return false;
+
+			if( call.val[i - 1] == 0 )
+				return false;
+		}
+
+		// Only check skill ID for bonus2, bonus3, bonus4, or bonus5
+		if( script_bonus_takes_skill( call.type ) && strings[1] == nullptr && func != bonus_func && !skill_get_index( call.val[0] ) )
+			return false;
+
+		calls.push_back( call );
+	}
+
+	code->bonuses = new std::vector<s_script_bonus_call>( std::move( calls ) );
+
+	return true;
+}
+
 int32 run_func(struct script_state *st)
 {
 	struct script_data* data;
@@ -4122,6 +5564,9 @@ int32 run_func(struct script_state *st)
 		script_check_buildin_argtype(st, func);
 	}
 
+	if( script_bonus_record != nullptr && !script_bonus_record_allows( buildin_func[str_data[func].val].name, st->end - st->start - 2 ) )
+		script_bonus_record->pure = false;
+
 	if(str_data[func].func) {
 #if defined(SCRIPT_COMMAND_DEPRECATION)
 		if( buildin_func[str_data[func].val].deprecated ){
@@ -4131,7 +5576,18 @@ int32 run_func(struct script_state *st)
 		}
 #endif
 
-		if (str_data[func].func(st) == SCRIPT_CMD_FAILURE) {
+		struct s_script_profile* profile = st->profile;
+		std::chrono::steady_clock::time_point start;
+
+		if (profile != nullptr)
+			start = std::chrono::steady_clock::now();
+
+		int32 result = str_data[func].func(st);
+
+		if (profile != nullptr)
+			script_profile_func(profile, func, start);
+
+		if (result == SCRIPT_CMD_FAILURE) {
 			//Report error
 			ShowWarning("Script command '%s' returned failure.\n", get_str(func));
 			script_reportsrc(st);
@@ -4162,13 +5618,13 @@ int32 run_func(struct script_state *st)
 		}
 		script_free_vars(st->stack->scope.vars);
 		st->stack->scope.arrays->destroy(st->stack->scope.arrays, script_free_array_db);
+		script_slots_free(st->stack->scope.slot_layout, st->stack->scope.slots);
 
 		ri = st->stack->stack_data[st->stack->defsp-1].u.ri;
 		nargs = ri->nargs;
 		st->pos = ri->pos;
 		st->script = ri->script;
-		st->stack->scope.vars = ri->scope.vars;
-		st->stack->scope.arrays = ri->scope.arrays;
+		st->stack->scope = ri->scope;
 		st->stack->defsp = ri->defsp;
 		memset(ri, 0, sizeof(struct script_retinfo));
 
@@ -4197,6 +5653,55 @@ void run_script(struct script_code *rootscript, int32 pos, int32 rid, int32 oid)
 	run_script_main(st);
 }
 
+/**
+ * Compiles a script file and runs it repeatedly without an attached player, reporting how long it took.
+ * Used to compare interpreter changes on the bundled scripts, e.g. with variable_slots enabled and disabled.
+ * @param file: file holding a script body between brackets
+ * @param runs: number of times the script is run
+ */
+void script_benchmark( const char* file, int32 runs ){
+	FILE* fp = fopen( file, "rb" );
+
+	if( fp == nullptr ){
+		ShowError( "script_benchmark: Could not open '%s'.\n", file );
+		return;
+	}
+
+	std::string source;
+	char buf[4096];
+	size_t len;
+
+	while( ( len = fread( buf, 1, sizeof( buf ), fp ) ) > 0 ){
+		source.append( buf, len );
+	}
+	fclose( fp );
+
+	auto start = std::chrono::steady_clock::now();
+	struct script_code* code = parse_script( source.c_str(), file, 1, 0 );
+
+	if( code == nullptr ){
+		return;
+	}
+
+	auto compiled = std::chrono::steady_clock::now();
+
+	for( int32 i = 0; i < runs; i++ ){
+		run_script( code, 0, 0, fake_nd->id );
+	}
+
+	auto finished = std::chrono::steady_clock::now();
+	int64 compile_us = std::chrono::duration_cast<std::chrono::microseconds>( compiled - start ).count();
+	int64 run_us = std::chrono::duration_cast<std::chrono::microseconds>( finished - compiled ).count();
+
+	ShowInfo( "script_benchmark: '%s' compiled in %" PRId64 " us, %d runs took %" PRId64 " us (%.2f us/run, variable slots %s, %" PRIuPTR " scope/%" PRIuPTR " npc slots).\n",
+		file, compile_us, runs, run_us, runs > 0 ? (double)run_us / runs : 0.,
+		script_config.variable_slots ? "on" : "off",
+		code->scope_layout ? code->scope_layout->ids.size() : 0, code->local_layout ? code->local_layout->ids.size() : 0 );
+
+	script_stop_scriptinstances( code );
+	script_free_code( code );
+}
+
 /**
  * Free all related script code
  * @param code: Script code to free
@@ -4379,6 +5884,15 @@ void run_script_main(struct script_state *st)
 	int32 gotocount = script_config.check_gotocount;
 	TBL_PC *sd;
 	struct script_stack *stack = st->stack;
+	int32 slot = -1;
+	struct s_script_profile* profile = st->profile;
+	std::chrono::steady_clock::time_point profile_start;
+	uint64 ops = 0;
+
+	if( profile != nullptr ){
+		profile->entries++;
+		profile_start = std::chrono::steady_clock::now();
+	}
 
 	script_attach_state(st);
 
@@ -4391,6 +5905,7 @@ void run_script_main(struct script_state *st)
 
 	while(st->state == RUN) {
 		enum c_op c = get_com(st->script->script_buf,&st->pos);
+		ops++;
 		switch(c){
 		case C_EOL:
 			if( stack->defsp > stack->sp )
@@ -4401,10 +5916,14 @@ void run_script_main(struct script_state *st)
 		case C_INT:
 			push_val(stack,C_INT,get_num(st->script->script_buf,&st->pos));
 			break;
+		case C_SLOT:
+			slot = (int32)get_num(st->script->script_buf,&st->pos);
+			break;
 		case C_POS:
 		case C_NAME:
-			push_val(stack,c,GETVALUE(st->script->script_buf,st->pos));
+			push_val(stack,c,GETVALUE(st->script->script_buf,st->pos))->slot = slot;
 			st->pos+=3;
+			slot = -1;
 			break;
 		case C_ARG:
 			push_val(stack,c,0);
@@ -4476,6 +5995,11 @@ void run_script_main(struct script_state *st)
 		}
 	}
 
+	if( profile != nullptr ){
+		profile->ops += ops;
+		profile->time += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - profile_start ).count();
+	}
+
 	if(st->sleep.tick > 0) {
 		//Restore previous script
 		script_detach_state(st, false);
@@ -4546,6 +6070,15 @@ int32 script_config_read(const char *cfgName)
 		if(strcmpi(w1,"warn_func_mismatch_paramnum")==0) {
 			script_config.warn_func_mismatch_paramnum = config_switch(w2);
 		}
+		else if(strcmpi(w1,"variable_slots")==0) {
+			script_config.variable_slots = config_switch(w2);
+		}
+		else if(strcmpi(w1,"bytecode_cache")==0) {
+			if( strcmpi( w2, "no" ) == 0 )
+				script_cache_path[0] = '\0';
+			else
+				safestrncpy( script_cache_path, w2, sizeof( script_cache_path ) );
+		}
 		else if(strcmpi(w1,"check_cmdcount")==0) {
 			script_config.check_cmdcount = config_switch(w2);
 		}
@@ -4899,6 +6432,10 @@ void script_reload(void) {
 	dbi_destroy(iter);
 	db_clear(st_db);
 
+	// No state points to the profiles anymore
+	script_profile_db.clear();
+	script_profiles.clear();
+
 	mapreg_reload();
 }
 
@@ -5417,14 +6954,12 @@ BUILDIN_FUNC(callfunc)
 	}
 
 	ref = (struct reg_db *)aCalloc(sizeof(struct reg_db), 2);
-	ref[0].vars = st->stack->scope.vars;
 	if (!st->stack->scope.arrays)
 		st->stack->scope.arrays = idb_alloc(DB_OPT_BASE); // TODO: Can this happen? when?
-	ref[0].arrays = st->stack->scope.arrays;
-	ref[1].vars = st->script->local.vars;
+	ref[0] = st->stack->scope;
 	if (!st->script->local.arrays)
 		st->script->local.arrays = idb_alloc(DB_OPT_BASE); // TODO: Can this happen? when?
-	ref[1].arrays = st->script->local.arrays;
+	ref[1] = st->script->local;
 
 	for(i = st->start+3, j = 0; i < st->end; i++, j++) {
 		struct script_data* data = push_copy(st->stack,i);
@@ -5439,8 +6974,7 @@ BUILDIN_FUNC(callfunc)
 
 	CREATE(ri, struct script_retinfo, 1);
 	ri->script       = st->script;              // script code
-	ri->scope.vars   = st->stack->scope.vars;   // scope variables
-	ri->scope.arrays = st->stack->scope.arrays; // scope arrays
+	ri->scope        = st->stack->scope;        // scope variables and arrays
 	ri->pos          = st->pos;                 // script location
 	ri->nargs        = j;                       // argument count
 	ri->defsp        = st->stack->defsp;        // default stack pointer
@@ -5450,7 +6984,7 @@ BUILDIN_FUNC(callfunc)
 	st->script = scr;
 	st->stack->defsp = st->stack->sp;
 	st->state = GOTO;
-	st->stack->scope.vars = i64db_alloc(DB_OPT_RELEASE_DATA);
+	script_scope_alloc(&st->stack->scope, scr);
 	st->stack->scope.arrays = idb_alloc(DB_OPT_BASE);
 
 	if (!st->script->local.vars)
@@ -5477,10 +7011,9 @@ BUILDIN_FUNC(callsub)
 	}
 
 	ref = (struct reg_db *)aCalloc(sizeof(struct reg_db), 1);
-	ref[0].vars = st->stack->scope.vars;
 	if (!st->stack->scope.arrays)
 		st->stack->scope.arrays = idb_alloc(DB_OPT_BASE); // TODO: Can this happen? when?
-	ref[0].arrays = st->stack->scope.arrays;
+	ref[0] = st->stack->scope;
 
 	for(i = st->start+3, j = 0; i < st->end; i++, j++) {
 		struct script_data* data = push_copy(st->stack,i);
@@ -5495,8 +7028,7 @@ BUILDIN_FUNC(callsub)
 
 	CREATE(ri, struct script_retinfo, 1);
 	ri->script       = st->script;              // script code
-	ri->scope.vars   = st->stack->scope.vars;   // scope variables
-	ri->scope.arrays = st->stack->scope.arrays; // scope arrays
+	ri->scope        = st->stack->scope;        // scope variables and arrays
 	ri->pos          = st->pos;                 // script location
 	ri->nargs        = j;                       // argument count
 	ri->defsp        = st->stack->defsp;        // default stack pointer
@@ -5505,7 +7037,7 @@ BUILDIN_FUNC(callsub)
 	st->pos = pos;
 	st->stack->defsp = st->stack->sp;
 	st->state = GOTO;
-	st->stack->scope.vars = i64db_alloc(DB_OPT_RELEASE_DATA);
+	script_scope_alloc(&st->stack->scope, st->script);
 	st->stack->scope.arrays = idb_alloc(DB_OPT_BASE);
 
 	return SCRIPT_CMD_SUCCESS;
@@ -10040,47 +11572,25 @@ BUILDIN_FUNC(bonus)
 		return SCRIPT_CMD_SUCCESS; // no player attached
 
 	type = script_getnum(st,2);
-	switch( type ) {
-		case SP_AUTOSPELL:
-		case SP_AUTOSPELL_WHENHIT:
-		case SP_AUTOSPELL_ONSKILL:
-		case SP_SKILL_ATK:
-		case SP_SKILL_HEAL:
-		case SP_SKILL_HEAL2:
-		case SP_ADD_SKILL_BLOW:
-		case SP_CASTRATE:
-		case SP_ADDEFF_ONSKILL:
-		case SP_SKILL_USE_SP_RATE:
-		case SP_SKILL_COOLDOWN:
-		case SP_SKILL_FIXEDCAST:
-		case SP_SKILL_VARIABLECAST:
-		case SP_VARCASTRATE:
-		case SP_FIXCASTRATE:
-		case SP_SKILL_DELAY:
-		case SP_SKILL_USE_SP:
-		case SP_SUB_SKILL:
-			// these bonuses support skill names
-			if (script_isstring(st, 3)) {
-				const char *name = script_getstr(st, 3);
+	if( script_bonus_takes_skill( type ) ){
+		// these bonuses support skill names
+		if (script_isstring(st, 3)) {
+			const char *name = script_getstr(st, 3);
 
-				if (!(val1 = skill_name2id(name))) {
-					ShowError("buildin_bonus: Invalid skill name %s passed to item bonus. Skipping.\n", name);
-					return SCRIPT_CMD_FAILURE;
-				}
-			} else {
-				val1 = script_getnum(st, 3);
+			if (!(val1 = skill_name2id(name))) {
+				ShowError("buildin_bonus: Invalid skill name %s passed to item bonus. Skipping.\n", name);
+				return SCRIPT_CMD_FAILURE;
+			}
+		} else {
+			val1 = script_getnum(st, 3);
 
-				if (strcmpi(script_getfuncname(st), "bonus") && !skill_get_index(val1)) { // Only check skill ID for bonus2, bonus3, bonus4, or bonus5
-					ShowError("buildin_bonus: Invalid skill ID %d passed to item bonus. Skipping.\n", val1);
-					return SCRIPT_CMD_FAILURE;
-				}
+			if (strcmpi(script_getfuncname(st), "bonus") && !skill_get_index(val1)) { // Only check skill ID for bonus2, bonus3, bonus4, or bonus5
+				ShowError("buildin_bonus: Invalid skill ID %d passed to item bonus. Skipping.\n", val1);
+				return SCRIPT_CMD_FAILURE;
 			}
-			break;
-		default:
-			if (script_hasdata(st, 3))
-				val1 = script_getnum(st, 3);
-			break;
-	}
+		}
+	}else if (script_hasdata(st, 3))
+		val1 = script_getnum(st, 3);
 
 	switch( script_lastdata(st)-2 ) {
 		case 0:
@@ -10119,9 +11629,12 @@ BUILDIN_FUNC(bonus)
 			break;
 		default:
 			ShowDebug("buildin_bonus: unexpected number of arguments (%d)\n", (script_lastdata(st) - 1));
-			break;
+			return SCRIPT_CMD_SUCCESS;
 	}
 
+	if( script_bonus_record != nullptr )
+		script_bonus_record->calls.push_back( { static_cast<uint8>( script_lastdata(st) - 2 ), type, { val1, val2, val3, val4, val5 } } );
+
 	return SCRIPT_CMD_SUCCESS;
 }
 
@@ -20026,7 +21539,7 @@ BUILDIN_FUNC(unitwalk)
 		int32 x = script_getnum(st,3);
 		int32 y = script_getnum(st,4);
 
-		if (script_pushint(st, unit_can_reach_pos(bl,x,y,0))) {
+		if (script_pushint(st, unit_can_reach_pos(bl,x,y,0) || unit_can_reach_route(bl,x,y))) {
 			if (ud != nullptr)
 				ud->state.force_walk = true;
 			add_timer(gettick()+50, unit_delay_walktoxy_timer, bl->id, (x<<16)|(y&0xFFFF)); // Need timer to avoid mismatches
@@ -24514,6 +26027,14 @@ BUILDIN_FUNC(navigateto){
 
 	clif_navigateTo(sd,mapname,x,y,flag,hideWindow,monster_id);
 
+	// The client finds its own way, tell the script how many warps the server knows it takes
+	s_navgraph_route route;
+
+	if( navgraph_route( sd->m, sd->x, sd->y, map_mapname2mapid( mapname ), x, y, route ) )
+		script_pushint( st, static_cast<int32>( route.hops.size() ) );
+	else
+		script_pushint( st, -1 );
+
 	return SCRIPT_CMD_SUCCESS;
 #else
 	return SCRIPT_CMD_FAILURE;
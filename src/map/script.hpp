@@ -4,6 +4,10 @@
 #ifndef SCRIPT_HPP
 #define SCRIPT_HPP
 
+#include <functional>
+#include <memory>
+#include <vector>
+
 #include <ryml_std.hpp>
 #include <ryml.hpp>
 
@@ -149,10 +153,12 @@ extern int32 potion_hp, potion_per_hp, potion_sp, potion_per_sp;
 extern int32 potion_target;
 extern uint32 *generic_ui_array;
 extern uint32 generic_ui_array_size;
+extern struct s_script_bonus_record* script_bonus_record;
 
 struct Script_Config {
 	unsigned warn_func_mismatch_argtypes : 1;
 	unsigned warn_func_mismatch_paramnum : 1;
+	unsigned variable_slots : 1;
 	int32 check_cmdcount;
 	int32 check_gotocount;
 	int32 input_min_value;
@@ -234,6 +240,7 @@ typedef enum c_op {
 	C_USERFUNC, // internal script function
 	C_USERFUNC_POS, // internal script function label
 	C_REF, // the next call to c_op2 should push back a ref to the left operand
+	C_SLOT, // slot of the scope/npc variable pushed by the next C_NAME
 
 	// operators
 	C_OP3, // a ? b : c
@@ -264,12 +271,27 @@ typedef enum c_op {
 	C_SUB_PRE, // --a
 } c_op;
 
+/// Scope or npc variables that were given a fixed slot by the script compiler
+struct script_slot_layout {
+	std::vector<int32> ids; ///< Variable id stored in each slot
+	std::vector<bool> strings; ///< Whether the slot holds a string
+	std::vector<std::pair<int32, int32>> index; ///< Variable id to slot, sorted by variable id
+};
+
+/// Value of a slotted variable (0 and nullptr stand for an unset variable)
+union script_slot {
+	int64 num;
+	char* str;
+};
+
 /**
  * Generic reg database abstraction to be used with various types of regs/script variables.
  */
 struct reg_db {
 	struct DBMap *vars;
 	struct DBMap *arrays;
+	const struct script_slot_layout* slot_layout; ///< Slotted variables of this scope, only used by scope/npc variables
+	union script_slot* slots; ///< Values of the slotted variables
 };
 
 struct script_retinfo {
@@ -282,6 +304,7 @@ struct script_retinfo {
 
 struct script_data {
 	enum c_op type;
+	int32 slot; ///< Slot hint of a scope/npc variable reference, -1 if unknown
 	union script_data_val {
 		int64 num;
 		char *str;
@@ -290,15 +313,31 @@ struct script_data {
 	struct reg_db *ref;
 };
 
-// Moved defsp from script_state to script_stack since
-// it must be saved when script state is RERUNLINE. [Eoe / jA 1094]
+/// Bonus command run by an equipment script that is being recorded
+struct s_script_bonus_call {
+	uint8 args; ///< Number of values given to the command
+	int32 type;
+	int32 val[5];
+};
+
+/// Recording of an equipment script run by status_calc_pc
+struct s_script_bonus_record {
+	bool pure; ///< The script only ran bonus commands and read nothing but its locals and its own item
+	std::vector<s_script_bonus_call> calls; ///< Bonus commands in the order they were run
+};
+
 struct script_code {
 	int32 script_size;
 	unsigned char* script_buf;
 	struct reg_db local;
 	uint16 instances;
+	std::vector<s_script_bonus_call>* bonuses; ///< Native bonus table of a script that only runs constant bonus commands, see script_compile_bonus
+	struct script_slot_layout* scope_layout; ///< Slotted scope variables, allocated for every scope of this script
+	struct script_slot_layout* local_layout; ///< Slotted npc variables, see local
 };
 
+// Moved defsp from script_state to script_stack since
+// it must be saved when script state is RERUNLINE. [Eoe / jA 1094]
 struct script_stack {
 	int32 sp;                         ///< number of entries in the stack
 	int32 sp_max;                     ///< capacity of the stack
@@ -313,6 +352,9 @@ struct script_stack {
 //
 enum e_script_state { RUN,STOP,END,RERUNLINE,GOTO,RETFUNC,CLOSE };
 
+struct s_script_profile;
+struct s_script_precompiled_file;
+
 struct script_state {
 	struct script_stack* stack;
 	int32 start,end;
@@ -333,6 +375,7 @@ struct script_state {
 	unsigned clear_cutin : 1;
 	char* funcname; // Stores the current running function name
 	uint32 id;
+	struct s_script_profile* profile; ///< Profiling counters of the npc and label this state started at, see script_profile_enable
 };
 
 struct script_reg {
@@ -2308,6 +2351,25 @@ bool is_number(const char *p);
 struct script_code* parse_script_( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func );
 #define parse_script( src, file, line, options ) parse_script_( ( src ), ( file ), ( line ), ( options ), ALC_MARK )
 void run_script(struct script_code *rootscript,int32 pos,int32 rid,int32 oid);
+void script_benchmark(const char* file, int32 runs);
+
+void script_cache_open(void);
+void script_cache_close(void);
+bool script_cache_stored(const char* file, uint32 crc, size_t length);
+void script_cache_begin(const char* file, const char* buffer, size_t length, s_script_precompiled_file* precompiled = nullptr);
+void script_cache_end(void);
+std::shared_ptr<s_script_precompiled_file> script_precompile_file(void);
+void script_precompile_open(void);
+void script_precompile_close(void);
+void script_precompile_thread_begin(void);
+void script_precompile_thread_end(void);
+void script_precompile(s_script_precompiled_file& file, const char* buffer, const char* src, const char* filepath, int32 line, int32 options, const std::function<bool(const char*)>& function_defined);
+
+void script_profile_enable(bool enable);
+bool script_profile_enabled(void);
+void script_profile_reset(void);
+void script_profile_show(int32 fd, map_session_data* sd, int32 count);
+bool script_profile_dump(const char* file);
 
 bool set_reg_num(struct script_state* st, map_session_data* sd, int64 num, const char* name, const int64 value, struct reg_db *ref);
 bool set_reg_str(struct script_state* st, map_session_data* sd, int64 num, const char* name, const char* value, struct reg_db* ref);
@@ -2326,6 +2388,7 @@ void run_script_main(struct script_state *st);
 
 void script_stop_scriptinstances(struct script_code *code);
 void script_free_code(struct script_code* code);
+bool script_compile_bonus(struct script_code* code);
 void script_free_vars(struct DBMap *storage);
 struct script_state* script_alloc_state(struct script_code* rootscript, int32 pos, int32 rid, int32 oid);
 void script_free_state(struct script_state* st);
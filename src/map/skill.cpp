@@ -3318,24 +3318,10 @@ int64 skill_attack (int32 attack_type, block_list* src, block_list *dsrc, block_
  * Checking bl battle flag and display damage
  * then call func with source,target,skill_id,skill_lv,tick,flag
  *------------------------------------------*/
-typedef int32 (*SkillFunc)(block_list *, block_list *, int32, int32, t_tick, int32);
-int32 skill_area_sub(block_list *bl, va_list ap)
+int32 skill_area_sub(block_list *bl, block_list *src, uint16 skill_id, uint16 skill_lv, t_tick tick, int32 flag, SkillFunc func)
 {
-	block_list *src;
-	uint16 skill_id,skill_lv;
-	int32 flag;
-	t_tick tick;
-	SkillFunc func;
-
 	nullpo_ret(bl);
 
-	src = va_arg(ap,block_list *);
-	skill_id = va_arg(ap,int32);
-	skill_lv = va_arg(ap,int32);
-	tick = va_arg(ap,t_tick);
-	flag = va_arg(ap,int32);
-	func = va_arg(ap,SkillFunc);
-
 	if(battle_check_target(src,bl,flag) > 0) {
 		// several splash skills need this initial dummy packet to display correctly
 		if (flag&SD_PREAMBLE && skill_area_temp[2] == 0)
@@ -3349,6 +3335,19 @@ int32 skill_area_sub(block_list *bl, va_list ap)
 	return 0;
 }
 
+/// va_list version of skill_area_sub for the map_foreach* functions taking a va_list callback
+int32 skill_area_sub(block_list *bl, va_list ap)
+{
+	block_list *src = va_arg(ap,block_list *);
+	uint16 skill_id = va_arg(ap,int32);
+	uint16 skill_lv = va_arg(ap,int32);
+	t_tick tick = va_arg(ap,t_tick);
+	int32 flag = va_arg(ap,int32);
+	SkillFunc func = va_arg(ap,SkillFunc);
+
+	return skill_area_sub(bl, src, skill_id, skill_lv, tick, flag, func);
+}
+
 static int32 skill_check_unit_range_sub(block_list *bl, va_list ap)
 {
 	skill_unit *unit;
@@ -11458,7 +11457,7 @@ int32 skill_trap_splash(block_list *bl, va_list ap)
 				int32 split_count = 0;
 
 				if (skill_get_nk(sg->skill_id, NK_SPLASHSPLIT))
-					split_count = max(1, map_foreachinallrange(skill_area_sub, src, skill_get_splash(sg->skill_id, sg->skill_lv), BL_CHAR, src, sg->skill_id, sg->skill_lv, tick, BCT_ENEMY, skill_area_sub_count));
+					split_count = max(1, map_foreachinallrange([&]( block_list* target ){ return skill_area_sub( target, src, sg->skill_id, sg->skill_lv, tick, BCT_ENEMY, skill_area_sub_count ); }, src, skill_get_splash(sg->skill_id, sg->skill_lv), BL_CHAR));
 				skill_attack(skill_get_type(sg->skill_id), ss, src, bl, sg->skill_id, sg->skill_lv, tick, split_count);
 			}
 			break;
@@ -12326,7 +12325,7 @@ static int32 skill_unit_timer_sub(DBKey key, DBData *data, va_list ap)
 				block_list *src = map_id2bl(group->src_id);
 
 				if (src)
-					map_foreachinrange(skill_area_sub, unit, unit->range, BL_CHAR|BL_SKILL, src, group->skill_id, group->skill_lv, tick, BCT_ENEMY|SD_ANIMATION|5, skill_castend_damage_id);
+					map_foreachinrange([&]( block_list* target ){ return skill_area_sub( target, src, group->skill_id, group->skill_lv, tick, BCT_ENEMY|SD_ANIMATION|5, skill_castend_damage_id ); }, unit, unit->range, BL_CHAR|BL_SKILL);
 				skill_delunit(unit);
 			}
 				break;
@@ -16295,12 +16294,17 @@ void skill_reload (void) {
 
 	skill_readdb();
 
+	// Item bonuses refer to skills by name, compile and record them again with the reloaded skills
+	status_bonus_cache_clear();
+	itemdb_compile_bonus_scripts();
+
 	/* lets update all players skill tree : so that if any skill modes were changed they're properly updated */
 	s_mapiterator *iter = mapit_getallusers();
 
 	for( map_session_data *sd = (TBL_PC*)mapit_first(iter); mapit_exists(iter); sd = (TBL_PC*)mapit_next(iter) ) {
 		pc_validate_skill(sd);
 		clif_skillinfoblock(*sd);
+		status_calc_pc(sd, SCO_FORCE);
 	}
 	mapit_free(iter);
 }
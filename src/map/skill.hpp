@@ -666,6 +666,8 @@ bool skill_arrow_create( map_session_data *sd, t_itemid nameid);
 int32 skill_castend_nodamage_id( block_list *src, block_list *bl,uint16 skill_id,uint16 skill_lv,t_tick tick,int32 flag );
 int32 skill_castend_damage_id( block_list* src, block_list *bl,uint16 skill_id,uint16 skill_lv,t_tick tick,int32 flag );
 int32 skill_castend_pos2( block_list *src, int32 x,int32 y,uint16 skill_id,uint16 skill_lv,t_tick tick,int32 flag);
+typedef int32 (*SkillFunc)(block_list *src, block_list *target, uint16 skill_id, uint16 skill_lv, t_tick tick, int32 flag);
+int32 skill_area_sub(block_list *bl, block_list *src, uint16 skill_id, uint16 skill_lv, t_tick tick, int32 flag, SkillFunc func);
 int32 skill_area_sub(block_list *bl, va_list ap);
 int32 skill_area_sub_count(block_list* src, block_list* target, uint16 skill_id, uint16 skill_lv, t_tick tick, int32 flag);
 TIMER_FUNC(skill_timerskill);
@@ -5,6 +5,7 @@
 
 #include "map/clif.hpp"
 #include "map/pc.hpp"
+#include "map/status.hpp"
 
 SkillEquipSwitch::SkillEquipSwitch() : SkillImpl(ALL_EQSWITCH) {
 }
@@ -15,10 +16,15 @@ void SkillEquipSwitch::castendNoDamageId(block_list* src, block_list* target, ui
 	if( sd ){
 		clif_equipswitch_reply( sd, false );
 
+		// Recalculate once for the whole set
+		status_calc_pc_batch_begin( *sd );
+
 		for( int32 i = 0, position = 0; i < EQI_MAX; i++ ){
 			if( sd->equip_switch_index[i] >= 0 && !( position & equip_bitmask[i] ) ){
 				position |= pc_equipswitch( sd, sd->equip_switch_index[i] );
 			}
 		}
+
+		status_calc_pc_batch_end( *sd );
 	}
 }
@@ -117,7 +117,9 @@ void SkillImplRecursiveDamageSplash::castendPos2(block_list* src, int32 x, int32
 
 	int16 size = this->getSplashSearchSize(src, skill_lv);
 
-	map_foreachinarea(skill_area_sub, src->m, x - size, y - size, x + size, y + size, this->getSplashTarget(src), src, this->getSkillId(), skill_lv, tick, flag | BCT_ENEMY | 1, skill_castend_damage_id);
+	uint16 skill_id = this->getSkillId();
+
+	map_foreachinarea([&]( block_list* target ){ return skill_area_sub( target, src, skill_id, skill_lv, tick, flag | BCT_ENEMY | 1, skill_castend_damage_id ); }, src->m, x - size, y - size, x + size, y + size, this->getSplashTarget(src));
 }
 
 int16 SkillImplRecursiveDamageSplash::getSearchSize(block_list* src, uint16 skill_lv) const {
@@ -133,17 +135,19 @@ int32 SkillImplRecursiveDamageSplash::getSplashTarget(block_list* src) const {
 }
 
 void SkillImplRecursiveDamageSplash::splashSearch(block_list* src, block_list* target, uint16 skill_lv, t_tick tick, int32 flag) const {
+	uint16 skill_id = this->getSkillId();
+
 	// if skill damage should be split among targets, count them
 	// SD_LEVEL -> Forced splash damage -> count targets
-	if (flag & SD_LEVEL || skill_get_nk(getSkillId(), NK_SPLASHSPLIT)){
-		skill_area_temp[0] = map_foreachinallrange(skill_area_sub, target, this->getSearchSize(src, skill_lv), BL_CHAR, src, getSkillId(), skill_lv, tick, BCT_ENEMY, skill_area_sub_count);
+	if (flag & SD_LEVEL || skill_get_nk(skill_id, NK_SPLASHSPLIT)){
+		skill_area_temp[0] = map_foreachinallrange([&]( block_list* bl ){ return skill_area_sub( bl, src, skill_id, skill_lv, tick, BCT_ENEMY, skill_area_sub_count ); }, target, this->getSearchSize(src, skill_lv), BL_CHAR);
 		// If there are no characters in the area, then it always counts as if there was one target
 		// This happens when targetting skill units such as icewall
 		skill_area_temp[0] = std::max(1, skill_area_temp[0]);
 	}
 
 	// recursive invocation of skill_castend_damage_id() with flag|1
-	map_foreachinrange(skill_area_sub, target, this->getSplashSearchSize(src, skill_lv), this->getSplashTarget(src), src, getSkillId(), skill_lv, tick, flag | BCT_ENEMY | SD_SPLASH | 1, skill_castend_damage_id);
+	map_foreachinrange([&]( block_list* bl ){ return skill_area_sub( bl, src, skill_id, skill_lv, tick, flag | BCT_ENEMY | SD_SPLASH | 1, skill_castend_damage_id ); }, target, this->getSplashSearchSize(src, skill_lv), this->getSplashTarget(src));
 }
 
 int64 SkillImplRecursiveDamageSplash::splashDamage(block_list* src, block_list* target, uint16 skill_lv, t_tick tick, int32 flag) const {
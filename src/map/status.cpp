@@ -72,6 +72,39 @@ int32 current_equip_card_id; /// To prevent card-stacking (from jA) [Skotlex]
 // We need it for new cards 15 Feb 2005, to check if the combo cards are insrerted into the CURRENT weapon only to avoid cards exploits
 int16 current_equip_opt_index; /// Contains random option index of an equipped item. [Secret]
 
+/// Inputs of an equipment script that only reads its own item, see status_calc_pc_script
+struct s_bonus_cache_key {
+	const script_code* script;
+	uint8 refine;
+	uint8 enchantgrade;
+	int16 option_value;
+	int8 option_param;
+
+	bool operator==( const s_bonus_cache_key& other ) const {
+		return this->script == other.script && this->refine == other.refine && this->enchantgrade == other.enchantgrade
+			&& this->option_value == other.option_value && this->option_param == other.option_param;
+	}
+};
+
+struct s_bonus_cache_key_hash {
+	size_t operator()( const s_bonus_cache_key& key ) const {
+		return std::hash<const void*>()( key.script ) ^ ( (size_t)key.refine << 8 | (size_t)key.enchantgrade << 16 | (size_t)(uint16)key.option_value << 24 | (size_t)(uint8)key.option_param << 40 );
+	}
+};
+
+/// Recorded bonus commands of the equipment scripts, cleared when the item database is reloaded
+static std::unordered_map<s_bonus_cache_key, s_script_bonus_record, s_bonus_cache_key_hash> bonus_cache;
+
+/// Counters of the player status calculation, see status_calc_counters_report
+static struct s_status_calc_counters {
+	uint64 full; ///< Full recalculations (status_calc_pc_sub)
+	uint64 batched; ///< Full recalculations requested during a batch and merged into its final one
+	uint64 partial; ///< Recalculations of a player that did not need the base status (status changes)
+	uint64 scripts_run; ///< Equipment scripts run by the script engine
+	uint64 scripts_replayed; ///< Equipment scripts replaced by their recorded bonuses
+	uint64 scripts_compiled; ///< Equipment scripts replaced by their native bonus table
+} status_calc_counters;
+
 uint16 SCDisabled[SC_MAX]; ///< List of disabled SC on map zones. [Cydh]
 
 static uint16 status_calc_str(block_list *,status_change *,int32);
@@ -3744,6 +3777,79 @@ bool status_calc_cart_weight(map_session_data *sd, enum e_status_calc_weight_opt
 	return true;
 }
 
+/**
+ * Applies bonus commands without the script engine.
+ * @param sd: Player object
+ * @param calls: Bonus commands, recorded or compiled
+ */
+static void status_calc_pc_bonus_calls(map_session_data* sd, const std::vector<s_script_bonus_call>& calls)
+{
+	for (const s_script_bonus_call& call : calls) {
+		switch (call.args) {
+			case 0:
+			case 1: pc_bonus(sd, call.type, call.val[0]); break;
+			case 2: pc_bonus2(sd, call.type, call.val[0], call.val[1]); break;
+			case 3: pc_bonus3(sd, call.type, call.val[0], call.val[1], call.val[2]); break;
+			case 4: pc_bonus4(sd, call.type, call.val[0], call.val[1], call.val[2], call.val[3]); break;
+			case 5: pc_bonus5(sd, call.type, call.val[0], call.val[1], call.val[2], call.val[3], call.val[4]); break;
+		}
+	}
+}
+
+/**
+ * Runs an equipment bonus script for status_calc_pc_sub.
+ * Scripts compiled at load time by script_compile_bonus apply their native bonus table.
+ * Other scripts that only run bonus commands and read nothing but their own item are
+ * recorded once, later calculations replay the recorded bonuses without the
+ * script engine as long as the item's refine, enchant grade and random option match.
+ * @param sd: Player object
+ * @param script: Item, card, combo or random option script
+ */
+static void status_calc_pc_script(map_session_data* sd, script_code* script)
+{
+	if (script->bonuses != nullptr) {
+		status_calc_pc_bonus_calls(sd, *script->bonuses);
+		status_calc_counters.scripts_compiled++;
+		return;
+	}
+
+	s_bonus_cache_key key = { script, 0, 0, 0, 0 };
+
+	if (current_equip_item_index >= 0 && current_equip_item_index < MAX_INVENTORY) {
+		const struct item& equip = sd->inventory.u.items_inventory[current_equip_item_index];
+
+		key.refine = equip.refine;
+		key.enchantgrade = equip.enchantgrade;
+
+		if (current_equip_opt_index >= 0 && current_equip_opt_index < MAX_ITEM_RDM_OPT) {
+			key.option_value = equip.option[current_equip_opt_index].value;
+			key.option_param = equip.option[current_equip_opt_index].param;
+		}
+	}
+
+	if (auto cached = bonus_cache.find(key); cached != bonus_cache.end() && cached->second.pure) {
+		status_calc_pc_bonus_calls(sd, cached->second.calls);
+		status_calc_counters.scripts_replayed++;
+		return;
+	} else if (cached != bonus_cache.end()) {
+		status_calc_counters.scripts_run++;
+		run_script(script, 0, sd->id, 0);
+		return;
+	}
+
+	s_script_bonus_record record = { true };
+	s_script_bonus_record* previous = script_bonus_record;
+
+	script_bonus_record = &record;
+	run_script(script, 0, sd->id, 0);
+	script_bonus_record = previous;
+	status_calc_counters.scripts_run++;
+
+	if (!record.pure)
+		record.calls.clear();
+	bonus_cache[key] = std::move(record);
+}
+
 /**
  * Calculates player data from scratch without counting SC adjustments
  * Should be invoked whenever players raise stats, learn passive skills or change equipment
@@ -3763,6 +3869,8 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 	if (++calculating > 10) // Too many recursive calls!
 		return -1;
 
+	status_calc_counters.full++;
+
 	// Remember player-specific values that are currently being shown to the client (for refresh purposes)
 	memcpy(b_skill, &sd->status.skill, sizeof(b_skill));
 
@@ -3990,10 +4098,10 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 			if(sd->inventory_data[index]->script && (pc_has_permission(sd,PC_PERM_USE_ALL_EQUIPMENT) || !itemdb_isNoEquip(sd->inventory_data[index],sd->m))) {
 				if (wd == &sd->left_weapon) {
 					sd->state.lr_flag = LR_FLAG_WEAPON;
-					run_script(sd->inventory_data[index]->script,0,sd->id,0);
+					status_calc_pc_script(sd, sd->inventory_data[index]->script);
 					sd->state.lr_flag = LR_FLAG_NONE;
 				} else
-					run_script(sd->inventory_data[index]->script,0,sd->id,0);
+					status_calc_pc_script(sd, sd->inventory_data[index]->script);
 				if (!calculating) // Abort, run_script retriggered this. [Skotlex]
 					return 1;
 			}
@@ -4024,7 +4132,7 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 			if(sd->inventory_data[index]->script && (pc_has_permission(sd,PC_PERM_USE_ALL_EQUIPMENT) || !itemdb_isNoEquip(sd->inventory_data[index],sd->m))) {
 				if( i == EQI_HAND_L ) // Shield
 					sd->state.lr_flag = LR_FLAG_SHIELD;
-				run_script(sd->inventory_data[index]->script,0,sd->id,0);
+				status_calc_pc_script(sd, sd->inventory_data[index]->script);
 				if( i == EQI_HAND_L ) // Shield
 					sd->state.lr_flag = LR_FLAG_NONE;
 				if (!calculating) // Abort, run_script retriggered this. [Skotlex]
@@ -4032,7 +4140,7 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 			}
 		} else if( sd->inventory_data[index]->type == IT_SHADOWGEAR ) { // Shadow System
 			if (sd->inventory_data[index]->script && (pc_has_permission(sd,PC_PERM_USE_ALL_EQUIPMENT) || !itemdb_isNoEquip(sd->inventory_data[index],sd->m))) {
-				run_script(sd->inventory_data[index]->script,0,sd->id,0);
+				status_calc_pc_script(sd, sd->inventory_data[index]->script);
 				if( !calculating )
 					return 1;
 			}
@@ -4045,7 +4153,7 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 			sd->bonus.arrow_atk += sd->inventory_data[index]->atk;
 			sd->state.lr_flag = LR_FLAG_ARROW;
 			if( !itemdb_group.item_exists(IG_THROWABLE, sd->inventory_data[index]->nameid) ) // Don't run scripts on throwable items
-				run_script(sd->inventory_data[index]->script,0,sd->id,0);
+				status_calc_pc_script(sd, sd->inventory_data[index]->script);
 			sd->state.lr_flag = LR_FLAG_NONE;
 			if (!calculating) // Abort, run_script retriggered status_calc_pc. [Skotlex]
 				return 1;
@@ -4082,7 +4190,7 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 			if (no_run)
 				continue;
 
-			run_script(combo->bonus, 0, sd->id, 0);
+			status_calc_pc_script(sd, combo->bonus);
 
 			if (!calculating) // Abort, run_script retriggered this
 				return 1;
@@ -4133,10 +4241,10 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 					continue;
 				if(i == EQI_HAND_L && sd->inventory.u.items_inventory[index].equip == EQP_HAND_L) { // Left hand status.
 					sd->state.lr_flag = LR_FLAG_WEAPON;
-					run_script(data->script,0,sd->id,0);
+					status_calc_pc_script(sd, data->script);
 					sd->state.lr_flag = LR_FLAG_NONE;
 				} else
-					run_script(data->script,0,sd->id,0);
+					status_calc_pc_script(sd, data->script);
 				if (!calculating) // Abort, run_script his function. [Skotlex]
 					return 1;
 			}
@@ -4173,11 +4281,11 @@ int32 status_calc_pc_sub(map_session_data* sd, uint8 opt)
 					continue;
 				if (i == EQI_HAND_L && sd->inventory.u.items_inventory[index].equip == EQP_HAND_L) { // Left hand status.
 					sd->state.lr_flag = LR_FLAG_WEAPON;
-					run_script(data->script, 0, sd->id, 0);
+					status_calc_pc_script(sd, data->script);
 					sd->state.lr_flag = LR_FLAG_NONE;
 				}
 				else
-					run_script(data->script, 0, sd->id, 0);
+					status_calc_pc_script(sd, data->script);
 				if (!calculating)
 					return 1;
 			}
@@ -5011,6 +5119,78 @@ int32 status_calc_pc_( map_session_data* sd, uint8 opt ){
 	return ret;
 }
 
+/**
+ * Starts a batch of changes on a player, like swapping several equipments.
+ * Full recalculations requested until the matching status_calc_pc_batch_end
+ * are merged into a single one. Status changes are still applied right away.
+ * @param sd: Player object
+ */
+void status_calc_pc_batch_begin( map_session_data& sd ){
+	sd.calc_batch++;
+}
+
+/**
+ * Ends a batch of changes on a player and runs the full recalculation that
+ * was requested during the batch, if any.
+ * @param sd: Player object
+ */
+void status_calc_pc_batch_end( map_session_data& sd ){
+	if( sd.calc_batch == 0 || --sd.calc_batch > 0 ){
+		return;
+	}
+
+	if( sd.calc_batch_pending ){
+		uint8 opt = sd.calc_batch_opt;
+
+		sd.calc_batch_pending = false;
+		sd.calc_batch_opt = SCO_NONE;
+		status_calc_pc( &sd, opt );
+	}
+}
+
+/**
+ * Runs the full recalculation requested so far in a batch right away, for code
+ * inside the batch that reads the status. The batch stays open.
+ * @param sd: Player object
+ */
+void status_calc_pc_batch_flush( map_session_data& sd ){
+	if( sd.calc_batch == 0 || !sd.calc_batch_pending ){
+		return;
+	}
+
+	uint8 opt = sd.calc_batch_opt;
+	int32 batch = sd.calc_batch;
+
+	sd.calc_batch_pending = false;
+	sd.calc_batch_opt = SCO_NONE;
+	sd.calc_batch = 0; // Otherwise the recalculation is deferred again
+	status_calc_pc( &sd, opt );
+	sd.calc_batch = batch;
+}
+
+/**
+ * Forgets the recorded bonuses of the equipment scripts.
+ * Must be called whenever the scripts are freed.
+ */
+void status_bonus_cache_clear( void ){
+	bonus_cache.clear();
+}
+
+/**
+ * Shows how many full status recalculations and equipment scripts were avoided.
+ * @param reset: Resets the counters after showing them
+ */
+void status_calc_counters_report( bool reset ){
+	const s_status_calc_counters& c = status_calc_counters;
+
+	ShowInfo( "Status calculation: %" PRIu64 " full, %" PRIu64 " merged into batches, %" PRIu64 " without base status.\n", c.full, c.batched, c.partial );
+	ShowInfo( "Equipment scripts: %" PRIu64 " run, %" PRIu64 " replayed from %" PRIuPTR " recorded scripts, %" PRIu64 " applied from native bonus tables.\n", c.scripts_run, c.scripts_replayed, bonus_cache.size(), c.scripts_compiled );
+
+	if( reset ){
+		status_calc_counters = {};
+	}
+}
+
 /**
  * Calculates Mercenary data
  * @param md: Mercenary object
@@ -6535,6 +6715,16 @@ void status_calc_bl_(block_list* bl, std::bitset<SCB_MAX> flag, uint8 opt)
 				return;
 			}
 		}
+
+		if (flag[SCB_BASE] && sd->calc_batch > 0) { // Done once when the batch ends
+			sd->calc_batch_pending = true;
+			sd->calc_batch_opt |= opt;
+			status_calc_counters.batched++;
+			return;
+		}
+
+		if (!flag[SCB_BASE])
+			status_calc_counters.partial++;
 	}
 
 	// Pointer to current battle status
@@ -16496,12 +16686,14 @@ void do_init_status(void) {
 	add_timer_func_list(status_clear_lastEffect_timer, "status_clear_lastEffect_timer");
 	initDummyData();
 	status_readdb();
+	itemdb_compile_bonus_scripts(); // Needs the skill database for skill names
 	natural_heal_prev_tick = gettick();
 	add_timer_interval(natural_heal_prev_tick + NATURAL_HEAL_INTERVAL, status_natural_heal_timer, 0, 0, NATURAL_HEAL_INTERVAL);
 }
 
 /** Destroy status data */
 void do_final_status(void) {
+	status_bonus_cache_clear();
 	enchantgrade_db.clear();
 	size_fix_db.clear();
 	refine_db.clear();
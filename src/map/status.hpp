@@ -3693,6 +3693,11 @@ void status_calc_bl_(block_list *bl, std::bitset<SCB_MAX> flag, uint8 opt = SCO_
 int32 status_calc_mob_(mob_data* md, uint8 opt);
 void status_calc_pet_(pet_data* pd, uint8 opt);
 int32 status_calc_pc_(map_session_data* sd, uint8 opt);
+void status_calc_pc_batch_begin( map_session_data& sd );
+void status_calc_pc_batch_end( map_session_data& sd );
+void status_calc_pc_batch_flush( map_session_data& sd );
+void status_bonus_cache_clear( void );
+void status_calc_counters_report( bool reset );
 int32 status_calc_homunculus_(homun_data *hd, uint8 opt);
 int32 status_calc_mercenary_(s_mercenary_data *md, uint8 opt);
 int32 status_calc_elemental_(s_elemental_data *ed, uint8 opt);
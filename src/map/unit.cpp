@@ -62,6 +62,12 @@ using namespace rathena;
 	#define MOVE_REFRESH_TIME MAX_WALK_SPEED
 #endif
 
+// Steps of a long walk path covered by one segment, see unit_walkroute_next
+// Leaves room for the segment's own walk path to go around obstacles within MAX_WALKPATH
+#ifndef WALKROUTE_SEGMENT
+	#define WALKROUTE_SEGMENT 24
+#endif
+
 // Directions values
 // 1 0 7
 // 2 . 6
@@ -74,6 +80,16 @@ const int16 diry[DIR_MAX]={1,1,0,-1,-1,-1,0,1}; ///lookup to know where will mov
 static TIMER_FUNC(unit_attack_timer);
 static TIMER_FUNC(unit_walktoxy_timer);
 int32 unit_unattackable(block_list *bl);
+static bool unit_walkroute_chasing(const unit_data& ud, const block_list& tbl);
+
+/// Counters of long walk paths, see unit_walkroute_report
+static struct {
+	uint64 started; ///< Long walk paths started
+	uint64 failed; ///< Long walk path searches that did not find one
+	uint64 steps; ///< Steps of the started long walk paths
+	uint64 segments; ///< Segments walked
+	uint64 searches; ///< Walk path searches for the segments
+} walkroute_stats;
 
 /**
  * Get the unit_data related to the bl
@@ -159,8 +175,8 @@ bool unit_update_chase(block_list& bl, t_tick tick, bool fullcheck) {
 		unit_stop_walking(&bl, USW_FIXPOS|USW_FORCE_STOP|USW_RELEASE_TARGET);
 		return true;
 	}
-	// Update chase path
-	else if (fullcheck && ud->walkpath.path_pos > 0 && DIFF_TICK(ud->canmove_tick, tick) <= 0) {
+	// Update chase path, unless a long walk path still leads to the target
+	else if (fullcheck && ud->walkpath.path_pos > 0 && DIFF_TICK(ud->canmove_tick, tick) <= 0 && !unit_walkroute_chasing(*ud, *tbl)) {
 		// We call this only when we know there is no walk delay to prevent it pre-planning a chase
 		// If the call here fails, the unit should continue its current path
 		if(unit_walktobl(&bl, tbl, ud->chaserange, ud->state.walk_easy | (ud->state.attack_continue ? 2 : 0)))
@@ -170,6 +186,168 @@ bool unit_update_chase(block_list& bl, t_tick tick, bool fullcheck) {
 	return false;
 }
 
+/**
+ * Whether a unit may walk a long walk path when its destination is too far for a single walk path
+ * NPCs, players walking to a clicked cell, units forced to walk by scripts and chasing units do.
+ * Monsters walking randomly do not, they pick a closer cell instead of searching far around walls.
+ * @param bl: Unit that walks
+ * @param ud: Unit data of bl
+ * @param easy: Whether the unit walks the easy path
+ * @return True if it may walk a long walk path
+ */
+static bool unit_walkroute_allowed(const block_list& bl, const unit_data& ud, bool easy) {
+	return battle_config.max_walk_route > 0 && !easy && (bl.type == BL_NPC || bl.type == BL_PC || ud.target_to != 0 || ud.state.force_walk);
+}
+
+/**
+ * Checks if a unit chases its target along a long walk path that still ends next to the target
+ * The path is kept while the target stays there and searched again once the target moved.
+ * @param ud: Unit data of the chasing unit
+ * @param tbl: Chase target
+ * @return True if the unit can keep walking its long walk path
+ */
+static bool unit_walkroute_chasing(const unit_data& ud, const block_list& tbl) {
+	const walkroute_data* route = ud.walkroute;
+
+	return route != nullptr && route->pos < route->len && route->m == tbl.m && check_distance_xy(route->x1, route->y1, tbl.x, tbl.y, 1);
+}
+
+/**
+ * Frees the long walk path of a unit
+ * @param ud: Unit data
+ */
+static void unit_walkroute_clear(unit_data& ud) {
+	if (ud.walkroute != nullptr) {
+		aFree(ud.walkroute);
+		ud.walkroute = nullptr;
+	}
+}
+
+/**
+ * Searches the next segment of a long walk path
+ * Each segment is a normal walk path to a cell further ahead on the long path and becomes the
+ * unit's walk target, so the client walks the same cells when it receives the move packet.
+ * @param bl: Walking unit, standing where the segment starts
+ * @param ud: Unit data of bl
+ * @param wpd: Walk path of the segment
+ * @return True if a segment was found
+ */
+static bool unit_walkroute_next(block_list& bl, unit_data& ud, walkpath_data& wpd) {
+	walkroute_data* route = ud.walkroute;
+
+	if (route == nullptr || route->pos >= route->len)
+		return false;
+
+	// Try closer cells of the long path if the cells changed since it was searched
+	for (int32 steps = min(route->len - route->pos, WALKROUTE_SEGMENT); steps > 0; steps /= 2) {
+		int16 x = bl.x, y = bl.y;
+
+		for (int32 i = 0; i < steps; i++) {
+			x += dirx[route->path[route->pos + i]];
+			y += diry[route->path[route->pos + i]];
+		}
+
+		walkroute_stats.searches++;
+
+		if (path_search(&wpd, bl.m, bl.x, bl.y, x, y, 0, CELL_CHKNOPASS)) {
+			route->pos += steps;
+			ud.to_x = x;
+			ud.to_y = y;
+			walkroute_stats.segments++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Starts a long walk path to the unit's walk target, see max_walk_route
+ * @param bl: Unit that walks
+ * @param ud: Unit data of bl
+ * @param wpd: Walk path of the first segment
+ * @return True if the unit walks a long walk path now
+ */
+static bool unit_walkroute_start(block_list& bl, unit_data& ud, walkpath_data& wpd) {
+	if (!unit_walkroute_allowed(bl, ud, ud.state.walk_easy))
+		return false;
+
+	walkroute_data* found = ud.walkroute_found;
+
+	ud.walkroute_found = nullptr;
+
+	// Walk the path unit_can_reach_route found if it still starts here and leads to the walk target
+	if (found != nullptr && found->m == bl.m && found->x0 == bl.x && found->y0 == bl.y && found->x1 == ud.to_x && found->y1 == ud.to_y) {
+		ud.walkroute = found;
+	} else {
+		if (found != nullptr)
+			aFree(found);
+
+		CREATE(ud.walkroute, struct walkroute_data, 1);
+
+		if (!path_search_route(ud.walkroute, bl.m, bl.x, bl.y, ud.to_x, ud.to_y, battle_config.max_walk_route, CELL_CHKNOPASS)) {
+			unit_walkroute_clear(ud);
+			walkroute_stats.failed++;
+			return false;
+		}
+	}
+
+	if (!unit_walkroute_next(bl, ud, wpd)) {
+		unit_walkroute_clear(ud);
+		walkroute_stats.failed++;
+		return false;
+	}
+
+	walkroute_stats.started++;
+	walkroute_stats.steps += ud.walkroute->len;
+	return true;
+}
+
+/**
+ * Checks if a unit can walk to a cell that is too far for a single walk path, see max_walk_route
+ * The path found is kept on the unit, so walking to the cell right after does not search it again.
+ * @param bl: Unit that would walk
+ * @param x: X coordinate of the destination
+ * @param y: Y coordinate of the destination
+ * @return True if there is a long walk path
+ */
+bool unit_can_reach_route(block_list* bl, int16 x, int16 y) {
+	nullpo_retr(false, bl);
+
+	if (battle_config.max_walk_route <= 0)
+		return false;
+
+	unit_data* ud = unit_bl2ud(bl);
+
+	if (ud == nullptr)
+		return path_search_route(nullptr, bl->m, bl->x, bl->y, x, y, battle_config.max_walk_route, CELL_CHKNOPASS);
+
+	if (ud->walkroute_found == nullptr)
+		CREATE(ud->walkroute_found, struct walkroute_data, 1);
+
+	if (!path_search_route(ud->walkroute_found, bl->m, bl->x, bl->y, x, y, battle_config.max_walk_route, CELL_CHKNOPASS)) {
+		aFree(ud->walkroute_found);
+		ud->walkroute_found = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Displays how many long walk paths were walked and how many path searches their segments needed
+ * @param reset: Resets the counters afterwards
+ */
+void unit_walkroute_report(bool reset) {
+	uint64 started = walkroute_stats.started;
+
+	ShowInfo("Long walk paths: %" PRIu64 " started, %" PRIu64 " not found, %.1f steps each.\n", started, walkroute_stats.failed, started ? (double)walkroute_stats.steps / started : 0.);
+	ShowInfo("Segments: %" PRIu64 " walked, %.1f per long walk path, %" PRIu64 " path searches for them.\n", walkroute_stats.segments, started ? (double)walkroute_stats.segments / started : 0., walkroute_stats.searches);
+
+	if (reset)
+		walkroute_stats = {};
+}
+
 /**
  * Handles everything that happens when movement to the next cell is initiated
  * @param bl: Moving bl
@@ -185,11 +363,21 @@ bool unit_walktoxy_nextcell(block_list& bl, bool sendMove, t_tick tick) {
 
 	// Reached end of walkpath
 	if (ud->walkpath.path_pos >= ud->walkpath.path_len) {
-		// We need to send the reply to the client even if already at the target cell
-		// This allows the client to synchronize the position correctly
-		if (sendMove && bl.type == BL_PC)
-			clif_walkok(reinterpret_cast<map_session_data&>(bl));
-		return false;
+		walkpath_data wpd = { 0 };
+
+		// Continue with the next segment of a long walk path
+		if (unit_walkroute_next(bl, *ud, wpd)) {
+			ud->walkpath = wpd;
+			sendMove = true;
+		} else {
+			unit_walkroute_clear(*ud);
+
+			// We need to send the reply to the client even if already at the target cell
+			// This allows the client to synchronize the position correctly
+			if (sendMove && bl.type == BL_PC)
+				clif_walkok(reinterpret_cast<map_session_data&>(bl));
+			return false;
+		}
 	}
 
 	// Monsters first check for a chase skill and if they didn't use one if their target is in range each cell after checking for a chase skill
@@ -262,11 +450,15 @@ int32 unit_walktoxy_sub(block_list *bl)
 
 	walkpath_data wpd = { 0 };
 
-	if( !path_search(&wpd,bl->m,bl->x,bl->y,ud->to_x,ud->to_y,ud->state.walk_easy,CELL_CHKNOPASS) )
+	unit_walkroute_clear(*ud);
+
+	// Too far for a single walk path, walk a long walk path in segments instead
+	if( !path_search(&wpd,bl->m,bl->x,bl->y,ud->to_x,ud->to_y,ud->state.walk_easy,CELL_CHKNOPASS) && !unit_walkroute_start(*bl, *ud, wpd) )
 		return 0;
 
 #ifdef OFFICIAL_WALKPATH
 	if( bl->type != BL_NPC // If type is a NPC, please disregard.
+		&& ud->walkroute == nullptr // Segments of long walk paths are not limited either
 		&& wpd.path_len > 14 // Official number of walkable cells is 14 if and only if there is an obstacle between. [malufett]
 		&& !path_search_long(nullptr, bl->m, bl->x, bl->y, ud->to_x, ud->to_y, CELL_CHKNOPASS) ) // Check if there is an obstacle between
 			return 0;
@@ -277,7 +469,8 @@ int32 unit_walktoxy_sub(block_list *bl)
 	int32 i;
 
 	// Monsters always target an adjacent tile even if ranged, no need to shorten the path
-	if (ud->target_to != 0 && ud->chaserange > 1 && bl->type != BL_MOB) {
+	// Segments of long walk paths are not shortened either, the chase stops once the target is in range
+	if (ud->target_to != 0 && ud->chaserange > 1 && bl->type != BL_MOB && ud->walkroute == nullptr) {
 		// Generally speaking, the walk path is already to an adjacent tile
 		// so we only need to shorten the path if the range is greater than 1.
 		// Trim the last part of the path to account for range,
@@ -603,8 +796,14 @@ static TIMER_FUNC(unit_walktoxy_timer)
 
 	//Monsters will walk into an icewall from the west and south if they already started walking
 	if(map_getcell(bl->m,x+dx,y+dy,CELL_CHKNOPASS) 
-		&& (icewall_walk_block == 0 || dx < 0 || dy < 0 || !map_getcell(bl->m,x+dx,y+dy,CELL_CHKICEWALL)))
+		&& (icewall_walk_block == 0 || dx < 0 || dy < 0 || !map_getcell(bl->m,x+dx,y+dy,CELL_CHKICEWALL))) {
+		// Search the rest of a long walk path again instead of the current segment only
+		if (ud->walkroute != nullptr) {
+			ud->to_x = ud->walkroute->x1;
+			ud->to_y = ud->walkroute->y1;
+		}
 		return unit_walktoxy_sub(bl);
+	}
 
 	//Monsters can only leave icewalls to the west and south
 	//But if movement fails more than icewall_walk_block times, they can ignore this rule
@@ -631,7 +830,8 @@ static TIMER_FUNC(unit_walktoxy_timer)
 	map_foreachinmovearea(clif_insight, bl, AREA_SIZE, -dx, -dy, sd?BL_ALL:BL_PC, bl);
 	ud->walktimer = INVALID_TIMER;
 
-	if (bl->x == ud->to_x && bl->y == ud->to_y) {
+	// Segments of a long walk path end on the way
+	if (bl->x == ud->to_x && bl->y == ud->to_y && (ud->walkroute == nullptr || ud->walkroute->pos >= ud->walkroute->len)) {
 #if PACKETVER >= 20170726
 		// If this was a walking NPC and it used a player sprite
 		if( bl->type == BL_NPC && pcdb_checkid( status_get_viewdata( bl )->look[LOOK_BASE] ) ){
@@ -852,11 +1052,13 @@ int32 unit_walktoxy( block_list *bl, int16 x, int16 y, unsigned char flag)
 
 	walkpath_data wpd = { 0 };
 
-	if (!path_search(&wpd, bl->m, bl->x, bl->y, x, y, flag&1, CELL_CHKNOPASS)) // Count walk path cells
-		return 0;
-
+	if (!path_search(&wpd, bl->m, bl->x, bl->y, x, y, flag&1, CELL_CHKNOPASS)) { // Count walk path cells
+		// Too far for a single walk path, unit_walktoxy_sub searches a long walk path
+		if (!unit_walkroute_allowed(*bl, *ud, flag&1))
+			return 0;
+	}
 	// NPCs do not need to fulfill the following checks
-	if( bl->type != BL_NPC ){
+	else if( bl->type != BL_NPC ){
 		if( wpd.path_len > battle_config.max_walk_path ){
 			return 0;
 		}
@@ -960,7 +1162,8 @@ int32 unit_walktobl(block_list *bl, block_list *tbl, int32 range, unsigned char
 	if (!status_bl_has_mode(bl,MD_CANMOVE))
 		return 0;
 
-	if (!unit_can_reach_bl(bl, tbl, distance_bl(bl, tbl)+1, flag&1, &ud->to_x, &ud->to_y)) {
+	// Too far for a single walk path, unit_walktoxy_sub walks the long walk path found
+	if (!unit_can_reach_bl(bl, tbl, distance_bl(bl, tbl)+1, flag&1, &ud->to_x, &ud->to_y) && !unit_can_reach_bl_route(bl, tbl, flag&1, &ud->to_x, &ud->to_y)) {
 		ud->to_x = bl->x;
 		ud->to_y = bl->y;
 		ud->target_to = 0;
@@ -1708,6 +1911,8 @@ bool unit_stop_walking( block_list* bl, int32 type, t_tick canmove_delay ){
 	if (type&USW_RELEASE_TARGET)
 		ud->target_to = 0;
 
+	unit_walkroute_clear(*ud);
+
 	if (!(type&USW_FORCE_STOP) && ud->walktimer == INVALID_TIMER)
 		return false;
 
@@ -3031,6 +3236,37 @@ bool unit_can_reach_pos( const block_list* bl, int32 x, int32 y, int32 easy )
 	return path_search(nullptr,bl->m,bl->x,bl->y,x,y,easy,CELL_CHKNOREACH);
 }
 
+/**
+ * Picks the cell next to a target that a unit walks to, preferably the one facing the unit
+ * @param bl: Object walking to the target
+ * @param tbl: Target
+ * @param dx: Receives the X offset from the cell to tbl
+ * @param dy: Receives the Y offset from the cell to tbl
+ * @return False if every cell around tbl is blocked
+ */
+static bool unit_adjacent_cell( const block_list* bl, const block_list* tbl, int16& dx, int16& dy )
+{
+	// It judges whether it can adjoin or not.
+	dx = tbl->x - bl->x;
+	dy = tbl->y - bl->y;
+	dx = (dx > 0) ? 1 : ((dx < 0) ? -1 : 0);
+	dy = (dy > 0) ? 1 : ((dy < 0) ? -1 : 0);
+
+	if (map_getcell(tbl->m,tbl->x-dx,tbl->y-dy,CELL_CHKNOPASS)) { // Look for a suitable cell to place in.
+		int32 i;
+
+		for(i = 0; i < 8 && map_getcell(tbl->m,tbl->x-dirx[i],tbl->y-diry[i],CELL_CHKNOPASS); i++);
+
+		if (i == 8)
+			return false;
+
+		dx = dirx[i];
+		dy = diry[i];
+	}
+
+	return true;
+}
+
 /**
  * Does a path_search to check if a unit can be reached
  * @param bl: Object to check path
@@ -3058,23 +3294,8 @@ bool unit_can_reach_bl( const block_list* bl, const block_list* tbl, int32 range
 	if(range > 0 && !check_distance_bl(bl, tbl, range))
 		return false;
 
-	// It judges whether it can adjoin or not.
-	dx = tbl->x - bl->x;
-	dy = tbl->y - bl->y;
-	dx = (dx > 0) ? 1 : ((dx < 0) ? -1 : 0);
-	dy = (dy > 0) ? 1 : ((dy < 0) ? -1 : 0);
-
-	if (map_getcell(tbl->m,tbl->x-dx,tbl->y-dy,CELL_CHKNOPASS)) { // Look for a suitable cell to place in.
-		int32 i;
-
-		for(i = 0; i < 8 && map_getcell(tbl->m,tbl->x-dirx[i],tbl->y-diry[i],CELL_CHKNOPASS); i++);
-
-		if (i == 8)
-			return false; // No valid cells.
-
-		dx = dirx[i];
-		dy = diry[i];
-	}
+	if (!unit_adjacent_cell(bl, tbl, dx, dy))
+		return false; // No valid cells.
 
 	if (x)
 		*x = tbl->x-dx;
@@ -3095,6 +3316,38 @@ bool unit_can_reach_bl( const block_list* bl, const block_list* tbl, int32 range
 	return true;
 }
 
+/**
+ * Checks if a target that no single walk path reaches can be reached by a long walk path, see max_walk_route
+ * The path found is kept on the unit, so chasing the target right after does not search it again.
+ * @param bl: Object to check path
+ * @param tbl: Target to be checked for available path
+ * @param easy: Easy(1) or Hard(0) path check, long walk paths are never easy
+ * @param x: Pointer storing the X coordinate next to tbl that can be reached
+ * @param y: Pointer storing the Y coordinate next to tbl that can be reached
+ * @return true or false
+ */
+bool unit_can_reach_bl_route( block_list* bl, const block_list* tbl, int32 easy, int16* x, int16* y )
+{
+	int16 dx, dy;
+
+	nullpo_retr(false, bl);
+	nullpo_retr(false, tbl);
+
+	if( easy || bl->m != tbl->m )
+		return false;
+
+	if( !unit_adjacent_cell(bl, tbl, dx, dy) || !unit_can_reach_route(bl, tbl->x - dx, tbl->y - dy) )
+		return false;
+
+	if (x)
+		*x = tbl->x-dx;
+
+	if (y)
+		*y = tbl->y-dy;
+
+	return true;
+}
+
 /**
  * Calculates position of Pet/Mercenary/Homunculus/Elemental
  * @param bl: Object to calculate position
@@ -3923,6 +4176,13 @@ int32 unit_free(block_list *bl, clr_type clrtype)
 	if( bl->prev )	// Players are supposed to logout with a "warp" effect.
 		unit_remove_map(bl, clrtype);
 
+	unit_walkroute_clear(*ud);
+
+	if (ud->walkroute_found != nullptr) {
+		aFree(ud->walkroute_found);
+		ud->walkroute_found = nullptr;
+	}
+
 	switch( bl->type ) {
 		case BL_PC: {
 			map_session_data *sd = (map_session_data*)bl;
@@ -22,6 +22,8 @@ extern const int16 diry[DIR_MAX]; ///lookup to know where will move to y accordi
 struct unit_data {
 	block_list *bl; ///link to owner object BL_PC|BL_MOB|BL_PET|BL_NPC|BL_HOM|BL_MER|BL_ELEM
 	struct walkpath_data walkpath;
+	struct walkroute_data* walkroute; ///< Long walk path walked in segments, nullptr unless walking one
+	struct walkroute_data* walkroute_found; ///< Long walk path found by unit_can_reach_route, taken by the walk that follows
 	struct skill_timerskill *skilltimerskill[MAX_SKILLTIMERSKILL];
 	std::vector<std::shared_ptr<s_skill_unit_group>> skillunits;
 	struct skill_unit_group_tickset skillunittick[MAX_SKILLUNITGROUPTICKSET];
@@ -155,7 +157,10 @@ enum e_unit_blown unit_blown_immune( const block_list* bl, uint8 flag );
 
 // Can-reach checks
 bool unit_can_reach_pos( const block_list* bl, int32 x, int32 y, int32 easy );
+bool unit_can_reach_route(block_list* bl, int16 x, int16 y);
+void unit_walkroute_report(bool reset);
 bool unit_can_reach_bl( const block_list* bl, const block_list* tbl, int32 range, int32 easy, int16* x, int16* y );
+bool unit_can_reach_bl_route( block_list* bl, const block_list* tbl, int32 easy, int16* x, int16* y );
 
 // Unit attack functions
 int32 unit_stopattack(block_list *bl, va_list ap);